@@ -0,0 +1,255 @@
+#include "AnnexB.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ENABLE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace beton {
+
+//每次比较3个字节: p[2] > 1 时 p/p+1/p+2 都不可能是起始码，可以跳3个字节
+const uint8_t *findStartCodeScalar(const uint8_t *p, const uint8_t *end) {
+    while (p + 3 <= end) {
+        if (p[2] > 1) {
+            p += 3;
+        } else if (p[1]) {
+            p += 2;
+        } else if (p[0] || p[2] != 1) {
+            ++p;
+        } else {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef ENABLE_X86_SIMD
+/**
+ * 压缩数据中零字节很少: 先只看16/32字节里有没有零，没有就整块跳过;
+ * 有零时再用错开1、2字节的两次加载做完整的 00 00 01 比较
+ * 块内最后一个字节为零时起始码会跨到下一块，由完整比较的错位加载覆盖
+*/
+static const uint8_t *findStartCodeSse2(const uint8_t *p, const uint8_t *end) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    while (p + 18 <= end) {
+        auto a = _mm_loadu_si128((const __m128i *)p);
+        auto z = _mm_cmpeq_epi8(a, zero);
+        if (!_mm_movemask_epi8(z)) {
+            p += 16;
+            continue;
+        }
+        auto b = _mm_loadu_si128((const __m128i *)(p + 1));
+        auto c = _mm_loadu_si128((const __m128i *)(p + 2));
+        auto m = _mm_and_si128(_mm_and_si128(z, _mm_cmpeq_epi8(b, zero)), _mm_cmpeq_epi8(c, one));
+        int mask = _mm_movemask_epi8(m);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return findStartCodeScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *findStartCodeAvx2(const uint8_t *p, const uint8_t *end) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    //每轮64字节
+    while (p + 66 <= end) {
+        auto z0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), zero);
+        auto z1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 32)), zero);
+        auto any = _mm256_or_si256(z0, z1);
+        if (_mm256_testz_si256(any, any)) {
+            p += 64;
+            continue;
+        }
+        for (int i = 0; i < 2; ++i) {
+            auto q = p + i * 32;
+            auto b = _mm256_loadu_si256((const __m256i *)(q + 1));
+            auto c = _mm256_loadu_si256((const __m256i *)(q + 2));
+            auto m = _mm256_and_si256(_mm256_and_si256(i ? z1 : z0, _mm256_cmpeq_epi8(b, zero)), _mm256_cmpeq_epi8(c, one));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+            if (mask) {
+                return q + __builtin_ctz(mask);
+            }
+        }
+        p += 64;
+    }
+    return findStartCodeSse2(p, end);
+}
+#endif  //ENABLE_X86_SIMD
+
+using FindStartCode = const uint8_t *(*)(const uint8_t *, const uint8_t *);
+
+struct StartCodeScanner {
+    const char *name;
+    FindStartCode func;
+};
+
+static StartCodeScanner s_scanner = []() {
+#ifdef ENABLE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return StartCodeScanner{"avx2", findStartCodeAvx2};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return StartCodeScanner{"sse2", findStartCodeSse2};
+    }
+#endif
+    return StartCodeScanner{"scalar", findStartCodeScalar};
+}();
+
+const uint8_t *findStartCode(const uint8_t *data, const uint8_t *end) {
+    return s_scanner.func(data, end);
+}
+
+const char *startCodeScanner() {
+    return s_scanner.name;
+}
+
+bool setStartCodeScanner(const string &name) {
+    if (name == "scalar") {
+        s_scanner = {"scalar", findStartCodeScalar};
+        return true;
+    }
+#ifdef ENABLE_X86_SIMD
+    if (name == "sse2" && __builtin_cpu_supports("sse2")) {
+        s_scanner = {"sse2", findStartCodeSse2};
+        return true;
+    }
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        s_scanner = {"avx2", findStartCodeAvx2};
+        return true;
+    }
+#endif
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void splitAnnexB(const Buffer::Ptr &buf, vector<Buffer::Ptr> &nalus) {
+    auto base = (const uint8_t *)buf->data();
+    forEachNalu(base, buf->size(), [&](const uint8_t *nal, size_t size) {
+        nalus.emplace_back(BufferSlice::create(buf, nal - base, size));
+    });
+}
+
+bool splitLengthPrefixed(const Buffer::Ptr &buf, size_t offset, size_t length_size, vector<Buffer::Ptr> &nalus) {
+    if (length_size < 1 || length_size > 4) {
+        return false;
+    }
+    auto data = (const uint8_t *)buf->data();
+    size_t size = buf->size();
+    while (offset + length_size <= size) {
+        size_t len = 0;
+        for (size_t i = 0; i < length_size; ++i) {
+            len = (len << 8) | data[offset + i];
+        }
+        offset += length_size;
+        if (len > size - offset) {
+            return false;
+        }
+        if (len) {
+            nalus.emplace_back(BufferSlice::create(buf, offset, len));
+        }
+        offset += len;
+    }
+    return offset == size;
+}
+
+void toAnnexB(const vector<Buffer::Ptr> &nalus, vector<Buffer::Ptr> &out) {
+    static Buffer::Ptr s_start_code = std::make_shared<BufferString>(string("\x00\x00\x00\x01", 4));
+    out.reserve(out.size() + nalus.size() * 2);
+    for (auto &nal : nalus) {
+        out.emplace_back(s_start_code);
+        out.emplace_back(nal);
+    }
+}
+
+void toLengthPrefixed(const vector<Buffer::Ptr> &nalus, vector<Buffer::Ptr> &out) {
+    if (nalus.empty()) {
+        return;
+    }
+    auto lengths = BufferRaw::create(nalus.size() * 4, nalus.size() * 4);
+    auto p = (uint8_t *)lengths->data();
+    for (auto &nal : nalus) {
+        auto len = nal->size();
+        p[0] = len >> 24;
+        p[1] = len >> 16;
+        p[2] = len >> 8;
+        p[3] = len;
+        p += 4;
+    }
+    out.reserve(out.size() + nalus.size() * 2);
+    for (size_t i = 0; i < nalus.size(); ++i) {
+        out.emplace_back(nalus.size() == 1 ? Buffer::Ptr(lengths) : BufferSlice::create(lengths, i * 4, 4));
+        out.emplace_back(nalus[i]);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool BitReader::fillByte() {
+    if (_data >= _end) {
+        _overflow = true;
+        return false;
+    }
+    //两个零字节之后的 03 是防竞争字节
+    if (_zeros >= 2 && *_data == 0x03) {
+        ++_data;
+        _zeros = 0;
+        if (_data >= _end) {
+            _overflow = true;
+            return false;
+        }
+    }
+    _cur = *_data++;
+    _zeros = _cur ? 0 : _zeros + 1;
+    _bits_left = 8;
+    return true;
+}
+
+uint32_t BitReader::readBits(int count) {
+    uint32_t ret = 0;
+    while (count > 0) {
+        if (!_bits_left && !fillByte()) {
+            return 0;
+        }
+        int take = std::min(count, _bits_left);
+        ret = (ret << take) | ((_cur >> (_bits_left - take)) & ((1u << take) - 1));
+        _bits_left -= take;
+        count -= take;
+    }
+    return ret;
+}
+
+void BitReader::skipBits(int count) {
+    while (count > 0) {
+        int take = std::min(count, 32);
+        readBits(take);
+        count -= take;
+    }
+}
+
+uint32_t BitReader::readUE() {
+    int leading_zeros = 0;
+    while (!readBit()) {
+        if (_overflow || ++leading_zeros > 31) {
+            _overflow = true;
+            return 0;
+        }
+    }
+    if (!leading_zeros) {
+        return 0;
+    }
+    return ((1u << leading_zeros) - 1) + readBits(leading_zeros);
+}
+
+int32_t BitReader::readSE() {
+    uint32_t val = readUE();
+    return (val & 1) ? (int32_t)((val + 1) / 2) : -(int32_t)(val / 2);
+}
+
+}
@@ -0,0 +1,106 @@
+#ifndef __ANNEXB_H__
+#define __ANNEXB_H__
+
+#include "network/Buffer.h"
+#include <stdint.h>
+
+namespace beton {
+
+/**
+ * H.264/H.265 共用的码流工具:
+ * 1. 起始码(00 00 01)查找，按 cpu 在运行时选择 AVX2/SSE2/标量实现
+ * 2. Annex-B 与长度前缀(AVCC/HVCC)两种格式互转，NAL 以 BufferSlice 引用原始数据，不拷贝负载
+ * 3. 按位读取 RBSP, 读取时跳过防竞争字节(00 00 03), 不先拷贝出去
+*/
+
+/**
+ * 查找第一个 00 00 01
+ * @return 起始码(3字节部分)的位置，没有时返回 end
+*/
+const uint8_t *findStartCode(const uint8_t *data, const uint8_t *end);
+//标量实现，用于校验
+const uint8_t *findStartCodeScalar(const uint8_t *data, const uint8_t *end);
+//当前使用的实现: "avx2"/"sse2"/"scalar"
+const char *startCodeScanner();
+//强制使用指定实现(cpu 不支持时返回 false), 用于测试和性能对比
+bool setStartCodeScanner(const std::string &name);
+
+/**
+ * 遍历 Annex-B 数据中的 NAL 单元，回调的数据不含起始码和其前面的填充零
+ * @param cb: void(const uint8_t *nal, size_t size)
+*/
+template <typename FUNC>
+void forEachNalu(const uint8_t *data, size_t size, FUNC &&cb) {
+    auto end = data + size;
+    auto start = findStartCode(data, end);
+    while (start != end) {
+        auto nal = start + 3;
+        auto next = findStartCode(nal, end);
+        //去掉下一个起始码前的零(4字节起始码的首字节或 trailing_zero_8bits)
+        auto nal_end = next;
+        while (nal_end > nal && nal_end[-1] == 0) {
+            --nal_end;
+        }
+        if (nal_end > nal) {
+            cb(nal, (size_t)(nal_end - nal));
+        }
+        start = next;
+    }
+}
+
+//Annex-B -> NAL 切片
+void splitAnnexB(const Buffer::Ptr &buf, std::vector<Buffer::Ptr> &nalus);
+/**
+ * 长度前缀格式(AVCC/HVCC) -> NAL 切片
+ * @param offset: 从哪里开始，比如跳过 FLV 视频 tag 头
+ * @param length_size: 长度字段字节数，来自配置记录的 lengthSizeMinusOne + 1
+ * @return 长度字段越界时返回 false
+*/
+bool splitLengthPrefixed(const Buffer::Ptr &buf, size_t offset, size_t length_size, std::vector<Buffer::Ptr> &nalus);
+//NAL 切片 -> Annex-B, 起始码共用一个静态 Buffer, 结果可以直接作为 iovec 发送
+void toAnnexB(const std::vector<Buffer::Ptr> &nalus, std::vector<Buffer::Ptr> &out);
+//NAL 切片 -> 4字节长度前缀，所有长度字段写在同一块内存里
+void toLengthPrefixed(const std::vector<Buffer::Ptr> &nalus, std::vector<Buffer::Ptr> &out);
+
+/**
+ * NAL 打包成 RTP 时每个包的回调
+ * @param pieces: RTP 负载(不含 RTP 头)的各个片段，负载部分引用原始 NAL, 可以和 RTP 头一起作为 iovec 发送
+ * @param size: 负载总字节数
+ * @param marker: 是否为一帧的最后一个包
+*/
+using onRtpPayload = std::function<void(const std::vector<Buffer::Ptr> &pieces, size_t size, bool marker)>;
+
+/**
+ * 按位读取 NAL 的 RBSP, 自动跳过防竞争字节
+ * 读越界后返回0并置 overflow, 调用方在解析完一段后统一检查
+*/
+class BitReader {
+public:
+    BitReader(const uint8_t *data, size_t size) : _data(data), _end(data + size) {}
+
+    uint32_t readBits(int count);
+    bool readBit() { return readBits(1) != 0; }
+    void skipBits(int count);
+    //无符号/有符号指数哥伦布码
+    uint32_t readUE();
+    int32_t readSE();
+
+    bool overflow() const { return _overflow; }
+    //剩余的未读的字节中是否还有数据(不计防竞争字节)
+    bool hasMoreData() const { return _data < _end || _bits_left > 0; }
+
+private:
+    bool fillByte();
+
+private:
+    bool _overflow = false;
+    int _bits_left = 0;
+    //连续零字节个数，用于识别 00 00 03
+    int _zeros = 0;
+    uint8_t _cur = 0;
+    const uint8_t *_data;
+    const uint8_t *_end;
+};
+
+}
+#endif  //__ANNEXB_H__
@@ -0,0 +1,118 @@
+#include "GopCache.h"
+#include "Util/Logger.h"
+
+using namespace std;
+
+namespace beton {
+
+INSTANCE_IMP(GopCacheManager)
+
+void GopCacheManager::add(GopCacheBase *cache) {
+    lock_guard<mutex> lck(_mutex);
+    cache->_last_access = ++_clock;
+    _caches.emplace_back(cache);
+}
+
+void GopCacheManager::remove(GopCacheBase *cache) {
+    lock_guard<mutex> lck(_mutex);
+    _caches.remove(cache);
+}
+
+void GopCacheManager::onGrow(size_t bytes, GopCacheBase *cache) {
+    if ((_bytes += bytes) <= _budget) {
+        return;
+    }
+    lock_guard<mutex> lck(_mutex);
+    //从最久没有起播的流开始清空，直到回到预算以内; 正在增长的流排在最后
+    while (_bytes > _budget) {
+        GopCacheBase *coldest = nullptr;
+        for (auto item : _caches) {
+            if (item->_bytes && item != cache && (!coldest || item->_last_access < coldest->_last_access)) {
+                coldest = item;
+            }
+        }
+        if (!coldest) {
+            coldest = cache->_bytes ? cache : nullptr;
+        }
+        if (!coldest) {
+            break;
+        }
+        coldest->evict();
+        if (coldest == cache) {
+            break;
+        }
+    }
+}
+
+GopCacheManager::Stats GopCacheManager::stats() const {
+    Stats ret;
+    ret.bytes = _bytes;
+    ret.budget = _budget;
+    ret.hits = _hits;
+    ret.misses = _misses;
+    ret.evictions = _evictions;
+    lock_guard<mutex> lck(_mutex);
+    for (auto item : _caches) {
+        ret.caches += item->_bytes ? 1 : 0;
+    }
+    return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+GopCacheBase::GopCacheBase() {
+    GopCacheManager::Instance().add(this);
+    _attached = true;
+}
+
+GopCacheBase::~GopCacheBase() {
+    detach();
+}
+
+void GopCacheBase::detach() {
+    if (_attached) {
+        _attached = false;
+        GopCacheManager::Instance().remove(this);
+    }
+}
+
+void GopCacheBase::onAppended(size_t bytes, size_t released) {
+    auto &manager = GopCacheManager::Instance();
+    if (released) {
+        manager.onShrink(released);
+    }
+    manager.onGrow(bytes, this);
+    if (_bytes > manager.maxGopBytes()) {
+        //一直没有关键帧或者码率异常，不再缓存这个 GOP
+        WarnL_EVERY_MS(5000) << "gop cache exceeds " << manager.maxGopBytes() << " bytes, dropped until next key frame";
+        evict();
+    }
+}
+
+void GopCacheBase::onReleased(size_t bytes) {
+    if (bytes) {
+        GopCacheManager::Instance().onShrink(bytes);
+    }
+}
+
+void GopCacheBase::onAccess(bool hit) {
+    auto &manager = GopCacheManager::Instance();
+    hit ? ++manager._hits : ++manager._misses;
+    _last_access = ++manager._clock;
+}
+
+void GopCacheBase::evict() {
+    size_t released;
+    {
+        lock_guard<mutex> lck(_mutex);
+        released = clearLocked();
+        _waiting_key = true;
+    }
+    if (released) {
+        auto &manager = GopCacheManager::Instance();
+        manager.onShrink(released);
+        ++manager._evictions;
+        DebugL << "gop cache evicted, released " << released << " bytes";
+    }
+}
+
+}
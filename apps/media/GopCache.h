@@ -0,0 +1,180 @@
+#ifndef __GOP_CACHE_H__
+#define __GOP_CACHE_H__
+
+#include "Util/Util.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <stdint.h>
+
+namespace beton {
+
+class GopCacheBase;
+
+/**
+ * 所有流的 GOP 缓存共用一个内存预算，超出后按最近一次起播的时间从最冷的流开始清空缓存
+ * 被清空的流在下一个关键帧到来时重新开始缓存
+*/
+class GopCacheManager : public noncopyable {
+public:
+    struct Stats {
+        //缓存的帧数据总字节数
+        size_t bytes = 0;
+        size_t budget = 0;
+        //有缓存的流的个数
+        size_t caches = 0;
+        //起播时缓存中有完整 GOP 的次数 / 没有、只能等下一个关键帧的次数
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        //因超出预算或单个 GOP 过大被清空的次数
+        uint64_t evictions = 0;
+
+        double hitRate() const { return hits + misses ? (double)hits / (hits + misses) : 0; }
+    };
+
+    static GopCacheManager &Instance();
+
+    //全局预算, 默认 512MB
+    void setBudget(size_t bytes) { _budget = bytes; }
+    size_t budget() const { return _budget; }
+    //单个流一个 GOP 的上限，超过后该流暂停缓存直到下一个关键帧, 默认 32MB
+    void setMaxGopBytes(size_t bytes) { _max_gop_bytes = bytes; }
+    size_t maxGopBytes() const { return _max_gop_bytes; }
+
+    Stats stats() const;
+
+private:
+    friend class GopCacheBase;
+
+    GopCacheManager() = default;
+    void add(GopCacheBase *cache);
+    void remove(GopCacheBase *cache);
+    //缓存增长后检查预算
+    void onGrow(size_t bytes, GopCacheBase *cache);
+    void onShrink(size_t bytes) { _bytes -= bytes; }
+
+private:
+    std::atomic<size_t> _budget{512 * 1024 * 1024};
+    std::atomic<size_t> _max_gop_bytes{32 * 1024 * 1024};
+    std::atomic<size_t> _bytes{0};
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _evictions{0};
+    //逻辑时钟，每次登记或起播加一，用于 LRU 排序
+    std::atomic<uint64_t> _clock{0};
+    mutable std::mutex _mutex;
+    std::list<GopCacheBase *> _caches;
+};
+
+//与帧类型无关的部分: 字节数统计、访问时间、清空
+class GopCacheBase : public noncopyable {
+public:
+    GopCacheBase();
+    virtual ~GopCacheBase();
+
+    size_t bytes() const { return _bytes; }
+
+protected:
+    //写入一帧后调用, 调用时不能持有 _mutex; released 为因新的关键帧清掉的旧 GOP 字节数
+    void onAppended(size_t bytes, size_t released);
+    //析构等场合清空后归还预算
+    void onReleased(size_t bytes);
+    //起播读取后调用
+    void onAccess(bool hit);
+    //持有 _mutex 时调用，清空缓存的帧并返回释放的字节数
+    virtual size_t clearLocked() = 0;
+    //被管理器清空
+    void evict();
+    //从管理器移除，子类析构时先调用
+    void detach();
+
+protected:
+    mutable std::mutex _mutex;
+    //被清空后等到下一个关键帧才重新缓存
+    bool _waiting_key = true;
+    std::atomic<size_t> _bytes{0};
+    //最近一次起播的逻辑时间，越小越冷
+    std::atomic<uint64_t> _last_access{0};
+
+private:
+    friend class GopCacheManager;
+    bool _attached = false;
+};
+
+/**
+ * 一路流最近一个 GOP(最后一个关键帧及之后的帧), 与实时的环形缓冲共享同一份帧
+ * 推流端写入，播放端起播时取出，帧的序号与环形缓冲一致，取出后从下一个序号接着读环形缓冲
+*/
+template <typename T>
+class GopCache : public GopCacheBase {
+public:
+    ~GopCache() override {
+        //先退出管理，之后不会再被并发清空
+        detach();
+        size_t released;
+        {
+            std::lock_guard<std::mutex> lck(_mutex);
+            released = clearLocked();
+        }
+        onReleased(released);
+    }
+
+    /**
+     * 写入一帧，只在推流端线程调用
+     * @param seq: 该帧在环形缓冲中的序号
+     * @param bytes: 计入预算的字节数
+    */
+    void append(uint64_t seq, const T &frame, size_t bytes, bool key) {
+        size_t released = 0;
+        {
+            std::lock_guard<std::mutex> lck(_mutex);
+            if (key) {
+                released = clearLocked();
+                _waiting_key = false;
+            } else if (_waiting_key) {
+                return;
+            }
+            _frames.emplace_back(seq, frame);
+            _bytes += bytes;
+        }
+        onAppended(bytes, released);
+    }
+
+    /**
+     * 起播时取出缓存的帧
+     * @return 下一帧在环形缓冲中的序号; 缓存为空时返回 UINT64_MAX
+    */
+    uint64_t get(std::vector<T> &out) {
+        uint64_t next = UINT64_MAX;
+        {
+            std::lock_guard<std::mutex> lck(_mutex);
+            if (!_frames.empty()) {
+                out.reserve(out.size() + _frames.size());
+                for (auto &pr : _frames) {
+                    out.emplace_back(pr.second);
+                }
+                next = _frames.back().first + 1;
+            }
+        }
+        onAccess(next != UINT64_MAX);
+        return next;
+    }
+
+    size_t frames() const {
+        std::lock_guard<std::mutex> lck(_mutex);
+        return _frames.size();
+    }
+
+protected:
+    size_t clearLocked() override {
+        size_t bytes = _bytes.exchange(0);
+        _frames.clear();
+        return bytes;
+    }
+
+private:
+    std::vector<std::pair<uint64_t, T> > _frames;
+};
+
+}
+#endif  //__GOP_CACHE_H__
@@ -0,0 +1,364 @@
+#include "H264.h"
+
+using namespace std;
+
+namespace beton {
+
+//带 chroma_format_idc 等扩展字段的 profile
+static bool isHighProfile(uint8_t profile_idc) {
+    switch (profile_idc) {
+        case 100: case 110: case 122: case 244: case 44: case 83:
+        case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void skipScalingList(BitReader &br, int size) {
+    int last = 8;
+    int next = 8;
+    for (int i = 0; i < size; ++i) {
+        if (next) {
+            next = (last + br.readSE() + 256) % 256;
+        }
+        last = next ? next : last;
+    }
+}
+
+//只解析到 timing_info 为止
+static void parseVui(BitReader &br, H264Sps &sps) {
+    if (br.readBit()) {
+        //aspect_ratio_idc, 255 为 Extended_SAR
+        if (br.readBits(8) == 255) {
+            br.skipBits(32);
+        }
+    }
+    if (br.readBit()) {
+        //overscan_appropriate_flag
+        br.skipBits(1);
+    }
+    if (br.readBit()) {
+        //video_format + video_full_range_flag
+        br.skipBits(4);
+        if (br.readBit()) {
+            //colour_primaries, transfer_characteristics, matrix_coefficients
+            br.skipBits(24);
+        }
+    }
+    if (br.readBit()) {
+        br.readUE();
+        br.readUE();
+    }
+    if (br.readBit()) {
+        uint32_t num_units_in_tick = br.readBits(32);
+        uint32_t time_scale = br.readBits(32);
+        if (num_units_in_tick && !br.overflow()) {
+            sps.fps = (double)time_scale / (2.0 * num_units_in_tick);
+        }
+    }
+}
+
+bool parseH264Sps(const uint8_t *nal, size_t size, H264Sps &sps) {
+    if (size < 4 || h264NalType(nal[0]) != H264_NAL_SPS) {
+        return false;
+    }
+    BitReader br(nal + 1, size - 1);
+    sps.profile_idc = br.readBits(8);
+    sps.constraint_flags = br.readBits(8);
+    sps.level_idc = br.readBits(8);
+    sps.sps_id = br.readUE();
+    if (sps.sps_id > 31) {
+        return false;
+    }
+    bool separate_colour_plane = false;
+    if (isHighProfile(sps.profile_idc)) {
+        sps.chroma_format_idc = br.readUE();
+        if (sps.chroma_format_idc > 3) {
+            return false;
+        }
+        if (sps.chroma_format_idc == 3) {
+            separate_colour_plane = br.readBit();
+        }
+        sps.bit_depth_luma = br.readUE() + 8;
+        sps.bit_depth_chroma = br.readUE() + 8;
+        //qpprime_y_zero_transform_bypass_flag
+        br.skipBits(1);
+        if (br.readBit()) {
+            int count = sps.chroma_format_idc == 3 ? 12 : 8;
+            for (int i = 0; i < count; ++i) {
+                if (br.readBit()) {
+                    skipScalingList(br, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+    sps.log2_max_frame_num = br.readUE() + 4;
+    sps.poc_type = br.readUE();
+    if (sps.poc_type == 0) {
+        sps.log2_max_poc_lsb = br.readUE() + 4;
+    } else if (sps.poc_type == 1) {
+        //delta_pic_order_always_zero_flag, offset_for_non_ref_pic, offset_for_top_to_bottom_field
+        br.skipBits(1);
+        br.readSE();
+        br.readSE();
+        uint32_t cycle = br.readUE();
+        if (cycle > 255) {
+            return false;
+        }
+        for (uint32_t i = 0; i < cycle; ++i) {
+            br.readSE();
+        }
+    } else if (sps.poc_type != 2) {
+        return false;
+    }
+    sps.max_num_ref_frames = br.readUE();
+    //gaps_in_frame_num_value_allowed_flag
+    br.skipBits(1);
+    uint32_t width_mbs = br.readUE() + 1;
+    uint32_t height_map_units = br.readUE() + 1;
+    sps.frame_mbs_only = br.readBit();
+    if (!sps.frame_mbs_only) {
+        //mb_adaptive_frame_field_flag
+        br.skipBits(1);
+    }
+    //direct_8x8_inference_flag
+    br.skipBits(1);
+    uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+    if (br.readBit()) {
+        crop_left = br.readUE();
+        crop_right = br.readUE();
+        crop_top = br.readUE();
+        crop_bottom = br.readUE();
+    }
+    if (br.overflow()) {
+        return false;
+    }
+    if (br.readBit()) {
+        parseVui(br, sps);
+    }
+
+    //裁剪单位取决于色度采样格式
+    uint32_t crop_x = 1;
+    uint32_t crop_y = 2 - sps.frame_mbs_only;
+    if (sps.chroma_format_idc && !separate_colour_plane) {
+        crop_x = sps.chroma_format_idc == 3 ? 1 : 2;
+        crop_y *= sps.chroma_format_idc == 1 ? 2 : 1;
+    }
+    uint64_t width = (uint64_t)width_mbs * 16;
+    uint64_t height = (uint64_t)height_map_units * 16 * (2 - sps.frame_mbs_only);
+    uint64_t crop_w = (uint64_t)(crop_left + crop_right) * crop_x;
+    uint64_t crop_h = (uint64_t)(crop_top + crop_bottom) * crop_y;
+    if (crop_w >= width || crop_h >= height) {
+        return false;
+    }
+    sps.width = width - crop_w;
+    sps.height = height - crop_h;
+    return true;
+}
+
+bool parseH264Pps(const uint8_t *nal, size_t size, H264Pps &pps) {
+    if (size < 2 || h264NalType(nal[0]) != H264_NAL_PPS) {
+        return false;
+    }
+    BitReader br(nal + 1, size - 1);
+    pps.pps_id = br.readUE();
+    pps.sps_id = br.readUE();
+    pps.entropy_coding_mode = br.readBit();
+    pps.bottom_field_pic_order_in_frame_present = br.readBit();
+    return !br.overflow() && pps.pps_id <= 255 && pps.sps_id <= 31;
+}
+
+H264FrameType h264FrameType(const uint8_t *nal, size_t size) {
+    if (size < 2 || !h264IsVcl(nal[0])) {
+        return H264_FRAME_UNKNOWN;
+    }
+    //slice 头的前两个字段足够，最多读几个字节
+    BitReader br(nal + 1, std::min<size_t>(size - 1, 16));
+    br.readUE();
+    uint32_t slice_type = br.readUE();
+    if (br.overflow()) {
+        return H264_FRAME_UNKNOWN;
+    }
+    switch (slice_type % 5) {
+        case 0:
+        case 3: return H264_FRAME_P;
+        case 1: return H264_FRAME_B;
+        default: return H264_FRAME_I;
+    }
+}
+
+H264FrameInfo h264FrameInfo(const vector<Buffer::Ptr> &nalus) {
+    H264FrameInfo info;
+    for (auto &nal : nalus) {
+        if (!nal->size()) {
+            continue;
+        }
+        auto data = (const uint8_t *)nal->data();
+        switch (h264NalType(data[0])) {
+            case H264_NAL_SPS:
+            case H264_NAL_PPS: info.config = true; break;
+            case H264_NAL_IDR: info.key = true;
+            //fall through
+            case H264_NAL_SLICE:
+            case H264_NAL_SLICE_DPA: {
+                if (!info.slices++) {
+                    info.type = h264FrameType(data, nal->size());
+                }
+                break;
+            }
+            default: break;
+        }
+    }
+    return info;
+}
+
+string makeAvcConfig(const string &sps, const string &pps) {
+    if (sps.size() < 4 || sps.size() > 0xffff || pps.size() > 0xffff) {
+        return "";
+    }
+    string ret;
+    ret.reserve(16 + sps.size() + pps.size());
+    ret.push_back(1);
+    //profile, compatibility, level
+    ret.append(sps, 1, 3);
+    //lengthSizeMinusOne = 3
+    ret.push_back((char)0xff);
+    ret.push_back((char)0xe1);
+    ret.push_back((char)(sps.size() >> 8));
+    ret.push_back((char)sps.size());
+    ret.append(sps);
+    ret.push_back(1);
+    ret.push_back((char)(pps.size() >> 8));
+    ret.push_back((char)pps.size());
+    ret.append(pps);
+    H264Sps info;
+    if (isHighProfile((uint8_t)sps[1]) && parseH264Sps((const uint8_t *)sps.data(), sps.size(), info)) {
+        ret.push_back((char)(0xfc | info.chroma_format_idc));
+        ret.push_back((char)(0xf8 | (info.bit_depth_luma - 8)));
+        ret.push_back((char)(0xf8 | (info.bit_depth_chroma - 8)));
+        ret.push_back(0);
+    }
+    return ret;
+}
+
+bool parseAvcConfig(const uint8_t *data, size_t size, vector<string> &sps, vector<string> &pps, size_t &length_size) {
+    if (size < 7 || data[0] != 1) {
+        return false;
+    }
+    length_size = (data[4] & 0x03) + 1;
+    size_t pos = 5;
+    for (int list = 0; list < 2; ++list) {
+        if (pos >= size) {
+            return false;
+        }
+        size_t count = list ? data[pos] : (data[pos] & 0x1f);
+        ++pos;
+        for (size_t i = 0; i < count; ++i) {
+            if (pos + 2 > size) {
+                return false;
+            }
+            size_t len = (data[pos] << 8) | data[pos + 1];
+            pos += 2;
+            if (pos + len > size) {
+                return false;
+            }
+            (list ? pps : sps).emplace_back((const char *)data + pos, len);
+            pos += len;
+        }
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void h264PacketizeRtp(const vector<Buffer::Ptr> &nalus, size_t max_payload, const onRtpPayload &cb) {
+    //FU-A 至少要带1字节数据
+    if (max_payload < 3) {
+        return;
+    }
+    //先算出新增头部的总字节数上限, 一次分配
+    vector<const Buffer::Ptr *> list;
+    list.reserve(nalus.size());
+    size_t header_bytes = 0;
+    for (auto &nal : nalus) {
+        auto size = nal->size();
+        if (size < 2) {
+            continue;
+        }
+        list.emplace_back(&nal);
+        //单独发送或 STAP-A(负载头均摊 + 2字节长度) / FU-A(每片2字节)
+        header_bytes += size <= max_payload ? 3 : 2 * ((size - 1 + max_payload - 3) / (max_payload - 2));
+    }
+    if (list.empty()) {
+        return;
+    }
+    auto headers = BufferRaw::create(header_bytes, header_bytes);
+    auto base = (uint8_t *)headers->data();
+    size_t used = 0;
+    vector<Buffer::Ptr> pieces;
+
+    size_t i = 0;
+    while (i < list.size()) {
+        auto &nal = *list[i];
+        auto data = (const uint8_t *)nal->data();
+        auto size = nal->size();
+        if (size > max_payload) {
+            //FU indicator 沿用 NAL 头的 F/NRI, FU header 记录原类型和首尾标记; NAL 头本身不发送
+            for (size_t offset = 1; offset < size;) {
+                size_t len = std::min(max_payload - 2, size - offset);
+                bool end = offset + len == size;
+                auto p = base + used;
+                p[0] = (data[0] & 0xe0) | H264_NAL_FU_A;
+                p[1] = h264NalType(data[0]) | (offset == 1 ? 0x80 : 0) | (end ? 0x40 : 0);
+                pieces.clear();
+                pieces.emplace_back(BufferSlice::create(headers, used, 2));
+                pieces.emplace_back(BufferSlice::create(nal, offset, len));
+                used += 2;
+                cb(pieces, 2 + len, end && i + 1 == list.size());
+                offset += len;
+            }
+            ++i;
+            continue;
+        }
+
+        //尽量把后面的小 NAL 合并进来
+        size_t total = 1 + 2 + size;
+        size_t j = i + 1;
+        while (j < list.size() && total + 2 + (*list[j])->size() <= max_payload) {
+            total += 2 + (*list[j])->size();
+            ++j;
+        }
+        pieces.clear();
+        if (j == i + 1) {
+            pieces.emplace_back(nal);
+            cb(pieces, size, i + 1 == list.size());
+            ++i;
+            continue;
+        }
+
+        //STAP-A 头: F 取或, NRI 取最大值
+        uint8_t forbidden = 0, nri = 0;
+        for (size_t k = i; k < j; ++k) {
+            auto h = (uint8_t)(*list[k])->data()[0];
+            forbidden |= h & 0x80;
+            nri = std::max<uint8_t>(nri, h & 0x60);
+        }
+        auto p = base + used;
+        p[0] = forbidden | nri | H264_NAL_STAP_A;
+        pieces.emplace_back(BufferSlice::create(headers, used, 1));
+        used += 1;
+        for (size_t k = i; k < j; ++k) {
+            auto &item = *list[k];
+            p = base + used;
+            p[0] = item->size() >> 8;
+            p[1] = item->size();
+            pieces.emplace_back(BufferSlice::create(headers, used, 2));
+            used += 2;
+            pieces.emplace_back(item);
+        }
+        cb(pieces, total, j == list.size());
+        i = j;
+    }
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef __H264_H__
+#define __H264_H__
+
+#include "AnnexB.h"
+
+namespace beton {
+
+//NAL 单元类型(nal_unit_type)
+typedef enum : uint8_t {
+    H264_NAL_SLICE = 1,
+    H264_NAL_SLICE_DPA = 2,
+    H264_NAL_SLICE_DPB = 3,
+    H264_NAL_SLICE_DPC = 4,
+    H264_NAL_IDR = 5,
+    H264_NAL_SEI = 6,
+    H264_NAL_SPS = 7,
+    H264_NAL_PPS = 8,
+    H264_NAL_AUD = 9,
+    H264_NAL_END_SEQUENCE = 10,
+    H264_NAL_END_STREAM = 11,
+    H264_NAL_FILLER = 12,
+    H264_NAL_SPS_EXT = 13,
+    H264_NAL_PREFIX = 14,
+    H264_NAL_SUBSET_SPS = 15,
+    //RTP 打包使用(RFC 6184)
+    H264_NAL_STAP_A = 24,
+    H264_NAL_FU_A = 28
+}H264NalType;
+
+//帧类型，由 slice_type 得到
+typedef enum : uint8_t {
+    H264_FRAME_UNKNOWN = 0,
+    H264_FRAME_I,
+    H264_FRAME_P,
+    H264_FRAME_B
+}H264FrameType;
+
+static inline H264NalType h264NalType(uint8_t nal_header) {
+    return (H264NalType)(nal_header & 0x1f);
+}
+
+//是否为图像数据(VCL)
+static inline bool h264IsVcl(uint8_t nal_header) {
+    auto type = h264NalType(nal_header);
+    return type >= H264_NAL_SLICE && type <= H264_NAL_IDR;
+}
+
+struct H264Sps {
+    uint8_t profile_idc = 0;
+    //constraint_set0~5_flag 及保留位
+    uint8_t constraint_flags = 0;
+    uint8_t level_idc = 0;
+    uint32_t sps_id = 0;
+    uint32_t chroma_format_idc = 1;
+    uint32_t bit_depth_luma = 8;
+    uint32_t bit_depth_chroma = 8;
+    uint32_t log2_max_frame_num = 4;
+    uint32_t poc_type = 0;
+    uint32_t log2_max_poc_lsb = 4;
+    uint32_t max_num_ref_frames = 0;
+    bool frame_mbs_only = true;
+    //裁剪后的宽高
+    uint32_t width = 0;
+    uint32_t height = 0;
+    //VUI 中的帧率，没有时为0
+    double fps = 0;
+};
+
+struct H264Pps {
+    uint32_t pps_id = 0;
+    uint32_t sps_id = 0;
+    //true 为 CABAC
+    bool entropy_coding_mode = false;
+    bool bottom_field_pic_order_in_frame_present = false;
+};
+
+/**
+ * 解析 SPS/PPS
+ * @param nal: 完整的 NAL 单元(含1字节 NAL 头, 不含起始码)
+*/
+bool parseH264Sps(const uint8_t *nal, size_t size, H264Sps &sps);
+bool parseH264Pps(const uint8_t *nal, size_t size, H264Pps &pps);
+
+/**
+ * 由 slice 头得到帧类型，只需要 NAL 开头的几个字节
+ * 非 VCL 的 NAL 返回 H264_FRAME_UNKNOWN
+*/
+H264FrameType h264FrameType(const uint8_t *nal, size_t size);
+
+/**
+ * 一个访问单元(一帧)的概况，遍历其所有 NAL 得到
+*/
+struct H264FrameInfo {
+    //含 IDR slice
+    bool key = false;
+    //含 SPS 或 PPS
+    bool config = false;
+    H264FrameType type = H264_FRAME_UNKNOWN;
+    //VCL NAL 个数
+    size_t slices = 0;
+};
+//访问单元为 NAL 切片列表(来自 splitAnnexB/splitLengthPrefixed)
+H264FrameInfo h264FrameInfo(const std::vector<Buffer::Ptr> &nalus);
+
+/**
+ * AVCDecoderConfigurationRecord(FLV/MP4 的 avcC), 长度字段固定4字节
+ * @return SPS 太短时返回空
+*/
+std::string makeAvcConfig(const std::string &sps, const std::string &pps);
+//解析 avcC, 取出全部 SPS/PPS 和长度字段字节数
+bool parseAvcConfig(const uint8_t *data, size_t size, std::vector<std::string> &sps, std::vector<std::string> &pps, size_t &length_size);
+
+/**
+ * 按 RFC 6184 packetization-mode=1 把一帧的 NAL 打包为 RTP 负载:
+ * 能放进一个包的 NAL 单独发送，相邻的小 NAL(比如 SPS/PPS)合并为 STAP-A, 超长的 NAL 拆成 FU-A
+ * 新增的负载头和长度字段写在同一块内存里，NAL 数据只做切片
+ * @param max_payload: 单个 RTP 负载最大字节数(MTU 减去 IP/UDP/RTP 头)
+*/
+void h264PacketizeRtp(const std::vector<Buffer::Ptr> &nalus, size_t max_payload, const onRtpPayload &cb);
+
+}
+#endif  //__H264_H__
@@ -0,0 +1,459 @@
+#include "H265.h"
+
+using namespace std;
+
+namespace beton {
+
+static void parsePtl(BitReader &br, uint32_t max_sub_layers_minus1, H265Ptl &ptl) {
+    ptl.profile_space = br.readBits(2);
+    ptl.tier_flag = br.readBits(1);
+    ptl.profile_idc = br.readBits(5);
+    ptl.compatibility_flags = br.readBits(32);
+    ptl.constraint_flags = ((uint64_t)br.readBits(32) << 16) | br.readBits(16);
+    ptl.level_idc = br.readBits(8);
+    //子层的 profile/level 只需跳过
+    bool profile_present[8] = {false};
+    bool level_present[8] = {false};
+    for (uint32_t i = 0; i < max_sub_layers_minus1; ++i) {
+        profile_present[i] = br.readBit();
+        level_present[i] = br.readBit();
+    }
+    if (max_sub_layers_minus1 > 0) {
+        br.skipBits(2 * (8 - max_sub_layers_minus1));
+    }
+    for (uint32_t i = 0; i < max_sub_layers_minus1; ++i) {
+        if (profile_present[i]) {
+            br.skipBits(88);
+        }
+        if (level_present[i]) {
+            br.skipBits(8);
+        }
+    }
+}
+
+static void skipScalingListData(BitReader &br) {
+    for (int size_id = 0; size_id < 4; ++size_id) {
+        for (int matrix_id = 0; matrix_id < 6; matrix_id += (size_id == 3) ? 3 : 1) {
+            if (!br.readBit()) {
+                //scaling_list_pred_matrix_id_delta
+                br.readUE();
+                continue;
+            }
+            int coef_num = std::min(64, 1 << (4 + (size_id << 1)));
+            if (size_id > 1) {
+                br.readSE();
+            }
+            for (int i = 0; i < coef_num; ++i) {
+                br.readSE();
+            }
+        }
+    }
+}
+
+//st_ref_pic_set(), 只需要记录每个集合的 delta poc 个数供后续集合预测
+static bool skipShortTermRefPicSet(BitReader &br, uint32_t idx, uint32_t *num_delta_pocs) {
+    if (idx && br.readBit()) {
+        //delta_rps_sign, abs_delta_rps_minus1
+        br.skipBits(1);
+        br.readUE();
+        uint32_t count = 0;
+        for (uint32_t j = 0; j <= num_delta_pocs[idx - 1]; ++j) {
+            bool used_by_curr_pic = br.readBit();
+            if (used_by_curr_pic || br.readBit()) {
+                ++count;
+            }
+        }
+        num_delta_pocs[idx] = count;
+        return true;
+    }
+    uint32_t negative = br.readUE();
+    uint32_t positive = br.readUE();
+    if (negative > 16 || positive > 16) {
+        return false;
+    }
+    for (uint32_t i = 0; i < negative + positive; ++i) {
+        //delta_poc_s0/s1_minus1, used_by_curr_pic_s0/s1_flag
+        br.readUE();
+        br.skipBits(1);
+    }
+    num_delta_pocs[idx] = negative + positive;
+    return true;
+}
+
+//只解析到 timing_info 为止
+static void parseVui(BitReader &br, H265Sps &sps) {
+    if (br.readBit()) {
+        if (br.readBits(8) == 255) {
+            br.skipBits(32);
+        }
+    }
+    if (br.readBit()) {
+        br.skipBits(1);
+    }
+    if (br.readBit()) {
+        br.skipBits(4);
+        if (br.readBit()) {
+            br.skipBits(24);
+        }
+    }
+    if (br.readBit()) {
+        br.readUE();
+        br.readUE();
+    }
+    //neutral_chroma_indication_flag, field_seq_flag, frame_field_info_present_flag
+    br.skipBits(3);
+    if (br.readBit()) {
+        //default display window
+        for (int i = 0; i < 4; ++i) {
+            br.readUE();
+        }
+    }
+    if (br.readBit()) {
+        uint32_t num_units_in_tick = br.readBits(32);
+        uint32_t time_scale = br.readBits(32);
+        if (num_units_in_tick && !br.overflow()) {
+            sps.fps = (double)time_scale / num_units_in_tick;
+        }
+    }
+}
+
+bool parseH265Vps(const uint8_t *nal, size_t size, H265Vps &vps) {
+    if (size < 4 || h265NalType(nal[0]) != H265_NAL_VPS) {
+        return false;
+    }
+    BitReader br(nal + 2, size - 2);
+    vps.vps_id = br.readBits(4);
+    //base_layer_internal_flag, base_layer_available_flag, max_layers_minus1
+    br.skipBits(8);
+    uint32_t max_sub_layers_minus1 = br.readBits(3);
+    if (max_sub_layers_minus1 > 6) {
+        return false;
+    }
+    vps.max_sub_layers = max_sub_layers_minus1 + 1;
+    vps.temporal_id_nesting = br.readBit();
+    //vps_reserved_0xffff_16bits
+    br.skipBits(16);
+    parsePtl(br, max_sub_layers_minus1, vps.ptl);
+    return !br.overflow();
+}
+
+bool parseH265Sps(const uint8_t *nal, size_t size, H265Sps &sps) {
+    if (size < 4 || h265NalType(nal[0]) != H265_NAL_SPS) {
+        return false;
+    }
+    BitReader br(nal + 2, size - 2);
+    sps.vps_id = br.readBits(4);
+    uint32_t max_sub_layers_minus1 = br.readBits(3);
+    if (max_sub_layers_minus1 > 6) {
+        return false;
+    }
+    sps.max_sub_layers = max_sub_layers_minus1 + 1;
+    sps.temporal_id_nesting = br.readBit();
+    parsePtl(br, max_sub_layers_minus1, sps.ptl);
+    sps.sps_id = br.readUE();
+    if (sps.sps_id > 15) {
+        return false;
+    }
+    sps.chroma_format_idc = br.readUE();
+    if (sps.chroma_format_idc > 3) {
+        return false;
+    }
+    bool separate_colour_plane = false;
+    if (sps.chroma_format_idc == 3) {
+        separate_colour_plane = br.readBit();
+    }
+    uint32_t width = br.readUE();
+    uint32_t height = br.readUE();
+    uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+    if (br.readBit()) {
+        crop_left = br.readUE();
+        crop_right = br.readUE();
+        crop_top = br.readUE();
+        crop_bottom = br.readUE();
+    }
+    sps.bit_depth_luma = br.readUE() + 8;
+    sps.bit_depth_chroma = br.readUE() + 8;
+    sps.log2_max_poc_lsb = br.readUE() + 4;
+    if (br.overflow() || sps.log2_max_poc_lsb > 16) {
+        return false;
+    }
+
+    //裁剪单位取决于色度采样格式
+    uint32_t crop_x = 1, crop_y = 1;
+    if (!separate_colour_plane && (sps.chroma_format_idc == 1 || sps.chroma_format_idc == 2)) {
+        crop_x = 2;
+        crop_y = sps.chroma_format_idc == 1 ? 2 : 1;
+    }
+    uint64_t crop_w = (uint64_t)(crop_left + crop_right) * crop_x;
+    uint64_t crop_h = (uint64_t)(crop_top + crop_bottom) * crop_y;
+    if (crop_w >= width || crop_h >= height) {
+        return false;
+    }
+    sps.width = width - crop_w;
+    sps.height = height - crop_h;
+
+    //以下只为了拿到 VUI 中的帧率，解析失败不影响前面的结果
+    bool sub_layer_ordering_info_present = br.readBit();
+    for (uint32_t i = sub_layer_ordering_info_present ? 0 : max_sub_layers_minus1; i <= max_sub_layers_minus1; ++i) {
+        br.readUE();
+        br.readUE();
+        br.readUE();
+    }
+    //编码块、变换块的尺寸和深度
+    for (int i = 0; i < 6; ++i) {
+        br.readUE();
+    }
+    if (br.readBit() && br.readBit()) {
+        skipScalingListData(br);
+    }
+    //amp_enabled_flag, sample_adaptive_offset_enabled_flag
+    br.skipBits(2);
+    if (br.readBit()) {
+        //pcm 的位深和块尺寸
+        br.skipBits(8);
+        br.readUE();
+        br.readUE();
+        br.skipBits(1);
+    }
+    uint32_t num_short_term_ref_pic_sets = br.readUE();
+    if (num_short_term_ref_pic_sets > 64) {
+        return true;
+    }
+    uint32_t num_delta_pocs[64] = {0};
+    for (uint32_t i = 0; i < num_short_term_ref_pic_sets; ++i) {
+        if (!skipShortTermRefPicSet(br, i, num_delta_pocs) || br.overflow()) {
+            return true;
+        }
+    }
+    if (br.readBit()) {
+        uint32_t num_long_term_ref_pics = br.readUE();
+        if (num_long_term_ref_pics > 32) {
+            return true;
+        }
+        for (uint32_t i = 0; i < num_long_term_ref_pics; ++i) {
+            br.skipBits(sps.log2_max_poc_lsb + 1);
+        }
+    }
+    //sps_temporal_mvp_enabled_flag, strong_intra_smoothing_enabled_flag
+    br.skipBits(2);
+    if (br.readBit()) {
+        H265Sps vui = sps;
+        parseVui(br, vui);
+        if (!br.overflow()) {
+            sps.fps = vui.fps;
+        }
+    }
+    return true;
+}
+
+bool parseH265Pps(const uint8_t *nal, size_t size, H265Pps &pps) {
+    if (size < 3 || h265NalType(nal[0]) != H265_NAL_PPS) {
+        return false;
+    }
+    BitReader br(nal + 2, size - 2);
+    pps.pps_id = br.readUE();
+    pps.sps_id = br.readUE();
+    pps.dependent_slice_segments_enabled = br.readBit();
+    pps.output_flag_present = br.readBit();
+    pps.num_extra_slice_header_bits = br.readBits(3);
+    return !br.overflow() && pps.pps_id <= 63 && pps.sps_id <= 15;
+}
+
+H265FrameInfo h265FrameInfo(const vector<Buffer::Ptr> &nalus) {
+    H265FrameInfo info;
+    for (auto &nal : nalus) {
+        if (nal->size() < 2) {
+            continue;
+        }
+        auto header = (uint8_t)nal->data()[0];
+        auto type = h265NalType(header);
+        if (type >= H265_NAL_VPS && type <= H265_NAL_PPS) {
+            info.config = true;
+        } else if (h265IsVcl(header)) {
+            ++info.slices;
+            info.key = info.key || h265IsIrap(header);
+        }
+    }
+    return info;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void appendNalArray(string &out, H265NalType type, const string &nal) {
+    //array_completeness = 1
+    out.push_back((char)(0x80 | type));
+    out.push_back(0);
+    out.push_back(1);
+    out.push_back((char)(nal.size() >> 8));
+    out.push_back((char)nal.size());
+    out.append(nal);
+}
+
+string makeHevcConfig(const string &vps, const string &sps, const string &pps) {
+    H265Sps info;
+    if (vps.size() > 0xffff || sps.size() > 0xffff || pps.size() > 0xffff ||
+        !parseH265Sps((const uint8_t *)sps.data(), sps.size(), info)) {
+        return "";
+    }
+    auto &ptl = info.ptl;
+    string ret;
+    ret.reserve(23 + 15 + vps.size() + sps.size() + pps.size());
+    ret.push_back(1);
+    ret.push_back((char)((ptl.profile_space << 6) | (ptl.tier_flag << 5) | ptl.profile_idc));
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        ret.push_back((char)(ptl.compatibility_flags >> shift));
+    }
+    for (int shift = 40; shift >= 0; shift -= 8) {
+        ret.push_back((char)(ptl.constraint_flags >> shift));
+    }
+    ret.push_back((char)ptl.level_idc);
+    //min_spatial_segmentation_idc = 0, parallelismType = 0
+    ret.push_back((char)0xf0);
+    ret.push_back(0);
+    ret.push_back((char)0xfc);
+    ret.push_back((char)(0xfc | info.chroma_format_idc));
+    ret.push_back((char)(0xf8 | (info.bit_depth_luma - 8)));
+    ret.push_back((char)(0xf8 | (info.bit_depth_chroma - 8)));
+    //avgFrameRate = 0
+    ret.push_back(0);
+    ret.push_back(0);
+    //constantFrameRate = 0, numTemporalLayers, temporalIdNested, lengthSizeMinusOne = 3
+    ret.push_back((char)((info.max_sub_layers << 3) | (info.temporal_id_nesting << 2) | 0x03));
+    ret.push_back(3);
+    appendNalArray(ret, H265_NAL_VPS, vps);
+    appendNalArray(ret, H265_NAL_SPS, sps);
+    appendNalArray(ret, H265_NAL_PPS, pps);
+    return ret;
+}
+
+bool parseHevcConfig(const uint8_t *data, size_t size, vector<string> &vps, vector<string> &sps,
+                     vector<string> &pps, size_t &length_size) {
+    if (size < 23 || data[0] != 1) {
+        return false;
+    }
+    length_size = (data[21] & 0x03) + 1;
+    size_t arrays = data[22];
+    size_t pos = 23;
+    for (size_t i = 0; i < arrays; ++i) {
+        if (pos + 3 > size) {
+            return false;
+        }
+        auto type = data[pos] & 0x3f;
+        size_t count = (data[pos + 1] << 8) | data[pos + 2];
+        pos += 3;
+        for (size_t j = 0; j < count; ++j) {
+            if (pos + 2 > size) {
+                return false;
+            }
+            size_t len = (data[pos] << 8) | data[pos + 1];
+            pos += 2;
+            if (pos + len > size) {
+                return false;
+            }
+            switch (type) {
+                case H265_NAL_VPS: vps.emplace_back((const char *)data + pos, len); break;
+                case H265_NAL_SPS: sps.emplace_back((const char *)data + pos, len); break;
+                case H265_NAL_PPS: pps.emplace_back((const char *)data + pos, len); break;
+                //SEI 等其他类型忽略
+                default: break;
+            }
+            pos += len;
+        }
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void h265PacketizeRtp(const vector<Buffer::Ptr> &nalus, size_t max_payload, const onRtpPayload &cb) {
+    //FU 至少要带1字节数据
+    if (max_payload < 4) {
+        return;
+    }
+    //先算出新增头部的总字节数上限, 一次分配
+    vector<const Buffer::Ptr *> list;
+    list.reserve(nalus.size());
+    size_t header_bytes = 0;
+    for (auto &nal : nalus) {
+        auto size = nal->size();
+        if (size < 3) {
+            continue;
+        }
+        list.emplace_back(&nal);
+        //单独发送或 AP(负载头均摊 + 2字节长度) / FU(每片3字节)
+        header_bytes += size <= max_payload ? 4 : 3 * ((size - 2 + max_payload - 4) / (max_payload - 3));
+    }
+    if (list.empty()) {
+        return;
+    }
+    auto headers = BufferRaw::create(header_bytes, header_bytes);
+    auto base = (uint8_t *)headers->data();
+    size_t used = 0;
+    vector<Buffer::Ptr> pieces;
+
+    size_t i = 0;
+    while (i < list.size()) {
+        auto &nal = *list[i];
+        auto data = (const uint8_t *)nal->data();
+        auto size = nal->size();
+        if (size > max_payload) {
+            //FU: 负载头沿用 NAL 头的 F/LayerId/TID, FU 头记录原类型和首尾标记; NAL 头本身不发送
+            for (size_t offset = 2; offset < size;) {
+                size_t len = std::min(max_payload - 3, size - offset);
+                bool end = offset + len == size;
+                auto p = base + used;
+                p[0] = (data[0] & 0x81) | (H265_NAL_FU << 1);
+                p[1] = data[1];
+                p[2] = h265NalType(data[0]) | (offset == 2 ? 0x80 : 0) | (end ? 0x40 : 0);
+                pieces.clear();
+                pieces.emplace_back(BufferSlice::create(headers, used, 3));
+                pieces.emplace_back(BufferSlice::create(nal, offset, len));
+                used += 3;
+                cb(pieces, 3 + len, end && i + 1 == list.size());
+                offset += len;
+            }
+            ++i;
+            continue;
+        }
+
+        //尽量把后面的小 NAL 合并进来
+        size_t total = 2 + 2 + size;
+        size_t j = i + 1;
+        while (j < list.size() && total + 2 + (*list[j])->size() <= max_payload) {
+            total += 2 + (*list[j])->size();
+            ++j;
+        }
+        pieces.clear();
+        if (j == i + 1) {
+            pieces.emplace_back(nal);
+            cb(pieces, size, i + 1 == list.size());
+            ++i;
+            continue;
+        }
+
+        //AP 负载头: F 取或, LayerId 和 TID 取最小值
+        uint8_t forbidden = 0, layer_id = 63, tid = 7;
+        for (size_t k = i; k < j; ++k) {
+            auto h = (const uint8_t *)(*list[k])->data();
+            forbidden |= h[0] & 0x80;
+            layer_id = std::min<uint8_t>(layer_id, ((h[0] & 0x01) << 5) | (h[1] >> 3));
+            tid = std::min<uint8_t>(tid, h[1] & 0x07);
+        }
+        auto p = base + used;
+        p[0] = forbidden | (H265_NAL_AP << 1) | (layer_id >> 5);
+        p[1] = ((layer_id & 0x1f) << 3) | tid;
+        pieces.emplace_back(BufferSlice::create(headers, used, 2));
+        used += 2;
+        for (size_t k = i; k < j; ++k) {
+            auto &item = *list[k];
+            p = base + used;
+            p[0] = item->size() >> 8;
+            p[1] = item->size();
+            pieces.emplace_back(BufferSlice::create(headers, used, 2));
+            used += 2;
+            pieces.emplace_back(item);
+        }
+        cb(pieces, total, j == list.size());
+        i = j;
+    }
+}
+
+}
@@ -0,0 +1,130 @@
+#ifndef __H265_H__
+#define __H265_H__
+
+#include "AnnexB.h"
+
+namespace beton {
+
+//NAL 单元类型(nal_unit_type)
+typedef enum : uint8_t {
+    H265_NAL_TRAIL_N = 0,
+    H265_NAL_TRAIL_R = 1,
+    H265_NAL_RASL_R = 9,
+    H265_NAL_BLA_W_LP = 16,
+    H265_NAL_BLA_W_RADL = 17,
+    H265_NAL_BLA_N_LP = 18,
+    H265_NAL_IDR_W_RADL = 19,
+    H265_NAL_IDR_N_LP = 20,
+    H265_NAL_CRA = 21,
+    //22、23 为保留的 IRAP 类型
+    H265_NAL_IRAP_MAX = 23,
+    H265_NAL_VPS = 32,
+    H265_NAL_SPS = 33,
+    H265_NAL_PPS = 34,
+    H265_NAL_AUD = 35,
+    H265_NAL_EOS = 36,
+    H265_NAL_EOB = 37,
+    H265_NAL_FD = 38,
+    H265_NAL_SEI_PREFIX = 39,
+    H265_NAL_SEI_SUFFIX = 40,
+    //RTP 打包使用(RFC 7798)
+    H265_NAL_AP = 48,
+    H265_NAL_FU = 49
+}H265NalType;
+
+//NAL 头2字节: forbidden_zero_bit(1) nal_unit_type(6) nuh_layer_id(6) nuh_temporal_id_plus1(3)
+static inline H265NalType h265NalType(uint8_t nal_header) {
+    return (H265NalType)((nal_header >> 1) & 0x3f);
+}
+
+static inline bool h265IsVcl(uint8_t nal_header) {
+    return h265NalType(nal_header) < H265_NAL_VPS;
+}
+
+//随机接入点(BLA/IDR/CRA), 可以从这里开始解码
+static inline bool h265IsIrap(uint8_t nal_header) {
+    auto type = h265NalType(nal_header);
+    return type >= H265_NAL_BLA_W_LP && type <= H265_NAL_IRAP_MAX;
+}
+
+//profile_tier_level 中的 general 部分，hvcC 需要原样写入
+struct H265Ptl {
+    uint8_t profile_space = 0;
+    uint8_t tier_flag = 0;
+    uint8_t profile_idc = 0;
+    uint32_t compatibility_flags = 0;
+    //48位
+    uint64_t constraint_flags = 0;
+    uint8_t level_idc = 0;
+};
+
+struct H265Vps {
+    uint32_t vps_id = 0;
+    uint32_t max_sub_layers = 1;
+    bool temporal_id_nesting = false;
+    H265Ptl ptl;
+};
+
+struct H265Sps {
+    uint32_t vps_id = 0;
+    uint32_t sps_id = 0;
+    uint32_t max_sub_layers = 1;
+    bool temporal_id_nesting = false;
+    H265Ptl ptl;
+    uint32_t chroma_format_idc = 1;
+    uint32_t bit_depth_luma = 8;
+    uint32_t bit_depth_chroma = 8;
+    uint32_t log2_max_poc_lsb = 4;
+    //裁剪后的宽高
+    uint32_t width = 0;
+    uint32_t height = 0;
+    //VUI 中的帧率，没有时为0
+    double fps = 0;
+};
+
+struct H265Pps {
+    uint32_t pps_id = 0;
+    uint32_t sps_id = 0;
+    bool dependent_slice_segments_enabled = false;
+    bool output_flag_present = false;
+    uint32_t num_extra_slice_header_bits = 0;
+};
+
+/**
+ * 解析 VPS/SPS/PPS
+ * @param nal: 完整的 NAL 单元(含2字节 NAL 头, 不含起始码)
+*/
+bool parseH265Vps(const uint8_t *nal, size_t size, H265Vps &vps);
+bool parseH265Sps(const uint8_t *nal, size_t size, H265Sps &sps);
+bool parseH265Pps(const uint8_t *nal, size_t size, H265Pps &pps);
+
+//一个访问单元(一帧)的概况
+struct H265FrameInfo {
+    //含 IRAP slice
+    bool key = false;
+    //含 VPS/SPS/PPS
+    bool config = false;
+    //VCL NAL 个数
+    size_t slices = 0;
+};
+H265FrameInfo h265FrameInfo(const std::vector<Buffer::Ptr> &nalus);
+
+/**
+ * HEVCDecoderConfigurationRecord(enhanced FLV/MP4 的 hvcC), 长度字段固定4字节
+ * @return SPS 解析失败时返回空
+*/
+std::string makeHevcConfig(const std::string &vps, const std::string &sps, const std::string &pps);
+//解析 hvcC, 取出全部 VPS/SPS/PPS 和长度字段字节数
+bool parseHevcConfig(const uint8_t *data, size_t size, std::vector<std::string> &vps, std::vector<std::string> &sps,
+                     std::vector<std::string> &pps, size_t &length_size);
+
+/**
+ * 按 RFC 7798 把一帧的 NAL 打包为 RTP 负载(不使用 DONL):
+ * 能放进一个包的 NAL 单独发送，相邻的小 NAL(比如 VPS/SPS/PPS)合并为 AP, 超长的 NAL 拆成 FU
+ * 新增的负载头和长度字段写在同一块内存里，NAL 数据只做切片
+ * @param max_payload: 单个 RTP 负载最大字节数(MTU 减去 IP/UDP/RTP 头)
+*/
+void h265PacketizeRtp(const std::vector<Buffer::Ptr> &nalus, size_t max_payload, const onRtpPayload &cb);
+
+}
+#endif  //__H265_H__
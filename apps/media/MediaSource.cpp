@@ -0,0 +1,151 @@
+#include "MediaSource.h"
+#include "threadpool/ThreadPool.h"
+
+using namespace std;
+
+namespace beton {
+
+//全局登记表，只在推流开始/结束和播放端查找时访问
+struct SourceRegistry {
+    std::mutex mutex;
+    std::unordered_map<string, weak_ptr<MediaSource> > sources;
+};
+
+static SourceRegistry &registry() {
+    static SourceRegistry s_registry;
+    return s_registry;
+}
+
+MediaSource::MediaSource(const string &schema, const string &vhost, const string &app, const string &stream)
+    : _schema(schema), _vhost(vhost.empty() ? DEFAULT_VHOST : vhost), _app(app), _stream(stream) {
+    for (auto &poller : ThreadPool::Instance().getAllPollers()) {
+        auto shard = std::make_shared<Shard>();
+        shard->poller = poller;
+        _shards.emplace_back(std::move(shard));
+    }
+}
+
+MediaSource::~MediaSource() {
+    if (_registed) {
+        //已经不能 shared_from_this, 只移除已失效的登记
+        auto &reg = registry();
+        lock_guard<mutex> lck(reg.mutex);
+        auto it = reg.sources.find(makeKey(_schema, _vhost, _app, _stream));
+        if (it != reg.sources.end() && it->second.expired()) {
+            reg.sources.erase(it);
+        }
+    }
+}
+
+string MediaSource::makeKey(const string &schema, const string &vhost, const string &app, const string &stream) {
+    return schema + "://" + vhost + "/" + app + "/" + stream;
+}
+
+string MediaSource::url() const {
+    return makeKey(_schema, _vhost, _app, _stream);
+}
+
+bool MediaSource::regist() {
+    auto &reg = registry();
+    lock_guard<mutex> lck(reg.mutex);
+    auto &entry = reg.sources[url()];
+    auto exists = entry.lock();
+    if (exists && exists.get() != this) {
+        return false;
+    }
+    entry = shared_from_this();
+    _registed = true;
+    InfoL << "media source registered: " << url();
+    return true;
+}
+
+void MediaSource::close() {
+    if (_closed.exchange(true)) {
+        return;
+    }
+    if (_registed) {
+        auto &reg = registry();
+        lock_guard<mutex> lck(reg.mutex);
+        auto it = reg.sources.find(url());
+        if (it != reg.sources.end()) {
+            auto exists = it->second.lock();
+            if (!exists || exists.get() == this) {
+                reg.sources.erase(it);
+            }
+        }
+        InfoL << "media source closed: " << url() << ", readers: " << readerCount();
+    }
+    //播放端在回调中发现流已关闭
+    notifyReaders();
+}
+
+MediaSource::Ptr MediaSource::find(const string &schema, const string &vhost, const string &app, const string &stream) {
+    auto &reg = registry();
+    lock_guard<mutex> lck(reg.mutex);
+    auto it = reg.sources.find(makeKey(schema, vhost.empty() ? DEFAULT_VHOST : vhost, app, stream));
+    return it == reg.sources.end() ? nullptr : it->second.lock();
+}
+
+size_t MediaSource::count() {
+    auto &reg = registry();
+    lock_guard<mutex> lck(reg.mutex);
+    return reg.sources.size();
+}
+
+MediaSource::Shard::Ptr MediaSource::getShard(const PollerThread::Ptr &poller) const {
+    for (auto &shard : _shards) {
+        if (shard->poller == poller) {
+            return shard;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t MediaSource::addListener(const PollerThread::Ptr &poller, onReadable cb) {
+    auto shard = getShard(poller);
+    if (!shard || !cb) {
+        WarnL << "add listener to " << url() << " failed, not on a pool poller";
+        return 0;
+    }
+    auto id = ++_listener_id;
+    ++shard->count;
+    ++_reader_count;
+    //可能正在遍历本分片，不在当前调用栈中修改
+    poller->async([shard, id, cb]() {
+        shard->listeners.emplace(id, cb);
+        cb();
+    }, Thread::Normal, false);
+    return id;
+}
+
+void MediaSource::removeListener(const PollerThread::Ptr &poller, uint64_t id) {
+    auto shard = getShard(poller);
+    if (!shard || !id) {
+        return;
+    }
+    --shard->count;
+    --_reader_count;
+    poller->async([shard, id]() {
+        shard->listeners.erase(id);
+    }, Thread::Normal, false);
+}
+
+void MediaSource::notifyReaders() {
+    for (auto &shard : _shards) {
+        if (shard->count.load(std::memory_order_relaxed) && !shard->pending.exchange(true, std::memory_order_acq_rel)) {
+            wakeup(shard);
+        }
+    }
+}
+
+void MediaSource::wakeup(const Shard::Ptr &shard) {
+    shard->poller->async([shard]() {
+        //先清除标记，回调期间的写入会再投递一次
+        shard->pending.store(false, std::memory_order_release);
+        for (auto &pr : shard->listeners) {
+            pr.second();
+        }
+    }, Thread::Normal, false);
+}
+
+}
@@ -0,0 +1,90 @@
+#ifndef __MEDIA_SOURCE_H__
+#define __MEDIA_SOURCE_H__
+
+#include "threadpool/PollerThread.h"
+#include <atomic>
+#include <unordered_map>
+
+namespace beton {
+
+//未指定 vhost 时使用
+#define DEFAULT_VHOST "__defaultVhost__"
+
+/**
+ * 一路正在推送的流，按 schema/vhost/app/stream 登记，播放端通过 find 找到它:
+ * 1. 子类持有该协议的帧环形缓冲(RingBuffer), 推流端所在线程写入，播放端各自持有读游标
+ * 2. 写入后调用 notifyReaders() 唤醒播放端: 每个 poller 一个分片, 分片内的播放端只在该 poller 访问,
+ *    一轮唤醒内多次写入只投递一次任务，播放端在回调中把积压的帧一次读完
+ * 3. 登记表只在推流开始/结束、播放端查找时加锁，不在帧的路径上
+*/
+class MediaSource : public std::enable_shared_from_this<MediaSource> {
+public:
+    using Ptr = std::shared_ptr<MediaSource>;
+    using onReadable = std::function<void()>;
+
+    MediaSource(const std::string &schema, const std::string &vhost, const std::string &app, const std::string &stream);
+    virtual ~MediaSource();
+
+    /**
+     * 登记到全局表
+     * @return 同名的流已经存在时返回 false
+    */
+    bool regist();
+    //从全局表移除并唤醒所有播放端，播放端发现 closed() 后结束播放
+    void close();
+
+    static Ptr find(const std::string &schema, const std::string &vhost, const std::string &app, const std::string &stream);
+    //当前登记的流的个数
+    static size_t count();
+
+    const std::string &schema() const { return _schema; }
+    const std::string &vhost() const { return _vhost; }
+    const std::string &app() const { return _app; }
+    const std::string &stream() const { return _stream; }
+    std::string url() const;
+    bool closed() const { return _closed.load(std::memory_order_acquire); }
+
+    /**
+     * 播放端登记数据到达的回调，只能在 poller 线程为自己所在的 poller 调用
+     * 登记后会先回调一次，之后每次有新数据或流关闭时回调
+     * @return 监听id, 用于 removeListener
+    */
+    uint64_t addListener(const PollerThread::Ptr &poller, onReadable cb);
+    void removeListener(const PollerThread::Ptr &poller, uint64_t id);
+    //播放端个数
+    size_t readerCount() const { return _reader_count.load(std::memory_order_relaxed); }
+
+protected:
+    //写入帧之后由推流端调用
+    void notifyReaders();
+
+private:
+    //一个 poller 上的播放端，listeners 只在该 poller 线程访问
+    struct Shard {
+        using Ptr = std::shared_ptr<Shard>;
+        PollerThread::Ptr poller;
+        std::atomic<size_t> count{0};
+        //已经投递了唤醒任务还未执行
+        std::atomic<bool> pending{false};
+        std::unordered_map<uint64_t, onReadable> listeners;
+    };
+
+    Shard::Ptr getShard(const PollerThread::Ptr &poller) const;
+    static void wakeup(const Shard::Ptr &shard);
+    static std::string makeKey(const std::string &schema, const std::string &vhost, const std::string &app, const std::string &stream);
+
+private:
+    std::atomic<bool> _closed{false};
+    bool _registed = false;
+    std::atomic<size_t> _reader_count{0};
+    std::atomic<uint64_t> _listener_id{0};
+    std::string _schema;
+    std::string _vhost;
+    std::string _app;
+    std::string _stream;
+    //每个 poller 一个分片，创建后不再修改
+    std::vector<Shard::Ptr> _shards;
+};
+
+}
+#endif  //__MEDIA_SOURCE_H__
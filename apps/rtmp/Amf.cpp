@@ -0,0 +1,613 @@
+#include "Amf.h"
+#include <string.h>
+
+using namespace std;
+
+namespace beton {
+
+//嵌套层数上限，防止恶意数据耗尽栈
+static constexpr int s_max_depth = 32;
+
+typedef enum : uint8_t {
+    AMF0_NUMBER = 0x00,
+    AMF0_BOOLEAN = 0x01,
+    AMF0_STRING = 0x02,
+    AMF0_OBJECT = 0x03,
+    AMF0_NULL = 0x05,
+    AMF0_UNDEFINED = 0x06,
+    AMF0_ECMA_ARRAY = 0x08,
+    AMF0_OBJECT_END = 0x09,
+    AMF0_STRICT_ARRAY = 0x0a,
+    AMF0_DATE = 0x0b,
+    AMF0_LONG_STRING = 0x0c,
+    AMF0_UNSUPPORTED = 0x0d,
+    AMF0_XML_DOC = 0x0f,
+    AMF0_TYPED_OBJECT = 0x10,
+    AMF0_AVMPLUS = 0x11
+}Amf0Marker;
+
+typedef enum : uint8_t {
+    AMF3_UNDEFINED = 0x00,
+    AMF3_NULL = 0x01,
+    AMF3_FALSE = 0x02,
+    AMF3_TRUE = 0x03,
+    AMF3_INTEGER = 0x04,
+    AMF3_DOUBLE = 0x05,
+    AMF3_STRING = 0x06,
+    AMF3_XML_DOC = 0x07,
+    AMF3_DATE = 0x08,
+    AMF3_ARRAY = 0x09,
+    AMF3_OBJECT = 0x0a,
+    AMF3_XML = 0x0b,
+    AMF3_BYTE_ARRAY = 0x0c
+}Amf3Marker;
+
+static const AmfValue &undefinedValue() {
+    static AmfValue s_undefined;
+    return s_undefined;
+}
+
+//////////////////////////// AmfValue ////////////////////////////
+AmfValue::AmfValue(AmfType type) : _type(type) {
+    //容器类型立即分配存储，拷贝出去的值(如 AMF3 引用表)与之共享成员
+    if (type == AMF_OBJECT || type == AMF_ECMA_ARRAY) {
+        _object = std::make_shared<Object>();
+    } else if (type == AMF_STRICT_ARRAY) {
+        _array = std::make_shared<Array>();
+    } else if (type == AMF_STRING) {
+        _string = std::make_shared<string>();
+    }
+}
+
+AmfValue::AmfValue(double num) : _type(AMF_NUMBER), _number(num) {}
+
+AmfValue::AmfValue(bool b) : _type(AMF_BOOLEAN), _boolean(b) {}
+
+AmfValue::AmfValue(string str) : _type(AMF_STRING), _string(std::make_shared<string>(std::move(str))) {}
+
+const string &AmfValue::asString() const {
+    static const string s_empty;
+    return _type == AMF_STRING ? *_string : s_empty;
+}
+
+const AmfValue &AmfValue::operator[](const string &key) const {
+    if (_object) {
+        for (auto &pr : *_object) {
+            if (pr.first == key) {
+                return pr.second;
+            }
+        }
+    }
+    return undefinedValue();
+}
+
+const AmfValue &AmfValue::operator[](size_t index) const {
+    if (_array && index < _array->size()) {
+        return (*_array)[index];
+    }
+    return undefinedValue();
+}
+
+AmfValue &AmfValue::set(const string &key, AmfValue value) {
+    if (!_object) {
+        return *this;
+    }
+    for (auto &pr : *_object) {
+        if (pr.first == key) {
+            pr.second = std::move(value);
+            return *this;
+        }
+    }
+    _object->emplace_back(key, std::move(value));
+    return *this;
+}
+
+AmfValue &AmfValue::add(AmfValue value) {
+    if (_array) {
+        _array->emplace_back(std::move(value));
+    }
+    return *this;
+}
+
+const AmfValue::Object &AmfValue::object() const {
+    static const Object s_empty;
+    return _object ? *_object : s_empty;
+}
+
+const AmfValue::Array &AmfValue::array() const {
+    static const Array s_empty;
+    return _array ? *_array : s_empty;
+}
+
+//////////////////////////// AmfDecoder ////////////////////////////
+AmfDecoder::AmfDecoder(const char *data, size_t size, bool amf3)
+    : _amf3(amf3), _size(size), _data((const uint8_t *)data) {}
+
+bool AmfDecoder::load(AmfValue &value) {
+    return _amf3 ? loadAmf3(value, 0) : loadAmf0(value, 0);
+}
+
+AmfValue AmfDecoder::load() {
+    AmfValue ret;
+    if (!load(ret)) {
+        //后续的值已无法定位
+        _pos = _size;
+        return AmfValue();
+    }
+    return ret;
+}
+
+bool AmfDecoder::readU8(uint8_t &val) {
+    if (_pos + 1 > _size) {
+        return false;
+    }
+    val = _data[_pos++];
+    return true;
+}
+
+bool AmfDecoder::readU16(uint16_t &val) {
+    if (_pos + 2 > _size) {
+        return false;
+    }
+    val = (_data[_pos] << 8) | _data[_pos + 1];
+    _pos += 2;
+    return true;
+}
+
+bool AmfDecoder::readU32(uint32_t &val) {
+    if (_pos + 4 > _size) {
+        return false;
+    }
+    val = ((uint32_t)_data[_pos] << 24) | (_data[_pos + 1] << 16) | (_data[_pos + 2] << 8) | _data[_pos + 3];
+    _pos += 4;
+    return true;
+}
+
+bool AmfDecoder::readDouble(double &val) {
+    if (_pos + 8 > _size) {
+        return false;
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+        bits = (bits << 8) | _data[_pos + i];
+    }
+    _pos += 8;
+    memcpy(&val, &bits, sizeof(val));
+    return true;
+}
+
+bool AmfDecoder::readString(size_t len, string &str) {
+    if (len > _size - _pos) {
+        return false;
+    }
+    str.assign((const char *)_data + _pos, len);
+    _pos += len;
+    return true;
+}
+
+bool AmfDecoder::loadAmf0Props(AmfValue &value, int depth) {
+    while (true) {
+        uint16_t len;
+        string key;
+        if (!readU16(len) || !readString(len, key)) {
+            return false;
+        }
+        if (key.empty() && _pos < _size && _data[_pos] == AMF0_OBJECT_END) {
+            ++_pos;
+            return true;
+        }
+        AmfValue member;
+        if (!loadAmf0(member, depth + 1)) {
+            return false;
+        }
+        value.set(key, std::move(member));
+    }
+}
+
+bool AmfDecoder::loadAmf0(AmfValue &value, int depth) {
+    uint8_t marker;
+    if (depth > s_max_depth || !readU8(marker)) {
+        return false;
+    }
+    switch (marker) {
+        case AMF0_NUMBER: {
+            double num;
+            if (!readDouble(num)) {
+                return false;
+            }
+            value = AmfValue(num);
+            return true;
+        }
+        case AMF0_BOOLEAN: {
+            uint8_t b;
+            if (!readU8(b)) {
+                return false;
+            }
+            value = AmfValue(b != 0);
+            return true;
+        }
+        case AMF0_STRING:
+        case AMF0_LONG_STRING:
+        case AMF0_XML_DOC: {
+            uint32_t len;
+            if (marker == AMF0_STRING) {
+                uint16_t len16;
+                if (!readU16(len16)) {
+                    return false;
+                }
+                len = len16;
+            } else if (!readU32(len)) {
+                return false;
+            }
+            string str;
+            if (!readString(len, str)) {
+                return false;
+            }
+            value = AmfValue(std::move(str));
+            return true;
+        }
+        case AMF0_TYPED_OBJECT: {
+            //类名丢弃，按普通对象处理
+            uint16_t len;
+            string class_name;
+            if (!readU16(len) || !readString(len, class_name)) {
+                return false;
+            }
+        }
+        //fall through
+        case AMF0_OBJECT:
+            value = AmfValue(AMF_OBJECT);
+            return loadAmf0Props(value, depth);
+        case AMF0_ECMA_ARRAY: {
+            //元素个数不可靠，以结束标记为准
+            uint32_t count;
+            if (!readU32(count)) {
+                return false;
+            }
+            value = AmfValue(AMF_ECMA_ARRAY);
+            return loadAmf0Props(value, depth);
+        }
+        case AMF0_STRICT_ARRAY: {
+            uint32_t count;
+            if (!readU32(count) || count > _size - _pos) {
+                return false;
+            }
+            value = AmfValue(AMF_STRICT_ARRAY);
+            for (uint32_t i = 0; i < count; ++i) {
+                AmfValue item;
+                if (!loadAmf0(item, depth + 1)) {
+                    return false;
+                }
+                value.add(std::move(item));
+            }
+            return true;
+        }
+        case AMF0_DATE: {
+            double ms;
+            uint16_t tz;
+            if (!readDouble(ms) || !readU16(tz)) {
+                return false;
+            }
+            value = AmfValue(ms);
+            return true;
+        }
+        case AMF0_NULL:
+            value = AmfValue(AMF_NULL);
+            return true;
+        case AMF0_UNDEFINED:
+        case AMF0_UNSUPPORTED:
+            value = AmfValue(AMF_UNDEFINED);
+            return true;
+        case AMF0_AVMPLUS:
+            //每次切换到 AMF3 都是新的上下文，引用表重新开始
+            _amf3_strings.clear();
+            _amf3_objects.clear();
+            _amf3_traits.clear();
+            return loadAmf3(value, depth + 1);
+        default:
+            //movieclip、reference、recordset 等已废弃的类型
+            return false;
+    }
+}
+
+bool AmfDecoder::readU29(uint32_t &val) {
+    val = 0;
+    for (int i = 0; i < 4; ++i) {
+        uint8_t b;
+        if (!readU8(b)) {
+            return false;
+        }
+        if (i == 3) {
+            val = (val << 8) | b;
+            return true;
+        }
+        val = (val << 7) | (b & 0x7f);
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return true;
+}
+
+bool AmfDecoder::readAmf3String(string &str) {
+    uint32_t header;
+    if (!readU29(header)) {
+        return false;
+    }
+    if (!(header & 1)) {
+        //引用之前出现过的字符串
+        auto index = header >> 1;
+        if (index >= _amf3_strings.size()) {
+            return false;
+        }
+        str = _amf3_strings[index];
+        return true;
+    }
+    if (!readString(header >> 1, str)) {
+        return false;
+    }
+    if (!str.empty()) {
+        _amf3_strings.emplace_back(str);
+    }
+    return true;
+}
+
+bool AmfDecoder::loadAmf3(AmfValue &value, int depth) {
+    uint8_t marker;
+    if (depth > s_max_depth || !readU8(marker)) {
+        return false;
+    }
+    switch (marker) {
+        case AMF3_UNDEFINED:
+            value = AmfValue(AMF_UNDEFINED);
+            return true;
+        case AMF3_NULL:
+            value = AmfValue(AMF_NULL);
+            return true;
+        case AMF3_FALSE:
+        case AMF3_TRUE:
+            value = AmfValue(marker == AMF3_TRUE);
+            return true;
+        case AMF3_INTEGER: {
+            uint32_t u29;
+            if (!readU29(u29)) {
+                return false;
+            }
+            //29位有符号整数
+            int32_t num = (u29 & 0x10000000) ? (int32_t)(u29 | 0xe0000000) : (int32_t)u29;
+            value = AmfValue((double)num);
+            return true;
+        }
+        case AMF3_DOUBLE: {
+            double num;
+            if (!readDouble(num)) {
+                return false;
+            }
+            value = AmfValue(num);
+            return true;
+        }
+        case AMF3_STRING: {
+            string str;
+            if (!readAmf3String(str)) {
+                return false;
+            }
+            value = AmfValue(std::move(str));
+            return true;
+        }
+        default:
+            break;
+    }
+
+    //以下类型都可能引用对象表
+    uint32_t header;
+    if (!readU29(header)) {
+        return false;
+    }
+    if (!(header & 1)) {
+        auto index = header >> 1;
+        if (index >= _amf3_objects.size()) {
+            return false;
+        }
+        value = _amf3_objects[index];
+        return true;
+    }
+    switch (marker) {
+        case AMF3_XML_DOC:
+        case AMF3_XML:
+        case AMF3_BYTE_ARRAY: {
+            string str;
+            if (!readString(header >> 1, str)) {
+                return false;
+            }
+            value = AmfValue(std::move(str));
+            _amf3_objects.emplace_back(value);
+            return true;
+        }
+        case AMF3_DATE: {
+            double ms;
+            if (!readDouble(ms)) {
+                return false;
+            }
+            value = AmfValue(ms);
+            _amf3_objects.emplace_back(value);
+            return true;
+        }
+        case AMF3_ARRAY: {
+            uint32_t dense = header >> 1;
+            string key;
+            if (!readAmf3String(key)) {
+                return false;
+            }
+            //只有稠密部分时为 strict array, 否则关联部分和稠密部分(以下标为 key)一起放进 ecma array
+            bool assoc = !key.empty();
+            value = AmfValue(assoc ? AMF_ECMA_ARRAY : AMF_STRICT_ARRAY);
+            _amf3_objects.emplace_back(value);
+            while (!key.empty()) {
+                AmfValue item;
+                if (!loadAmf3(item, depth + 1)) {
+                    return false;
+                }
+                value.set(key, std::move(item));
+                if (!readAmf3String(key)) {
+                    return false;
+                }
+            }
+            if (dense > _size - _pos) {
+                return false;
+            }
+            for (uint32_t i = 0; i < dense; ++i) {
+                AmfValue item;
+                if (!loadAmf3(item, depth + 1)) {
+                    return false;
+                }
+                if (assoc) {
+                    value.set(to_string(i), std::move(item));
+                } else {
+                    value.add(std::move(item));
+                }
+            }
+            return true;
+        }
+        case AMF3_OBJECT: {
+            Amf3Traits traits;
+            if ((header & 3) == 1) {
+                auto index = header >> 2;
+                if (index >= _amf3_traits.size()) {
+                    return false;
+                }
+                traits = _amf3_traits[index];
+            } else if ((header & 7) == 7) {
+                //自定义序列化的对象无法解码
+                return false;
+            } else {
+                string class_name;
+                if (!readAmf3String(class_name)) {
+                    return false;
+                }
+                traits.dynamic = (header & 8) != 0;
+                uint32_t count = header >> 4;
+                if (count > _size - _pos) {
+                    return false;
+                }
+                for (uint32_t i = 0; i < count; ++i) {
+                    string member;
+                    if (!readAmf3String(member)) {
+                        return false;
+                    }
+                    traits.members.emplace_back(std::move(member));
+                }
+                _amf3_traits.emplace_back(traits);
+            }
+            value = AmfValue(AMF_OBJECT);
+            _amf3_objects.emplace_back(value);
+            for (auto &member : traits.members) {
+                AmfValue item;
+                if (!loadAmf3(item, depth + 1)) {
+                    return false;
+                }
+                value.set(member, std::move(item));
+            }
+            while (traits.dynamic) {
+                string key;
+                if (!readAmf3String(key)) {
+                    return false;
+                }
+                if (key.empty()) {
+                    break;
+                }
+                AmfValue item;
+                if (!loadAmf3(item, depth + 1)) {
+                    return false;
+                }
+                value.set(key, std::move(item));
+            }
+            return true;
+        }
+        default:
+            //vector、dictionary 在 rtmp 命令中不会出现
+            return false;
+    }
+}
+
+//////////////////////////// AmfEncoder ////////////////////////////
+void AmfEncoder::writeDouble(double num) {
+    uint64_t bits;
+    memcpy(&bits, &num, sizeof(bits));
+    char buf[8];
+    for (int i = 7; i >= 0; --i) {
+        buf[i] = bits & 0xff;
+        bits >>= 8;
+    }
+    _data.append(buf, 8);
+}
+
+void AmfEncoder::writeString(const string &str, bool with_marker) {
+    if (str.size() > 0xffff) {
+        char buf[5] = {(char)AMF0_LONG_STRING, (char)(str.size() >> 24), (char)(str.size() >> 16), (char)(str.size() >> 8), (char)str.size()};
+        _data.append(buf, 5);
+    } else {
+        char buf[3] = {(char)AMF0_STRING, (char)(str.size() >> 8), (char)str.size()};
+        _data.append(with_marker ? buf : buf + 1, with_marker ? 3 : 2);
+    }
+    _data.append(str);
+}
+
+void AmfEncoder::writeProps(const AmfValue::Object &obj) {
+    for (auto &pr : obj) {
+        //属性名不能超过 64K
+        writeString(pr.first.size() > 0xffff ? pr.first.substr(0, 0xffff) : pr.first, false);
+        *this << pr.second;
+    }
+    _data.append("\x00\x00\x09", 3);
+}
+
+AmfEncoder &AmfEncoder::operator<<(const AmfValue &value) {
+    switch (value.type()) {
+        case AMF_NUMBER:
+            _data.push_back(AMF0_NUMBER);
+            writeDouble(value.asNumber());
+            break;
+        case AMF_BOOLEAN:
+            _data.push_back(AMF0_BOOLEAN);
+            _data.push_back(value.asBoolean() ? 1 : 0);
+            break;
+        case AMF_STRING:
+            writeString(value.asString(), true);
+            break;
+        case AMF_OBJECT:
+            _data.push_back(AMF0_OBJECT);
+            writeProps(value.object());
+            break;
+        case AMF_ECMA_ARRAY: {
+            auto count = value.object().size();
+            char buf[5] = {(char)AMF0_ECMA_ARRAY, (char)(count >> 24), (char)(count >> 16), (char)(count >> 8), (char)count};
+            _data.append(buf, 5);
+            writeProps(value.object());
+            break;
+        }
+        case AMF_STRICT_ARRAY: {
+            auto count = value.array().size();
+            char buf[5] = {(char)AMF0_STRICT_ARRAY, (char)(count >> 24), (char)(count >> 16), (char)(count >> 8), (char)count};
+            _data.append(buf, 5);
+            for (auto &item : value.array()) {
+                *this << item;
+            }
+            break;
+        }
+        case AMF_NULL:
+            _data.push_back(AMF0_NULL);
+            break;
+        default:
+            _data.push_back(AMF0_UNDEFINED);
+            break;
+    }
+    return *this;
+}
+
+string AmfEncoder::take() {
+    string ret = std::move(_data);
+    _data.clear();
+    return ret;
+}
+
+}
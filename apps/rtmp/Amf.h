@@ -0,0 +1,133 @@
+#ifndef __AMF_H__
+#define __AMF_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace beton {
+
+typedef enum : uint8_t {
+    AMF_NUMBER = 0,
+    AMF_BOOLEAN,
+    AMF_STRING,
+    AMF_OBJECT,
+    AMF_NULL,
+    AMF_UNDEFINED,
+    AMF_ECMA_ARRAY,
+    AMF_STRICT_ARRAY
+}AmfType;
+
+/**
+ * AMF0/AMF3 解码后的值，两种编码统一成同一套类型:
+ * AMF3 的 integer/date 转为 number, bytearray/xml 转为 string, 稠密数组为 strict array, 带关联部分的数组为 ecma array
+ * 对象和数组的成员共享存储，拷贝 AmfValue 的代价与拷贝 shared_ptr 相同
+*/
+class AmfValue {
+public:
+    using Object = std::vector<std::pair<std::string, AmfValue> >;
+    using Array = std::vector<AmfValue>;
+
+    AmfValue(AmfType type = AMF_UNDEFINED);
+    AmfValue(double num);
+    AmfValue(int num) : AmfValue((double)num) {}
+    AmfValue(bool b);
+    AmfValue(std::string str);
+    AmfValue(const char *str) : AmfValue(std::string(str)) {}
+
+    AmfType type() const { return _type; }
+    bool isNull() const { return _type == AMF_NULL || _type == AMF_UNDEFINED; }
+
+    //类型不符时返回默认值，不抛异常
+    double asNumber() const { return _type == AMF_NUMBER ? _number : 0; }
+    bool asBoolean() const { return _type == AMF_BOOLEAN ? _boolean : (_type == AMF_NUMBER && _number != 0); }
+    const std::string &asString() const;
+
+    //对象/ecma 数组的成员，不存在时返回 undefined
+    const AmfValue &operator[](const std::string &key) const;
+    //strict 数组的元素
+    const AmfValue &operator[](size_t index) const;
+    //对象/ecma 数组按插入顺序保存成员，重复的 key 会覆盖
+    AmfValue &set(const std::string &key, AmfValue value);
+    AmfValue &add(AmfValue value);
+
+    const Object &object() const;
+    const Array &array() const;
+
+private:
+    AmfType _type;
+    bool _boolean = false;
+    double _number = 0;
+    std::shared_ptr<std::string> _string;
+    std::shared_ptr<Object> _object;
+    std::shared_ptr<Array> _array;
+};
+
+/**
+ * 直接在消息 Buffer 的内存上解码，不先拷贝成连续的字符串
+ * AMF0 中遇到 avmplus 标记(0x11)时按 AMF3 解码随后的一个值
+*/
+class AmfDecoder {
+public:
+    /**
+     * @param data: 待解码的数据，解码期间需要保持有效
+     * @param amf3: 是否整个数据都是 AMF3 编码
+    */
+    AmfDecoder(const char *data, size_t size, bool amf3 = false);
+
+    //解码下一个值，数据不完整或格式错误时返回 false
+    bool load(AmfValue &value);
+    //便于逐个读取命令参数，失败时得到 undefined
+    AmfValue load();
+
+    bool empty() const { return _pos >= _size; }
+    size_t pos() const { return _pos; }
+
+private:
+    bool loadAmf0(AmfValue &value, int depth);
+    bool loadAmf3(AmfValue &value, int depth);
+    bool loadAmf0Props(AmfValue &value, int depth);
+    bool readU8(uint8_t &val);
+    bool readU16(uint16_t &val);
+    bool readU32(uint32_t &val);
+    bool readDouble(double &val);
+    bool readU29(uint32_t &val);
+    bool readString(size_t len, std::string &str);
+    bool readAmf3String(std::string &str);
+
+private:
+    bool _amf3;
+    size_t _pos = 0;
+    size_t _size;
+    const uint8_t *_data;
+    //AMF3 的引用表
+    std::vector<std::string> _amf3_strings;
+    std::vector<AmfValue> _amf3_objects;
+    struct Amf3Traits {
+        bool dynamic;
+        std::vector<std::string> members;
+    };
+    std::vector<Amf3Traits> _amf3_traits;
+};
+
+//AMF0 编码，回复命令只用 AMF0
+class AmfEncoder {
+public:
+    AmfEncoder &operator<<(const AmfValue &value);
+
+    const std::string &data() const { return _data; }
+    //取出编码结果并清空
+    std::string take();
+
+private:
+    void writeString(const std::string &str, bool with_marker);
+    void writeProps(const AmfValue::Object &obj);
+    void writeDouble(double num);
+
+private:
+    std::string _data;
+};
+
+}
+#endif  //__AMF_H__
@@ -0,0 +1,90 @@
+#ifndef __RTMP_H__
+#define __RTMP_H__
+
+#include "network/Buffer.h"
+
+namespace beton {
+
+//C1/S1/C2/S2 的长度
+static constexpr size_t RTMP_HANDSHAKE_SIZE = 1536;
+static constexpr uint8_t RTMP_VERSION = 3;
+//协议规定的初始块大小
+static constexpr size_t RTMP_DEFAULT_CHUNK_SIZE = 128;
+//消息长度字段只有24位
+static constexpr size_t RTMP_MAX_MESSAGE_SIZE = 0xffffff;
+
+//消息类型
+typedef enum : uint8_t {
+    RTMP_SET_CHUNK_SIZE = 1,
+    RTMP_ABORT = 2,
+    RTMP_ACK = 3,
+    RTMP_USER_CONTROL = 4,
+    RTMP_WINDOW_ACK_SIZE = 5,
+    RTMP_SET_PEER_BANDWIDTH = 6,
+    RTMP_AUDIO = 8,
+    RTMP_VIDEO = 9,
+    RTMP_DATA_AMF3 = 15,
+    RTMP_SHARED_OBJECT_AMF3 = 16,
+    RTMP_COMMAND_AMF3 = 17,
+    RTMP_DATA_AMF0 = 18,
+    RTMP_SHARED_OBJECT_AMF0 = 19,
+    RTMP_COMMAND_AMF0 = 20,
+    RTMP_AGGREGATE = 22
+}RtmpMessageType;
+
+//用户控制消息的事件类型
+typedef enum : uint16_t {
+    RTMP_STREAM_BEGIN = 0,
+    RTMP_STREAM_EOF = 1,
+    RTMP_STREAM_DRY = 2,
+    RTMP_SET_BUFFER_LENGTH = 3,
+    RTMP_STREAM_IS_RECORDED = 4,
+    RTMP_PING_REQUEST = 6,
+    RTMP_PING_RESPONSE = 7
+}RtmpUserControl;
+
+//发送时使用的块流id
+typedef enum : uint32_t {
+    RTMP_CSID_CONTROL = 2,
+    RTMP_CSID_COMMAND = 3,
+    RTMP_CSID_AUDIO = 4,
+    RTMP_CSID_DATA = 5,
+    RTMP_CSID_VIDEO = 6
+}RtmpChunkStreamId;
+
+//一个完整的 rtmp 消息，负载可能直接引用接收到的 Buffer
+struct RtmpPacket {
+    using Ptr = std::shared_ptr<RtmpPacket>;
+
+    uint8_t type_id = 0;
+    uint32_t csid = 0;
+    uint32_t stream_id = 0;
+    //绝对时间戳(毫秒)，32位回绕
+    uint32_t timestamp = 0;
+    Buffer::Ptr payload;
+
+    size_t size() const { return payload ? payload->size() : 0; }
+    const uint8_t *data() const { return payload ? (const uint8_t *)payload->data() : nullptr; }
+
+    //FLV 视频 tag 头: 高4位帧类型，低4位编码 id; enhanced rtmp 最高位置1, 帧类型占接下来的3位
+    bool isVideoKeyFrame() const {
+        return type_id == RTMP_VIDEO && size() > 0 && ((data()[0] >> 4) & 0x07) == 1;
+    }
+    //AVC/HEVC 的序列头或 AAC 的 AudioSpecificConfig, 播放器必须先收到
+    bool isConfigFrame() const {
+        if (size() < 2) {
+            return false;
+        }
+        if (type_id == RTMP_VIDEO) {
+            //enhanced rtmp 的 PacketTypeSequenceStart
+            if (data()[0] & 0x80) {
+                return (data()[0] & 0x0f) == 0;
+            }
+            return data()[1] == 0 && ((data()[0] & 0x0f) == 7 || (data()[0] & 0x0f) == 12);
+        }
+        return type_id == RTMP_AUDIO && (data()[0] >> 4) == 10 && data()[1] == 0;
+    }
+};
+
+}
+#endif  //__RTMP_H__
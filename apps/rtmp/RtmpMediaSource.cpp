@@ -0,0 +1,59 @@
+#include "RtmpMediaSource.h"
+
+using namespace std;
+
+namespace beton {
+
+RtmpMediaSource::RtmpMediaSource(const string &vhost, const string &app, const string &stream, size_t ring_size)
+    : MediaSource(RTMP_SCHEMA, vhost, app, stream) {
+    _ring = std::make_shared<Ring>(ring_size);
+}
+
+RtmpMediaSource::Ptr RtmpMediaSource::find(const string &vhost, const string &app, const string &stream) {
+    return dynamic_pointer_cast<RtmpMediaSource>(MediaSource::find(RTMP_SCHEMA, vhost, app, stream));
+}
+
+void RtmpMediaSource::onWrite(const RtmpPacket::Ptr &pkt) {
+    bool key = false;
+    switch (pkt->type_id) {
+        case RTMP_VIDEO: {
+            _have_video = true;
+            if (pkt->isConfigFrame()) {
+                lock_guard<mutex> lck(_mutex);
+                _video_config = pkt;
+            }
+            key = pkt->isVideoKeyFrame() && !pkt->isConfigFrame();
+            break;
+        }
+        case RTMP_AUDIO: {
+            if (pkt->isConfigFrame()) {
+                lock_guard<mutex> lck(_mutex);
+                _audio_config = pkt;
+            }
+            //纯音频的流每帧都可以起播
+            key = !_have_video;
+            break;
+        }
+        default: {
+            lock_guard<mutex> lck(_mutex);
+            _metadata = pkt;
+            break;
+        }
+    }
+    //序列头也写入缓冲，已经在播放的播放端据此感知编码参数的变化
+    auto seq = _ring->writeSeq();
+    _ring->write(pkt, key);
+    _gop.append(seq, pkt, pkt->size(), key);
+    notifyReaders();
+}
+
+void RtmpMediaSource::getConfig(vector<RtmpPacket::Ptr> &out) const {
+    lock_guard<mutex> lck(_mutex);
+    for (auto &pkt : {_metadata, _video_config, _audio_config}) {
+        if (pkt) {
+            out.emplace_back(pkt);
+        }
+    }
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef __RTMP_MEDIA_SOURCE_H__
+#define __RTMP_MEDIA_SOURCE_H__
+
+#include "media/MediaSource.h"
+#include "media/GopCache.h"
+#include "Util/RingBuffer.h"
+#include "Rtmp.h"
+#include <mutex>
+
+namespace beton {
+
+#define RTMP_SCHEMA "rtmp"
+
+/**
+ * rtmp 推流产生的流，帧以 RtmpPacket 的形式写入环形缓冲，播放端直接转发，不重新封装
+ * 元数据和音视频序列头另外保存一份，播放端起播时先发送; 最近一个 GOP 放在 GOP 缓存中，新的播放端不用等关键帧
+*/
+class RtmpMediaSource : public MediaSource {
+public:
+    using Ptr = std::shared_ptr<RtmpMediaSource>;
+    using Ring = RingBuffer<RtmpPacket::Ptr>;
+
+    /**
+     * @param ring_size: 环形缓冲的帧数，决定了播放端最多可以落后多少
+    */
+    RtmpMediaSource(const std::string &vhost, const std::string &app, const std::string &stream, size_t ring_size = 1024);
+
+    static Ptr find(const std::string &vhost, const std::string &app, const std::string &stream);
+
+    //写入一个音频、视频或 onMetaData 消息，只能在推流端所在线程调用
+    void onWrite(const RtmpPacket::Ptr &pkt);
+
+    //起播时需要先发送的元数据和序列头，可以在任意线程调用
+    void getConfig(std::vector<RtmpPacket::Ptr> &out) const;
+
+    /**
+     * 起播时取出 GOP 缓存的帧，可以在任意线程调用
+     * @return 之后应从环形缓冲的哪个序号接着读; 没有缓存时返回 UINT64_MAX
+    */
+    uint64_t getGop(std::vector<RtmpPacket::Ptr> &out) { return _gop.get(out); }
+
+    const Ring::Ptr &getRing() const { return _ring; }
+
+private:
+    bool _have_video = false;
+    Ring::Ptr _ring;
+    mutable std::mutex _mutex;
+    RtmpPacket::Ptr _metadata;
+    RtmpPacket::Ptr _video_config;
+    RtmpPacket::Ptr _audio_config;
+    GopCache<RtmpPacket::Ptr> _gop;
+};
+
+}
+#endif  //__RTMP_MEDIA_SOURCE_H__
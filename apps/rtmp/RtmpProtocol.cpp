@@ -0,0 +1,470 @@
+#include "RtmpProtocol.h"
+#include "Util/Logger.h"
+#include <string.h>
+#include <time.h>
+#include <stdexcept>
+
+using namespace std;
+
+namespace beton {
+
+//所有块流上同时拼接中的消息总长度上限，防止对端在大量块流上各开一个大消息耗尽内存
+static constexpr size_t s_max_assembling_bytes = 64 * 1024 * 1024;
+//fmt 0~3 的消息头长度
+static const size_t s_msg_header_size[] = {11, 7, 3, 0};
+
+static inline uint32_t load24(const uint8_t *p) {
+    return (p[0] << 16) | (p[1] << 8) | p[2];
+}
+
+static inline uint32_t load32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void set24(uint8_t *p, uint32_t val) {
+    p[0] = val >> 16;
+    p[1] = val >> 8;
+    p[2] = val;
+}
+
+static inline void set32(uint8_t *p, uint32_t val) {
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+//基本头长度由第一个字节的低6位决定
+static inline size_t basicHeaderSize(uint8_t b0) {
+    return (b0 & 0x3f) == 0 ? 2 : ((b0 & 0x3f) == 1 ? 3 : 1);
+}
+
+static inline uint32_t chunkStreamId(const uint8_t *p) {
+    switch (p[0] & 0x3f) {
+        case 0: return 64 + p[1];
+        case 1: return 64 + p[1] + (p[2] << 8);
+        default: return p[0] & 0x3f;
+    }
+}
+
+static size_t writeBasicHeader(uint8_t *p, uint8_t fmt, uint32_t csid) {
+    if (csid < 64) {
+        p[0] = (fmt << 6) | csid;
+        return 1;
+    }
+    if (csid < 64 + 256) {
+        p[0] = fmt << 6;
+        p[1] = csid - 64;
+        return 2;
+    }
+    p[0] = (fmt << 6) | 1;
+    p[1] = (csid - 64) & 0xff;
+    p[2] = (csid - 64) >> 8;
+    return 3;
+}
+
+RtmpProtocol::RtmpProtocol() {}
+
+void RtmpProtocol::onParseRtmp(const Buffer::Ptr &buf) {
+    auto data = (const uint8_t *)buf->data();
+    size_t size = buf->size();
+    size_t pos = 0;
+    _bytes_recv += size;
+
+    while (pos < size) {
+        switch (_state) {
+            case State_C0C1:
+            case State_C2: {
+                pos += onHandshake((const char *)data + pos, size - pos);
+                break;
+            }
+
+            case State_Header: {
+                //块头可能被拆在两次接收中，凑齐之前暂存
+                size_t need;
+                while ((need = headerNeeded()) > _header_size && pos < size) {
+                    size_t take = std::min(need - _header_size, size - pos);
+                    memcpy(_header + _header_size, data + pos, take);
+                    _header_size += take;
+                    pos += take;
+                }
+                if (need <= _header_size) {
+                    onChunkHeader();
+                }
+                break;
+            }
+
+            case State_Payload: {
+                auto &cs = *_chunk;
+                size_t take = std::min(_chunk_remain, size - pos);
+                if (cs.received == 0 && take == cs.length) {
+                    //整个消息在这一个块里且已全部收到，直接引用接收的 Buffer
+                    _chunk_remain = 0;
+                    _state = State_Header;
+                    auto payload = BufferSlice::create(buf, pos, take);
+                    pos += take;
+                    onMessage(cs, std::move(payload));
+                    break;
+                }
+                if (!cs.body) {
+                    //跨块的消息按总长度申请一次
+                    _assembling_bytes += cs.length;
+                    if (_assembling_bytes > s_max_assembling_bytes) {
+                        throw std::runtime_error("too many rtmp messages assembling: " + to_string(_assembling_bytes) + " bytes");
+                    }
+                    cs.body = BufferRaw::create(cs.length, cs.length);
+                }
+                memcpy(cs.body->data() + cs.received, data + pos, take);
+                cs.received += take;
+                _chunk_remain -= take;
+                pos += take;
+                if (_chunk_remain) {
+                    break;
+                }
+                _state = State_Header;
+                if (cs.received == cs.length) {
+                    _assembling_bytes -= cs.length;
+                    auto body = std::move(cs.body);
+                    onMessage(cs, std::move(body));
+                }
+                break;
+            }
+        }
+    }
+
+    if (_peer_window && _bytes_recv - _last_ack >= _peer_window) {
+        _last_ack = _bytes_recv;
+        sendControl(RTMP_ACK, (uint32_t)_bytes_recv);
+    }
+}
+
+size_t RtmpProtocol::onHandshake(const char *data, size_t size) {
+    size_t need = _state == State_C0C1 ? 1 + RTMP_HANDSHAKE_SIZE : RTMP_HANDSHAKE_SIZE;
+    size_t take;
+    const char *ptr;
+    if (_handshake.empty() && size >= need) {
+        //通常 C0C1 在一次接收中完整到达，不用暂存
+        take = need;
+        ptr = data;
+    } else {
+        take = std::min(need - _handshake.size(), size);
+        _handshake.append(data, take);
+        if (_handshake.size() < need) {
+            return take;
+        }
+        ptr = _handshake.data();
+    }
+
+    if (_state == State_C2) {
+        //C2 只是回显 S1, 不做校验
+        string().swap(_handshake);
+        _state = State_Header;
+        return take;
+    }
+
+    if ((uint8_t)ptr[0] != RTMP_VERSION) {
+        throw std::runtime_error("unsupported rtmp version: " + to_string((uint8_t)ptr[0]));
+    }
+    //S0 + S1 + S2 一次发出
+    auto buf = BufferRaw::create(1 + 2 * RTMP_HANDSHAKE_SIZE, 1 + 2 * RTMP_HANDSHAKE_SIZE);
+    auto out = (uint8_t *)buf->data();
+    out[0] = RTMP_VERSION;
+    //S1: 时间(4) + 零(4, 表示简单握手) + 随机数据
+    auto s1 = out + 1;
+    memset(s1, 0, 8);
+    uint32_t seed = (uint32_t)(uintptr_t)this ^ (uint32_t)time(nullptr);
+    for (size_t i = 8; i < RTMP_HANDSHAKE_SIZE; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        s1[i] = (uint8_t)seed;
+    }
+    //S2: 回显 C1
+    memcpy(s1 + RTMP_HANDSHAKE_SIZE, ptr + 1, RTMP_HANDSHAKE_SIZE);
+    _handshake.clear();
+    _state = State_C2;
+    onSendRawData(std::move(buf));
+    return take;
+}
+
+size_t RtmpProtocol::headerNeeded() const {
+    if (_header_size == 0) {
+        return 1;
+    }
+    uint8_t fmt = _header[0] >> 6;
+    size_t basic = basicHeaderSize(_header[0]);
+    size_t len = basic + s_msg_header_size[fmt];
+    if (_header_size < len) {
+        return len;
+    }
+    bool extended;
+    if (fmt < 3) {
+        auto p = _header + basic;
+        extended = p[0] == 0xff && p[1] == 0xff && p[2] == 0xff;
+    } else {
+        //fmt 3 是否带扩展时间戳取决于该块流上一个块头
+        auto it = _chunk_streams.find(chunkStreamId(_header));
+        extended = it != _chunk_streams.end() && it->second.extended;
+    }
+    return extended ? len + 4 : len;
+}
+
+void RtmpProtocol::onChunkHeader() {
+    uint8_t fmt = _header[0] >> 6;
+    uint32_t csid = chunkStreamId(_header);
+    size_t basic = basicHeaderSize(_header[0]);
+    auto &cs = _chunk_streams[csid];
+    bool new_message = cs.received == 0;
+    if (fmt < 3) {
+        if (!new_message) {
+            throw std::runtime_error("rtmp chunk stream " + to_string(csid) + " got a new message header before previous message completed");
+        }
+        auto p = _header + basic;
+        uint32_t ts = load24(p);
+        cs.extended = ts == 0xffffff;
+        if (cs.extended) {
+            ts = load32(p + s_msg_header_size[fmt]);
+        }
+        if (fmt <= 1) {
+            cs.length = load24(p + 3);
+            cs.type_id = p[6];
+        }
+        if (fmt == 0) {
+            //消息流id 是小端
+            cs.stream_id = p[7] | (p[8] << 8) | (p[9] << 16) | ((uint32_t)p[10] << 24);
+            cs.timestamp = ts;
+        } else {
+            cs.timestamp += ts;
+        }
+        //之后 fmt 3 开始的新消息沿用这个增量(fmt 0 时即绝对时间戳，与 ffmpeg/srs 一致)
+        cs.delta = ts;
+    } else if (new_message) {
+        cs.timestamp += cs.delta;
+    }
+
+    cs.csid = csid;
+    _chunk = &cs;
+    _header_size = 0;
+    if (cs.length == 0) {
+        onMessage(cs, std::make_shared<BufferString>(string()));
+        return;
+    }
+    _chunk_remain = std::min<size_t>(cs.length - cs.received, _in_chunk_size);
+    _state = State_Payload;
+}
+
+void RtmpProtocol::onMessage(ChunkStream &cs, Buffer::Ptr payload) {
+    cs.received = 0;
+    auto pkt = std::make_shared<RtmpPacket>();
+    pkt->type_id = cs.type_id;
+    pkt->csid = cs.csid;
+    pkt->stream_id = cs.stream_id;
+    pkt->timestamp = cs.timestamp;
+    pkt->payload = std::move(payload);
+
+    switch (pkt->type_id) {
+        case RTMP_SET_CHUNK_SIZE:
+        case RTMP_ABORT:
+        case RTMP_ACK:
+        case RTMP_USER_CONTROL:
+        case RTMP_WINDOW_ACK_SIZE:
+        case RTMP_SET_PEER_BANDWIDTH: onControl(pkt); break;
+        case RTMP_AGGREGATE: onAggregate(pkt); break;
+        default: onRtmpMessage(pkt); break;
+    }
+}
+
+void RtmpProtocol::onControl(const RtmpPacket::Ptr &pkt) {
+    auto p = pkt->data();
+    if (pkt->size() < (pkt->type_id == RTMP_USER_CONTROL ? 2u : 4u)) {
+        throw std::runtime_error("invalid rtmp control message, type: " + to_string(pkt->type_id) + ", size: " + to_string(pkt->size()));
+    }
+    switch (pkt->type_id) {
+        case RTMP_SET_CHUNK_SIZE: {
+            //最高位必须为0
+            uint32_t size = load32(p) & 0x7fffffff;
+            if (size == 0) {
+                throw std::runtime_error("invalid rtmp chunk size 0");
+            }
+            _in_chunk_size = size;
+            TraceL << "rtmp peer chunk size: " << size;
+            break;
+        }
+        case RTMP_ABORT: {
+            auto it = _chunk_streams.find(load32(p));
+            if (it != _chunk_streams.end() && it->second.body) {
+                _assembling_bytes -= it->second.length;
+                it->second.body = nullptr;
+                it->second.received = 0;
+            }
+            break;
+        }
+        case RTMP_WINDOW_ACK_SIZE: {
+            _peer_window = load32(p);
+            break;
+        }
+        case RTMP_USER_CONTROL: {
+            uint16_t event = (p[0] << 8) | p[1];
+            if (event == RTMP_PING_REQUEST && pkt->size() >= 6) {
+                sendUserControl(RTMP_PING_RESPONSE, load32(p + 2));
+                break;
+            }
+            //其他事件(如设置缓冲时长)交给上层
+            onRtmpMessage(pkt);
+            break;
+        }
+        default: break;
+    }
+}
+
+void RtmpProtocol::onAggregate(const RtmpPacket::Ptr &pkt) {
+    //每个子消息: 类型(1) + 长度(3) + 时间戳(3+1) + 流id(3) + 数据 + 回指长度(4)
+    auto p = pkt->data();
+    size_t size = pkt->size();
+    size_t pos = 0;
+    bool first = true;
+    uint32_t base = 0;
+    while (pos + 11 <= size) {
+        uint32_t len = load24(p + pos + 1);
+        if (pos + 11 + len > size) {
+            throw std::runtime_error("invalid rtmp aggregate message");
+        }
+        uint32_t ts = load24(p + pos + 4) | ((uint32_t)p[pos + 7] << 24);
+        if (first) {
+            base = ts;
+            first = false;
+        }
+        auto sub = std::make_shared<RtmpPacket>();
+        sub->type_id = p[pos];
+        sub->csid = pkt->csid;
+        sub->stream_id = pkt->stream_id;
+        //子消息时间戳相对第一个子消息，以聚合消息的时间戳为基准
+        sub->timestamp = pkt->timestamp + (ts - base);
+        sub->payload = BufferSlice::create(pkt->payload, pos + 11, len);
+        pos += 11 + len + 4;
+        if (sub->type_id == RTMP_AUDIO || sub->type_id == RTMP_VIDEO || sub->type_id == RTMP_DATA_AMF0) {
+            onRtmpMessage(sub);
+        }
+    }
+}
+
+void RtmpProtocol::sendRtmp(uint8_t type_id, uint32_t stream_id, const Buffer::Ptr &payload, uint32_t timestamp, uint32_t csid) {
+    size_t size = payload ? payload->size() : 0;
+    if (size > RTMP_MAX_MESSAGE_SIZE) {
+        WarnL << "rtmp message too large, dropped: " << size;
+        return;
+    }
+    auto &out = _out_streams[csid];
+    //同一消息流上时间戳不回退时使用 fmt 1, 只写增量
+    bool delta = out.valid && out.stream_id == stream_id && (int32_t)(timestamp - out.timestamp) >= 0;
+    uint32_t ts = delta ? timestamp - out.timestamp : timestamp;
+    out.valid = true;
+    out.stream_id = stream_id;
+    out.timestamp = timestamp;
+
+    bool extended = ts >= 0xffffff;
+    size_t chunks = size ? (size + _out_chunk_size - 1) / _out_chunk_size : 1;
+    size_t basic = csid < 64 ? 1 : (csid < 64 + 256 ? 2 : 3);
+    size_t first_size = basic + (delta ? 7 : 11) + (extended ? 4 : 0);
+    size_t next_size = basic + (extended ? 4 : 0);
+    size_t total = first_size + next_size * (chunks - 1);
+
+    //所有块头写在同一块内存里
+    auto headers = BufferRaw::create(total, total);
+    auto p = (uint8_t *)headers->data();
+    p += writeBasicHeader(p, delta ? 1 : 0, csid);
+    set24(p, extended ? 0xffffff : ts);
+    set24(p + 3, size);
+    p[6] = type_id;
+    p += 7;
+    if (!delta) {
+        p[0] = stream_id;
+        p[1] = stream_id >> 8;
+        p[2] = stream_id >> 16;
+        p[3] = stream_id >> 24;
+        p += 4;
+    }
+    if (extended) {
+        set32(p, ts);
+        p += 4;
+    }
+    for (size_t i = 1; i < chunks; ++i) {
+        p += writeBasicHeader(p, 3, csid);
+        if (extended) {
+            set32(p, ts);
+            p += 4;
+        }
+    }
+
+    if (chunks == 1) {
+        onSendRawData(std::move(headers));
+        if (size) {
+            onSendRawData(payload);
+        }
+        return;
+    }
+    //块头切片与负载切片交替排列，负载不拷贝
+    size_t header_pos = 0;
+    size_t pos = 0;
+    for (size_t i = 0; i < chunks; ++i) {
+        size_t header_size = i ? next_size : first_size;
+        onSendRawData(BufferSlice::create(headers, header_pos, header_size));
+        header_pos += header_size;
+        size_t len = std::min(_out_chunk_size, size - pos);
+        onSendRawData(BufferSlice::create(payload, pos, len));
+        pos += len;
+    }
+}
+
+void RtmpProtocol::sendRtmp(const RtmpPacket &pkt, uint32_t stream_id) {
+    uint32_t csid;
+    switch (pkt.type_id) {
+        case RTMP_AUDIO: csid = RTMP_CSID_AUDIO; break;
+        case RTMP_VIDEO: csid = RTMP_CSID_VIDEO; break;
+        case RTMP_DATA_AMF0:
+        case RTMP_DATA_AMF3: csid = RTMP_CSID_DATA; break;
+        default: csid = RTMP_CSID_COMMAND; break;
+    }
+    sendRtmp(pkt.type_id, stream_id, pkt.payload, pkt.timestamp, csid);
+}
+
+void RtmpProtocol::sendAmf(uint8_t type_id, uint32_t stream_id, AmfEncoder &enc, uint32_t csid) {
+    sendRtmp(type_id, stream_id, std::make_shared<BufferString>(enc.take()), 0, csid);
+}
+
+void RtmpProtocol::sendControl(uint8_t type_id, uint32_t value, int extra) {
+    auto buf = BufferRaw::create(5, extra < 0 ? 4 : 5);
+    auto p = (uint8_t *)buf->data();
+    set32(p, value);
+    if (extra >= 0) {
+        p[4] = extra;
+    }
+    sendRtmp(type_id, 0, buf, 0, RTMP_CSID_CONTROL);
+}
+
+void RtmpProtocol::setChunkSize(size_t size) {
+    size = std::max<size_t>(1, std::min<size_t>(size, 0x7fffffff));
+    //通知消息本身只有4字节，用旧的块大小发出
+    sendControl(RTMP_SET_CHUNK_SIZE, size);
+    _out_chunk_size = size;
+}
+
+void RtmpProtocol::sendWindowAckSize(uint32_t size) {
+    sendControl(RTMP_WINDOW_ACK_SIZE, size);
+}
+
+void RtmpProtocol::sendPeerBandwidth(uint32_t size) {
+    //limit type 2: dynamic
+    sendControl(RTMP_SET_PEER_BANDWIDTH, size, 2);
+}
+
+void RtmpProtocol::sendUserControl(uint16_t event, uint32_t value) {
+    auto buf = BufferRaw::create(6, 6);
+    auto p = (uint8_t *)buf->data();
+    p[0] = event >> 8;
+    p[1] = event;
+    set32(p + 2, value);
+    sendRtmp(RTMP_USER_CONTROL, 0, buf, 0, RTMP_CSID_CONTROL);
+}
+
+}
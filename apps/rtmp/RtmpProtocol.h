@@ -0,0 +1,119 @@
+#ifndef __RTMP_PROTOCOL_H__
+#define __RTMP_PROTOCOL_H__
+
+#include "Rtmp.h"
+#include "Amf.h"
+#include <unordered_map>
+
+namespace beton {
+
+/**
+ * rtmp 协议层(服务端), 与 socket 无关, 输入收到的数据，输出完整的消息和待发送的 Buffer:
+ * 1. 握手使用简单握手(S1 版本字段为0), ffmpeg/OBS 等编码器以及 flash 之后的播放器都接受
+ * 2. 解析块流时，整个消息落在一个块里(协商了大块的推流端几乎总是如此)的直接切片引用接收到的 Buffer;
+ *    跨多个块的消息在第一个块到达时按消息长度从内存池申请一次，各块的数据依次写入，不再按块申请或拼接
+ * 3. 接收数据中不完整的块头(最多18字节)暂存在本对象中，其余数据不保留
+ * 4. 发送时同一消息所有块的块头写在一块内存里，与负载的切片交替排列，交给 socket 用 sendmsg 一次写出,
+ *    同一份负载(比如一帧视频)发给多个播放器时只是多了各自的块头
+ * 5. 设置块大小、窗口确认、ping 等控制消息在本层处理，其余消息交给 onRtmpMessage
+*/
+class RtmpProtocol {
+public:
+    RtmpProtocol();
+    virtual ~RtmpProtocol() = default;
+
+    //输入收到的数据，协议错误时抛出 std::runtime_error
+    void onParseRtmp(const Buffer::Ptr &buf);
+
+    /**
+     * 发送一个消息，负载按当前块大小切分，各块引用同一个 payload
+     * @param csid: 块流id, 音频、视频、命令各用一个，避免互相影响头部压缩
+    */
+    void sendRtmp(uint8_t type_id, uint32_t stream_id, const Buffer::Ptr &payload, uint32_t timestamp, uint32_t csid);
+    //按消息类型选择块流id
+    void sendRtmp(const RtmpPacket &pkt, uint32_t stream_id);
+    //发送 AMF0 编码的命令或数据消息
+    void sendAmf(uint8_t type_id, uint32_t stream_id, AmfEncoder &enc, uint32_t csid = RTMP_CSID_COMMAND);
+
+    //修改发送的块大小并通知对端，块越大块头越少
+    void setChunkSize(size_t size);
+    void sendWindowAckSize(uint32_t size);
+    void sendPeerBandwidth(uint32_t size);
+    void sendUserControl(uint16_t event, uint32_t value);
+
+    size_t inChunkSize() const { return _in_chunk_size; }
+    size_t outChunkSize() const { return _out_chunk_size; }
+    uint64_t bytesReceived() const { return _bytes_recv; }
+    bool handshakeDone() const { return _state == State_Header || _state == State_Payload; }
+
+protected:
+    virtual void onSendRawData(Buffer::Ptr buf) = 0;
+    //收到控制消息以外的完整消息(命令、数据、音视频)
+    virtual void onRtmpMessage(const RtmpPacket::Ptr &pkt) = 0;
+
+private:
+    typedef enum : uint8_t {
+        State_C0C1 = 0,
+        State_C2,
+        State_Header,
+        State_Payload
+    }State;
+
+    //接收方向每个块流的状态
+    struct ChunkStream {
+        uint32_t csid = 0;
+        uint32_t timestamp = 0;
+        uint32_t delta = 0;
+        uint32_t length = 0;
+        uint32_t stream_id = 0;
+        uint8_t type_id = 0;
+        //上一个 fmt 0~2 的块头带了扩展时间戳，之后的 fmt 3 块也带
+        bool extended = false;
+        //当前消息已收到的字节数
+        uint32_t received = 0;
+        //跨块的消息在这里拼接
+        BufferRaw::Ptr body;
+    };
+
+    //发送方向每个块流的状态，用于选择块头格式
+    struct OutStream {
+        bool valid = false;
+        uint32_t stream_id = 0;
+        uint32_t timestamp = 0;
+    };
+
+    size_t onHandshake(const char *data, size_t size);
+    //当前块头还需要的总字节数
+    size_t headerNeeded() const;
+    void onChunkHeader();
+    void onMessage(ChunkStream &cs, Buffer::Ptr payload);
+    void onControl(const RtmpPacket::Ptr &pkt);
+    void onAggregate(const RtmpPacket::Ptr &pkt);
+    void sendControl(uint8_t type_id, uint32_t value, int extra = -1);
+
+private:
+    State _state = State_C0C1;
+    //握手阶段凑齐 C0C1/C2, 完成后释放
+    std::string _handshake;
+
+    size_t _in_chunk_size = RTMP_DEFAULT_CHUNK_SIZE;
+    size_t _out_chunk_size = RTMP_DEFAULT_CHUNK_SIZE;
+    //正在解析的块头
+    uint8_t _header[18];
+    size_t _header_size = 0;
+    //当前块还未收到的负载长度
+    size_t _chunk_remain = 0;
+    ChunkStream *_chunk = nullptr;
+    std::unordered_map<uint32_t, ChunkStream> _chunk_streams;
+    //所有块流上正在拼接的消息的总长度
+    size_t _assembling_bytes = 0;
+    std::unordered_map<uint32_t, OutStream> _out_streams;
+
+    uint64_t _bytes_recv = 0;
+    uint64_t _last_ack = 0;
+    //对端要求的确认窗口，0 表示不需要确认
+    uint32_t _peer_window = 0;
+};
+
+}
+#endif  //__RTMP_PROTOCOL_H__
@@ -1,13 +1,290 @@
 #include "RtmpSession.h"
+#include "Util/Logger.h"
 
 using namespace std;
 
 namespace beton {
 
-RtmpSession::RtmpSession() {
+//connect 之后使用的发送块大小，一帧视频大多只需要一个块
+static constexpr size_t s_out_chunk_size = 60000;
+//要求对端确认的窗口大小
+static constexpr uint32_t s_window_ack_size = 5000000;
 
+RtmpSession::RtmpSession(const Socket::Ptr &sock) : Session(sock) {
+    DebugL << "new rtmp session from " << get_peer_ip() << ":" << get_peer_port();
 }
 
+RtmpSession::~RtmpSession() {
+    stopStream();
+    DebugL << "rtmp session destroyed, " << _app << "/" << _stream_name;
+}
+
+void RtmpSession::onRecv(const Buffer::Ptr &buf) {
+    try {
+        onParseRtmp(buf);
+    } catch (std::exception &ex) {
+        WarnL << "rtmp session " << get_peer_ip() << " error: " << ex.what();
+        shutdown(SockException(EPROTO, ex.what(), Err_Other));
+    }
+}
+
+void RtmpSession::onError(const SockException &ex) {
+    DebugL << "rtmp session " << _app << "/" << _stream_name << " closed: " << ex;
+    stopStream();
+}
+
+void RtmpSession::onFlowControl(bool blocked) {
+    _send_blocked = blocked;
+    if (!blocked) {
+        onPlayReadable();
+    }
+}
+
+void RtmpSession::onSendRawData(Buffer::Ptr buf) {
+    send(std::move(buf));
+}
+
+void RtmpSession::onRtmpMessage(const RtmpPacket::Ptr &pkt) {
+    switch (pkt->type_id) {
+        case RTMP_COMMAND_AMF0:
+        case RTMP_COMMAND_AMF3: onCommand(pkt); break;
+        case RTMP_DATA_AMF0:
+        case RTMP_DATA_AMF3: onData(pkt); break;
+        case RTMP_AUDIO:
+        case RTMP_VIDEO: {
+            if (_publish_src) {
+                _publish_src->onWrite(pkt);
+                _rtsp_muxer->onRtmp(pkt);
+            }
+            break;
+        }
+        default: break;
+    }
+}
+
+const unordered_map<string, RtmpSession::CommandHandler> &RtmpSession::commandHandlers() {
+    static const unordered_map<string, CommandHandler> s_handlers = {
+        {"connect", &RtmpSession::onCmdConnect},
+        {"createStream", &RtmpSession::onCmdCreateStream},
+        {"publish", &RtmpSession::onCmdPublish},
+        {"play", &RtmpSession::onCmdPlay},
+        {"deleteStream", &RtmpSession::onCmdDeleteStream},
+        {"closeStream", &RtmpSession::onCmdDeleteStream},
+        {"releaseStream", &RtmpSession::onCmdAck},
+        {"FCPublish", &RtmpSession::onCmdAck},
+        {"FCUnpublish", &RtmpSession::onCmdAck},
+        {"getStreamLength", &RtmpSession::onCmdAck},
+        {"FCSubscribe", &RtmpSession::onCmdIgnore},
+        {"receiveAudio", &RtmpSession::onCmdIgnore},
+        {"receiveVideo", &RtmpSession::onCmdIgnore},
+        {"_checkbw", &RtmpSession::onCmdIgnore}
+    };
+    return s_handlers;
+}
+
+void RtmpSession::onCommand(const RtmpPacket::Ptr &pkt) {
+    auto data = (const char *)pkt->data();
+    size_t size = pkt->size();
+    //AMF3 命令消息以一个字节的0开头，之后仍是 AMF0 编码(可能含 avmplus 标记)
+    if (pkt->type_id == RTMP_COMMAND_AMF3 && size && data[0] == 0) {
+        ++data;
+        --size;
+    }
+    AmfDecoder dec(data, size);
+    auto cmd = dec.load().asString();
+    auto transaction_id = dec.load().asNumber();
+    auto &handlers = commandHandlers();
+    auto it = handlers.find(cmd);
+    if (it == handlers.end()) {
+        TraceL << "unhandled rtmp command: " << cmd;
+        return;
+    }
+    (this->*(it->second))(transaction_id, dec);
+}
+
+void RtmpSession::onData(const RtmpPacket::Ptr &pkt) {
+    auto data = (const char *)pkt->data();
+    size_t size = pkt->size();
+    if (pkt->type_id == RTMP_DATA_AMF3 && size && data[0] == 0) {
+        ++data;
+        --size;
+    }
+    AmfDecoder dec(data, size);
+    auto type = dec.load().asString();
+    if (type == "@setDataFrame") {
+        type = dec.load().asString();
+    }
+    if (type != "onMetaData" || !_publish_src) {
+        return;
+    }
+    _metadata = dec.load();
+    //去掉 @setDataFrame, 播放端直接收到 onMetaData
+    AmfEncoder enc;
+    enc << "onMetaData" << _metadata;
+    auto meta = std::make_shared<RtmpPacket>(*pkt);
+    meta->type_id = RTMP_DATA_AMF0;
+    meta->payload = std::make_shared<BufferString>(enc.take());
+    _publish_src->onWrite(meta);
+}
+
+void RtmpSession::sendResult(double transaction_id, const AmfValue &info) {
+    AmfEncoder enc;
+    enc << "_result" << transaction_id << AmfValue(AMF_NULL) << info;
+    sendAmf(RTMP_COMMAND_AMF0, 0, enc);
+}
+
+void RtmpSession::sendStatus(const string &level, const string &code, const string &description) {
+    AmfValue info(AMF_OBJECT);
+    info.set("level", level).set("code", code).set("description", description);
+    AmfEncoder enc;
+    enc << "onStatus" << 0 << AmfValue(AMF_NULL) << info;
+    sendAmf(RTMP_COMMAND_AMF0, _stream_id, enc);
+}
 
+void RtmpSession::onCmdConnect(double transaction_id, AmfDecoder &dec) {
+    auto obj = dec.load();
+    _app = obj["app"].asString();
+    _tc_url = obj["tcUrl"].asString();
+    _object_encoding = obj["objectEncoding"].asNumber();
+    InfoL << "rtmp connect " << _tc_url << " from " << get_peer_ip();
 
-}
\ No newline at end of file
+    sendWindowAckSize(s_window_ack_size);
+    sendPeerBandwidth(s_window_ack_size);
+    setChunkSize(s_out_chunk_size);
+
+    AmfValue props(AMF_OBJECT);
+    props.set("fmsVer", "FMS/3,0,1,123").set("capabilities", 31);
+    AmfValue info(AMF_OBJECT);
+    info.set("level", "status")
+        .set("code", "NetConnection.Connect.Success")
+        .set("description", "Connection succeeded.")
+        .set("objectEncoding", _object_encoding);
+    AmfEncoder enc;
+    enc << "_result" << transaction_id << props << info;
+    sendAmf(RTMP_COMMAND_AMF0, 0, enc);
+}
+
+void RtmpSession::onCmdCreateStream(double transaction_id, AmfDecoder &dec) {
+    sendResult(transaction_id, (double)_stream_id);
+}
+
+//流名后面可能带鉴权参数
+static string streamNameOf(const string &name) {
+    auto pos = name.find('?');
+    return pos == string::npos ? name : name.substr(0, pos);
+}
+
+void RtmpSession::onCmdPublish(double transaction_id, AmfDecoder &dec) {
+    dec.load();
+    auto name = streamNameOf(dec.load().asString());
+    if (_publish_src || _play_src || name.empty()) {
+        sendStatus("error", "NetStream.Publish.BadName", "Invalid stream name or stream already started.");
+        return;
+    }
+    if (!onPublish(_app, name)) {
+        sendStatus("error", "NetStream.Publish.BadName", "Publish rejected: " + name);
+        return;
+    }
+    auto src = std::make_shared<RtmpMediaSource>(DEFAULT_VHOST, _app, name);
+    if (!src->regist()) {
+        sendStatus("error", "NetStream.Publish.BadName", "Stream already publishing: " + name);
+        return;
+    }
+    _stream_name = name;
+    _publish_src = std::move(src);
+    _rtsp_muxer = std::make_shared<RtspMuxer>(DEFAULT_VHOST, _app, name);
+    InfoL << "rtmp publish " << _app << "/" << _stream_name;
+    sendStatus("status", "NetStream.Publish.Start", "Started publishing stream.");
+}
+
+void RtmpSession::onCmdPlay(double transaction_id, AmfDecoder &dec) {
+    dec.load();
+    auto name = streamNameOf(dec.load().asString());
+    auto src = (_publish_src || _play_src || name.empty()) ? nullptr : RtmpMediaSource::find(DEFAULT_VHOST, _app, name);
+    if (!src || !onPlay(_app, name)) {
+        sendStatus("error", "NetStream.Play.StreamNotFound", "No such stream: " + name);
+        return;
+    }
+    _stream_name = name;
+    _play_src = src;
+    InfoL << "rtmp play " << _app << "/" << _stream_name;
+    sendUserControl(RTMP_STREAM_BEGIN, _stream_id);
+    sendStatus("status", "NetStream.Play.Reset", "Playing and resetting stream.");
+    sendStatus("status", "NetStream.Play.Start", "Started playing stream.");
+
+    vector<RtmpPacket::Ptr> frames;
+    src->getConfig(frames);
+    //播放时才需要按发送队列水位暂停读取
+    enableFlowControl();
+    //GOP 缓存命中时立即发出关键帧及之后的帧，然后从缓存之后的序号接着读环形缓冲; 否则等下一个关键帧
+    _play_reader.reset(new RtmpMediaSource::Ring::Reader(src->getRing()));
+    auto next = src->getGop(frames);
+    if (next != UINT64_MAX) {
+        _play_reader->seek(next);
+    }
+    for (auto &pkt : frames) {
+        sendRtmp(*pkt, _stream_id);
+    }
+    weak_ptr<RtmpSession> weak_self = static_pointer_cast<RtmpSession>(shared_from_this());
+    _listener_id = src->addListener(getPoller(), [weak_self]() {
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            strong_self->onPlayReadable();
+        }
+    });
+}
+
+void RtmpSession::onPlayReadable() {
+    if (!_play_reader || _send_blocked) {
+        return;
+    }
+    //先取关闭标记，关闭前写入的帧在下面都能读到
+    bool closed = _play_src->closed();
+    auto &ring = _play_reader->ring();
+    RtmpPacket::Ptr pkt;
+    while (true) {
+        int ret = _play_reader->lag() > ring->capacity() / 2 ? -1 : _play_reader->read(pkt);
+        if (ret == 0) {
+            break;
+        }
+        if (ret < 0) {
+            //发送跟不上或者被追上，丢掉积压的帧
+            auto skipped = _play_reader->skipToKeyFrame();
+            WarnL_EVERY_MS(5000) << "rtmp player " << get_peer_ip() << " of " << _play_src->url() << " is too slow, skipped "
+                                 << skipped << " frames";
+            continue;
+        }
+        sendRtmp(*pkt, _stream_id);
+    }
+    if (closed) {
+        InfoL << "rtmp play " << _play_src->url() << " ended, publisher left";
+        sendUserControl(RTMP_STREAM_EOF, _stream_id);
+        sendStatus("status", "NetStream.Play.UnpublishNotify", "Stream is now unpublished.");
+        stopStream();
+    }
+}
+
+void RtmpSession::stopStream() {
+    if (_publish_src) {
+        InfoL << "rtmp publish stopped " << _publish_src->url();
+        _publish_src->close();
+        _publish_src = nullptr;
+        _rtsp_muxer = nullptr;
+    }
+    if (_play_src) {
+        _play_src->removeListener(getPoller(), _listener_id);
+        _play_src = nullptr;
+        _play_reader = nullptr;
+        _listener_id = 0;
+    }
+}
+
+void RtmpSession::onCmdDeleteStream(double transaction_id, AmfDecoder &dec) {
+    stopStream();
+}
+
+void RtmpSession::onCmdAck(double transaction_id, AmfDecoder &dec) {
+    sendResult(transaction_id);
+}
+
+}
@@ -2,14 +2,83 @@
 #define __RTMP_SESSION_H__
 
 #include "network/Session.h"
+#include "RtmpProtocol.h"
+#include "RtmpMediaSource.h"
+#include "rtsp/RtspMuxer.h"
+#include <unordered_map>
 
 namespace beton {
 
-class RtmpSession : public Session {
+/**
+ * rtmp 服务端会话，处理 connect/createStream/publish/play 等命令
+ * 推流时创建并登记 RtmpMediaSource, 收到的音视频写入其环形缓冲;
+ * 播放时在本会话的 poller 上读取环形缓冲并转发，积压过多时丢到最近的关键帧
+*/
+class RtmpSession : public Session, public RtmpProtocol {
 public:
-    RtmpSession();
+    using Ptr = std::shared_ptr<RtmpSession>;
 
+    RtmpSession(const Socket::Ptr &sock);
+    ~RtmpSession() override;
+
+    void onRecv(const Buffer::Ptr &buf) override;
+    void onError(const SockException &ex) override;
+    void onFlowControl(bool blocked) override;
+
+    const std::string &app() const { return _app; }
+    const std::string &streamName() const { return _stream_name; }
+    //推流端 @setDataFrame 携带的 onMetaData
+    const AmfValue &metadata() const { return _metadata; }
+
+protected:
+    void onSendRawData(Buffer::Ptr buf) override;
+    void onRtmpMessage(const RtmpPacket::Ptr &pkt) override;
+
+    //推流/播放鉴权，返回 false 时回复失败状态
+    virtual bool onPublish(const std::string &app, const std::string &stream) { return true; }
+    virtual bool onPlay(const std::string &app, const std::string &stream) { return true; }
+
+    //回复 onStatus
+    void sendStatus(const std::string &level, const std::string &code, const std::string &description);
+
+private:
+    using CommandHandler = void (RtmpSession::*)(double transaction_id, AmfDecoder &dec);
+    static const std::unordered_map<std::string, CommandHandler> &commandHandlers();
+
+    void onCommand(const RtmpPacket::Ptr &pkt);
+    void onData(const RtmpPacket::Ptr &pkt);
+    void sendResult(double transaction_id, const AmfValue &info = AmfValue(AMF_NULL));
+    //把环形缓冲中积压的帧发给播放端
+    void onPlayReadable();
+    //停止推流或播放(deleteStream 或断开)
+    void stopStream();
+
+    void onCmdConnect(double transaction_id, AmfDecoder &dec);
+    void onCmdCreateStream(double transaction_id, AmfDecoder &dec);
+    void onCmdPublish(double transaction_id, AmfDecoder &dec);
+    void onCmdPlay(double transaction_id, AmfDecoder &dec);
+    void onCmdDeleteStream(double transaction_id, AmfDecoder &dec);
+    //releaseStream/FCPublish 等只需要回复 _result 的命令
+    void onCmdAck(double transaction_id, AmfDecoder &dec);
+    void onCmdIgnore(double transaction_id, AmfDecoder &dec) {}
+
+private:
+    //发送队列超过高水位，暂停读取环形缓冲
+    bool _send_blocked = false;
+    //createStream 分配的消息流id, 一个连接只支持一路流
+    uint32_t _stream_id = 1;
+    double _object_encoding = 0;
+    std::string _app;
+    std::string _tc_url;
+    std::string _stream_name;
+    AmfValue _metadata;
+    RtmpMediaSource::Ptr _publish_src;
+    //推流同时转为同名的 rtsp 流
+    RtspMuxer::Ptr _rtsp_muxer;
+    RtmpMediaSource::Ptr _play_src;
+    std::unique_ptr<RtmpMediaSource::Ring::Reader> _play_reader;
+    uint64_t _listener_id = 0;
 };
 
 }
-#endif  //__RTMP_SESSION_H__
\ No newline at end of file
+#endif  //__RTMP_SESSION_H__
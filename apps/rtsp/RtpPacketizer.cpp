@@ -0,0 +1,107 @@
+#include "RtpPacketizer.h"
+#include "media/H264.h"
+#include "media/H265.h"
+
+using namespace std;
+
+namespace beton {
+
+//一块头部内存的大小，可以容纳约40个 rtp 头
+static constexpr size_t s_header_block = 512;
+
+RtpPacketizer::RtpPacketizer(uint8_t track, const SdpTrack &info, size_t max_payload) {
+    if (info.codec == "H264") {
+        _codec = Codec_H264;
+    } else if (info.codec == "H265") {
+        _codec = Codec_H265;
+    } else if (info.codec == "MPEG4-GENERIC") {
+        _codec = Codec_AAC;
+    } else {
+        _codec = Codec_Invalid;
+    }
+    _track = track;
+    _pt = info.pt;
+    _clock_rate = info.clock_rate;
+    _max_payload = max_payload;
+    _seq = rtspRandom();
+    _ssrc = rtspRandom();
+}
+
+bool RtpPacketizer::supported(const string &codec) {
+    return codec == "H264" || codec == "H265" || codec == "MPEG4-GENERIC";
+}
+
+RtpFrame::Ptr RtpPacketizer::packetize(const vector<Buffer::Ptr> &frame, uint64_t pts, bool key) {
+    if (frame.empty() || _codec == Codec_Invalid) {
+        return nullptr;
+    }
+    auto ret = std::make_shared<RtpFrame>();
+    ret->track = _track;
+    ret->key = key;
+    //32位回绕
+    uint32_t stamp = (uint32_t)(pts * _clock_rate / 1000);
+    auto on_payload = [&](const vector<Buffer::Ptr> &pieces, size_t size, bool marker) {
+        onPayload(*ret, pieces, size, marker, stamp);
+    };
+    switch (_codec) {
+        case Codec_H264: h264PacketizeRtp(frame, _max_payload, on_payload); break;
+        case Codec_H265: h265PacketizeRtp(frame, _max_payload, on_payload); break;
+        default: {
+            for (auto &au : frame) {
+                packetizeAac(*ret, au, stamp);
+            }
+            break;
+        }
+    }
+    return ret->packets.empty() ? nullptr : ret;
+}
+
+Buffer::Ptr RtpPacketizer::allocHeader(size_t size, uint8_t *&ptr) {
+    if (!_headers || _headers_used + size > _headers->size()) {
+        //旧的内存块由引用它的包持有，全部释放后回到内存池
+        _headers = BufferRaw::create(s_header_block, s_header_block);
+        _headers_used = 0;
+    }
+    ptr = (uint8_t *)_headers->data() + _headers_used;
+    auto ret = BufferSlice::create(_headers, _headers_used, size);
+    _headers_used += size;
+    return ret;
+}
+
+void RtpPacketizer::onPayload(RtpFrame &frame, const vector<Buffer::Ptr> &pieces, size_t size, bool marker, uint32_t stamp) {
+    auto pkt = std::make_shared<RtpPacket>();
+    uint8_t *ptr;
+    pkt->header = allocHeader(RTP_HEADER_SIZE, ptr);
+    writeRtpHeader(ptr, marker, _pt, _seq++, stamp, _ssrc);
+    pkt->track = _track;
+    pkt->payload = pieces;
+    pkt->payload_size = size;
+    frame.bytes += pkt->size();
+    frame.packets.emplace_back(std::move(pkt));
+}
+
+//AAC-hbr: 2字节 AU-headers-length(16位) + 一个 AU-header(13位长度 + 3位序号);
+//超过负载上限的帧分片发送，每片都带完整长度的 AU-header, 最后一片置 marker
+void RtpPacketizer::packetizeAac(RtpFrame &frame, const Buffer::Ptr &au, uint32_t stamp) {
+    size_t size = au->size();
+    if (!size || size > 0x1fff || _max_payload <= 4) {
+        return;
+    }
+    vector<Buffer::Ptr> pieces;
+    for (size_t offset = 0; offset < size;) {
+        size_t len = std::min(_max_payload - 4, size - offset);
+        uint8_t *p;
+        auto au_header = allocHeader(4, p);
+        p[0] = 0;
+        p[1] = 16;
+        p[2] = size >> 5;
+        p[3] = (size & 0x1f) << 3;
+        pieces.clear();
+        pieces.emplace_back(std::move(au_header));
+        pieces.emplace_back(len == size ? au : BufferSlice::create(au, offset, len));
+        onPayload(frame, pieces, 4 + len, offset + len == size, stamp);
+        offset += len;
+    }
+}
+
+}
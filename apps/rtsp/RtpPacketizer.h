@@ -0,0 +1,66 @@
+#ifndef __RTP_PACKETIZER_H__
+#define __RTP_PACKETIZER_H__
+
+#include "Rtsp.h"
+
+namespace beton {
+
+/**
+ * 把一路媒体的帧打包为 rtp, 支持 H264(FU-A/STAP-A), H265(FU/AP), AAC(RFC 3640 AAC-hbr):
+ * 1. rtp 头从内存池中按块申请，一块可以容纳几十个包的头，用完再申请下一块，每个包只是其中的一个切片
+ * 2. 负载直接引用帧数据的切片，FU/STAP/AU 等负载头同样写在内存池的内存里，不拷贝帧数据
+ * 3. 同一帧的包放在一个 RtpFrame 中，写入 RtspMediaSource 后由所有播放端共用
+*/
+class RtpPacketizer {
+public:
+    using Ptr = std::shared_ptr<RtpPacketizer>;
+
+    /**
+     * @param track: sdp 中的序号
+     * @param info: 编码名、负载类型和时钟频率
+     * @param max_payload: 单个 rtp 包的负载上限
+    */
+    RtpPacketizer(uint8_t track, const SdpTrack &info, size_t max_payload = RTP_MAX_PAYLOAD);
+
+    //是否支持该编码
+    static bool supported(const std::string &codec);
+
+    /**
+     * 打包一帧
+     * @param frame: 视频为一帧的 NAL 切片(不含起始码/长度前缀), AAC 为一帧不带 ADTS 头的数据
+     * @param pts: 显示时间戳，毫秒
+     * @param key: 是否为关键帧
+     * @return 不支持的编码或空帧返回 nullptr
+    */
+    RtpFrame::Ptr packetize(const std::vector<Buffer::Ptr> &frame, uint64_t pts, bool key);
+
+    uint32_t ssrc() const { return _ssrc; }
+
+private:
+    void onPayload(RtpFrame &frame, const std::vector<Buffer::Ptr> &pieces, size_t size, bool marker, uint32_t stamp);
+    void packetizeAac(RtpFrame &frame, const Buffer::Ptr &au, uint32_t stamp);
+    //从当前的头部内存块切出 size 字节
+    Buffer::Ptr allocHeader(size_t size, uint8_t *&ptr);
+
+private:
+    typedef enum : uint8_t {
+        Codec_H264 = 0,
+        Codec_H265,
+        Codec_AAC,
+        Codec_Invalid
+    }Codec;
+
+    Codec _codec;
+    uint8_t _track;
+    uint8_t _pt;
+    uint16_t _seq;
+    uint32_t _ssrc;
+    uint32_t _clock_rate;
+    size_t _max_payload;
+    //当前的头部内存块及已使用的字节数
+    BufferRaw::Ptr _headers;
+    size_t _headers_used = 0;
+};
+
+}
+#endif  //__RTP_PACKETIZER_H__
@@ -0,0 +1,272 @@
+#include "Rtsp.h"
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+#include <random>
+
+using namespace std;
+
+namespace beton {
+
+//请求头的长度上限，超过视为协议错误
+static constexpr size_t s_max_request_size = 64 * 1024;
+
+uint32_t rtspRandom() {
+    static thread_local std::mt19937 s_random(std::random_device{}());
+    return s_random();
+}
+
+void writeRtpHeader(uint8_t *p, bool marker, uint8_t pt, uint16_t seq, uint32_t stamp, uint32_t ssrc) {
+    p[0] = 0x80;
+    p[1] = (marker ? 0x80 : 0) | (pt & 0x7f);
+    p[2] = seq >> 8;
+    p[3] = seq;
+    p[4] = stamp >> 24;
+    p[5] = stamp >> 16;
+    p[6] = stamp >> 8;
+    p[7] = stamp;
+    p[8] = ssrc >> 24;
+    p[9] = ssrc >> 16;
+    p[10] = ssrc >> 8;
+    p[11] = ssrc;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool parseSdp(const string &sdp, vector<SdpTrack> &tracks) {
+    vector<SdpTrack> all;
+    for (auto &item : split(sdp, "\n")) {
+        auto line = trim(std::move(item));
+        if (start_with(line, "m=")) {
+            //m=video 0 RTP/AVP 96
+            auto fields = split(line.substr(2), " ");
+            all.emplace_back();
+            auto &track = all.back();
+            if (fields.size() >= 4) {
+                track.type = fields[0] == "video" ? TRACK_VIDEO : (fields[0] == "audio" ? TRACK_AUDIO : TRACK_INVALID);
+                track.pt = atoi(fields[3].data());
+            }
+            //静态负载类型可以不写 rtpmap
+            if (track.pt == 0 || track.pt == 8) {
+                track.codec = track.pt ? "PCMA" : "PCMU";
+                track.clock_rate = 8000;
+                track.channels = 1;
+            }
+            continue;
+        }
+        //会话级属性不关心
+        if (all.empty() || !start_with(line, "a=")) {
+            continue;
+        }
+        auto &track = all.back();
+        if (start_with(line, "a=rtpmap:")) {
+            //a=rtpmap:96 H264/90000, 音频可能带声道数
+            auto pos = line.find(' ');
+            if (pos == string::npos) {
+                continue;
+            }
+            auto fields = split(line.substr(pos + 1), "/");
+            track.codec = fields[0];
+            std::transform(track.codec.begin(), track.codec.end(), track.codec.begin(), ::toupper);
+            track.clock_rate = fields.size() > 1 ? atoi(fields[1].data()) : 0;
+            track.channels = fields.size() > 2 ? atoi(fields[2].data()) : (track.type == TRACK_AUDIO ? 1 : 0);
+        } else if (start_with(line, "a=fmtp:")) {
+            auto pos = line.find(' ');
+            if (pos != string::npos) {
+                track.fmtp = trim(line.substr(pos + 1));
+            }
+        } else if (start_with(line, "a=control:")) {
+            track.control = line.substr(10);
+        }
+    }
+    for (auto &track : all) {
+        if (track.type != TRACK_INVALID && track.clock_rate && !track.control.empty()) {
+            tracks.emplace_back(std::move(track));
+        }
+    }
+    return !tracks.empty();
+}
+
+string makeSdp(vector<SdpTrack> &tracks) {
+    string ret = "v=0\r\n"
+                 "o=- 0 0 IN IP4 0.0.0.0\r\n"
+                 "s=beton\r\n"
+                 "c=IN IP4 0.0.0.0\r\n"
+                 "t=0 0\r\n"
+                 "a=control:*\r\n";
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        auto &track = tracks[i];
+        auto pt = to_string(track.pt);
+        track.control = "trackID=" + to_string(i);
+        ret += string("m=") + (track.type == TRACK_VIDEO ? "video" : "audio") + " 0 RTP/AVP " + pt + "\r\n";
+        ret += "a=rtpmap:" + pt + " " + track.codec + "/" + to_string(track.clock_rate);
+        if (track.type == TRACK_AUDIO && track.channels) {
+            ret += "/" + to_string(track.channels);
+        }
+        ret += "\r\n";
+        if (!track.fmtp.empty()) {
+            ret += "a=fmtp:" + pt + " " + track.fmtp + "\r\n";
+        }
+        ret += "a=control:" + track.control + "\r\n";
+    }
+    return ret;
+}
+
+string encodeBase64(const string &str) {
+    static const char s_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string ret;
+    ret.reserve((str.size() + 2) / 3 * 4);
+    auto data = (const uint8_t *)str.data();
+    size_t i = 0;
+    for (; i + 3 <= str.size(); i += 3) {
+        uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        ret.push_back(s_table[v >> 18]);
+        ret.push_back(s_table[(v >> 12) & 0x3f]);
+        ret.push_back(s_table[(v >> 6) & 0x3f]);
+        ret.push_back(s_table[v & 0x3f]);
+    }
+    if (i < str.size()) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < str.size()) {
+            v |= data[i + 1] << 8;
+        }
+        ret.push_back(s_table[v >> 18]);
+        ret.push_back(s_table[(v >> 12) & 0x3f]);
+        ret.push_back(i + 1 < str.size() ? s_table[(v >> 6) & 0x3f] : '=');
+        ret.push_back('=');
+    }
+    return ret;
+}
+
+bool parseRtspUrl(const string &url, string &app, string &stream) {
+    auto pos = url.find("://");
+    pos = url.find('/', pos == string::npos ? 0 : pos + 3);
+    if (pos == string::npos) {
+        return false;
+    }
+    auto path = url.substr(pos, url.find('?', pos) - pos);
+    auto fields = split(path, "/");
+    //split 会保留开头的空串
+    fields.erase(std::remove(fields.begin(), fields.end(), ""), fields.end());
+    if (fields.size() < 2) {
+        return false;
+    }
+    app = fields[0];
+    stream = fields[1];
+    return true;
+}
+
+const string &RtspRequest::header(const string &key) const {
+    static const string s_empty;
+    auto it = headers.find(key);
+    return it == headers.end() ? s_empty : it->second;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void RtspSplitter::onParseRtsp(const Buffer::Ptr &buf) {
+    onData(buf, 0);
+}
+
+void RtspSplitter::onData(const Buffer::Ptr &buf, size_t offset) {
+    auto data = (const uint8_t *)buf->data();
+    size_t size = buf->size();
+    while (offset < size) {
+        if (_rtp) {
+            size_t len = std::min(_rtp_need, size - offset);
+            memcpy(_rtp->data() + _rtp->size(), data + offset, len);
+            _rtp->setSize(_rtp->size() + len);
+            _rtp_need -= len;
+            offset += len;
+            if (!_rtp_need) {
+                Buffer::Ptr pkt = std::move(_rtp);
+                _rtp = nullptr;
+                onRtpInterleaved(_channel, pkt);
+            }
+            continue;
+        }
+        if (_prefix_size || (_text.empty() && data[offset] == '$')) {
+            while (_prefix_size < RTP_TCP_PREFIX_SIZE && offset < size) {
+                _prefix[_prefix_size++] = data[offset++];
+            }
+            if (_prefix_size < RTP_TCP_PREFIX_SIZE) {
+                return;
+            }
+            _prefix_size = 0;
+            _channel = _prefix[1];
+            size_t len = (_prefix[2] << 8) | _prefix[3];
+            if (size - offset >= len) {
+                if (len) {
+                    onRtpInterleaved(_channel, BufferSlice::create(buf, offset, len));
+                }
+                offset += len;
+            } else {
+                _rtp = BufferRaw::create(len);
+                _rtp_need = len;
+            }
+            continue;
+        }
+
+        //文本请求，可能紧跟着 interleaved 数据(比如 RECORD 之后)
+        _text.append((const char *)data + offset, size - offset);
+        offset = size;
+        while (!_text.empty() && _text[0] != '$') {
+            //请求之间多余的空行
+            auto pos = _text.find_first_not_of("\r\n");
+            if (pos == string::npos) {
+                _text.clear();
+                break;
+            }
+            _text.erase(0, pos);
+            auto used = onText();
+            if (!used) {
+                if (_text.size() > s_max_request_size) {
+                    throw std::runtime_error("rtsp request too large");
+                }
+                return;
+            }
+            _text.erase(0, used);
+        }
+        if (!_text.empty()) {
+            //剩下的是 interleaved 数据，只有请求和数据在同一次接收时才会走到这里
+            auto rest = std::make_shared<BufferString>(std::move(_text));
+            _text.clear();
+            onData(rest, 0);
+        }
+    }
+}
+
+size_t RtspSplitter::onText() {
+    auto pos = _text.find("\r\n\r\n");
+    if (pos == string::npos) {
+        return 0;
+    }
+    RtspRequest req;
+    auto lines = split(_text.substr(0, pos), "\r\n");
+    //OPTIONS rtsp://host/app/stream RTSP/1.0
+    auto first = split(lines[0], " ");
+    if (first.size() != 3 || !start_with(first[2], "RTSP/")) {
+        throw std::runtime_error("bad rtsp request line: " + lines[0]);
+    }
+    req.method = first[0];
+    req.url = first[1];
+    for (size_t i = 1; i < lines.size(); ++i) {
+        auto colon = lines[i].find(':');
+        if (colon == string::npos) {
+            continue;
+        }
+        auto key = trim(lines[i].substr(0, colon));
+        std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+        req.headers[key] = trim(lines[i].substr(colon + 1));
+    }
+    size_t content_length = atoi(req.header("content-length").data());
+    if (content_length > s_max_request_size) {
+        throw std::runtime_error("rtsp content too large");
+    }
+    if (_text.size() < pos + 4 + content_length) {
+        return 0;
+    }
+    req.content = _text.substr(pos + 4, content_length);
+    onRtspRequest(req);
+    return pos + 4 + content_length;
+}
+
+}
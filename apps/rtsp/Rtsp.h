@@ -0,0 +1,149 @@
+#ifndef __RTSP_H__
+#define __RTSP_H__
+
+#include "network/Buffer.h"
+#include <map>
+
+namespace beton {
+
+#define RTSP_SCHEMA "rtsp"
+
+static constexpr size_t RTP_HEADER_SIZE = 12;
+//rtp over tcp 每个包前面的 '$' + 通道号 + 2字节长度
+static constexpr size_t RTP_TCP_PREFIX_SIZE = 4;
+//rtp 负载上限，加上 IP/UDP/RTP 头不超过常见的 1500 MTU
+static constexpr size_t RTP_MAX_PAYLOAD = 1400;
+//视频的 rtp 时钟频率
+static constexpr uint32_t RTP_VIDEO_CLOCK = 90000;
+
+typedef enum : uint8_t {
+    TRACK_VIDEO = 0,
+    TRACK_AUDIO,
+    TRACK_INVALID
+}TrackType;
+
+typedef enum : uint8_t {
+    RTP_INVALID = 0,
+    RTP_UDP,
+    RTP_TCP
+}RtpTransport;
+
+//随机数，用于 ssrc、初始序号和会话id
+uint32_t rtspRandom();
+
+//写12字节 rtp 头(version 2, 不带 CSRC 和扩展头)
+void writeRtpHeader(uint8_t *p, bool marker, uint8_t pt, uint16_t seq, uint32_t stamp, uint32_t ssrc);
+
+/**
+ * 一个 rtp 包，由推流端或打包器生成一次，所有播放端共用:
+ * 头部切自内存池中的一块内存，负载是帧数据的切片; 播放端发送时只另写自己的 rtp 头(seq/ssrc)
+*/
+struct RtpPacket {
+    using Ptr = std::shared_ptr<RtpPacket>;
+
+    //在 sdp 中的序号
+    uint8_t track = 0;
+    //12字节 rtp 头
+    Buffer::Ptr header;
+    std::vector<Buffer::Ptr> payload;
+    size_t payload_size = 0;
+
+    const uint8_t *head() const { return (const uint8_t *)header->data(); }
+    bool marker() const { return head()[1] & 0x80; }
+    uint8_t payloadType() const { return head()[1] & 0x7f; }
+    uint16_t seq() const { return (head()[2] << 8) | head()[3]; }
+    uint32_t timestamp() const {
+        return ((uint32_t)head()[4] << 24) | (head()[5] << 16) | (head()[6] << 8) | head()[7];
+    }
+    size_t size() const { return RTP_HEADER_SIZE + payload_size; }
+};
+
+//同一路媒体、同一时间戳的一组 rtp 包(一帧), 是环形缓冲和 GOP 缓存的单位
+struct RtpFrame {
+    using Ptr = std::shared_ptr<RtpFrame>;
+
+    uint8_t track = 0;
+    //视频的关键帧，没有视频时每帧都是
+    bool key = false;
+    //所有 rtp 包的字节数
+    size_t bytes = 0;
+    std::vector<RtpPacket::Ptr> packets;
+
+    uint32_t timestamp() const { return packets.empty() ? 0 : packets[0]->timestamp(); }
+};
+
+//sdp 中的一路媒体
+struct SdpTrack {
+    TrackType type = TRACK_INVALID;
+    uint8_t pt = 0;
+    //大写的编码名，如 H264/H265/MPEG4-GENERIC
+    std::string codec;
+    uint32_t clock_rate = 0;
+    uint32_t channels = 0;
+    //a=fmtp 中负载类型之后的部分
+    std::string fmtp;
+    //a=control 的值，SETUP 的 url 以它结尾
+    std::string control;
+};
+
+//解析推流端 ANNOUNCE 的 sdp, 没有可用的媒体时返回 false
+bool parseSdp(const std::string &sdp, std::vector<SdpTrack> &tracks);
+//生成给播放端的 sdp, 会改写各路媒体的 control 为 trackID=序号
+std::string makeSdp(std::vector<SdpTrack> &tracks);
+
+std::string encodeBase64(const std::string &str);
+
+/**
+ * 从 rtsp url 中取出 app 和 stream, 去掉参数
+ * rtsp://host:port/app/stream?token=x -> app, stream
+*/
+bool parseRtspUrl(const std::string &url, std::string &app, std::string &stream);
+
+struct RtspRequest {
+    std::string method;
+    std::string url;
+    //头部字段名转为小写
+    std::map<std::string, std::string> headers;
+    std::string content;
+
+    //取头部字段，key 为小写，没有时返回空
+    const std::string &header(const std::string &key) const;
+};
+
+/**
+ * rtsp 协议层(服务端), 与 socket 无关, 把 tcp 数据流拆分为 rtsp 请求和 interleaved 的 rtp/rtcp 包:
+ * 1. 请求头和内容只在凑齐前暂存，一般只有几百字节
+ * 2. 完整落在一次接收里的 rtp 包直接切片引用接收到的 Buffer;
+ *    跨多次接收的在包头到达时按包长从内存池申请一次，后续数据依次写入
+*/
+class RtspSplitter {
+public:
+    virtual ~RtspSplitter() = default;
+
+    //输入收到的数据，协议错误时抛出 std::runtime_error
+    void onParseRtsp(const Buffer::Ptr &buf);
+
+protected:
+    virtual void onRtspRequest(const RtspRequest &req) = 0;
+    //收到 interleaved 包，channel 为 SETUP 时协商的通道号
+    virtual void onRtpInterleaved(uint8_t channel, const Buffer::Ptr &pkt) = 0;
+
+private:
+    //从 offset 开始解析
+    void onData(const Buffer::Ptr &buf, size_t offset);
+    //尝试从 _text 中取出一个完整的请求，返回消费的字节数, 不完整时返回0
+    size_t onText();
+
+private:
+    std::string _text;
+    //不完整的 interleaved 包头
+    uint8_t _prefix[RTP_TCP_PREFIX_SIZE];
+    size_t _prefix_size = 0;
+    //正在拼接的 interleaved 包
+    BufferRaw::Ptr _rtp;
+    size_t _rtp_need = 0;
+    uint8_t _channel = 0;
+};
+
+}
+#endif  //__RTSP_H__
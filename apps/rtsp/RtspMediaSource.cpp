@@ -0,0 +1,34 @@
+#include "RtspMediaSource.h"
+
+using namespace std;
+
+namespace beton {
+
+RtspMediaSource::RtspMediaSource(const string &vhost, const string &app, const string &stream, size_t ring_size)
+    : MediaSource(RTSP_SCHEMA, vhost, app, stream) {
+    _ring = std::make_shared<Ring>(ring_size);
+}
+
+RtspMediaSource::Ptr RtspMediaSource::find(const string &vhost, const string &app, const string &stream) {
+    return dynamic_pointer_cast<RtspMediaSource>(MediaSource::find(RTSP_SCHEMA, vhost, app, stream));
+}
+
+void RtspMediaSource::setTracks(vector<SdpTrack> tracks) {
+    _tracks = std::move(tracks);
+    _sdp = makeSdp(_tracks);
+    _have_video = false;
+    for (auto &track : _tracks) {
+        _have_video = _have_video || track.type == TRACK_VIDEO;
+    }
+}
+
+void RtspMediaSource::onWrite(const RtpFrame::Ptr &frame) {
+    //纯音频的流每帧都可以起播
+    bool key = frame->key || !_have_video;
+    auto seq = _ring->writeSeq();
+    _ring->write(frame, key);
+    _gop.append(seq, frame, frame->bytes, key);
+    notifyReaders();
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef __RTSP_MEDIA_SOURCE_H__
+#define __RTSP_MEDIA_SOURCE_H__
+
+#include "media/MediaSource.h"
+#include "media/GopCache.h"
+#include "Util/RingBuffer.h"
+#include "Rtsp.h"
+
+namespace beton {
+
+/**
+ * rtsp 流，帧以打包好的 RtpFrame 写入环形缓冲，所有播放端共用同一份 rtp 包
+ * 来源是 rtsp 推流(RECORD)或者 rtmp 推流转换(RtspMuxer)
+*/
+class RtspMediaSource : public MediaSource {
+public:
+    using Ptr = std::shared_ptr<RtspMediaSource>;
+    using Ring = RingBuffer<RtpFrame::Ptr>;
+
+    /**
+     * @param ring_size: 环形缓冲的帧数，决定了播放端最多可以落后多少
+    */
+    RtspMediaSource(const std::string &vhost, const std::string &app, const std::string &stream, size_t ring_size = 1024);
+
+    static Ptr find(const std::string &vhost, const std::string &app, const std::string &stream);
+
+    //设置各路媒体，在 regist() 之前调用，之后不再修改; control 被改写为 trackID=序号
+    void setTracks(std::vector<SdpTrack> tracks);
+    const std::vector<SdpTrack> &tracks() const { return _tracks; }
+    //给播放端的 sdp
+    const std::string &sdp() const { return _sdp; }
+
+    //写入一帧，只能在推流端所在线程调用
+    void onWrite(const RtpFrame::Ptr &frame);
+
+    /**
+     * 起播时取出 GOP 缓存的帧，可以在任意线程调用
+     * @return 之后应从环形缓冲的哪个序号接着读; 没有缓存时返回 UINT64_MAX
+    */
+    uint64_t getGop(std::vector<RtpFrame::Ptr> &out) { return _gop.get(out); }
+
+    const Ring::Ptr &getRing() const { return _ring; }
+
+private:
+    bool _have_video = false;
+    std::string _sdp;
+    std::vector<SdpTrack> _tracks;
+    Ring::Ptr _ring;
+    GopCache<RtpFrame::Ptr> _gop;
+};
+
+}
+#endif  //__RTSP_MEDIA_SOURCE_H__
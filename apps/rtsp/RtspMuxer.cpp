@@ -0,0 +1,222 @@
+#include "RtspMuxer.h"
+#include "media/H264.h"
+#include "media/H265.h"
+#include "Util/Logger.h"
+
+using namespace std;
+
+namespace beton {
+
+//FLV 的编码 id 和 enhanced rtmp 的包类型
+static constexpr uint8_t s_flv_codec_h264 = 7;
+static constexpr uint8_t s_flv_codec_h265 = 12;
+static constexpr uint8_t s_flv_sound_aac = 10;
+static constexpr uint8_t s_ex_sequence_start = 0;
+static constexpr uint8_t s_ex_coded_frames = 1;
+static constexpr uint8_t s_ex_coded_frames_x = 3;
+
+static string hexString(const string &data) {
+    static const char s_hex[] = "0123456789ABCDEF";
+    string ret;
+    for (auto c : data) {
+        ret.push_back(s_hex[(uint8_t)c >> 4]);
+        ret.push_back(s_hex[c & 0x0f]);
+    }
+    return ret;
+}
+
+RtspMuxer::RtspMuxer(const string &vhost, const string &app, const string &stream)
+    : _vhost(vhost), _app(app), _stream(stream) {}
+
+RtspMuxer::~RtspMuxer() {
+    if (_src) {
+        _src->close();
+    }
+}
+
+void RtspMuxer::onRtmp(const RtmpPacket::Ptr &pkt) {
+    if (_regist_failed || pkt->size() < 2) {
+        return;
+    }
+    if (pkt->type_id == RTMP_VIDEO) {
+        onVideo(pkt);
+    } else if (pkt->type_id == RTMP_AUDIO) {
+        onAudio(pkt);
+    }
+}
+
+bool RtspMuxer::checkRegist() {
+    if (_src) {
+        return true;
+    }
+    //第一个编码帧到来时，推流端通常已经发完了所有序列头
+    vector<SdpTrack> tracks;
+    for (auto track : {&_video_track, &_audio_track}) {
+        if (track->type != TRACK_INVALID) {
+            tracks.emplace_back(*track);
+        }
+    }
+    if (tracks.empty()) {
+        return false;
+    }
+    auto src = std::make_shared<RtspMediaSource>(_vhost, _app, _stream);
+    src->setTracks(std::move(tracks));
+    if (!src->regist()) {
+        WarnL << "rtsp stream " << src->url() << " already exists, rtmp stream not converted";
+        _regist_failed = true;
+        return false;
+    }
+    uint8_t index = 0;
+    if (_video_track.type != TRACK_INVALID) {
+        _video = std::make_shared<RtpPacketizer>(index, src->tracks()[index]);
+        ++index;
+    }
+    if (_audio_track.type != TRACK_INVALID) {
+        _audio = std::make_shared<RtpPacketizer>(index, src->tracks()[index]);
+    }
+    _src = std::move(src);
+    return true;
+}
+
+void RtspMuxer::onVideoConfig(const string &codec, const uint8_t *data, size_t size) {
+    vector<string> vps, sps, pps;
+    size_t length_size = 4;
+    bool ok = codec == "H264" ? parseAvcConfig(data, size, sps, pps, length_size)
+                              : parseHevcConfig(data, size, vps, sps, pps, length_size);
+    if (!ok || sps.empty() || pps.empty() || (codec == "H265" && vps.empty())) {
+        WarnL << "bad " << codec << " sequence header of " << _app << "/" << _stream;
+        return;
+    }
+    _length_size = length_size;
+    _video_config.clear();
+    for (auto list : {&vps, &sps, &pps}) {
+        for (auto &nal : *list) {
+            _video_config.emplace_back(std::make_shared<BufferString>(nal));
+        }
+    }
+    if (_src) {
+        //已经登记的流不能再修改 sdp, 新的参数集随关键帧发送
+        if (_video_codec != codec) {
+            WarnL << "video codec of " << _app << "/" << _stream << " changed, rtsp conversion ignores it";
+        }
+        return;
+    }
+    _video_codec = codec;
+    _video_track.type = TRACK_VIDEO;
+    _video_track.pt = 96;
+    _video_track.codec = codec;
+    _video_track.clock_rate = RTP_VIDEO_CLOCK;
+    if (codec == "H264") {
+        char profile[8];
+        snprintf(profile, sizeof(profile), "%02X%02X%02X", (uint8_t)sps[0][1], (uint8_t)sps[0][2], (uint8_t)sps[0][3]);
+        _video_track.fmtp = string("packetization-mode=1;profile-level-id=") + profile +
+                            ";sprop-parameter-sets=" + encodeBase64(sps[0]) + "," + encodeBase64(pps[0]);
+    } else {
+        _video_track.fmtp = "sprop-vps=" + encodeBase64(vps[0]) + ";sprop-sps=" + encodeBase64(sps[0]) +
+                            ";sprop-pps=" + encodeBase64(pps[0]);
+    }
+}
+
+void RtspMuxer::onVideo(const RtmpPacket::Ptr &pkt) {
+    auto data = pkt->data();
+    size_t size = pkt->size();
+    string codec;
+    uint8_t packet_type;
+    size_t offset;
+    int32_t cts = 0;
+    if (data[0] & 0x80) {
+        //enhanced rtmp: 1字节头 + FourCC, CodedFrames 才带 cts
+        if (size < 5) {
+            return;
+        }
+        if (!memcmp(data + 1, "hvc1", 4)) {
+            codec = "H265";
+        } else if (!memcmp(data + 1, "avc1", 4)) {
+            codec = "H264";
+        }
+        packet_type = data[0] & 0x0f;
+        offset = 5;
+        if (packet_type == s_ex_coded_frames) {
+            if (size < 8) {
+                return;
+            }
+            cts = (int32_t)(((uint32_t)data[5] << 24) | (data[6] << 16) | (data[7] << 8)) >> 8;
+            offset = 8;
+        } else if (packet_type == s_ex_coded_frames_x) {
+            packet_type = s_ex_coded_frames;
+        } else if (packet_type != s_ex_sequence_start) {
+            return;
+        }
+    } else {
+        //帧类型/编码 id + AVCPacketType + 24位 cts
+        if (size < 5) {
+            return;
+        }
+        auto codec_id = data[0] & 0x0f;
+        codec = codec_id == s_flv_codec_h264 ? "H264" : (codec_id == s_flv_codec_h265 ? "H265" : "");
+        packet_type = data[1];
+        cts = (int32_t)(((uint32_t)data[2] << 24) | (data[3] << 16) | (data[4] << 8)) >> 8;
+        offset = 5;
+    }
+    if (codec.empty()) {
+        return;
+    }
+    if (packet_type == s_ex_sequence_start) {
+        onVideoConfig(codec, data + offset, size - offset);
+        return;
+    }
+    if (packet_type != s_ex_coded_frames || _video_config.empty() || !checkRegist() || !_video) {
+        return;
+    }
+    bool key = pkt->isVideoKeyFrame();
+    vector<Buffer::Ptr> nalus;
+    if (key) {
+        nalus = _video_config;
+    }
+    if (!splitLengthPrefixed(pkt->payload, offset, _length_size, nalus)) {
+        WarnL_EVERY_MS(5000) << "bad " << codec << " frame of " << _app << "/" << _stream;
+        return;
+    }
+    auto frame = _video->packetize(nalus, (uint64_t)pkt->timestamp + cts, key);
+    if (frame) {
+        _src->onWrite(frame);
+    }
+}
+
+void RtspMuxer::onAudio(const RtmpPacket::Ptr &pkt) {
+    auto data = pkt->data();
+    size_t size = pkt->size();
+    if ((data[0] >> 4) != s_flv_sound_aac) {
+        return;
+    }
+    if (pkt->isConfigFrame()) {
+        //AudioSpecificConfig: 5位 audioObjectType, 4位采样率序号, 4位声道
+        static const uint32_t s_rates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000,
+                                          22050, 16000, 12000, 11025, 8000, 7350};
+        if (size < 4 || _src) {
+            return;
+        }
+        auto index = ((data[2] & 0x07) << 1) | (data[3] >> 7);
+        if (index >= 13) {
+            return;
+        }
+        _audio_track.type = TRACK_AUDIO;
+        _audio_track.pt = 97;
+        _audio_track.codec = "MPEG4-GENERIC";
+        _audio_track.clock_rate = s_rates[index];
+        _audio_track.channels = (data[3] >> 3) & 0x0f;
+        _audio_track.fmtp = "streamtype=5;profile-level-id=1;mode=AAC-hbr;sizelength=13;indexlength=3;"
+                            "indexdeltalength=3;config=" + hexString(string((const char *)data + 2, size - 2));
+        return;
+    }
+    if (size <= 2 || _audio_track.type == TRACK_INVALID || !checkRegist() || !_audio) {
+        return;
+    }
+    //有视频时 GOP 从视频关键帧开始，纯音频的流由 RtspMediaSource 把每帧都当作关键帧
+    auto frame = _audio->packetize({BufferSlice::create(pkt->payload, 2)}, pkt->timestamp, false);
+    if (frame) {
+        _src->onWrite(frame);
+    }
+}
+
+}
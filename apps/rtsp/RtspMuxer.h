@@ -0,0 +1,57 @@
+#ifndef __RTSP_MUXER_H__
+#define __RTSP_MUXER_H__
+
+#include "rtmp/Rtmp.h"
+#include "RtspMediaSource.h"
+#include "RtpPacketizer.h"
+
+namespace beton {
+
+/**
+ * 把 rtmp 推流(FLV 格式的音视频消息，包括 enhanced rtmp 的 H265)转为同名的 rtsp 流:
+ * 1. 从序列头取出 SPS/PPS(VPS)、AudioSpecificConfig 生成 sdp, 收到第一个编码帧时登记 RtspMediaSource
+ * 2. 视频按长度前缀切出 NAL 切片，关键帧前面加上参数集，交给 RtpPacketizer 打包，全程不拷贝帧数据
+ * 3. 目前支持 H264/H265/AAC, 其他编码的媒体不转换
+*/
+class RtspMuxer {
+public:
+    using Ptr = std::shared_ptr<RtspMuxer>;
+
+    RtspMuxer(const std::string &vhost, const std::string &app, const std::string &stream);
+    //关闭已登记的 rtsp 流
+    ~RtspMuxer();
+
+    //输入 rtmp 音视频消息，只能在推流端所在线程调用
+    void onRtmp(const RtmpPacket::Ptr &pkt);
+
+    //登记之前为空
+    const RtspMediaSource::Ptr &source() const { return _src; }
+
+private:
+    void onVideo(const RtmpPacket::Ptr &pkt);
+    void onAudio(const RtmpPacket::Ptr &pkt);
+    void onVideoConfig(const std::string &codec, const uint8_t *data, size_t size);
+    //收到编码帧时确认是否已经登记，登记失败(同名的 rtsp 流已存在)后不再转换
+    bool checkRegist();
+
+private:
+    bool _regist_failed = false;
+    std::string _vhost;
+    std::string _app;
+    std::string _stream;
+    RtspMediaSource::Ptr _src;
+
+    //视频，H264 或 H265
+    std::string _video_codec;
+    size_t _length_size = 4;
+    //VPS/SPS/PPS, 加在每个关键帧前面
+    std::vector<Buffer::Ptr> _video_config;
+    SdpTrack _video_track;
+    RtpPacketizer::Ptr _video;
+
+    SdpTrack _audio_track;
+    RtpPacketizer::Ptr _audio;
+};
+
+}
+#endif  //__RTSP_MUXER_H__
@@ -0,0 +1,640 @@
+#include "RtspSession.h"
+#include "media/H264.h"
+#include "media/H265.h"
+#include "network/SockUtil.h"
+#include "Util/Logger.h"
+#include <string.h>
+
+using namespace std;
+
+namespace beton {
+
+//udp 端口对的尝试次数，内核分配到奇数端口或者相邻端口被占用时重试
+static constexpr int s_udp_bind_retry = 16;
+//udp 播放端每路媒体缓存的包数和可以重传的时长，1024个包约是 10Mbps 视频的 1 秒
+static constexpr size_t s_rtx_cache_size = 1024;
+static constexpr uint32_t s_rtx_max_age = 1000;
+
+static const char *reasonOf(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 406: return "Not Acceptable";
+        case 454: return "Session Not Found";
+        case 455: return "Method Not Valid in This State";
+        case 461: return "Unsupported Transport";
+        default: return "Internal Server Error";
+    }
+}
+
+//推流端的 rtp 负载是否为关键帧的开始(H264 IDR, H265 IRAP), 包括聚合包和分片包
+static bool isKeyPayload(const string &codec, const uint8_t *p, size_t size) {
+    if (codec == "H264") {
+        auto type = p[0] & 0x1f;
+        if (type == H264_NAL_STAP_A) {
+            return size > 3 && (p[3] & 0x1f) == H264_NAL_IDR;
+        }
+        if (type == H264_NAL_FU_A) {
+            return size > 1 && (p[1] & 0x80) && (p[1] & 0x1f) == H264_NAL_IDR;
+        }
+        return type == H264_NAL_IDR;
+    }
+    if (codec == "H265") {
+        if (size < 2) {
+            return false;
+        }
+        auto type = h265NalType(p[0]);
+        if (type == 48) {
+            //AP: 2字节负载头 + 2字节长度 + NAL
+            return size > 4 && h265IsIrap(p[4]);
+        }
+        if (type == 49) {
+            //FU: 2字节负载头 + 1字节分片头, 分片头低6位为 NAL 类型
+            return size > 2 && (p[2] & 0x80) && h265IsIrap((p[2] & 0x3f) << 1);
+        }
+        return h265IsIrap(p[0]);
+    }
+    return false;
+}
+
+RtspSession::RtspSession(const Socket::Ptr &sock) : Session(sock) {
+    DebugL << "new rtsp session from " << get_peer_ip() << ":" << get_peer_port();
+}
+
+RtspSession::~RtspSession() {
+    stopStream();
+    DebugL << "rtsp session destroyed, " << _app << "/" << _stream;
+}
+
+void RtspSession::onRecv(const Buffer::Ptr &buf) {
+    try {
+        onParseRtsp(buf);
+    } catch (std::exception &ex) {
+        WarnL << "rtsp session " << get_peer_ip() << " error: " << ex.what();
+        shutdown(SockException(EPROTO, ex.what(), Err_Other));
+    }
+}
+
+void RtspSession::onError(const SockException &ex) {
+    DebugL << "rtsp session " << _app << "/" << _stream << " closed: " << ex;
+    stopStream();
+}
+
+void RtspSession::onFlowControl(bool blocked) {
+    _send_blocked = blocked;
+    if (!blocked) {
+        onPlayReadable();
+    }
+}
+
+const unordered_map<string, RtspSession::Handler> &RtspSession::handlers() {
+    static const unordered_map<string, Handler> s_handlers = {
+        {"OPTIONS", &RtspSession::onOptions},
+        {"DESCRIBE", &RtspSession::onDescribe},
+        {"ANNOUNCE", &RtspSession::onAnnounce},
+        {"SETUP", &RtspSession::onSetup},
+        {"PLAY", &RtspSession::onPlayCmd},
+        {"PAUSE", &RtspSession::onPause},
+        {"RECORD", &RtspSession::onRecord},
+        {"TEARDOWN", &RtspSession::onTeardown},
+        {"GET_PARAMETER", &RtspSession::onKeepAlive},
+        {"SET_PARAMETER", &RtspSession::onKeepAlive}
+    };
+    return s_handlers;
+}
+
+void RtspSession::onRtspRequest(const RtspRequest &req) {
+    auto &map = handlers();
+    auto it = map.find(req.method);
+    if (it == map.end()) {
+        TraceL << "unhandled rtsp method: " << req.method;
+        sendError(req, 405);
+        return;
+    }
+    (this->*(it->second))(req);
+}
+
+void RtspSession::sendResponse(const RtspRequest &req, int code, const string &headers, const string &content,
+                               const string &content_type) {
+    string res = "RTSP/1.0 " + to_string(code) + " " + reasonOf(code) + "\r\n";
+    res += "CSeq: " + req.header("cseq") + "\r\n";
+    res += "Server: beton\r\n";
+    if (!_session_id.empty()) {
+        res += "Session: " + _session_id + ";timeout=60\r\n";
+    }
+    res += headers;
+    if (!content.empty()) {
+        res += "Content-Type: " + content_type + "\r\n";
+        res += "Content-Length: " + to_string(content.size()) + "\r\n";
+    }
+    res += "\r\n";
+    res += content;
+    send(std::move(res));
+}
+
+void RtspSession::sendError(const RtspRequest &req, int code) {
+    WarnL << "rtsp " << req.method << " " << req.url << " from " << get_peer_ip() << " failed: " << code << " "
+          << reasonOf(code);
+    sendResponse(req, code);
+}
+
+void RtspSession::onOptions(const RtspRequest &req) {
+    sendResponse(req, 200, "Public: OPTIONS, DESCRIBE, ANNOUNCE, SETUP, PLAY, PAUSE, RECORD, TEARDOWN, GET_PARAMETER, "
+                           "SET_PARAMETER\r\n");
+}
+
+void RtspSession::onDescribe(const RtspRequest &req) {
+    string app, stream;
+    if (_publish_src || _play_src || !parseRtspUrl(req.url, app, stream)) {
+        sendError(req, _publish_src || _play_src ? 455 : 400);
+        return;
+    }
+    auto src = RtspMediaSource::find(DEFAULT_VHOST, app, stream);
+    if (!src) {
+        sendError(req, 404);
+        return;
+    }
+    if (!onPlay(app, stream)) {
+        sendError(req, 401);
+        return;
+    }
+    _app = app;
+    _stream = stream;
+    _play_src = src;
+    _content_base = req.url.substr(0, req.url.find_last_not_of('/') + 1);
+    _tracks.clear();
+    for (auto &info : src->tracks()) {
+        _tracks.emplace_back();
+        _tracks.back().info = info;
+    }
+    sendResponse(req, 200, "Content-Base: " + _content_base + "/\r\n", src->sdp(), "application/sdp");
+}
+
+void RtspSession::onAnnounce(const RtspRequest &req) {
+    string app, stream;
+    if (_publish_src || _play_src || !parseRtspUrl(req.url, app, stream)) {
+        sendError(req, _publish_src || _play_src ? 455 : 400);
+        return;
+    }
+    vector<SdpTrack> tracks;
+    if (!parseSdp(req.content, tracks) || tracks.size() > 0xff) {
+        sendError(req, 406);
+        return;
+    }
+    if (!onPublish(app, stream)) {
+        sendError(req, 401);
+        return;
+    }
+    auto src = std::make_shared<RtspMediaSource>(DEFAULT_VHOST, app, stream);
+    //推流端 SETUP 用的是它自己的 control, 播放端用改写后的
+    src->setTracks(tracks);
+    if (!src->regist()) {
+        sendError(req, 406);
+        return;
+    }
+    _app = app;
+    _stream = stream;
+    _publish_src = std::move(src);
+    _content_base = req.url.substr(0, req.url.find_last_not_of('/') + 1);
+    _tracks.clear();
+    for (auto &info : tracks) {
+        _tracks.emplace_back();
+        _tracks.back().info = std::move(info);
+    }
+    InfoL << "rtsp announce " << _publish_src->url() << ", " << _tracks.size() << " tracks";
+    sendResponse(req, 200);
+}
+
+RtspSession::Track *RtspSession::findTrack(const string &url) {
+    for (auto &track : _tracks) {
+        auto &control = track.info.control;
+        if (control.find("://") != string::npos) {
+            //绝对地址
+            if (url == control) {
+                return &track;
+            }
+            continue;
+        }
+        if (url.size() > control.size() && url.compare(url.size() - control.size(), control.size(), control) == 0 &&
+            url[url.size() - control.size() - 1] == '/') {
+            return &track;
+        }
+    }
+    //只有一路媒体时有的客户端直接用 Content-Base
+    if (_tracks.size() == 1 && url.substr(0, url.find_last_not_of('/') + 1) == _content_base) {
+        return &_tracks[0];
+    }
+    return nullptr;
+}
+
+bool RtspSession::setupUdp(Track &track, uint16_t peer_rtp_port) {
+    auto peer_ip = get_peer_ip();
+    struct sockaddr_storage peer;
+    if (!SockUtil::makeSockAddr(peer_ip, peer_rtp_port, peer)) {
+        return false;
+    }
+    auto bind_ip = peer.ss_family == AF_INET ? "0.0.0.0" : "::";
+    for (int i = 0; i < s_udp_bind_retry; ++i) {
+        //rtp 用偶数端口，rtcp 用紧接着的奇数端口
+        auto rtp = Socket::create(getPoller());
+        if (!rtp->bindUdp(0, bind_ip)) {
+            return false;
+        }
+        auto port = rtp->get_local_port();
+        if (port & 1) {
+            continue;
+        }
+        auto rtcp = Socket::create(getPoller());
+        if (!rtcp->bindUdp(port + 1, bind_ip)) {
+            continue;
+        }
+        rtp->bindPeerAddr((struct sockaddr *)&peer, SockUtil::getSockLen((struct sockaddr *)&peer));
+        SockUtil::makeSockAddr(peer_ip, peer_rtp_port + 1, peer);
+        rtcp->bindPeerAddr((struct sockaddr *)&peer, SockUtil::getSockLen((struct sockaddr *)&peer));
+        track.rtp_sock = std::move(rtp);
+        track.rtcp_sock = std::move(rtcp);
+        return true;
+    }
+    return false;
+}
+
+void RtspSession::onSetup(const RtspRequest &req) {
+    auto track = (_publish_src || _play_src) ? findTrack(req.url) : nullptr;
+    if (!track) {
+        sendError(req, (_publish_src || _play_src) ? 404 : 455);
+        return;
+    }
+    if (track->setup) {
+        sendError(req, 455);
+        return;
+    }
+    //Transport: RTP/AVP/TCP;unicast;interleaved=0-1 或 RTP/AVP;unicast;client_port=5000-5001
+    auto &transport = req.header("transport");
+    RtpTransport type = transport.find("/TCP") != string::npos ? RTP_TCP : RTP_UDP;
+    if (_transport != RTP_INVALID && _transport != type) {
+        //各路媒体必须使用同一种传输方式
+        sendError(req, 461);
+        return;
+    }
+    string interleaved, client_port;
+    for (auto &item : split(transport, ";")) {
+        auto field = trim(std::move(item));
+        if (start_with(field, "interleaved=")) {
+            interleaved = field.substr(12);
+        } else if (start_with(field, "client_port=")) {
+            client_port = field.substr(12);
+        }
+    }
+    string reply;
+    if (type == RTP_TCP) {
+        //没有指定通道号时按 sdp 中的序号分配
+        uint8_t channel = interleaved.empty() ? 2 * (track - _tracks.data()) : atoi(interleaved.data());
+        track->interleaved = channel;
+        reply = "RTP/AVP/TCP;unicast;interleaved=" + to_string(channel) + "-" + to_string(channel + 1);
+    } else {
+        uint16_t port = atoi(client_port.data());
+        if (!port || !setupUdp(*track, port)) {
+            sendError(req, 461);
+            return;
+        }
+        auto server_port = track->rtp_sock->get_local_port();
+        reply = "RTP/AVP;unicast;client_port=" + to_string(port) + "-" + to_string(port + 1) +
+                ";server_port=" + to_string(server_port) + "-" + to_string(server_port + 1);
+        weak_ptr<RtspSession> weak_self = static_pointer_cast<RtspSession>(shared_from_this());
+        uint8_t index = track - _tracks.data();
+        track->rtcp_sock->setRecvFromCB([weak_self, index](const Buffer::Ptr &buf, const struct sockaddr *, socklen_t) {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->onRtcp(index, buf);
+            }
+        });
+        if (_play_src) {
+            track->rtx = std::make_shared<NackResponder<RtxPacket> >(s_rtx_cache_size, s_rtx_max_age);
+        }
+        track->rtp_sock->setRecvFromCB([weak_self, index](const Buffer::Ptr &buf, const struct sockaddr *, socklen_t) {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->onRtpPacket(index, buf);
+            }
+        });
+    }
+    if (_publish_src) {
+        reply += ";mode=record";
+    }
+    _transport = type;
+    track->setup = true;
+    track->ssrc = rtspRandom();
+    track->seq = rtspRandom();
+    if (_session_id.empty()) {
+        char id[16];
+        snprintf(id, sizeof(id), "%08X", rtspRandom());
+        _session_id = id;
+    }
+    sendResponse(req, 200, "Transport: " + reply + "\r\n");
+}
+
+void RtspSession::onPlayCmd(const RtspRequest &req) {
+    if (!_play_src || _transport == RTP_INVALID) {
+        sendError(req, 455);
+        return;
+    }
+    if (_play_reader) {
+        //PAUSE 之后恢复，从暂停处接着发
+        _paused = false;
+        sendResponse(req, 200);
+        onPlayReadable();
+        return;
+    }
+    auto src = _play_src;
+    //播放时才需要按发送队列水位暂停读取
+    enableFlowControl();
+    //GOP 缓存命中时立即发出关键帧及之后的帧，然后从缓存之后的序号接着读环形缓冲; 否则等下一个关键帧
+    vector<RtpFrame::Ptr> frames;
+    _play_reader.reset(new RtspMediaSource::Ring::Reader(src->getRing()));
+    auto next = src->getGop(frames);
+    if (next != UINT64_MAX) {
+        _play_reader->seek(next);
+    }
+    //RTP-Info 告诉播放端各路媒体的第一个序号和时间戳
+    string rtp_info;
+    for (size_t i = 0; i < _tracks.size(); ++i) {
+        auto &track = _tracks[i];
+        if (!track.setup) {
+            continue;
+        }
+        if (!rtp_info.empty()) {
+            rtp_info += ",";
+        }
+        rtp_info += "url=" + _content_base + "/" + track.info.control + ";seq=" + to_string(track.seq);
+        for (auto &frame : frames) {
+            if (frame->track == i) {
+                rtp_info += ";rtptime=" + to_string(frame->timestamp());
+                break;
+            }
+        }
+    }
+    InfoL << "rtsp play " << src->url() << " over " << (_transport == RTP_TCP ? "tcp" : "udp") << " from "
+          << get_peer_ip();
+    sendResponse(req, 200, "Range: npt=0.000-\r\nRTP-Info: " + rtp_info + "\r\n");
+    for (auto &frame : frames) {
+        sendFrame(*frame);
+    }
+    weak_ptr<RtspSession> weak_self = static_pointer_cast<RtspSession>(shared_from_this());
+    _listener_id = src->addListener(getPoller(), [weak_self]() {
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            strong_self->onPlayReadable();
+        }
+    });
+}
+
+void RtspSession::onPause(const RtspRequest &req) {
+    if (!_play_reader) {
+        sendError(req, 455);
+        return;
+    }
+    //暂停期间的帧留在环形缓冲里，恢复时积压过多会丢到关键帧
+    _paused = true;
+    sendResponse(req, 200);
+}
+
+void RtspSession::onRecord(const RtspRequest &req) {
+    if (!_publish_src || _transport == RTP_INVALID) {
+        sendError(req, 455);
+        return;
+    }
+    InfoL << "rtsp record " << _publish_src->url() << " over " << (_transport == RTP_TCP ? "tcp" : "udp") << " from "
+          << get_peer_ip();
+    sendResponse(req, 200);
+}
+
+void RtspSession::onTeardown(const RtspRequest &req) {
+    sendResponse(req, 200);
+    stopStream();
+}
+
+void RtspSession::onKeepAlive(const RtspRequest &req) {
+    sendResponse(req, 200);
+}
+
+void RtspSession::onRtpInterleaved(uint8_t channel, const Buffer::Ptr &pkt) {
+    if (!_publish_src) {
+        //播放端的 rtcp 不处理
+        return;
+    }
+    for (size_t i = 0; i < _tracks.size(); ++i) {
+        if (_tracks[i].setup && _tracks[i].interleaved == channel) {
+            onRtpPacket(i, pkt);
+            return;
+        }
+    }
+}
+
+void RtspSession::onRtcp(uint8_t index, const Buffer::Ptr &buf) {
+    if (index >= _tracks.size() || !_tracks[index].rtx) {
+        return;
+    }
+    auto &track = _tracks[index];
+    auto data = (const uint8_t *)buf->data();
+    size_t size = buf->size();
+    vector<uint16_t> seqs;
+    //复合包，逐个遍历
+    for (size_t offset = 0; offset + 4 <= size;) {
+        auto p = data + offset;
+        size_t len = (((p[2] << 8) | p[3]) + 1) * 4;
+        if ((p[0] >> 6) != 2 || offset + len > size) {
+            break;
+        }
+        //RTPFB(205) 的 FMT 1 为通用 NACK, 12字节头部之后是 FCI
+        if (p[1] == 205 && (p[0] & 0x1f) == 1 && len > 12) {
+            parseNackFci(p + 12, len - 12, seqs);
+        }
+        offset += len;
+    }
+    if (seqs.empty()) {
+        return;
+    }
+    auto resent = track.rtx->onNack(seqs, getCurrentMilliSecond(), [&](uint16_t seq, const RtxPacket &rtx) {
+        vector<Buffer::Ptr> out;
+        out.reserve(1 + rtx.second->payload.size());
+        out.emplace_back(rtx.first);
+        out.insert(out.end(), rtx.second->payload.begin(), rtx.second->payload.end());
+        track.rtp_sock->send(std::move(out));
+    });
+    TraceL << "rtsp player " << get_peer_ip() << " nack " << seqs.size() << " packets, resent " << resent;
+}
+
+void RtspSession::onRtpPacket(uint8_t index, const Buffer::Ptr &buf) {
+    if (!_publish_src || index >= _tracks.size()) {
+        return;
+    }
+    auto data = (const uint8_t *)buf->data();
+    size_t size = buf->size();
+    if (size < RTP_HEADER_SIZE || (data[0] >> 6) != 2) {
+        return;
+    }
+    //跳过 CSRC 和扩展头，去掉填充
+    size_t offset = RTP_HEADER_SIZE + (data[0] & 0x0f) * 4;
+    if (data[0] & 0x10) {
+        if (size < offset + 4) {
+            return;
+        }
+        offset += 4 + ((data[offset + 2] << 8) | data[offset + 3]) * 4;
+    }
+    if (data[0] & 0x20) {
+        size -= std::min<size_t>(data[size - 1], size);
+    }
+    if (offset >= size) {
+        return;
+    }
+    auto pkt = std::make_shared<RtpPacket>();
+    pkt->track = index;
+    if (data[0] & 0x3f) {
+        //播放端发送时只替换 seq/ssrc, 固定头以外的部分必须去掉
+        auto header = BufferRaw::create(RTP_HEADER_SIZE, RTP_HEADER_SIZE);
+        memcpy(header->data(), data, RTP_HEADER_SIZE);
+        header->data()[0] = (char)0x80;
+        pkt->header = std::move(header);
+    } else {
+        pkt->header = BufferSlice::create(buf, 0, RTP_HEADER_SIZE);
+    }
+    pkt->payload.emplace_back(BufferSlice::create(buf, offset, size - offset));
+    pkt->payload_size = size - offset;
+
+    auto &track = _tracks[index];
+    if (track.frame && track.frame->timestamp() != pkt->timestamp()) {
+        //丢了带 marker 的包
+        flushFrame(track);
+    }
+    if (!track.frame) {
+        track.frame = std::make_shared<RtpFrame>();
+        track.frame->track = index;
+    }
+    auto &frame = *track.frame;
+    if (!frame.key && track.info.type == TRACK_VIDEO) {
+        frame.key = isKeyPayload(track.info.codec, data + offset, size - offset);
+    }
+    frame.bytes += pkt->size();
+    bool marker = pkt->marker();
+    frame.packets.emplace_back(std::move(pkt));
+    //音频每个包单独成帧
+    if (marker || track.info.type != TRACK_VIDEO) {
+        flushFrame(track);
+    }
+}
+
+void RtspSession::flushFrame(Track &track) {
+    RtpFrame::Ptr frame = std::move(track.frame);
+    track.frame = nullptr;
+    _publish_src->onWrite(frame);
+}
+
+void RtspSession::onPlayReadable() {
+    if (!_play_reader || _send_blocked || _paused) {
+        return;
+    }
+    //先取关闭标记，关闭前写入的帧在下面都能读到
+    bool closed = _play_src->closed();
+    auto &ring = _play_reader->ring();
+    RtpFrame::Ptr frame;
+    while (true) {
+        int ret = _play_reader->lag() > ring->capacity() / 2 ? -1 : _play_reader->read(frame);
+        if (ret == 0) {
+            break;
+        }
+        if (ret < 0) {
+            //发送跟不上或者被追上，丢掉积压的帧; seq 由本会话连续编号，播放端看不到跳号
+            auto skipped = _play_reader->skipToKeyFrame();
+            WarnL_EVERY_MS(5000) << "rtsp player " << get_peer_ip() << " of " << _play_src->url() << " is too slow, skipped "
+                                 << skipped << " frames";
+            continue;
+        }
+        sendFrame(*frame);
+    }
+    if (closed) {
+        //rtsp 没有流结束的消息，直接断开
+        InfoL << "rtsp play " << _play_src->url() << " ended, publisher left";
+        stopStream();
+        shutdown(SockException(0, "publisher left", Err_Eof));
+    }
+}
+
+void RtspSession::sendFrame(const RtpFrame &frame) {
+    if (frame.track >= _tracks.size() || !_tracks[frame.track].setup || frame.packets.empty()) {
+        return;
+    }
+    auto &track = _tracks[frame.track];
+    bool tcp = _transport == RTP_TCP;
+    size_t head_size = tcp ? RTP_TCP_PREFIX_SIZE + RTP_HEADER_SIZE : RTP_HEADER_SIZE;
+    //一帧所有包的头写在一块内存里
+    auto heads = BufferRaw::create(head_size * frame.packets.size(), head_size * frame.packets.size());
+    vector<Buffer::Ptr> out;
+    size_t offset = 0;
+    auto now = tcp ? 0 : getCurrentMilliSecond();
+    for (auto &pkt : frame.packets) {
+        auto p = (uint8_t *)heads->data() + offset;
+        if (tcp) {
+            auto size = pkt->size();
+            p[0] = '$';
+            p[1] = track.interleaved;
+            p[2] = size >> 8;
+            p[3] = size;
+            p += RTP_TCP_PREFIX_SIZE;
+        }
+        memcpy(p, pkt->head(), RTP_HEADER_SIZE);
+        p[2] = track.seq >> 8;
+        p[3] = track.seq;
+        p[8] = track.ssrc >> 24;
+        p[9] = track.ssrc >> 16;
+        p[10] = track.ssrc >> 8;
+        p[11] = track.ssrc;
+        ++track.seq;
+        auto head = BufferSlice::create(heads, offset, head_size);
+        offset += head_size;
+        if (!tcp) {
+            //udp 每个包一个报文，同时留在重传缓存里
+            track.rtx->insert(track.seq - 1, RtxPacket(head, pkt), now);
+            out.reserve(1 + pkt->payload.size());
+            out.emplace_back(std::move(head));
+            out.insert(out.end(), pkt->payload.begin(), pkt->payload.end());
+            track.rtp_sock->send(std::move(out));
+            out.clear();
+            continue;
+        }
+        out.emplace_back(std::move(head));
+        out.insert(out.end(), pkt->payload.begin(), pkt->payload.end());
+    }
+    if (tcp) {
+        send(std::move(out));
+    }
+}
+
+void RtspSession::stopStream() {
+    if (_publish_src) {
+        InfoL << "rtsp publish stopped " << _publish_src->url();
+        _publish_src->close();
+        _publish_src = nullptr;
+    }
+    if (_play_src) {
+        if (_listener_id) {
+            _play_src->removeListener(getPoller(), _listener_id);
+        }
+        _play_src = nullptr;
+        _play_reader = nullptr;
+        _listener_id = 0;
+    }
+    for (auto &track : _tracks) {
+        if (track.rtp_sock) {
+            track.rtp_sock->closeSock();
+            track.rtcp_sock->closeSock();
+        }
+    }
+    _tracks.clear();
+    _transport = RTP_INVALID;
+    _paused = false;
+}
+
+}
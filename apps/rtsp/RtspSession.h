@@ -0,0 +1,113 @@
+#ifndef __RTSP_SESSION_H__
+#define __RTSP_SESSION_H__
+
+#include "network/Session.h"
+#include "RtspMediaSource.h"
+#include "algorithm/Nack.h"
+#include <unordered_map>
+
+namespace beton {
+
+/**
+ * rtsp 服务端会话，支持 OPTIONS/DESCRIBE/ANNOUNCE/SETUP/PLAY/PAUSE/RECORD/TEARDOWN, rtp over udp 和 tcp interleaved:
+ * 1. 推流(ANNOUNCE + RECORD)时登记 RtspMediaSource, 收到的 rtp 包切片引用接收的 Buffer, 按时间戳组成帧写入环形缓冲
+ * 2. 播放时读取环形缓冲，所有播放端共用同一份 rtp 包; 每个播放端只另写自己的 rtp 头(seq/ssrc 连续，跳帧后也不断),
+ *    一帧的所有头写在一块内存里，与负载切片一起交给 socket, 在 poller 本轮结束时由 sendmsg/sendmmsg 一次发出
+ * 3. 积压过多时与 rtmp 一样丢到最近的关键帧
+*/
+class RtspSession : public Session, public RtspSplitter {
+public:
+    using Ptr = std::shared_ptr<RtspSession>;
+
+    RtspSession(const Socket::Ptr &sock);
+    ~RtspSession() override;
+
+    void onRecv(const Buffer::Ptr &buf) override;
+    void onError(const SockException &ex) override;
+    void onFlowControl(bool blocked) override;
+
+protected:
+    void onRtspRequest(const RtspRequest &req) override;
+    void onRtpInterleaved(uint8_t channel, const Buffer::Ptr &pkt) override;
+
+    //推流/播放鉴权，返回 false 时回复 401
+    virtual bool onPublish(const std::string &app, const std::string &stream) { return true; }
+    virtual bool onPlay(const std::string &app, const std::string &stream) { return true; }
+
+private:
+    using Handler = void (RtspSession::*)(const RtspRequest &req);
+    //重传缓存中的包: 本会话改写的 rtp 头 + 共用的 rtp 包
+    using RtxPacket = std::pair<Buffer::Ptr, RtpPacket::Ptr>;
+    static const std::unordered_map<std::string, Handler> &handlers();
+
+    //一路媒体在本会话中的状态
+    struct Track {
+        SdpTrack info;
+        bool setup = false;
+        //tcp interleaved 的 rtp 通道号，rtcp 为其加一
+        uint8_t interleaved = 0;
+        //udp 方式的 rtp/rtcp socket
+        Socket::Ptr rtp_sock;
+        Socket::Ptr rtcp_sock;
+        //播放端: 改写后的 ssrc 和下一个序号
+        uint32_t ssrc = 0;
+        uint16_t seq = 0;
+        //播放端(udp): 按 rtcp NACK 重传
+        std::shared_ptr<NackResponder<RtxPacket> > rtx;
+        //推流端: 正在组的帧
+        RtpFrame::Ptr frame;
+    };
+
+    /**
+     * 回复请求
+     * @param headers: 额外的头部，每行以 \r\n 结尾
+    */
+    void sendResponse(const RtspRequest &req, int code, const std::string &headers = "", const std::string &content = "",
+                      const std::string &content_type = "");
+    void sendError(const RtspRequest &req, int code);
+
+    void onOptions(const RtspRequest &req);
+    void onDescribe(const RtspRequest &req);
+    void onAnnounce(const RtspRequest &req);
+    void onSetup(const RtspRequest &req);
+    void onPlayCmd(const RtspRequest &req);
+    void onPause(const RtspRequest &req);
+    void onRecord(const RtspRequest &req);
+    void onTeardown(const RtspRequest &req);
+    //GET_PARAMETER/SET_PARAMETER 等保活请求
+    void onKeepAlive(const RtspRequest &req);
+
+    //按 SETUP 的 url 找到对应的媒体
+    Track *findTrack(const std::string &url);
+    //创建一对相邻端口的 udp socket, 发往对端的 client_port
+    bool setupUdp(Track &track, uint16_t peer_rtp_port);
+
+    //收到 udp 方式的 rtcp, 目前只处理播放端的 NACK
+    void onRtcp(uint8_t index, const Buffer::Ptr &buf);
+    //推流端收到一个 rtp 包，index 为 sdp 中的序号
+    void onRtpPacket(uint8_t index, const Buffer::Ptr &buf);
+    //推流端一帧凑齐，写入 RtspMediaSource
+    void flushFrame(Track &track);
+    void onPlayReadable();
+    void sendFrame(const RtpFrame &frame);
+    void stopStream();
+
+private:
+    //发送队列超过高水位，暂停读取环形缓冲
+    bool _send_blocked = false;
+    bool _paused = false;
+    RtpTransport _transport = RTP_INVALID;
+    std::string _session_id;
+    //DESCRIBE/ANNOUNCE 的 url, SETUP 和 RTP-Info 的 url 以它为前缀
+    std::string _content_base;
+    std::string _app;
+    std::string _stream;
+    std::vector<Track> _tracks;
+    RtspMediaSource::Ptr _publish_src;
+    RtspMediaSource::Ptr _play_src;
+    std::unique_ptr<RtspMediaSource::Ring::Reader> _play_reader;
+    uint64_t _listener_id = 0;
+};
+
+}
+#endif  //__RTSP_SESSION_H__
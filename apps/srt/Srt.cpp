@@ -0,0 +1,324 @@
+#include "Srt.h"
+#include "Util/Util.h"
+#include <string.h>
+#include <random>
+
+using namespace std;
+
+namespace beton {
+
+//区间包含的序号个数
+static inline size_t rangeSize(uint32_t first, uint32_t last) {
+    return srtSeqOff(first, last) + 1;
+}
+
+uint32_t srtRandom() {
+    static thread_local std::mt19937 s_random(std::random_device{}());
+    return s_random();
+}
+
+void writeSrtControlHeader(uint8_t *p, SrtControlType type, uint32_t info, uint32_t timestamp, uint32_t dst_id) {
+    srtStore32(p, 0x80000000 | ((uint32_t)type << 16));
+    srtStore32(p + 4, info);
+    srtStore32(p + 8, timestamp);
+    srtStore32(p + 12, dst_id);
+}
+
+void writeSrtDataHeader(uint8_t *p, uint32_t seq, uint32_t flags, uint32_t msgno, uint32_t timestamp, uint32_t dst_id) {
+    srtStore32(p, seq & SRT_SEQ_MAX);
+    srtStore32(p + 4, flags | (msgno & SRT_MSGNO_MAX));
+    srtStore32(p + 8, timestamp);
+    srtStore32(p + 12, dst_id);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool SrtHandshake::parse(const uint8_t *data, size_t size) {
+    if (size < SRT_HANDSHAKE_SIZE) {
+        return false;
+    }
+    version = srtLoad32(data);
+    encryption = srtLoad16(data + 4);
+    extension = srtLoad16(data + 6);
+    isn = srtLoad32(data + 8) & SRT_SEQ_MAX;
+    mtu = srtLoad32(data + 12);
+    window = srtLoad32(data + 16);
+    type = srtLoad32(data + 20);
+    socket_id = srtLoad32(data + 24);
+    cookie = srtLoad32(data + 28);
+    memcpy(peer_ip, data + 32, sizeof(peer_ip));
+
+    have_srt_ext = false;
+    have_km = false;
+    stream_id.clear();
+    //只有 HSv5 的 conclusion 带扩展，induction 的扩展字段是魔数
+    if (version < 5 || type != SRT_HS_CONCLUSION) {
+        return true;
+    }
+    size_t pos = SRT_HANDSHAKE_SIZE;
+    while (pos + 4 <= size) {
+        uint16_t ext_type = srtLoad16(data + pos);
+        size_t ext_size = srtLoad16(data + pos + 2) * 4;
+        pos += 4;
+        if (pos + ext_size > size) {
+            return false;
+        }
+        auto ext = data + pos;
+        pos += ext_size;
+        switch (ext_type) {
+            case SRT_EXT_HSREQ:
+            case SRT_EXT_HSRSP: {
+                if (ext_size < 12) {
+                    return false;
+                }
+                have_srt_ext = true;
+                srt_version = srtLoad32(ext);
+                srt_flags = srtLoad32(ext + 4);
+                recv_latency = srtLoad16(ext + 8);
+                send_latency = srtLoad16(ext + 10);
+                break;
+            }
+            case SRT_EXT_KMREQ:
+            case SRT_EXT_KMRSP: have_km = true; break;
+            case SRT_EXT_SID: {
+                //每4个字节按小端的32位字存放
+                stream_id.resize(ext_size);
+                for (size_t i = 0; i < ext_size; i += 4) {
+                    stream_id[i] = ext[i + 3];
+                    stream_id[i + 1] = ext[i + 2];
+                    stream_id[i + 2] = ext[i + 1];
+                    stream_id[i + 3] = ext[i];
+                }
+                auto end = stream_id.find('\0');
+                if (end != string::npos) {
+                    stream_id.resize(end);
+                }
+                break;
+            }
+            default: break;
+        }
+    }
+    return true;
+}
+
+void SrtHandshake::encode(string &out, SrtExtType srt_ext_type) const {
+    uint8_t cif[SRT_HANDSHAKE_SIZE];
+    srtStore32(cif, version);
+    srtStore16(cif + 4, encryption);
+    srtStore16(cif + 6, extension);
+    srtStore32(cif + 8, isn);
+    srtStore32(cif + 12, mtu);
+    srtStore32(cif + 16, window);
+    srtStore32(cif + 20, type);
+    srtStore32(cif + 24, socket_id);
+    srtStore32(cif + 28, cookie);
+    memcpy(cif + 32, peer_ip, sizeof(peer_ip));
+    out.append((char *)cif, sizeof(cif));
+
+    if (have_srt_ext) {
+        uint8_t ext[16];
+        srtStore16(ext, srt_ext_type);
+        srtStore16(ext + 2, 3);
+        srtStore32(ext + 4, srt_version);
+        srtStore32(ext + 8, srt_flags);
+        srtStore16(ext + 12, recv_latency);
+        srtStore16(ext + 14, send_latency);
+        out.append((char *)ext, sizeof(ext));
+    }
+    if (!stream_id.empty()) {
+        size_t words = (stream_id.size() + 3) / 4;
+        uint8_t head[4];
+        srtStore16(head, SRT_EXT_SID);
+        srtStore16(head + 2, words);
+        out.append((char *)head, sizeof(head));
+        string sid = stream_id;
+        sid.resize(words * 4, '\0');
+        for (size_t i = 0; i < sid.size(); i += 4) {
+            std::swap(sid[i], sid[i + 3]);
+            std::swap(sid[i + 1], sid[i + 2]);
+        }
+        out.append(sid);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool parseSrtStreamId(const string &stream_id, SrtStreamId &out) {
+    string resource = stream_id;
+    out.publish = false;
+    if (start_with(stream_id, "#!::")) {
+        resource.clear();
+        for (auto &item : split(stream_id.substr(4), ",")) {
+            auto pos = item.find('=');
+            if (pos == string::npos) {
+                continue;
+            }
+            auto key = trim(item.substr(0, pos));
+            auto value = trim(item.substr(pos + 1));
+            if (key == "r") {
+                resource = value;
+            } else if (key == "m") {
+                if (value == "publish") {
+                    out.publish = true;
+                } else if (value != "request") {
+                    return false;
+                }
+            }
+        }
+    }
+    //r=app/stream, 多级路径时最后一级为 stream
+    auto pos = resource.rfind('/');
+    if (pos == string::npos || pos == 0 || pos + 1 == resource.size()) {
+        return false;
+    }
+    out.app = resource.substr(0, pos);
+    out.stream = resource.substr(pos + 1);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+size_t SrtLossList::lowerBound(uint32_t seq) const {
+    size_t lo = 0, hi = _ranges.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (srtSeqOff(_ranges[mid].last, seq) > 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void SrtLossList::insert(uint32_t first, uint32_t last) {
+    if (_ranges.empty() || srtSeqOff(_ranges.back().last, first) > 1) {
+        //最常见的情况: 新的丢包在所有已知丢包之后
+        _ranges.push_back(Range{first, last});
+        _count += rangeSize(first, last);
+        return;
+    }
+    if (srtSeqOff(_ranges.back().last, first) == 1) {
+        _ranges.back().last = last;
+        _count += rangeSize(first, last);
+        return;
+    }
+    //与前一个区间相邻时一起合并
+    size_t begin = lowerBound(first);
+    if (begin > 0 && srtSeqOff(_ranges[begin - 1].last, first) == 1) {
+        --begin;
+    }
+    uint32_t lo = first, hi = last;
+    size_t end = begin;
+    while (end < _ranges.size() && srtSeqOff(hi, _ranges[end].first) <= 1) {
+        auto &range = _ranges[end];
+        if (srtSeqOff(range.first, lo) > 0) {
+            lo = range.first;
+        }
+        if (srtSeqOff(hi, range.last) > 0) {
+            hi = range.last;
+        }
+        _count -= rangeSize(range.first, range.last);
+        ++end;
+    }
+    auto it = _ranges.erase(_ranges.begin() + begin, _ranges.begin() + end);
+    _ranges.insert(it, Range{lo, hi});
+    _count += rangeSize(lo, hi);
+}
+
+bool SrtLossList::remove(uint32_t seq) {
+    size_t index = lowerBound(seq);
+    if (index == _ranges.size() || srtSeqOff(seq, _ranges[index].first) > 0) {
+        return false;
+    }
+    auto &range = _ranges[index];
+    --_count;
+    if (range.first == range.last) {
+        _ranges.erase(_ranges.begin() + index);
+    } else if (range.first == seq) {
+        range.first = srtSeqAdd(seq, 1);
+    } else if (range.last == seq) {
+        range.last = srtSeqAdd(seq, -1);
+    } else {
+        Range tail{srtSeqAdd(seq, 1), range.last};
+        range.last = srtSeqAdd(seq, -1);
+        _ranges.insert(_ranges.begin() + index + 1, tail);
+    }
+    return true;
+}
+
+void SrtLossList::removeBefore(uint32_t seq) {
+    while (!_ranges.empty()) {
+        auto &range = _ranges.front();
+        if (srtSeqOff(range.last, seq) > 0) {
+            _count -= rangeSize(range.first, range.last);
+            _ranges.pop_front();
+            continue;
+        }
+        if (srtSeqOff(range.first, seq) > 0) {
+            _count -= srtSeqOff(range.first, seq);
+            range.first = seq;
+        }
+        break;
+    }
+}
+
+bool SrtLossList::popFront(uint32_t &seq) {
+    if (_ranges.empty()) {
+        return false;
+    }
+    auto &range = _ranges.front();
+    seq = range.first;
+    --_count;
+    if (range.first == range.last) {
+        _ranges.pop_front();
+    } else {
+        range.first = srtSeqAdd(range.first, 1);
+    }
+    return true;
+}
+
+bool SrtLossList::contains(uint32_t seq) const {
+    size_t index = lowerBound(seq);
+    return index < _ranges.size() && srtSeqOff(_ranges[index].first, seq) >= 0;
+}
+
+size_t makeSrtNak(const deque<SrtLossList::Range> &ranges, string &out, size_t max_size) {
+    size_t count = 0;
+    size_t size = 0;
+    for (auto &range : ranges) {
+        uint8_t words[8];
+        if (range.first == range.last) {
+            if (size + 4 > max_size) {
+                break;
+            }
+            srtStore32(words, range.first);
+            out.append((char *)words, 4);
+            size += 4;
+        } else {
+            if (size + 8 > max_size) {
+                break;
+            }
+            srtStore32(words, range.first | 0x80000000);
+            srtStore32(words + 4, range.last);
+            out.append((char *)words, 8);
+            size += 8;
+        }
+        ++count;
+    }
+    return count;
+}
+
+void parseSrtNak(const uint8_t *data, size_t size, vector<SrtLossList::Range> &ranges) {
+    for (size_t pos = 0; pos + 4 <= size; pos += 4) {
+        uint32_t word = srtLoad32(data + pos);
+        if (!(word & 0x80000000)) {
+            ranges.emplace_back(SrtLossList::Range{word, word});
+            continue;
+        }
+        if (pos + 8 > size) {
+            break;
+        }
+        pos += 4;
+        ranges.emplace_back(SrtLossList::Range{word & SRT_SEQ_MAX, srtLoad32(data + pos) & SRT_SEQ_MAX});
+    }
+}
+
+}
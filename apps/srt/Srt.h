@@ -0,0 +1,227 @@
+#ifndef __SRT_H__
+#define __SRT_H__
+
+#include "network/Buffer.h"
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace beton {
+
+#define SRT_SCHEMA "srt"
+
+//数据包和控制包的头部长度
+static constexpr size_t SRT_HEADER_SIZE = 16;
+//live 模式每个包的负载，7个 ts 包
+static constexpr size_t SRT_LIVE_PAYLOAD = 1316;
+//单个包负载的上限: 1500 MTU 减去 IP/UDP/SRT 头
+static constexpr size_t SRT_MAX_PAYLOAD = 1456;
+//握手的固定部分(CIF)长度
+static constexpr size_t SRT_HANDSHAKE_SIZE = 48;
+//包序号为31位
+static constexpr uint32_t SRT_SEQ_MAX = 0x7FFFFFFF;
+//消息号为26位
+static constexpr uint32_t SRT_MSGNO_MAX = 0x03FFFFFF;
+//HSv5 induction 回复中扩展字段的魔数
+static constexpr uint16_t SRT_HS_MAGIC = 0x4A17;
+//本实现对外声明的 srt 版本 1.5.3
+static constexpr uint32_t SRT_VERSION = 0x010503;
+
+//控制包类型
+typedef enum : uint16_t {
+    SRT_CTRL_HANDSHAKE = 0,
+    SRT_CTRL_KEEPALIVE = 1,
+    SRT_CTRL_ACK = 2,
+    SRT_CTRL_NAK = 3,
+    SRT_CTRL_CONGESTION = 4,
+    SRT_CTRL_SHUTDOWN = 5,
+    SRT_CTRL_ACKACK = 6,
+    SRT_CTRL_DROPREQ = 7,
+    SRT_CTRL_PEERERROR = 8
+}SrtControlType;
+
+//握手类型，大于等于 1000 的是拒绝原因(1000 + SrtRejectReason)
+typedef enum : uint32_t {
+    SRT_HS_WAVEAHAND = 0,
+    SRT_HS_INDUCTION = 1,
+    SRT_HS_DONE = 0xFFFFFFFD,
+    SRT_HS_AGREEMENT = 0xFFFFFFFE,
+    SRT_HS_CONCLUSION = 0xFFFFFFFF
+}SrtHandshakeType;
+
+static constexpr uint32_t SRT_HS_REJECT_BASE = 1000;
+
+//拒绝原因，小于 1000 的是协议层原因，1000 以上的是按 http 状态码定义的应用层原因
+typedef enum : uint32_t {
+    SRT_REJ_UNKNOWN = 0,
+    SRT_REJ_SYSTEM = 1,
+    SRT_REJ_PEER = 2,
+    SRT_REJ_ROGUE = 4,
+    SRT_REJ_VERSION = 9,
+    SRT_REJ_UNSECURE = 13,
+    SRT_REJX_BAD_REQUEST = 1400,
+    SRT_REJX_UNAUTHORIZED = 1401,
+    SRT_REJX_FORBIDDEN = 1403,
+    SRT_REJX_NOTFOUND = 1404,
+    SRT_REJX_BAD_MODE = 1405,
+    SRT_REJX_CONFLICT = 1409
+}SrtRejectReason;
+
+//握手扩展类型
+typedef enum : uint16_t {
+    SRT_EXT_HSREQ = 1,
+    SRT_EXT_HSRSP = 2,
+    SRT_EXT_KMREQ = 3,
+    SRT_EXT_KMRSP = 4,
+    SRT_EXT_SID = 5
+}SrtExtType;
+
+//conclusion 握手中扩展字段的标志位
+static constexpr uint16_t SRT_HS_EXT_HSREQ = 0x1;
+static constexpr uint16_t SRT_HS_EXT_KMREQ = 0x2;
+static constexpr uint16_t SRT_HS_EXT_CONFIG = 0x4;
+
+//HSREQ/HSRSP 中的能力标志
+static constexpr uint32_t SRT_OPT_TSBPDSND = 0x1;
+static constexpr uint32_t SRT_OPT_TSBPDRCV = 0x2;
+static constexpr uint32_t SRT_OPT_HAICRYPT = 0x4;
+static constexpr uint32_t SRT_OPT_TLPKTDROP = 0x8;
+static constexpr uint32_t SRT_OPT_NAKREPORT = 0x10;
+static constexpr uint32_t SRT_OPT_REXMITFLG = 0x20;
+
+//数据包第二个字对应的标志: PP=11(单独成帧的包), R(重传)
+static constexpr uint32_t SRT_PKT_SOLO = 0xC0000000;
+static constexpr uint32_t SRT_PKT_RETRANS = 0x04000000;
+
+//随机数，用于初始序号、socket id 和 cookie
+uint32_t srtRandom();
+
+//31位序号的加减和比较，b 在 a 之后时返回正数
+static inline uint32_t srtSeqAdd(uint32_t seq, int32_t n) { return (seq + n) & SRT_SEQ_MAX; }
+static inline int32_t srtSeqOff(uint32_t a, uint32_t b) { return (int32_t)((b - a) << 1) >> 1; }
+
+static inline uint16_t srtLoad16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+static inline uint32_t srtLoad32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+static inline void srtStore16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+static inline void srtStore32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+//控制包头部
+void writeSrtControlHeader(uint8_t *p, SrtControlType type, uint32_t info, uint32_t timestamp, uint32_t dst_id);
+//数据包头部，flags 为第二个字除消息号之外的位
+void writeSrtDataHeader(uint8_t *p, uint32_t seq, uint32_t flags, uint32_t msgno, uint32_t timestamp, uint32_t dst_id);
+
+/**
+ * 握手包的 CIF 及其扩展，只支持 HSv5 的 caller-listener 模式
+ * 扩展只处理 HSREQ/HSRSP 和 stream id, 不支持加密(KMREQ)
+*/
+struct SrtHandshake {
+    uint32_t version = 5;
+    uint16_t encryption = 0;
+    uint16_t extension = 0;
+    uint32_t isn = 0;
+    uint32_t mtu = 1500;
+    uint32_t window = 8192;
+    uint32_t type = SRT_HS_INDUCTION;
+    uint32_t socket_id = 0;
+    uint32_t cookie = 0;
+    //发送方看到的对端地址，本实现不使用，发送时填0
+    uint8_t peer_ip[16] = {0};
+
+    //HSREQ/HSRSP 扩展
+    bool have_srt_ext = false;
+    uint32_t srt_version = 0;
+    uint32_t srt_flags = 0;
+    //接收方向和发送方向的 TSBPD 延时(毫秒)
+    uint16_t recv_latency = 0;
+    uint16_t send_latency = 0;
+    std::string stream_id;
+    //对端是否请求了加密
+    bool have_km = false;
+
+    /**
+     * 解析握手包的 CIF(不含16字节头部)
+     * @return 长度不足或扩展格式错误时返回 false
+    */
+    bool parse(const uint8_t *data, size_t size);
+    //编码为 CIF, 追加到 out; have_srt_ext 为 true 时 srt_ext_type 决定写 HSREQ 还是 HSRSP
+    void encode(std::string &out, SrtExtType srt_ext_type = SRT_EXT_HSREQ) const;
+};
+
+/**
+ * 丢包列表，按序号顺序保存为 [first, last] 区间，连续的丢包只占一项:
+ * 接收端记录尚未收到的包，发送端记录对端请求重传的包
+ * 新的丢包大多追加在末尾(O(1)), 迟到的包大多在头部，中间插入和删除需要移动 deque
+*/
+class SrtLossList {
+public:
+    struct Range {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    //插入 [first, last], 与已有区间合并
+    void insert(uint32_t first, uint32_t last);
+    void insert(uint32_t seq) { insert(seq, seq); }
+    //移除一个序号，可能把区间拆成两个; 返回是否存在
+    bool remove(uint32_t seq);
+    //移除所有在 seq 之前的序号(不含 seq)
+    void removeBefore(uint32_t seq);
+    //取出最早的一个序号，列表为空时返回 false
+    bool popFront(uint32_t &seq);
+    bool contains(uint32_t seq) const;
+
+    bool empty() const { return _ranges.empty(); }
+    //丢包总数
+    size_t size() const { return _count; }
+    const std::deque<Range> &ranges() const { return _ranges; }
+    const Range &front() const { return _ranges.front(); }
+    void clear() {
+        _ranges.clear();
+        _count = 0;
+    }
+
+private:
+    //第一个 last 不在 seq 之前的区间的下标
+    size_t lowerBound(uint32_t seq) const;
+
+private:
+    size_t _count = 0;
+    std::deque<Range> _ranges;
+};
+
+//stream id 中的流信息
+struct SrtStreamId {
+    std::string app;
+    std::string stream;
+    //推流(m=publish)还是播放(m=request, 默认)
+    bool publish = false;
+};
+
+/**
+ * 解析 stream id, 支持 access control 格式 "#!::r=app/stream,m=publish" 和直接写 "app/stream"
+ * @return 没有 app 或 stream、或者 m 不是 request/publish 时返回 false
+*/
+bool parseSrtStreamId(const std::string &stream_id, SrtStreamId &out);
+
+/**
+ * 把丢包区间编码为 NAK 的 CIF: 单个序号占一个字，区间为 first|0x80000000 加 last 两个字
+ * @param max_size: CIF 长度上限，超出的区间留到下次
+ * @return 编码的区间个数
+*/
+size_t makeSrtNak(const std::deque<SrtLossList::Range> &ranges, std::string &out, size_t max_size = SRT_MAX_PAYLOAD);
+//解析 NAK 的 CIF
+void parseSrtNak(const uint8_t *data, size_t size, std::vector<SrtLossList::Range> &ranges);
+
+}
+#endif  //__SRT_H__
@@ -0,0 +1,68 @@
+#include "SrtCaller.h"
+#include "Util/Logger.h"
+
+using namespace std;
+
+namespace beton {
+
+SrtCaller::SrtCaller(const SrtConfig &config, const PollerThread::Ptr &poller) : UdpClient(poller), SrtTransport(true, config) {}
+
+SrtCaller::~SrtCaller() {
+    if (_timer) {
+        _timer->cancel();
+    }
+}
+
+bool SrtCaller::startCaller(const string &peer_ip, uint16_t peer_port, uint16_t local_port) {
+    if (!startConnect(peer_ip, peer_port, local_port)) {
+        return false;
+    }
+    weak_ptr<SrtCaller> weak_self = static_pointer_cast<SrtCaller>(shared_from_this());
+    getPoller()->async([weak_self]() {
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            strong_self->startHandshake();
+        }
+    });
+    return true;
+}
+
+void SrtCaller::onRecv(const Buffer::Ptr &buf) {
+    onSrtPacket(buf);
+}
+
+void SrtCaller::onError(const SockException &ex) {
+    if (_timer) {
+        _timer->cancel();
+        _timer = nullptr;
+    }
+    if (!closed()) {
+        //socket 错误，比如对端端口不可达
+        closeSrt();
+        onSrtClose(ex);
+    }
+}
+
+void SrtCaller::onSrtSend(vector<Buffer::Ptr> bufs) {
+    send(std::move(bufs));
+}
+
+void SrtCaller::onSrtWakeup(uint32_t delay_ms) {
+    if (_timer) {
+        _timer->cancel();
+    }
+    weak_ptr<SrtCaller> weak_self = static_pointer_cast<SrtCaller>(shared_from_this());
+    _timer = getPoller()->doDelayTask(std::max<uint32_t>(delay_ms, 1), [weak_self]() -> uint64_t {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return 0;
+        }
+        auto next = strong_self->onSrtTimer();
+        if (!next) {
+            strong_self->_timer = nullptr;
+        }
+        return next;
+    });
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef __SRT_CALLER_H__
+#define __SRT_CALLER_H__
+
+#include "network/UdpClient.h"
+#include "SrtTransport.h"
+
+namespace beton {
+
+/**
+ * srt 客户端(caller), 用已 connect 的 udp socket 连接 listener, 用于拉流或推流到其他 srt 服务器
+ * 继承后实现 onSrtData/onSrtClose, 按需实现 onSrtConnected; 所有回调都在 socket 所属的 poller 线程执行
+*/
+class SrtCaller : public UdpClient, public SrtTransport {
+public:
+    using Ptr = std::shared_ptr<SrtCaller>;
+
+    /**
+     * @param config: 握手参数，推流或播放由其中的 stream_id 决定
+    */
+    SrtCaller(const SrtConfig &config = SrtConfig(), const PollerThread::Ptr &poller = nullptr);
+    ~SrtCaller() override;
+
+    /**
+     * 绑定本地端口并开始握手，结果通过 onSrtConnected/onSrtClose 通知
+     * @return 地址无效或绑定失败时返回 false
+    */
+    bool startCaller(const std::string &peer_ip, uint16_t peer_port, uint16_t local_port = 0);
+
+    void onRecv(const Buffer::Ptr &buf) override;
+    void onError(const SockException &ex) override;
+
+protected:
+    void onSrtSend(std::vector<Buffer::Ptr> bufs) override;
+    void onSrtWakeup(uint32_t delay_ms) override;
+
+private:
+    PollerThread::DelayTask::Ptr _timer;
+};
+
+}
+#endif  //__SRT_CALLER_H__
@@ -0,0 +1,21 @@
+#include "SrtMediaSource.h"
+
+using namespace std;
+
+namespace beton {
+
+SrtMediaSource::SrtMediaSource(const string &vhost, const string &app, const string &stream, size_t ring_size)
+    : MediaSource(SRT_SCHEMA, vhost, app, stream) {
+    _ring = std::make_shared<Ring>(ring_size);
+}
+
+SrtMediaSource::Ptr SrtMediaSource::find(const string &vhost, const string &app, const string &stream) {
+    return dynamic_pointer_cast<SrtMediaSource>(MediaSource::find(SRT_SCHEMA, vhost, app, stream));
+}
+
+void SrtMediaSource::onWrite(const Buffer::Ptr &payload) {
+    _ring->write(payload, true);
+    notifyReaders();
+}
+
+}
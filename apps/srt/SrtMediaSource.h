@@ -0,0 +1,36 @@
+#ifndef __SRT_MEDIA_SOURCE_H__
+#define __SRT_MEDIA_SOURCE_H__
+
+#include "media/MediaSource.h"
+#include "Util/RingBuffer.h"
+#include "Srt.h"
+
+namespace beton {
+
+/**
+ * srt 流，推流端交付的负载(通常是7个 ts 包)原样写入环形缓冲，所有播放端共用
+ * 不解析 ts, 每个负载都可以作为起播点，播放端从 PAT/PMT 和下一个关键帧开始解码
+*/
+class SrtMediaSource : public MediaSource {
+public:
+    using Ptr = std::shared_ptr<SrtMediaSource>;
+    using Ring = RingBuffer<Buffer::Ptr>;
+
+    /**
+     * @param ring_size: 环形缓冲的包数，决定了播放端最多可以落后多少
+    */
+    SrtMediaSource(const std::string &vhost, const std::string &app, const std::string &stream, size_t ring_size = 8192);
+
+    static Ptr find(const std::string &vhost, const std::string &app, const std::string &stream);
+
+    //写入一个负载，只能在推流端所在线程调用
+    void onWrite(const Buffer::Ptr &payload);
+
+    const Ring::Ptr &getRing() const { return _ring; }
+
+private:
+    Ring::Ptr _ring;
+};
+
+}
+#endif  //__SRT_MEDIA_SOURCE_H__
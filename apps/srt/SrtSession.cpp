@@ -0,0 +1,165 @@
+#include "SrtSession.h"
+#include "Util/Logger.h"
+
+using namespace std;
+
+namespace beton {
+
+SrtSession::SrtSession(const Socket::Ptr &sock) : Session(sock), SrtTransport(false) {
+    DebugL << "new srt session from " << get_peer_ip() << ":" << get_peer_port();
+}
+
+SrtSession::~SrtSession() {
+    stopStream();
+    if (_timer) {
+        _timer->cancel();
+    }
+    DebugL << "srt session destroyed, " << _app << "/" << _stream;
+}
+
+void SrtSession::onRecv(const Buffer::Ptr &buf) {
+    onSrtPacket(buf);
+}
+
+void SrtSession::onError(const SockException &ex) {
+    DebugL << "srt session " << _app << "/" << _stream << " closed: " << ex;
+    stopStream();
+    if (_timer) {
+        _timer->cancel();
+        _timer = nullptr;
+    }
+}
+
+void SrtSession::onSrtSend(vector<Buffer::Ptr> bufs) {
+    send(std::move(bufs));
+}
+
+uint32_t SrtSession::onSrtHandshake(const string &stream_id) {
+    SrtStreamId id;
+    if (!parseSrtStreamId(stream_id, id)) {
+        WarnL << "srt session " << get_peer_ip() << " with invalid stream id: " << stream_id;
+        return SRT_REJX_BAD_REQUEST;
+    }
+    _app = id.app;
+    _stream = id.stream;
+    if (id.publish) {
+        if (!onPublish(_app, _stream)) {
+            return SRT_REJX_FORBIDDEN;
+        }
+        auto src = std::make_shared<SrtMediaSource>(DEFAULT_VHOST, _app, _stream);
+        if (!src->regist()) {
+            WarnL << "srt publish " << _app << "/" << _stream << " rejected, stream already exists";
+            return SRT_REJX_CONFLICT;
+        }
+        _publish_src = src;
+        InfoL << "srt publish " << _publish_src->url();
+        return 0;
+    }
+    auto src = SrtMediaSource::find(DEFAULT_VHOST, _app, _stream);
+    if (!src) {
+        return SRT_REJX_NOTFOUND;
+    }
+    if (!onPlay(_app, _stream)) {
+        return SRT_REJX_FORBIDDEN;
+    }
+    _play_src = src;
+    return 0;
+}
+
+void SrtSession::onSrtConnected() {
+    if (!_play_src) {
+        return;
+    }
+    InfoL << "srt play " << _play_src->url() << ", latency " << latencyMs() << "ms";
+    //ts 流没有 GOP 缓存，从最新的负载开始
+    _play_reader.reset(new SrtMediaSource::Ring::Reader(_play_src->getRing()));
+    weak_ptr<SrtSession> weak_self = static_pointer_cast<SrtSession>(shared_from_this());
+    _listener_id = _play_src->addListener(getPoller(), [weak_self]() {
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            strong_self->onPlayReadable();
+        }
+    });
+}
+
+void SrtSession::onSrtData(const Buffer::Ptr &payload) {
+    if (_publish_src) {
+        _publish_src->onWrite(payload);
+    }
+}
+
+void SrtSession::onSrtClose(const SockException &ex) {
+    //握手被拒时 reject 包还在发送队列里
+    flush();
+    shutdown(ex);
+}
+
+void SrtSession::onSrtWakeup(uint32_t delay_ms) {
+    if (_timer) {
+        _timer->cancel();
+    }
+    weak_ptr<SrtSession> weak_self = static_pointer_cast<SrtSession>(shared_from_this());
+    _timer = getPoller()->doDelayTask(std::max<uint32_t>(delay_ms, 1), [weak_self]() -> uint64_t {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return 0;
+        }
+        auto next = strong_self->onSrtTimer();
+        if (!next) {
+            strong_self->_timer = nullptr;
+        }
+        return next;
+    });
+}
+
+void SrtSession::onPlayReadable() {
+    if (!_play_reader || !connected()) {
+        return;
+    }
+    //先取关闭标记，关闭前写入的负载在下面都能读到
+    bool closed = _play_src->closed();
+    auto &ring = _play_reader->ring();
+    Buffer::Ptr payload;
+    while (true) {
+        int ret = _play_reader->lag() > ring->capacity() / 2 ? -1 : _play_reader->read(payload);
+        if (ret == 0) {
+            break;
+        }
+        if (ret < 0) {
+            auto skipped = _play_reader->skipToKeyFrame();
+            WarnL_EVERY_MS(5000) << "srt player " << get_peer_ip() << " of " << _play_src->url() << " is too slow, skipped "
+                                 << skipped << " packets";
+            continue;
+        }
+        //发送缓冲满时丢掉，live 模式下晚到的数据没有意义
+        sendData(payload);
+    }
+    if (closed) {
+        InfoL << "srt play " << _play_src->url() << " ended, publisher left";
+        closeSession(SockException(0, "publisher left", Err_Eof));
+    }
+}
+
+void SrtSession::stopStream() {
+    if (_publish_src) {
+        InfoL << "srt publish stopped " << _publish_src->url();
+        _publish_src->close();
+        _publish_src = nullptr;
+    }
+    if (_play_src) {
+        _play_src->removeListener(getPoller(), _listener_id);
+        _play_src = nullptr;
+        _play_reader = nullptr;
+        _listener_id = 0;
+    }
+}
+
+void SrtSession::closeSession(const SockException &ex) {
+    stopStream();
+    closeSrt();
+    //shutdown 会清空发送队列，先把 SHUTDOWN 包写出去
+    flush();
+    shutdown(ex);
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef __SRT_SESSION_H__
+#define __SRT_SESSION_H__
+
+#include "network/Session.h"
+#include "SrtTransport.h"
+#include "SrtMediaSource.h"
+
+namespace beton {
+
+/**
+ * srt 服务端(listener)会话，由 UdpServer 以会话模式创建，每个对端一个会话:
+ * 1. 会话固定在一个 poller 上，收发、定时器和 SrtTransport 的状态都只在该线程访问，不加锁
+ * 2. 收到的报文直接交给 SrtTransport, 发出的报文在 poller 本轮结束时由 sendmmsg 批量发出
+ * 3. 按 stream id 推流(m=publish)或播放: 推流时按 TSBPD 交付的负载写入 SrtMediaSource,
+ *    播放时读取环形缓冲，所有播放端共用同一份负载，只是各自写16字节的包头
+*/
+class SrtSession : public Session, public SrtTransport {
+public:
+    using Ptr = std::shared_ptr<SrtSession>;
+
+    SrtSession(const Socket::Ptr &sock);
+    ~SrtSession() override;
+
+    void onRecv(const Buffer::Ptr &buf) override;
+    void onError(const SockException &ex) override;
+
+    const std::string &app() const { return _app; }
+    const std::string &streamName() const { return _stream; }
+
+protected:
+    void onSrtSend(std::vector<Buffer::Ptr> bufs) override;
+    uint32_t onSrtHandshake(const std::string &stream_id) override;
+    void onSrtConnected() override;
+    void onSrtData(const Buffer::Ptr &payload) override;
+    void onSrtClose(const SockException &ex) override;
+    void onSrtWakeup(uint32_t delay_ms) override;
+
+    //推流/播放鉴权，返回 false 时拒绝握手
+    virtual bool onPublish(const std::string &app, const std::string &stream) { return true; }
+    virtual bool onPlay(const std::string &app, const std::string &stream) { return true; }
+
+private:
+    void onPlayReadable();
+    void stopStream();
+    //通知对端后断开
+    void closeSession(const SockException &ex);
+
+private:
+    std::string _app;
+    std::string _stream;
+    PollerThread::DelayTask::Ptr _timer;
+    SrtMediaSource::Ptr _publish_src;
+    SrtMediaSource::Ptr _play_src;
+    std::unique_ptr<SrtMediaSource::Ring::Reader> _play_reader;
+    uint64_t _listener_id = 0;
+};
+
+}
+#endif  //__SRT_SESSION_H__
@@ -0,0 +1,785 @@
+#include "SrtTransport.h"
+#include "Util/Logger.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace beton {
+
+//caller 握手的重试间隔和握手超时
+static constexpr uint64_t s_hs_retry_us = 250 * 1000;
+static constexpr uint64_t s_hs_timeout_us = 3000 * 1000;
+//完整 ACK 的间隔
+static constexpr uint64_t s_ack_interval_us = 10 * 1000;
+//周期性 NAK 的最短间隔
+static constexpr uint64_t s_min_nak_interval_us = 20 * 1000;
+//没有其他包要发时的保活间隔
+static constexpr uint64_t s_keepalive_us = 1000 * 1000;
+//发送端丢弃的最短等待，超过 max(延时, 1s) + 20ms 仍未确认的包不再重传
+static constexpr uint64_t s_min_drop_us = 1000 * 1000;
+static constexpr uint64_t s_drop_margin_us = 20 * 1000;
+//每个包在链路上的额外开销(IPv4 + UDP 头)
+static constexpr size_t s_udp_overhead = 28;
+//自动限速: 估算输入码率的周期，还没有估算值时的速率和速率下限(字节/秒)
+static constexpr uint64_t s_rate_period_us = 500 * 1000;
+static constexpr uint64_t s_init_pace_rate = 30 * 1000 * 1000 / 8;
+static constexpr uint64_t s_min_pace_rate = 10 * 1000 * 1000 / 8;
+//令牌桶的容量，允许的突发为几毫秒的发送量
+static constexpr uint64_t s_pace_burst_us = 4000;
+//接收速率的统计周期
+static constexpr uint64_t s_recv_rate_period_us = 1000 * 1000;
+
+SrtTransport::SrtTransport(bool caller, const SrtConfig &config) : _caller(caller), _config(config) {
+    _socket_id = (srtRandom() & 0x3FFFFFFF) | 1;
+    if (_caller) {
+        _stream_id = _config.stream_id;
+    } else {
+        _cookie = srtRandom();
+    }
+    size_t size = 64;
+    while (size < _config.window && size < 0x100000) {
+        size <<= 1;
+    }
+    _mask = size - 1;
+    _start_us = nowUs();
+}
+
+uint64_t SrtTransport::nowUs() const {
+    return getCurrentMicroSecond();
+}
+
+void SrtTransport::wakeupAt(uint64_t when_us) {
+    //onSrtTimer 执行期间 _wakeup_us 为0, 结束时统一计算下次时间
+    if (when_us >= _wakeup_us) {
+        return;
+    }
+    _wakeup_us = when_us;
+    auto now = nowUs();
+    onSrtWakeup(when_us > now ? (uint32_t)std::min<uint64_t>((when_us - now + 999) / 1000, UINT32_MAX) : 0);
+}
+
+void SrtTransport::startHandshake() {
+    if (!_caller || _state != State_Init) {
+        return;
+    }
+    _isn = srtRandom() & SRT_SEQ_MAX;
+    _state = State_Induction;
+    _hs_start_us = nowUs();
+    sendCallerHandshake(_hs_start_us);
+    wakeupAt(_hs_next_us);
+}
+
+void SrtTransport::onSrtPacket(const Buffer::Ptr &buf) {
+    if (_state == State_Closed || buf->size() < SRT_HEADER_SIZE) {
+        return;
+    }
+    auto data = (const uint8_t *)buf->data();
+    auto now = nowUs();
+    if (_state == State_Connected) {
+        //对端重发的 conclusion 目标 socket id 仍为0
+        bool handshake = (data[0] & 0x80) && (srtLoad16(data) & 0x7FFF) == SRT_CTRL_HANDSHAKE;
+        if (srtLoad32(data + 12) != _socket_id && !handshake) {
+            //不是发给本连接的包
+            return;
+        }
+        _last_recv_us = now;
+    } else if (!_caller && !_hs_start_us) {
+        //listener 收到第一个包，开始计算握手超时
+        _hs_start_us = now;
+        wakeupAt(now + s_hs_timeout_us);
+    }
+    if (data[0] & 0x80) {
+        onControl(data, buf->size(), now);
+    } else {
+        onData(buf, now);
+    }
+}
+
+void SrtTransport::onControl(const uint8_t *data, size_t size, uint64_t now_us) {
+    auto type = srtLoad16(data) & 0x7FFF;
+    auto info = srtLoad32(data + 4);
+    auto cif = data + SRT_HEADER_SIZE;
+    auto cif_size = size - SRT_HEADER_SIZE;
+    if (type == SRT_CTRL_HANDSHAKE) {
+        SrtHandshake hs;
+        if (hs.parse(cif, cif_size)) {
+            onHandshake(hs, srtLoad32(data + 8), now_us);
+        }
+        return;
+    }
+    if (_state != State_Connected) {
+        return;
+    }
+    switch (type) {
+        case SRT_CTRL_ACK: onAck(info, cif, cif_size, now_us); break;
+        case SRT_CTRL_NAK: onNak(cif, cif_size, now_us); break;
+        case SRT_CTRL_ACKACK: onAckAck(info, now_us); break;
+        case SRT_CTRL_DROPREQ: onDropReq(cif, cif_size); break;
+        case SRT_CTRL_SHUTDOWN: onClose(SockException(ECONNRESET, "srt peer shutdown", Err_Eof)); break;
+        default: break;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SrtTransport::onHandshake(const SrtHandshake &hs, uint32_t pkt_ts, uint64_t now_us) {
+    if (_caller) {
+        onCallerHandshake(hs, pkt_ts, now_us);
+    } else {
+        onListenerHandshake(hs, pkt_ts, now_us);
+    }
+}
+
+void SrtTransport::onCallerHandshake(const SrtHandshake &hs, uint32_t pkt_ts, uint64_t now_us) {
+    if (_state != State_Induction && _state != State_Conclusion) {
+        return;
+    }
+    if (hs.type >= SRT_HS_REJECT_BASE && hs.type < SRT_HS_AGREEMENT) {
+        onClose(SockException(ECONNREFUSED, "srt handshake rejected: " + to_string(hs.type - SRT_HS_REJECT_BASE),
+                              Err_Refuse));
+        return;
+    }
+    if (_state == State_Induction && hs.type == SRT_HS_INDUCTION) {
+        if (hs.version < 5 || hs.extension != SRT_HS_MAGIC) {
+            onClose(SockException(EPROTO, "srt listener does not support HSv5", Err_Other));
+            return;
+        }
+        _cookie = hs.cookie;
+        _state = State_Conclusion;
+        sendCallerHandshake(now_us);
+        return;
+    }
+    if (_state == State_Conclusion && hs.type == SRT_HS_CONCLUSION) {
+        if (hs.encryption || hs.have_km) {
+            onClose(SockException(EPROTO, "srt encryption is not supported", Err_Other));
+            return;
+        }
+        _peer_id = hs.socket_id;
+        onConnected(_isn, hs.have_srt_ext ? std::max(hs.recv_latency, hs.send_latency) : 0, pkt_ts, now_us);
+    }
+}
+
+void SrtTransport::onListenerHandshake(const SrtHandshake &hs, uint32_t pkt_ts, uint64_t now_us) {
+    if (hs.type == SRT_HS_INDUCTION) {
+        if (_state != State_Init) {
+            return;
+        }
+        SrtHandshake rsp;
+        rsp.version = 5;
+        rsp.extension = SRT_HS_MAGIC;
+        rsp.isn = hs.isn;
+        rsp.mtu = hs.mtu;
+        rsp.window = _config.window;
+        rsp.type = SRT_HS_INDUCTION;
+        rsp.socket_id = _socket_id;
+        rsp.cookie = _cookie;
+        sendHandshake(rsp, hs.socket_id);
+        return;
+    }
+    if (hs.type != SRT_HS_CONCLUSION) {
+        return;
+    }
+    if (_state == State_Connected) {
+        if (hs.socket_id == _peer_id && _hs_response) {
+            //对端没有收到回复
+            onSrtSend(vector<Buffer::Ptr>{_hs_response});
+        }
+        return;
+    }
+    if (_state != State_Init) {
+        return;
+    }
+    if (hs.cookie != _cookie) {
+        //可能是伪造源地址的包，不关闭，等正确的 conclusion
+        sendReject(hs, SRT_REJ_ROGUE);
+        return;
+    }
+    if (hs.version < 5 || !hs.have_srt_ext) {
+        sendReject(hs, SRT_REJ_VERSION);
+        onClose(SockException(EPROTO, "srt caller does not support HSv5", Err_Other));
+        return;
+    }
+    if (hs.encryption || hs.have_km) {
+        sendReject(hs, SRT_REJ_UNSECURE);
+        onClose(SockException(EPROTO, "srt encryption is not supported", Err_Other));
+        return;
+    }
+    _stream_id = hs.stream_id;
+    auto reason = onSrtHandshake(_stream_id);
+    if (_state == State_Closed) {
+        return;
+    }
+    if (reason) {
+        sendReject(hs, reason);
+        onClose(SockException(ECONNREFUSED, "srt handshake rejected: " + to_string(reason), Err_Refuse));
+        return;
+    }
+    _peer_id = hs.socket_id;
+    uint16_t latency = std::max<uint16_t>(_config.latency_ms, std::max(hs.recv_latency, hs.send_latency));
+
+    SrtHandshake rsp;
+    rsp.version = 5;
+    rsp.extension = SRT_HS_EXT_HSREQ;
+    rsp.isn = hs.isn;
+    rsp.mtu = hs.mtu;
+    rsp.window = _config.window;
+    rsp.type = SRT_HS_CONCLUSION;
+    rsp.socket_id = _socket_id;
+    rsp.cookie = hs.cookie;
+    rsp.have_srt_ext = true;
+    rsp.srt_version = SRT_VERSION;
+    rsp.srt_flags = SRT_OPT_TSBPDSND | SRT_OPT_TSBPDRCV | SRT_OPT_TLPKTDROP | SRT_OPT_NAKREPORT | SRT_OPT_REXMITFLG;
+    rsp.recv_latency = latency;
+    rsp.send_latency = latency;
+    string out(SRT_HEADER_SIZE, '\0');
+    rsp.encode(out, SRT_EXT_HSRSP);
+    writeSrtControlHeader((uint8_t *)&out[0], SRT_CTRL_HANDSHAKE, 0, timestamp(now_us), _peer_id);
+    _hs_response = std::make_shared<BufferString>(std::move(out));
+    onSrtSend(vector<Buffer::Ptr>{_hs_response});
+    onConnected(hs.isn, latency, pkt_ts, now_us);
+}
+
+void SrtTransport::sendCallerHandshake(uint64_t now_us) {
+    SrtHandshake hs;
+    hs.isn = _isn;
+    hs.window = _config.window;
+    hs.socket_id = _socket_id;
+    if (_state == State_Induction) {
+        hs.version = 4;
+        //UDT 的 SOCK_DGRAM
+        hs.extension = 2;
+        hs.type = SRT_HS_INDUCTION;
+    } else {
+        hs.version = 5;
+        hs.extension = SRT_HS_EXT_HSREQ | (_config.stream_id.empty() ? 0 : SRT_HS_EXT_CONFIG);
+        hs.type = SRT_HS_CONCLUSION;
+        hs.cookie = _cookie;
+        hs.have_srt_ext = true;
+        hs.srt_version = SRT_VERSION;
+        hs.srt_flags = SRT_OPT_TSBPDSND | SRT_OPT_TSBPDRCV | SRT_OPT_TLPKTDROP | SRT_OPT_NAKREPORT | SRT_OPT_REXMITFLG;
+        hs.recv_latency = _config.latency_ms;
+        hs.send_latency = _config.latency_ms;
+        hs.stream_id = _config.stream_id;
+    }
+    //握手期间目标 socket id 为0
+    sendHandshake(hs, 0);
+    _hs_next_us = now_us + s_hs_retry_us;
+}
+
+void SrtTransport::sendHandshake(const SrtHandshake &hs, uint32_t dst_id, SrtExtType srt_ext_type) {
+    string out(SRT_HEADER_SIZE, '\0');
+    hs.encode(out, srt_ext_type);
+    auto now = nowUs();
+    writeSrtControlHeader((uint8_t *)&out[0], SRT_CTRL_HANDSHAKE, 0, timestamp(now), dst_id);
+    _last_send_us = now;
+    onSrtSend(vector<Buffer::Ptr>{std::make_shared<BufferString>(std::move(out))});
+}
+
+void SrtTransport::sendReject(const SrtHandshake &req, uint32_t reason) {
+    SrtHandshake rsp;
+    rsp.version = 5;
+    rsp.isn = req.isn;
+    rsp.mtu = req.mtu;
+    rsp.window = _config.window;
+    rsp.type = SRT_HS_REJECT_BASE + reason;
+    rsp.socket_id = _socket_id;
+    rsp.cookie = req.cookie;
+    sendHandshake(rsp, req.socket_id);
+}
+
+void SrtTransport::onConnected(uint32_t isn, uint32_t peer_latency_ms, uint32_t pkt_ts, uint64_t now_us) {
+    _state = State_Connected;
+    _latency_us = std::max<uint32_t>(_config.latency_ms, peer_latency_ms) * 1000;
+    _snd_slots.resize(_mask + 1);
+    _rcv_slots.resize(_mask + 1);
+    _snd_una = _snd_cur = _snd_next = isn;
+    _rcv_base = _rcv_next = _last_ack_seq = isn;
+    _peer_window = _mask + 1;
+    //对端时间戳以握手包为准对齐到本地时钟，单程时延计入延时之内
+    _tsbpd_base_us = now_us - pkt_ts;
+    _last_peer_ts = pkt_ts;
+    _last_recv_us = now_us;
+    _ack_next_us = now_us + s_ack_interval_us;
+    _nak_next_us = now_us;
+    _rate_start_us = now_us;
+    _input_start_us = now_us;
+    _pace_rate = _config.max_bw ? _config.max_bw : s_init_pace_rate;
+    _pace_us = now_us;
+    _pace_tokens = 0;
+    DebugL << "srt " << (_caller ? "caller" : "listener") << " connected, socket id " << _socket_id << ", peer "
+           << _peer_id << ", latency " << _latency_us / 1000 << "ms, stream id: " << _stream_id;
+    onSrtConnected();
+    if (_state == State_Connected) {
+        wakeupAt(_ack_next_us);
+    }
+}
+
+void SrtTransport::onClose(const SockException &ex) {
+    if (_state == State_Closed) {
+        return;
+    }
+    _state = State_Closed;
+    _snd_slots.clear();
+    _rcv_slots.clear();
+    _snd_loss.clear();
+    _rcv_loss.clear();
+    onSrtClose(ex);
+}
+
+void SrtTransport::closeSrt() {
+    if (_state == State_Connected) {
+        uint8_t cif[4] = {0};
+        sendControl(SRT_CTRL_SHUTDOWN, 0, cif, sizeof(cif));
+    }
+    _state = State_Closed;
+    _snd_slots.clear();
+    _rcv_slots.clear();
+    _snd_loss.clear();
+    _rcv_loss.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+uint64_t SrtTransport::onSrtTimer() {
+    if (_state == State_Closed) {
+        return 0;
+    }
+    auto now = nowUs();
+    //处理期间不再要求使用者唤醒
+    _wakeup_us = 0;
+    if (_state != State_Connected) {
+        if (_hs_start_us && now - _hs_start_us > s_hs_timeout_us) {
+            onClose(SockException(ETIMEDOUT, "srt handshake timeout", Err_Timeout));
+            return 0;
+        }
+        if (_caller && now >= _hs_next_us) {
+            sendCallerHandshake(now);
+        }
+        _wakeup_us = std::max(std::min(_caller ? _hs_next_us : UINT64_MAX, _hs_start_us + s_hs_timeout_us), now + 1);
+        return (_wakeup_us - now + 999) / 1000;
+    }
+
+    if (now - _last_recv_us > _config.peer_idle_ms * 1000ULL) {
+        onClose(SockException(ETIMEDOUT, "srt peer idle timeout", Err_Timeout));
+        return 0;
+    }
+    deliver(now);
+    if (_state != State_Connected) {
+        //上层在交付回调中关闭了连接
+        return 0;
+    }
+    dropSendTimeout(now);
+    updateRate(now);
+    sendPending(now);
+    if (now >= _ack_next_us) {
+        sendAck(now);
+        _ack_next_us = now + s_ack_interval_us;
+    }
+    if (!_rcv_loss.empty() && now >= _nak_next_us) {
+        sendNak(_rcv_loss.ranges());
+        _nak_next_us = now + std::max<uint64_t>(s_min_nak_interval_us, (_rtt_us + 4 * _rtt_var_us) / 2);
+    }
+    if (now - _last_send_us >= s_keepalive_us) {
+        uint8_t cif[4] = {0};
+        sendControl(SRT_CTRL_KEEPALIVE, 0, cif, sizeof(cif));
+    }
+    _wakeup_us = std::max(nextDeadline(now), now + 1);
+    return (_wakeup_us - now + 999) / 1000;
+}
+
+uint64_t SrtTransport::nextDeadline(uint64_t now_us) const {
+    uint64_t next = std::min(_ack_next_us, _pace_wait_us);
+    if (!_rcv_loss.empty()) {
+        next = std::min(next, _nak_next_us);
+    }
+    if (_rcv_base != _rcv_next) {
+        //队头的包, 或者队头丢包之后的第一个包的交付时间
+        auto &head = _rcv_slots[_rcv_base & _mask];
+        if (head.payload) {
+            next = std::min(next, playTime(head));
+        } else if (!_rcv_loss.empty() && _rcv_loss.front().first == _rcv_base) {
+            auto &after = _rcv_slots[srtSeqAdd(_rcv_loss.front().last, 1) & _mask];
+            if (after.payload && _config.too_late_drop) {
+                next = std::min(next, playTime(after));
+            }
+        } else {
+            next = now_us;
+        }
+    }
+    return next;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool SrtTransport::sendData(const Buffer::Ptr &payload) {
+    if (_state != State_Connected || !payload || payload->size() > SRT_MAX_PAYLOAD) {
+        return false;
+    }
+    if ((size_t)srtSeqOff(_snd_una, _snd_next) > _mask) {
+        WarnL_EVERY_MS(5000) << "srt send buffer of socket " << _socket_id << " is full";
+        return false;
+    }
+    auto now = nowUs();
+    auto &slot = sendSlot(_snd_next);
+    slot.payload = payload;
+    slot.timestamp = timestamp(now);
+    slot.msgno = _msgno;
+    slot.origin_us = now;
+    slot.resent_us = 0;
+    _msgno = _msgno >= SRT_MSGNO_MAX ? 1 : _msgno + 1;
+    _snd_next = srtSeqAdd(_snd_next, 1);
+    _input_bytes += SRT_HEADER_SIZE + payload->size() + s_udp_overhead;
+    sendPending(now);
+    return true;
+}
+
+void SrtTransport::sendPending(uint64_t now_us) {
+    if (_pace_rate) {
+        _pace_tokens += (int64_t)((now_us - _pace_us) * _pace_rate / 1000000);
+        _pace_us = now_us;
+        auto burst = (int64_t)std::max<uint64_t>(_pace_rate * s_pace_burst_us / 1000000, 2 * 1500);
+        _pace_tokens = std::min(_pace_tokens, burst);
+    }
+    _pace_wait_us = UINT64_MAX;
+    while (_pace_tokens > 0) {
+        uint32_t seq;
+        if (_snd_loss.popFront(seq)) {
+            //已确认、已丢弃或还没发出过的序号不重传
+            if (srtSeqOff(_snd_una, seq) < 0 || srtSeqOff(seq, _snd_cur) <= 0) {
+                continue;
+            }
+            auto &slot = sendSlot(seq);
+            if (!slot.payload || (slot.resent_us && now_us - slot.resent_us < _rtt_us)) {
+                continue;
+            }
+            slot.resent_us = now_us;
+            sendPacket(seq, true, now_us);
+            ++_stats.retransmitted;
+            continue;
+        }
+        if (_snd_cur == _snd_next || (uint32_t)srtSeqOff(_snd_una, _snd_cur) >= _peer_window) {
+            //没有新包，或者对端的接收缓冲已满，等 ACK
+            return;
+        }
+        sendPacket(_snd_cur, false, now_us);
+        _snd_cur = srtSeqAdd(_snd_cur, 1);
+        ++_stats.sent;
+    }
+    if ((!_snd_loss.empty() || _snd_cur != _snd_next) && _pace_rate) {
+        //欠下的令牌补足之后再发
+        _pace_wait_us = now_us + (1 - _pace_tokens) * 1000000 / _pace_rate + 1;
+        wakeupAt(_pace_wait_us);
+    }
+}
+
+void SrtTransport::sendPacket(uint32_t seq, bool retransmit, uint64_t now_us) {
+    auto &slot = sendSlot(seq);
+    //头部单独申请: 重传时原来的头部可能还在 socket 的发送队列里
+    auto header = BufferRaw::create(SRT_HEADER_SIZE, SRT_HEADER_SIZE);
+    writeSrtDataHeader((uint8_t *)header->data(), seq, SRT_PKT_SOLO | (retransmit ? SRT_PKT_RETRANS : 0), slot.msgno,
+                       slot.timestamp, _peer_id);
+    _pace_tokens -= SRT_HEADER_SIZE + slot.payload->size() + s_udp_overhead;
+    _last_send_us = now_us;
+    onSrtSend(vector<Buffer::Ptr>{std::move(header), slot.payload});
+}
+
+void SrtTransport::dropSendTimeout(uint64_t now_us) {
+    if (!_config.too_late_drop || _snd_una == _snd_next) {
+        return;
+    }
+    auto threshold = std::max<uint64_t>(_latency_us, s_min_drop_us) + s_drop_margin_us;
+    auto first = _snd_una;
+    uint32_t msgno = 0;
+    size_t count = 0;
+    while (_snd_una != _snd_next) {
+        auto &slot = sendSlot(_snd_una);
+        if (now_us - slot.origin_us < threshold) {
+            break;
+        }
+        msgno = slot.msgno;
+        slot.payload = nullptr;
+        _snd_una = srtSeqAdd(_snd_una, 1);
+        ++count;
+    }
+    if (!count) {
+        return;
+    }
+    if (srtSeqOff(_snd_cur, _snd_una) > 0) {
+        _snd_cur = _snd_una;
+    }
+    _snd_loss.removeBefore(_snd_una);
+    _stats.send_dropped += count;
+    WarnL_EVERY_MS(5000) << "srt socket " << _socket_id << " dropped " << count << " unacknowledged packets";
+    uint8_t cif[8];
+    srtStore32(cif, first);
+    srtStore32(cif + 4, srtSeqAdd(_snd_una, -1));
+    sendControl(SRT_CTRL_DROPREQ, msgno, cif, sizeof(cif));
+}
+
+void SrtTransport::updateRate(uint64_t now_us) {
+    if (_config.max_bw) {
+        _pace_rate = _config.max_bw;
+        return;
+    }
+    auto elapsed = now_us - _input_start_us;
+    if (elapsed < s_rate_period_us) {
+        //输入码率上涨时不等周期结束就提速，否则积压在发送队列里的包会吃掉接收端的延时
+        if (elapsed >= s_rate_period_us / 10 && _input_bytes * 1000000 / elapsed * 5 / 4 > _pace_rate) {
+            _pace_rate = _input_bytes * 1000000 / elapsed * 5 / 4;
+        }
+        return;
+    }
+    auto rate = _input_bytes * 1000000 / elapsed;
+    _input_rate = _input_rate ? (_input_rate * 3 + rate) / 4 : rate;
+    _input_bytes = 0;
+    _input_start_us = now_us;
+    //留出 25% 给重传
+    _pace_rate = std::max<uint64_t>(std::max(_input_rate, rate) * 5 / 4, s_min_pace_rate);
+}
+
+void SrtTransport::onAck(uint32_t ack_no, const uint8_t *cif, size_t size, uint64_t now_us) {
+    if (size < 4) {
+        return;
+    }
+    auto ack = srtLoad32(cif) & SRT_SEQ_MAX;
+    if (srtSeqOff(_snd_una, ack) > 0 && srtSeqOff(ack, _snd_cur) >= 0) {
+        for (auto seq = _snd_una; seq != ack; seq = srtSeqAdd(seq, 1)) {
+            sendSlot(seq).payload = nullptr;
+        }
+        _snd_una = ack;
+        _snd_loss.removeBefore(ack);
+    }
+    if (size >= 16) {
+        //完整的 ACK 带有接收端测量的 RTT 和可用缓冲，需要回复 ACKACK
+        auto rtt = srtLoad32(cif + 4);
+        if (rtt) {
+            _rtt_us = rtt;
+            _rtt_var_us = srtLoad32(cif + 8);
+        }
+        _peer_window = std::max<uint32_t>(srtLoad32(cif + 12), 2);
+        uint8_t ackack[4] = {0};
+        sendControl(SRT_CTRL_ACKACK, ack_no, ackack, sizeof(ackack));
+    }
+    sendPending(now_us);
+}
+
+void SrtTransport::onNak(const uint8_t *cif, size_t size, uint64_t now_us) {
+    ++_stats.nak_received;
+    vector<SrtLossList::Range> ranges;
+    parseSrtNak(cif, size, ranges);
+    if (_snd_una == _snd_cur) {
+        return;
+    }
+    auto max_seq = srtSeqAdd(_snd_cur, -1);
+    for (auto &range : ranges) {
+        auto first = srtSeqOff(_snd_una, range.first) < 0 ? _snd_una : range.first;
+        auto last = srtSeqOff(max_seq, range.last) > 0 ? max_seq : range.last;
+        if (srtSeqOff(first, last) >= 0) {
+            _snd_loss.insert(first, last);
+        }
+    }
+    sendPending(now_us);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void SrtTransport::onData(const Buffer::Ptr &buf, uint64_t now_us) {
+    if (_state != State_Connected) {
+        return;
+    }
+    auto data = (const uint8_t *)buf->data();
+    auto seq = srtLoad32(data) & SRT_SEQ_MAX;
+    auto ts = srtLoad32(data + 8);
+    ++_stats.received;
+    ++_rate_pkts;
+    _rate_bytes += buf->size();
+
+    auto offset = srtSeqOff(_rcv_base, seq);
+    if (offset < 0 || (size_t)offset > _mask) {
+        //已经交付或放弃的包, 或者超出了接收缓冲
+        ++_stats.discarded;
+        return;
+    }
+    auto gap = srtSeqOff(_rcv_next, seq);
+    if (gap > 0) {
+        auto last = srtSeqAdd(seq, -1);
+        if (_rcv_loss.empty()) {
+            //已有丢包时不推迟周期性 NAK, 否则持续丢包会让早先的丢包一直等不到重传
+            _nak_next_us = now_us + std::max<uint64_t>(s_min_nak_interval_us, (_rtt_us + 4 * _rtt_var_us) / 2);
+        }
+        _rcv_loss.insert(_rcv_next, last);
+        _stats.lost += gap;
+        sendNak(_rcv_next, last);
+    }
+    if (gap >= 0) {
+        _rcv_next = srtSeqAdd(seq, 1);
+    } else if (_rcv_loss.remove(seq)) {
+        ++_stats.recovered;
+    } else {
+        //重复的包
+        ++_stats.discarded;
+        return;
+    }
+
+    //展开32位时间戳, 约71分钟回绕一次
+    uint64_t ext = _last_peer_ts + (int32_t)(ts - (uint32_t)_last_peer_ts);
+    if ((int64_t)ext < 0) {
+        ext = 0;
+    }
+    if (ext > _last_peer_ts) {
+        _last_peer_ts = ext;
+    }
+    auto &slot = recvSlot(seq);
+    slot.payload = BufferSlice::create(buf, SRT_HEADER_SIZE);
+    slot.timestamp = ext;
+    wakeupAt(playTime(slot));
+}
+
+void SrtTransport::deliver(uint64_t now_us) {
+    while (_rcv_base != _rcv_next) {
+        auto &slot = recvSlot(_rcv_base);
+        if (slot.payload) {
+            if (now_us < playTime(slot)) {
+                break;
+            }
+            auto payload = std::move(slot.payload);
+            slot.payload = nullptr;
+            _rcv_base = srtSeqAdd(_rcv_base, 1);
+            ++_stats.delivered;
+            onSrtData(payload);
+            if (_state != State_Connected) {
+                return;
+            }
+            continue;
+        }
+        uint32_t next;
+        if (!_rcv_loss.empty() && _rcv_loss.front().first == _rcv_base) {
+            //队头丢包，之后的包到了交付时间还没补回就放弃
+            next = srtSeqAdd(_rcv_loss.front().last, 1);
+            if (next == _rcv_next || !_config.too_late_drop) {
+                break;
+            }
+            auto &after = recvSlot(next);
+            if (after.payload && now_us < playTime(after)) {
+                break;
+            }
+            auto count = srtSeqOff(_rcv_base, next);
+            _stats.recv_dropped += count;
+            _rcv_loss.removeBefore(next);
+            WarnL_EVERY_MS(5000) << "srt socket " << _socket_id << " dropped " << count << " packets too late to recover";
+        } else {
+            //发送端已经丢弃(DROPREQ)的包
+            next = srtSeqAdd(_rcv_base, 1);
+            ++_stats.recv_dropped;
+        }
+        _rcv_base = next;
+    }
+}
+
+void SrtTransport::onDropReq(const uint8_t *cif, size_t size) {
+    if (size < 8) {
+        return;
+    }
+    auto first = srtLoad32(cif) & SRT_SEQ_MAX;
+    auto last = srtLoad32(cif + 4) & SRT_SEQ_MAX;
+    if (srtSeqOff(first, _rcv_base) > 0) {
+        first = _rcv_base;
+    }
+    auto max_seq = srtSeqAdd(_rcv_next, -1);
+    if (srtSeqOff(max_seq, last) > 0) {
+        last = max_seq;
+    }
+    if (srtSeqOff(first, last) < 0) {
+        return;
+    }
+    //不再等待这些包，交付时直接跳过
+    for (auto seq = first;; seq = srtSeqAdd(seq, 1)) {
+        if (!recvSlot(seq).payload) {
+            _rcv_loss.remove(seq);
+        }
+        if (seq == last) {
+            break;
+        }
+    }
+}
+
+void SrtTransport::onAckAck(uint32_t ack_no, uint64_t now_us) {
+    for (auto &record : _ack_records) {
+        if (record.ack_no != ack_no || !record.time_us) {
+            continue;
+        }
+        auto sample = (uint32_t)std::min<uint64_t>(now_us - record.time_us, UINT32_MAX);
+        record.time_us = 0;
+        if (!_rtt_sampled) {
+            _rtt_sampled = true;
+            _rtt_us = sample;
+            _rtt_var_us = sample / 2;
+        } else {
+            auto diff = sample > _rtt_us ? sample - _rtt_us : _rtt_us - sample;
+            _rtt_var_us = (_rtt_var_us * 3 + diff) / 4;
+            _rtt_us = (_rtt_us * 7 + sample) / 8;
+        }
+        break;
+    }
+}
+
+void SrtTransport::sendAck(uint64_t now_us) {
+    if (now_us - _rate_start_us >= s_recv_rate_period_us) {
+        auto elapsed = now_us - _rate_start_us;
+        _recv_pkt_rate = (uint32_t)(_rate_pkts * 1000000ULL / elapsed);
+        _recv_byte_rate = (uint32_t)std::min<uint64_t>(_rate_bytes * 1000000 / elapsed, UINT32_MAX);
+        _rate_pkts = 0;
+        _rate_bytes = 0;
+        _rate_start_us = now_us;
+    }
+    //第一个还没收到的包
+    auto ack = _rcv_loss.empty() ? _rcv_next : _rcv_loss.front().first;
+    if (ack == _last_ack_seq) {
+        return;
+    }
+    _last_ack_seq = ack;
+    uint8_t cif[28];
+    srtStore32(cif, ack);
+    srtStore32(cif + 4, _rtt_us);
+    srtStore32(cif + 8, _rtt_var_us);
+    srtStore32(cif + 12, (uint32_t)(_mask + 1 - srtSeqOff(_rcv_base, _rcv_next)));
+    srtStore32(cif + 16, _recv_pkt_rate);
+    srtStore32(cif + 20, _recv_pkt_rate);
+    srtStore32(cif + 24, _recv_byte_rate);
+    ++_ack_no;
+    auto &record = _ack_records[_ack_no % (sizeof(_ack_records) / sizeof(_ack_records[0]))];
+    record.ack_no = _ack_no;
+    record.time_us = now_us;
+    sendControl(SRT_CTRL_ACK, _ack_no, cif, sizeof(cif));
+}
+
+void SrtTransport::sendNak(uint32_t first, uint32_t last) {
+    uint8_t cif[8];
+    size_t size = 4;
+    if (first == last) {
+        srtStore32(cif, first);
+    } else {
+        srtStore32(cif, first | 0x80000000);
+        srtStore32(cif + 4, last);
+        size = 8;
+    }
+    ++_stats.nak_sent;
+    sendControl(SRT_CTRL_NAK, 0, cif, size);
+}
+
+void SrtTransport::sendNak(const deque<SrtLossList::Range> &ranges) {
+    string cif;
+    makeSrtNak(ranges, cif);
+    ++_stats.nak_sent;
+    sendControl(SRT_CTRL_NAK, 0, cif.data(), cif.size());
+}
+
+void SrtTransport::sendControl(SrtControlType type, uint32_t info, const void *cif, size_t cif_size) {
+    auto now = nowUs();
+    auto buf = BufferRaw::create(SRT_HEADER_SIZE + cif_size, SRT_HEADER_SIZE + cif_size);
+    writeSrtControlHeader((uint8_t *)buf->data(), type, info, timestamp(now), _peer_id);
+    if (cif_size) {
+        memcpy(buf->data() + SRT_HEADER_SIZE, cif, cif_size);
+    }
+    _last_send_us = now;
+    onSrtSend(vector<Buffer::Ptr>{std::move(buf)});
+}
+
+}
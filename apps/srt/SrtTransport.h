@@ -0,0 +1,257 @@
+#ifndef __SRT_TRANSPORT_H__
+#define __SRT_TRANSPORT_H__
+
+#include "Srt.h"
+#include "network/SockUtil.h"
+
+namespace beton {
+
+//srt 连接的参数
+struct SrtConfig {
+    //TSBPD 延时，握手时与对端的取较大值, 两个方向使用同一个值
+    uint16_t latency_ms = 120;
+    //多久没有收到对端的包视为断开
+    uint32_t peer_idle_ms = 5000;
+    //发送限速(字节/秒, 含 IP/UDP 头), 0 按输入码率的 125% 自动估算
+    uint64_t max_bw = 0;
+    //收发缓冲的包数，向上取整到2的幂
+    uint32_t window = 8192;
+    //是否丢弃来不及重传的包，关闭后队头的丢包会一直等待
+    bool too_late_drop = true;
+    //caller 在握手中携带的 stream id
+    std::string stream_id;
+};
+
+/**
+ * srt live 模式的协议层，与 socket 无关: 输入收到的 udp 报文和定时器，输出待发送的报文和按时交付的负载
+ * 1. 握手为 HSv5 的 caller-listener 方式(induction + conclusion), 协商 TSBPD 延时，携带 stream id, 不支持加密
+ * 2. 发送端: 每个包的16字节头部单独申请，与负载(调用者的 Buffer, 不拷贝)一起作为一个报文分散写出;
+ *    包保存在按序号定位的环形数组中直到被 ACK, NAK 请求的序号进入发送端丢包列表, 重传优先于新包;
+ *    所有发送都经过令牌桶限速, 一个 I 帧的几十个包被摊开到几毫秒内发出，不在瓶颈链路上形成突发丢包
+ * 3. 接收端: 按序号放入环形数组，检测到跳号时立即发 NAK, 之后按 RTT 周期性重发整个丢包列表(区间压缩);
+ *    每 10ms 回复一次 ACK, 对端的 ACKACK 用于测量 RTT
+ * 4. TSBPD: 包的交付时间 = 对端时间戳 + 时钟基准 + 延时，负载按发送时的节奏交给上层;
+ *    队头的丢包在后面的包也到了交付时间时放弃(too-late drop), 发送端也丢弃超时未确认的包并通知对端(DROPREQ)
+ * 所有接口只能在同一个 poller 线程调用，不加锁; 定时器由使用者按 onSrtWakeup 的要求驱动
+*/
+class SrtTransport {
+public:
+    struct Stats {
+        //发送的数据包(不含重传)、重传、发送端超时丢弃的包数
+        uint64_t sent = 0;
+        uint64_t retransmitted = 0;
+        uint64_t send_dropped = 0;
+        //收到的数据包(含重传)、检测到的丢包、补回的丢包、放弃(未能按时补回)的包数, 重复或过期的包数
+        uint64_t received = 0;
+        uint64_t lost = 0;
+        uint64_t recovered = 0;
+        uint64_t recv_dropped = 0;
+        uint64_t discarded = 0;
+        //按时交付给上层的包数
+        uint64_t delivered = 0;
+        //发出的 NAK 个数, 收到的 NAK 个数
+        uint64_t nak_sent = 0;
+        uint64_t nak_received = 0;
+    };
+
+    /**
+     * @param caller: true 为发起连接的一方(caller), false 为 listener
+    */
+    SrtTransport(bool caller, const SrtConfig &config = SrtConfig());
+    virtual ~SrtTransport() = default;
+
+    //caller 开始握手
+    void startHandshake();
+    //输入收到的一个 udp 报文，格式错误的报文被忽略
+    void onSrtPacket(const Buffer::Ptr &buf);
+    /**
+     * 定时处理: 握手重试、ACK/NAK、TSBPD 交付、发送限速、超时检测
+     * @return 距离下次需要调用的毫秒数, 0 表示连接已关闭，不再需要定时器
+    */
+    uint64_t onSrtTimer();
+
+    /**
+     * 发送一个数据包，负载不拷贝, 之后不应修改
+     * @param payload: 不超过 SRT_MAX_PAYLOAD, 通常为 SRT_LIVE_PAYLOAD(7个 ts 包)
+     * @return 未连接、负载过大或发送缓冲已满时返回 false
+    */
+    bool sendData(const Buffer::Ptr &payload);
+    //主动关闭，已连接时通知对端; 不会回调 onSrtClose
+    void closeSrt();
+
+    bool connected() const { return _state == State_Connected; }
+    bool closed() const { return _state == State_Closed; }
+    const std::string &streamId() const { return _stream_id; }
+    //协商后的 TSBPD 延时
+    uint32_t latencyMs() const { return _latency_us / 1000; }
+    uint32_t rttUs() const { return _rtt_us; }
+    //当前的发送速率上限(字节/秒)
+    uint64_t sendRate() const { return _pace_rate; }
+    //已发送未确认的包数
+    size_t sendBuffered() const { return srtSeqOff(_snd_una, _snd_next); }
+    const Stats &stats() const { return _stats; }
+
+protected:
+    //发送一个报文，bufs 为头部和负载等分散的片段
+    virtual void onSrtSend(std::vector<Buffer::Ptr> bufs) = 0;
+    /**
+     * listener 收到 conclusion 握手，决定是否接受
+     * @return 0 接受，否则为拒绝原因(SrtRejectReason)
+    */
+    virtual uint32_t onSrtHandshake(const std::string &stream_id) { return 0; }
+    virtual void onSrtConnected() {}
+    //按 TSBPD 时间交付的负载，是接收 Buffer 的切片
+    virtual void onSrtData(const Buffer::Ptr &payload) = 0;
+    //对端关闭、超时或握手被拒绝
+    virtual void onSrtClose(const SockException &ex) = 0;
+    //要求使用者在 delay_ms 毫秒之后(0 为尽快)调用 onSrtTimer, 取代之前安排的时间; 只在需要提前时调用
+    virtual void onSrtWakeup(uint32_t delay_ms) = 0;
+
+private:
+    typedef enum : uint8_t {
+        State_Init = 0,
+        State_Induction,
+        State_Conclusion,
+        State_Connected,
+        State_Closed
+    }State;
+
+    struct SendSlot {
+        Buffer::Ptr payload;
+        uint32_t timestamp = 0;
+        uint32_t msgno = 0;
+        //进入发送缓冲的时间，用于发送端丢弃
+        uint64_t origin_us = 0;
+        //最近一次重传的时间, 一个 RTT 内不重复重传
+        uint64_t resent_us = 0;
+    };
+
+    struct RecvSlot {
+        Buffer::Ptr payload;
+        //展开为64位的对端时间戳
+        uint64_t timestamp = 0;
+    };
+
+    //发出 ACK 的编号和时间，收到 ACKACK 时计算 RTT
+    struct AckRecord {
+        uint32_t ack_no = 0;
+        uint64_t time_us = 0;
+    };
+
+    uint64_t nowUs() const;
+    uint32_t timestamp(uint64_t now_us) const { return (uint32_t)(now_us - _start_us); }
+    //要求在 when_us 之前调用 onSrtTimer
+    void wakeupAt(uint64_t when_us);
+
+    void onHandshake(const SrtHandshake &hs, uint32_t pkt_ts, uint64_t now_us);
+    void onCallerHandshake(const SrtHandshake &hs, uint32_t pkt_ts, uint64_t now_us);
+    void onListenerHandshake(const SrtHandshake &hs, uint32_t pkt_ts, uint64_t now_us);
+    //caller 按当前状态发送 induction 或 conclusion
+    void sendCallerHandshake(uint64_t now_us);
+    void sendHandshake(const SrtHandshake &hs, uint32_t dst_id, SrtExtType srt_ext_type = SRT_EXT_HSREQ);
+    void sendReject(const SrtHandshake &req, uint32_t reason);
+    //握手完成，初始化收发状态
+    void onConnected(uint32_t isn, uint32_t peer_latency_ms, uint32_t pkt_ts, uint64_t now_us);
+    //对端导致的关闭
+    void onClose(const SockException &ex);
+
+    void onControl(const uint8_t *data, size_t size, uint64_t now_us);
+    void onData(const Buffer::Ptr &buf, uint64_t now_us);
+    void onAck(uint32_t ack_no, const uint8_t *cif, size_t size, uint64_t now_us);
+    void onAckAck(uint32_t ack_no, uint64_t now_us);
+    void onNak(const uint8_t *cif, size_t size, uint64_t now_us);
+    void onDropReq(const uint8_t *cif, size_t size);
+
+    void sendControl(SrtControlType type, uint32_t info, const void *cif = nullptr, size_t cif_size = 0);
+    void sendAck(uint64_t now_us);
+    //检测到新的丢包时立即请求
+    void sendNak(uint32_t first, uint32_t last);
+    //周期性地请求整个丢包列表
+    void sendNak(const std::deque<SrtLossList::Range> &ranges);
+    //在令牌允许的范围内发出重传和新包
+    void sendPending(uint64_t now_us);
+    void sendPacket(uint32_t seq, bool retransmit, uint64_t now_us);
+    //丢弃超时未确认的包
+    void dropSendTimeout(uint64_t now_us);
+    //交付到时间的包，放弃来不及补回的丢包
+    void deliver(uint64_t now_us);
+    //更新发送速率
+    void updateRate(uint64_t now_us);
+    //下一次需要处理的时间
+    uint64_t nextDeadline(uint64_t now_us) const;
+
+    SendSlot &sendSlot(uint32_t seq) { return _snd_slots[seq & _mask]; }
+    RecvSlot &recvSlot(uint32_t seq) { return _rcv_slots[seq & _mask]; }
+    uint64_t playTime(const RecvSlot &slot) const { return _tsbpd_base_us + slot.timestamp + _latency_us; }
+
+private:
+    bool _caller;
+    State _state = State_Init;
+    SrtConfig _config;
+    std::string _stream_id;
+    uint32_t _socket_id;
+    uint32_t _peer_id = 0;
+    //listener 的 SYN cookie, caller 从 induction 回复中取得
+    uint32_t _cookie = 0;
+    //caller 选择的初始序号，两个方向共用
+    uint32_t _isn = 0;
+    //listener 缓存的 conclusion 回复，对端没收到而重发时原样回复
+    Buffer::Ptr _hs_response;
+    uint64_t _start_us;
+    uint64_t _hs_start_us = 0;
+    uint64_t _hs_next_us = 0;
+    uint64_t _last_recv_us = 0;
+    uint64_t _last_send_us = 0;
+    //已要求使用者调用 onSrtTimer 的时间
+    uint64_t _wakeup_us = UINT64_MAX;
+    uint32_t _latency_us = 0;
+    bool _rtt_sampled = false;
+    uint32_t _rtt_us = 100000;
+    uint32_t _rtt_var_us = 50000;
+    size_t _mask;
+
+    //发送端: [_snd_una, _snd_cur) 已发出未确认，[_snd_cur, _snd_next) 等待限速发出
+    uint32_t _snd_una = 0;
+    uint32_t _snd_cur = 0;
+    uint32_t _snd_next = 0;
+    uint32_t _msgno = 1;
+    //对端通告的可用接收缓冲(包数)
+    uint32_t _peer_window = 8192;
+    std::vector<SendSlot> _snd_slots;
+    SrtLossList _snd_loss;
+    //令牌桶(字节), 可以为负，表示欠下的发送量
+    int64_t _pace_tokens = 0;
+    uint64_t _pace_rate = 0;
+    uint64_t _pace_us = 0;
+    //令牌不足时，有足够令牌的时间
+    uint64_t _pace_wait_us = UINT64_MAX;
+    //输入码率的估算
+    uint64_t _input_bytes = 0;
+    uint64_t _input_start_us = 0;
+    uint64_t _input_rate = 0;
+
+    //接收端: _rcv_base 为下一个交付的序号，_rcv_next 为收到的最大序号加一
+    uint32_t _rcv_base = 0;
+    uint32_t _rcv_next = 0;
+    std::vector<RecvSlot> _rcv_slots;
+    SrtLossList _rcv_loss;
+    //对端时间戳 0 对应的本地时间，以及展开时间戳用的最近值
+    uint64_t _tsbpd_base_us = 0;
+    uint64_t _last_peer_ts = 0;
+    uint32_t _last_ack_seq = 0;
+    uint32_t _ack_no = 0;
+    uint64_t _ack_next_us = 0;
+    uint64_t _nak_next_us = 0;
+    AckRecord _ack_records[16];
+    //接收速率统计
+    uint64_t _rate_start_us = 0;
+    uint32_t _rate_pkts = 0;
+    uint64_t _rate_bytes = 0;
+    uint32_t _recv_pkt_rate = 0;
+    uint32_t _recv_byte_rate = 0;
+
+    Stats _stats;
+};
+
+}
+#endif  //__SRT_TRANSPORT_H__
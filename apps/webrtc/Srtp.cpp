@@ -0,0 +1,728 @@
+#include "Srtp.h"
+#include "Util/Logger.h"
+#include <string.h>
+
+#ifdef ENABLE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#endif
+
+using namespace std;
+
+namespace beton {
+
+//HMAC-SHA1 的认证标签: 80位, _32 方案的 rtp 截短为32位, srtcp 总是80位
+static constexpr size_t s_hmac_tag_size = 10;
+static constexpr size_t s_hmac_short_tag_size = 4;
+static constexpr size_t s_hmac_key_size = 20;
+static constexpr size_t s_gcm_tag_size = 16;
+static constexpr size_t s_gcm_iv_size = 12;
+//srtcp 尾部的 E 标志 + 31位序号
+static constexpr size_t s_rtcp_index_size = 4;
+static constexpr uint32_t s_rtcp_encrypted = 0x80000000;
+//rtcp 固定加密前 8 字节(头部和发送者 ssrc)之后的部分
+static constexpr size_t s_rtcp_header_size = 8;
+//密钥派生的标签(RFC 3711 4.3.1), rtcp 的依次加3
+static constexpr uint8_t s_label_encrypt = 0;
+static constexpr uint8_t s_label_auth = 1;
+static constexpr uint8_t s_label_salt = 2;
+static constexpr uint8_t s_label_rtcp = 3;
+//一批报文的密文写在一块内存里，单块的上限
+static constexpr size_t s_batch_block_size = 256 * 1024;
+//跟踪的 ssrc 上限，防止对端用随机 ssrc 耗尽内存
+static constexpr size_t s_max_streams = 1024;
+
+static inline uint16_t load16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t load32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void store32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+//比较认证标签，耗时与内容无关
+static bool tagEqual(const uint8_t *a, const uint8_t *b, size_t size) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < size; ++i) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+//rtp 头部长度(含 CSRC 和扩展头), 格式错误返回0
+static size_t rtpHeaderSize(const uint8_t *data, size_t size) {
+    if (size < 12) {
+        return 0;
+    }
+    size_t ret = 12 + (data[0] & 0x0F) * 4;
+    if (data[0] & 0x10) {
+        if (ret + 4 > size) {
+            return 0;
+        }
+        ret += 4 + load16(data + ret + 2) * 4;
+    }
+    return ret <= size ? ret : 0;
+}
+
+size_t srtpKeySize(SrtpProfile profile) {
+    switch (profile) {
+        case SRTP_AES128_CM_SHA1_80:
+        case SRTP_AES128_CM_SHA1_32:
+        case SRTP_AEAD_AES_128_GCM: return 16;
+        case SRTP_AEAD_AES_256_GCM: return 32;
+        default: return 0;
+    }
+}
+
+size_t srtpSaltSize(SrtpProfile profile) {
+    switch (profile) {
+        case SRTP_AES128_CM_SHA1_80:
+        case SRTP_AES128_CM_SHA1_32: return 14;
+        case SRTP_AEAD_AES_128_GCM:
+        case SRTP_AEAD_AES_256_GCM: return 12;
+        default: return 0;
+    }
+}
+
+const char *srtpProfileName(SrtpProfile profile) {
+    switch (profile) {
+        case SRTP_AES128_CM_SHA1_80: return "SRTP_AES128_CM_SHA1_80";
+        case SRTP_AES128_CM_SHA1_32: return "SRTP_AES128_CM_SHA1_32";
+        case SRTP_AEAD_AES_128_GCM: return "SRTP_AEAD_AES_128_GCM";
+        case SRTP_AEAD_AES_256_GCM: return "SRTP_AEAD_AES_256_GCM";
+        default: return "";
+    }
+}
+
+bool srtpSplitKeys(SrtpProfile profile, const string &material, bool server, string &local_key, string &local_salt,
+                   string &remote_key, string &remote_salt) {
+    auto key_size = srtpKeySize(profile);
+    auto salt_size = srtpSaltSize(profile);
+    if (!key_size || material.size() != 2 * (key_size + salt_size)) {
+        return false;
+    }
+    auto client_key = material.substr(0, key_size);
+    auto server_key = material.substr(key_size, key_size);
+    auto client_salt = material.substr(2 * key_size, salt_size);
+    auto server_salt = material.substr(2 * key_size + salt_size, salt_size);
+    local_key = server ? server_key : client_key;
+    local_salt = server ? server_salt : client_salt;
+    remote_key = server ? client_key : server_key;
+    remote_salt = server ? client_salt : server_salt;
+    return true;
+}
+
+bool isRtpOrRtcp(const uint8_t *data, size_t size) {
+    //首字节 128~191, 其余为 STUN(0~3)、DTLS(20~63) 等
+    return size >= s_rtcp_header_size && data[0] >= 128 && data[0] <= 191;
+}
+
+bool isRtcp(const uint8_t *data, size_t size) {
+    //rtcp 的包类型 192~223 与 rtp 的负载类型(含 marker 位)不重叠
+    return isRtpOrRtcp(data, size) && data[1] >= 192 && data[1] <= 223;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SrtpReplayWindow::check(uint64_t index) const {
+    if (!_init || index > _top) {
+        return 0;
+    }
+    if (_top - index >= kSize) {
+        return -2;
+    }
+    return (_bits[(index / 64) % (kSize / 64)] >> (index % 64)) & 1 ? -1 : 0;
+}
+
+void SrtpReplayWindow::add(uint64_t index) {
+    if (!_init || index >= _top + kSize) {
+        //第一个包，或者一次跳过了整个窗口
+        _init = true;
+        memset(_bits, 0, sizeof(_bits));
+        _top = index;
+    } else if (index > _top) {
+        //清掉窗口前移时滑出的位，按64位一组处理
+        for (auto i = _top + 1; i <= index;) {
+            auto bit = i % 64;
+            auto count = std::min<uint64_t>(64 - bit, index - i + 1);
+            auto mask = count == 64 ? ~0ULL : ((1ULL << count) - 1) << bit;
+            _bits[(i / 64) % (kSize / 64)] &= ~mask;
+            i += count;
+        }
+        _top = index;
+    }
+    _bits[(index / 64) % (kSize / 64)] |= 1ULL << (index % 64);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//按 RFC 3711 附录A 由16位序号和已知的最大序号推算48位的包序号
+static uint64_t estimateIndex(bool init, uint16_t last_seq, uint32_t roc, uint16_t seq) {
+    if (!init) {
+        return seq;
+    }
+    uint32_t v = roc;
+    if (last_seq < 0x8000) {
+        if ((int)seq - (int)last_seq > 0x8000 && roc) {
+            v = roc - 1;
+        }
+    } else if ((int)last_seq - 0x8000 > (int)seq) {
+        v = roc + 1;
+    }
+    return ((uint64_t)v << 16) | seq;
+}
+
+SrtpContext::Ptr SrtpContext::create(SrtpProfile profile, const string &key, const string &salt) {
+    if (!srtpKeySize(profile) || key.size() != srtpKeySize(profile) || salt.size() != srtpSaltSize(profile)) {
+        WarnL << "invalid srtp key for profile " << profile << ", key " << key.size() << " bytes, salt " << salt.size()
+              << " bytes";
+        return nullptr;
+    }
+    Ptr ret(new SrtpContext(profile));
+    if (!ret->init(key, salt)) {
+        return nullptr;
+    }
+    return ret;
+}
+
+SrtpContext::SrtpContext(SrtpProfile profile) : _profile(profile) {
+    _gcm = profile == SRTP_AEAD_AES_128_GCM || profile == SRTP_AEAD_AES_256_GCM;
+    _tag_size = _gcm ? s_gcm_tag_size : (profile == SRTP_AES128_CM_SHA1_32 ? s_hmac_short_tag_size : s_hmac_tag_size);
+    _salt_size = _gcm ? s_gcm_iv_size : 14;
+    memset(_salt, 0, sizeof(_salt));
+}
+
+SrtpContext::Stream *SrtpContext::getStream(uint32_t ssrc, bool create) {
+    if (_last_stream && _last_ssrc == ssrc) {
+        return _last_stream;
+    }
+    auto it = _streams.find(ssrc);
+    if (it == _streams.end()) {
+        if (!create || _streams.size() >= s_max_streams) {
+            return nullptr;
+        }
+        it = _streams.emplace(ssrc, Stream()).first;
+    }
+    //unordered_map 的元素地址在插入后不变
+    _last_ssrc = ssrc;
+    _last_stream = &it->second;
+    return _last_stream;
+}
+
+size_t SrtpContext::protect(Socket::UdpPacket *pkts, size_t count) {
+    size_t remain = 0;
+    for (size_t i = 0; i < count; ++i) {
+        remain += pkts[i].size + SRTP_MAX_TRAILER;
+    }
+    BufferRaw::Ptr block;
+    size_t offset = 0;
+    size_t done = 0;
+    for (size_t i = 0; i < count; ++i) {
+        auto &pkt = pkts[i];
+        size_t need = pkt.size + SRTP_MAX_TRAILER;
+        remain -= need;
+        if (pkt.buf->size() < 2 || !isRtpOrRtcp((const uint8_t *)pkt.buf->data(), pkt.size)) {
+            continue;
+        }
+        if (!block || offset + need > block->capacity()) {
+            //本批剩下的报文尽量放进同一块内存
+            block = BufferRaw::create(std::max(need, std::min(remain + need, s_batch_block_size)));
+            block->setSize(block->capacity());
+            offset = 0;
+        }
+        auto out = (uint8_t *)block->data() + offset;
+        auto size = pkt.size;
+        memcpy(out, pkt.buf->data(), pkt.buf->size());
+        auto pos = pkt.buf->size();
+        for (auto &piece : pkt.tail) {
+            memcpy(out + pos, piece->data(), piece->size());
+            pos += piece->size();
+        }
+        size_t out_size;
+        if (!protectPacket(out, size, out_size)) {
+            //不能把明文发出去
+            WarnL_EVERY_MS(5000) << "srtp protect failed, packet of " << size << " bytes dropped";
+            pkt.buf = nullptr;
+            pkt.tail.clear();
+            pkt.size = 0;
+            continue;
+        }
+        pkt.buf = BufferSlice::create(block, offset, out_size);
+        pkt.tail.clear();
+        pkt.size = out_size;
+        offset += out_size;
+        ++done;
+    }
+    _stats.encrypted += done;
+    return done;
+}
+
+Buffer::Ptr SrtpContext::protect(const vector<Buffer::Ptr> &pieces) {
+    size_t size = 0;
+    for (auto &piece : pieces) {
+        size += piece->size();
+    }
+    auto ret = BufferRaw::create(size + SRTP_MAX_TRAILER, size);
+    size_t pos = 0;
+    for (auto &piece : pieces) {
+        memcpy(ret->data() + pos, piece->data(), piece->size());
+        pos += piece->size();
+    }
+    size_t out_size;
+    if (!isRtpOrRtcp((const uint8_t *)ret->data(), size) || !protectPacket((uint8_t *)ret->data(), size, out_size)) {
+        return nullptr;
+    }
+    ret->setSize(out_size);
+    ++_stats.encrypted;
+    return ret;
+}
+
+bool SrtpContext::protectPacket(uint8_t *data, size_t size, size_t &out_size) {
+    return isRtcp(data, size) ? protectRtcp(data, size, out_size) : protectRtp(data, size, out_size);
+}
+
+bool SrtpContext::protectRtp(uint8_t *data, size_t size, size_t &out_size) {
+    auto header_size = rtpHeaderSize(data, size);
+    if (!header_size) {
+        return false;
+    }
+    auto seq = load16(data + 2);
+    auto ssrc = load32(data + 8);
+    auto stream = getStream(ssrc, true);
+    if (!stream) {
+        return false;
+    }
+    auto index = estimateIndex(stream->rtp_init, stream->seq, stream->roc, seq);
+    if (!stream->rtp_init || index > (((uint64_t)stream->roc << 16) | stream->seq)) {
+        stream->rtp_init = true;
+        stream->roc = index >> 16;
+        stream->seq = seq;
+    }
+    uint32_t roc = index >> 16;
+    auto payload = data + header_size;
+    auto payload_size = size - header_size;
+    if (_gcm) {
+        //IV = (0x0000 | ssrc | roc | seq) XOR salt, rtp 头作为附加数据(RFC 7714 8.1)
+        uint8_t iv[s_gcm_iv_size] = {0};
+        store32(iv + 2, ssrc);
+        store32(iv + 6, roc);
+        iv[10] = seq >> 8;
+        iv[11] = seq;
+        for (size_t i = 0; i < s_gcm_iv_size; ++i) {
+            iv[i] ^= _salt[0][i];
+        }
+        if (!cryptGcm(_cipher[0], iv, true, data, header_size, nullptr, 0, payload, payload_size, data + size)) {
+            return false;
+        }
+        out_size = size + s_gcm_tag_size;
+        return true;
+    }
+    //IV = (salt << 16) XOR (ssrc << 64) XOR (index << 16) (RFC 3711 4.1.1)
+    uint8_t iv[16];
+    memcpy(iv, _salt[0], 14);
+    iv[14] = iv[15] = 0;
+    for (int i = 0; i < 4; ++i) {
+        iv[4 + i] ^= ssrc >> (24 - 8 * i);
+    }
+    for (int i = 0; i < 6; ++i) {
+        iv[8 + i] ^= index >> (40 - 8 * i);
+    }
+    uint8_t roc_bytes[4];
+    store32(roc_bytes, roc);
+    uint8_t tag[s_hmac_key_size];
+    if (!cryptCtr(_cipher[0], iv, payload, payload_size) || !authenticate(false, data, size, roc_bytes, 4, tag)) {
+        return false;
+    }
+    memcpy(data + size, tag, _tag_size);
+    out_size = size + _tag_size;
+    return true;
+}
+
+bool SrtpContext::protectRtcp(uint8_t *data, size_t size, size_t &out_size) {
+    auto ssrc = load32(data + 4);
+    auto stream = getStream(ssrc, true);
+    if (!stream) {
+        return false;
+    }
+    auto index = stream->rtcp_index;
+    stream->rtcp_index = (index + 1) & ~s_rtcp_encrypted;
+    uint8_t trailer[s_rtcp_index_size];
+    store32(trailer, s_rtcp_encrypted | index);
+    auto payload = data + s_rtcp_header_size;
+    auto payload_size = size - s_rtcp_header_size;
+    if (_gcm) {
+        //IV = (0x0000 | ssrc | 0x0000 | index) XOR salt, 头部8字节和尾部序号作为附加数据(RFC 7714 9.1)
+        uint8_t iv[s_gcm_iv_size] = {0};
+        store32(iv + 2, ssrc);
+        store32(iv + 8, index);
+        for (size_t i = 0; i < s_gcm_iv_size; ++i) {
+            iv[i] ^= _salt[1][i];
+        }
+        if (!cryptGcm(_cipher[1], iv, true, data, s_rtcp_header_size, trailer, sizeof(trailer), payload, payload_size,
+                      data + size)) {
+            return false;
+        }
+        memcpy(data + size + s_gcm_tag_size, trailer, sizeof(trailer));
+        out_size = size + s_gcm_tag_size + sizeof(trailer);
+        return true;
+    }
+    uint8_t iv[16];
+    memcpy(iv, _salt[1], 14);
+    iv[14] = iv[15] = 0;
+    for (int i = 0; i < 4; ++i) {
+        iv[4 + i] ^= ssrc >> (24 - 8 * i);
+        iv[10 + i] ^= index >> (24 - 8 * i);
+    }
+    if (!cryptCtr(_cipher[1], iv, payload, payload_size)) {
+        return false;
+    }
+    memcpy(data + size, trailer, sizeof(trailer));
+    uint8_t tag[s_hmac_key_size];
+    if (!authenticate(true, data, size + sizeof(trailer), nullptr, 0, tag)) {
+        return false;
+    }
+    memcpy(data + size + sizeof(trailer), tag, s_hmac_tag_size);
+    out_size = size + sizeof(trailer) + s_hmac_tag_size;
+    return true;
+}
+
+Buffer::Ptr SrtpContext::unprotect(const Buffer::Ptr &buf) {
+    auto data = (uint8_t *)buf->data();
+    auto size = buf->size();
+    size_t out_size;
+    if (!isRtpOrRtcp(data, size)) {
+        ++_stats.auth_failed;
+        return nullptr;
+    }
+    if (!(isRtcp(data, size) ? unprotectRtcp(data, size, out_size) : unprotectRtp(data, size, out_size))) {
+        return nullptr;
+    }
+    ++_stats.decrypted;
+    return BufferSlice::create(buf, 0, out_size);
+}
+
+bool SrtpContext::unprotectRtp(uint8_t *data, size_t size, size_t &out_size) {
+    auto header_size = rtpHeaderSize(data, size);
+    if (!header_size || size < header_size + _tag_size) {
+        ++_stats.auth_failed;
+        return false;
+    }
+    auto seq = load16(data + 2);
+    auto ssrc = load32(data + 8);
+    //认证通过之前不为新的 ssrc 建立状态
+    Stream tmp;
+    auto stream = getStream(ssrc, false);
+    auto &state = stream ? *stream : tmp;
+    auto index = estimateIndex(state.rtp_init, state.seq, state.roc, seq);
+    if (state.rtp_window.check(index)) {
+        ++_stats.replayed;
+        return false;
+    }
+    uint32_t roc = index >> 16;
+    auto payload = data + header_size;
+    auto payload_size = size - header_size - _tag_size;
+    auto tag = data + size - _tag_size;
+    if (_gcm) {
+        uint8_t iv[s_gcm_iv_size] = {0};
+        store32(iv + 2, ssrc);
+        store32(iv + 6, roc);
+        iv[10] = seq >> 8;
+        iv[11] = seq;
+        for (size_t i = 0; i < s_gcm_iv_size; ++i) {
+            iv[i] ^= _salt[0][i];
+        }
+        if (!cryptGcm(_cipher[0], iv, false, data, header_size, nullptr, 0, payload, payload_size, tag)) {
+            ++_stats.auth_failed;
+            return false;
+        }
+    } else {
+        uint8_t roc_bytes[4];
+        store32(roc_bytes, roc);
+        uint8_t expect[s_hmac_key_size];
+        if (!authenticate(false, data, size - _tag_size, roc_bytes, 4, expect) ||
+            !tagEqual(expect, tag, _tag_size)) {
+            ++_stats.auth_failed;
+            return false;
+        }
+        uint8_t iv[16];
+        memcpy(iv, _salt[0], 14);
+        iv[14] = iv[15] = 0;
+        for (int i = 0; i < 4; ++i) {
+            iv[4 + i] ^= ssrc >> (24 - 8 * i);
+        }
+        for (int i = 0; i < 6; ++i) {
+            iv[8 + i] ^= index >> (40 - 8 * i);
+        }
+        if (!cryptCtr(_cipher[0], iv, payload, payload_size)) {
+            ++_stats.auth_failed;
+            return false;
+        }
+    }
+    if (!stream) {
+        stream = getStream(ssrc, true);
+        if (!stream) {
+            WarnL_EVERY_MS(5000) << "too many srtp streams, ssrc " << ssrc << " dropped";
+            return false;
+        }
+    }
+    if (!stream->rtp_init || index > (((uint64_t)stream->roc << 16) | stream->seq)) {
+        stream->rtp_init = true;
+        stream->roc = roc;
+        stream->seq = seq;
+    }
+    stream->rtp_window.add(index);
+    out_size = size - _tag_size;
+    return true;
+}
+
+bool SrtpContext::unprotectRtcp(uint8_t *data, size_t size, size_t &out_size) {
+    size_t tag_size = _gcm ? s_gcm_tag_size : s_hmac_tag_size;
+    if (size < s_rtcp_header_size + s_rtcp_index_size + tag_size) {
+        ++_stats.auth_failed;
+        return false;
+    }
+    //GCM: 密文 | tag | 序号; AES-CM: 密文 | 序号 | tag
+    auto trailer = _gcm ? data + size - s_rtcp_index_size : data + size - tag_size - s_rtcp_index_size;
+    auto tag = _gcm ? data + size - s_rtcp_index_size - tag_size : data + size - tag_size;
+    auto payload = data + s_rtcp_header_size;
+    auto payload_size = size - s_rtcp_header_size - s_rtcp_index_size - tag_size;
+    auto word = load32(trailer);
+    bool encrypted = word & s_rtcp_encrypted;
+    uint32_t index = word & ~s_rtcp_encrypted;
+    auto ssrc = load32(data + 4);
+    Stream tmp;
+    auto stream = getStream(ssrc, false);
+    auto &state = stream ? *stream : tmp;
+    if (state.rtcp_window.check(index)) {
+        ++_stats.replayed;
+        return false;
+    }
+    if (_gcm) {
+        uint8_t iv[s_gcm_iv_size] = {0};
+        store32(iv + 2, ssrc);
+        store32(iv + 8, index);
+        for (size_t i = 0; i < s_gcm_iv_size; ++i) {
+            iv[i] ^= _salt[1][i];
+        }
+        //没有加密的 srtcp 整个包都是附加数据
+        bool ok = encrypted ? cryptGcm(_cipher[1], iv, false, data, s_rtcp_header_size, trailer, s_rtcp_index_size,
+                                       payload, payload_size, tag)
+                            : cryptGcm(_cipher[1], iv, false, data, s_rtcp_header_size + payload_size, trailer,
+                                       s_rtcp_index_size, nullptr, 0, tag);
+        if (!ok) {
+            ++_stats.auth_failed;
+            return false;
+        }
+    } else {
+        uint8_t expect[s_hmac_key_size];
+        if (!authenticate(true, data, size - tag_size, nullptr, 0, expect) || !tagEqual(expect, tag, tag_size)) {
+            ++_stats.auth_failed;
+            return false;
+        }
+        uint8_t iv[16];
+        memcpy(iv, _salt[1], 14);
+        iv[14] = iv[15] = 0;
+        for (int i = 0; i < 4; ++i) {
+            iv[4 + i] ^= ssrc >> (24 - 8 * i);
+            iv[10 + i] ^= index >> (24 - 8 * i);
+        }
+        if (encrypted && !cryptCtr(_cipher[1], iv, payload, payload_size)) {
+            ++_stats.auth_failed;
+            return false;
+        }
+    }
+    if (!stream) {
+        stream = getStream(ssrc, true);
+        if (!stream) {
+            WarnL_EVERY_MS(5000) << "too many srtp streams, ssrc " << ssrc << " dropped";
+            return false;
+        }
+    }
+    stream->rtcp_window.add(index);
+    out_size = s_rtcp_header_size + payload_size;
+    return true;
+}
+
+void SrtpContext::attach(const Socket::Ptr &sock) {
+    auto self = shared_from_this();
+    sock->setUdpFlushCB([self](Socket::UdpPacket *pkts, size_t count) { self->protect(pkts, count); });
+}
+
+//////////////////////////////////////////////////////////////////////////////
+#ifdef ENABLE_OPENSSL
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static void *newHmac(const uint8_t *key, size_t size) {
+    auto mac = EVP_MAC_fetch(nullptr, OSSL_MAC_NAME_HMAC, nullptr);
+    if (!mac) {
+        return nullptr;
+    }
+    auto ctx = EVP_MAC_CTX_new(mac);
+    EVP_MAC_free(mac);
+    OSSL_PARAM params[] = {OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA1", 0),
+                           OSSL_PARAM_construct_end()};
+    if (ctx && !EVP_MAC_init(ctx, key, size, params)) {
+        EVP_MAC_CTX_free(ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+static void freeHmac(void *ctx) {
+    EVP_MAC_CTX_free((EVP_MAC_CTX *)ctx);
+}
+
+static bool computeHmac(void *ctx, const uint8_t *data, size_t size, const uint8_t *extra, size_t extra_size,
+                        uint8_t *out) {
+    auto mac = (EVP_MAC_CTX *)ctx;
+    size_t out_size = 0;
+    //key 为空时复用已经算好的内外两层填充状态
+    return EVP_MAC_init(mac, nullptr, 0, nullptr) && EVP_MAC_update(mac, data, size) &&
+           (!extra_size || EVP_MAC_update(mac, extra, extra_size)) && EVP_MAC_final(mac, out, &out_size, s_hmac_key_size);
+}
+#else
+static void *newHmac(const uint8_t *key, size_t size) {
+    auto ctx = HMAC_CTX_new();
+    if (ctx && !HMAC_Init_ex(ctx, key, size, EVP_sha1(), nullptr)) {
+        HMAC_CTX_free(ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+static void freeHmac(void *ctx) {
+    HMAC_CTX_free((HMAC_CTX *)ctx);
+}
+
+static bool computeHmac(void *ctx, const uint8_t *data, size_t size, const uint8_t *extra, size_t extra_size,
+                        uint8_t *out) {
+    auto mac = (HMAC_CTX *)ctx;
+    unsigned int out_size = 0;
+    return HMAC_Init_ex(mac, nullptr, 0, nullptr, nullptr) && HMAC_Update(mac, data, size) &&
+           (!extra_size || HMAC_Update(mac, extra, extra_size)) && HMAC_Final(mac, out, &out_size);
+}
+#endif
+
+//AES-CM 密钥派生: 以 (label << 48) XOR 主盐 为 IV, 用主密钥加密全0得到密钥流(RFC 3711 4.3.3)
+static bool deriveKey(const EVP_CIPHER *cipher, const string &master_key, const uint8_t *master_salt, uint8_t label,
+                      uint8_t *out, size_t size) {
+    uint8_t iv[16] = {0};
+    memcpy(iv, master_salt, 14);
+    iv[7] ^= label;
+    uint8_t zeros[32] = {0};
+    int len = 0;
+    auto ctx = EVP_CIPHER_CTX_new();
+    bool ret = ctx && EVP_EncryptInit_ex(ctx, cipher, nullptr, (const uint8_t *)master_key.data(), iv) &&
+               EVP_EncryptUpdate(ctx, out, &len, zeros, size);
+    EVP_CIPHER_CTX_free(ctx);
+    return ret;
+}
+
+bool SrtpContext::init(const string &key, const string &salt) {
+    bool aes256 = key.size() == 32;
+    auto kdf = aes256 ? EVP_aes_256_ctr() : EVP_aes_128_ctr();
+    auto cipher = _gcm ? (aes256 ? EVP_aes_256_gcm() : EVP_aes_128_gcm()) : kdf;
+    //GCM 的主盐只有12字节，后面补0
+    uint8_t master_salt[14] = {0};
+    memcpy(master_salt, salt.data(), salt.size());
+    for (int i = 0; i < 2; ++i) {
+        uint8_t label = i ? s_label_rtcp : 0;
+        uint8_t session_key[32];
+        uint8_t auth_key[s_hmac_key_size];
+        bool ok = deriveKey(kdf, key, master_salt, label + s_label_encrypt, session_key, key.size()) &&
+                  deriveKey(kdf, key, master_salt, label + s_label_salt, _salt[i], _salt_size) &&
+                  (_gcm || deriveKey(kdf, key, master_salt, label + s_label_auth, auth_key, sizeof(auth_key)));
+        if (ok) {
+            //轮密钥只展开这一次，之后每个包只换 IV
+            _cipher[i] = EVP_CIPHER_CTX_new();
+            ok = _cipher[i] && EVP_CipherInit_ex(_cipher[i], cipher, nullptr, session_key, nullptr, 1);
+        }
+        if (ok && !_gcm) {
+            _hmac[i] = newHmac(auth_key, sizeof(auth_key));
+            ok = _hmac[i] != nullptr;
+        }
+        OPENSSL_cleanse(session_key, sizeof(session_key));
+        OPENSSL_cleanse(auth_key, sizeof(auth_key));
+        if (!ok) {
+            WarnL << "init srtp context for " << srtpProfileName(_profile) << " failed";
+            return false;
+        }
+    }
+    return true;
+}
+
+SrtpContext::~SrtpContext() {
+    for (int i = 0; i < 2; ++i) {
+        if (_cipher[i]) {
+            EVP_CIPHER_CTX_free(_cipher[i]);
+        }
+        if (_hmac[i]) {
+            freeHmac(_hmac[i]);
+        }
+    }
+    OPENSSL_cleanse(_salt, sizeof(_salt));
+}
+
+bool SrtpContext::cryptCtr(evp_cipher_ctx_st *ctx, const uint8_t *iv, uint8_t *data, size_t size) {
+    int len = 0;
+    return EVP_CipherInit_ex(ctx, nullptr, nullptr, nullptr, iv, 1) && (!size || EVP_CipherUpdate(ctx, data, &len, data, size));
+}
+
+bool SrtpContext::cryptGcm(evp_cipher_ctx_st *ctx, const uint8_t *iv, bool encrypt, const uint8_t *aad, size_t aad_size,
+                           const uint8_t *aad_tail, size_t aad_tail_size, uint8_t *data, size_t size, uint8_t *tag) {
+    int len = 0;
+    if (!EVP_CipherInit_ex(ctx, nullptr, nullptr, nullptr, iv, encrypt ? 1 : 0) ||
+        (aad_size && !EVP_CipherUpdate(ctx, nullptr, &len, aad, aad_size)) ||
+        (aad_tail_size && !EVP_CipherUpdate(ctx, nullptr, &len, aad_tail, aad_tail_size)) ||
+        (size && !EVP_CipherUpdate(ctx, data, &len, data, size))) {
+        return false;
+    }
+    if (!encrypt && !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, s_gcm_tag_size, tag)) {
+        return false;
+    }
+    //GCM 的 final 不输出数据，解密时在这里校验 tag
+    if (EVP_CipherFinal_ex(ctx, data + size, &len) <= 0) {
+        return false;
+    }
+    return !encrypt || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, s_gcm_tag_size, tag) > 0;
+}
+
+bool SrtpContext::authenticate(bool rtcp, const uint8_t *data, size_t size, const uint8_t *extra, size_t extra_size,
+                               uint8_t *out) {
+    return computeHmac(_hmac[rtcp ? 1 : 0], data, size, extra, extra_size, out);
+}
+
+#else  //ENABLE_OPENSSL
+
+bool SrtpContext::init(const string &key, const string &salt) {
+    WarnL << "srtp is unavailable, rebuild with openssl";
+    return false;
+}
+
+SrtpContext::~SrtpContext() {}
+
+bool SrtpContext::cryptCtr(evp_cipher_ctx_st *ctx, const uint8_t *iv, uint8_t *data, size_t size) { return false; }
+
+bool SrtpContext::cryptGcm(evp_cipher_ctx_st *ctx, const uint8_t *iv, bool encrypt, const uint8_t *aad, size_t aad_size,
+                           const uint8_t *aad_tail, size_t aad_tail_size, uint8_t *data, size_t size, uint8_t *tag) {
+    return false;
+}
+
+bool SrtpContext::authenticate(bool rtcp, const uint8_t *data, size_t size, const uint8_t *extra, size_t extra_size,
+                               uint8_t *out) {
+    return false;
+}
+
+#endif  //ENABLE_OPENSSL
+
+}
@@ -0,0 +1,166 @@
+#ifndef __SRTP_H__
+#define __SRTP_H__
+
+#include "network/Socket.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+struct evp_cipher_ctx_st;
+
+namespace beton {
+
+//DTLS-SRTP 协商的保护方案，取值为 RFC 5764/7714 中的 profile 编号
+typedef enum : uint16_t {
+    SRTP_AES128_CM_SHA1_80 = 0x0001,
+    SRTP_AES128_CM_SHA1_32 = 0x0002,
+    SRTP_AEAD_AES_128_GCM = 0x0007,
+    SRTP_AEAD_AES_256_GCM = 0x0008
+}SrtpProfile;
+
+//加密后 rtp/rtcp 最多增加的长度: 16字节 tag + 4字节 srtcp 序号
+static constexpr size_t SRTP_MAX_TRAILER = 20;
+
+//主密钥和主盐的长度，不支持的 profile 返回0
+size_t srtpKeySize(SrtpProfile profile);
+size_t srtpSaltSize(SrtpProfile profile);
+//openssl 中的 profile 名称, 用于 SSL_CTX_set_tlsext_use_srtp
+const char *srtpProfileName(SrtpProfile profile);
+
+/**
+ * 拆分 DTLS 导出的密钥材料(EXTRACTOR-dtls_srtp): client_key | server_key | client_salt | server_salt
+ * @param server: 本端是否为 DTLS 服务端，决定哪一半用于发送
+ * @return 长度不符时返回 false
+*/
+bool srtpSplitKeys(SrtpProfile profile, const std::string &material, bool server, std::string &local_key,
+                   std::string &local_salt, std::string &remote_key, std::string &remote_salt);
+
+//rtp/rtcp 与 STUN/DTLS 复用同一端口时的区分(RFC 7983, RFC 5761)
+bool isRtpOrRtcp(const uint8_t *data, size_t size);
+bool isRtcp(const uint8_t *data, size_t size);
+
+/**
+ * 防重放窗口: 最近 kSize 个序号的位图，序号对 kSize 取模存放
+ * 窗口前移时只清掉滑出的位，不移动整个位图
+*/
+class SrtpReplayWindow {
+public:
+    //与 libwebrtc 对视频使用的窗口一致
+    static constexpr size_t kSize = 1024;
+
+    //0 可以接受; -1 已经收到过; -2 落在窗口之前，太旧
+    int check(uint64_t index) const;
+    //认证通过之后记录
+    void add(uint64_t index);
+
+    uint64_t top() const { return _top; }
+
+private:
+    bool _init = false;
+    uint64_t _top = 0;
+    uint64_t _bits[kSize / 64];
+};
+
+/**
+ * 一个方向(本端发送或者对端发送)的 srtp/srtcp 加解密上下文:
+ * 1. 会话密钥在创建时派生一次; openssl 的 cipher 上下文(含 AES 轮密钥)和 HMAC 状态在所有包之间复用，
+ *    每个包只重设 IV; AES 由 openssl 按 cpu 选择 AES-NI/VAES 实现
+ * 2. 按 ssrc 记录 ROC、srtcp 序号和防重放窗口
+ * 3. protect 一次加密一批报文，输出写进同一块内存再切片; attach 之后作为 Socket 的 onUdpFlush,
+ *    在 sendmmsg 之前加密本轮所有待发的 rtp/rtcp, 上层照常发送明文
+ * 只在一个线程中使用
+*/
+class SrtpContext : public noncopyable, public std::enable_shared_from_this<SrtpContext> {
+public:
+    using Ptr = std::shared_ptr<SrtpContext>;
+
+    struct Stats {
+        uint64_t encrypted = 0;
+        uint64_t decrypted = 0;
+        //认证失败或格式错误
+        uint64_t auth_failed = 0;
+        //重复或者太旧
+        uint64_t replayed = 0;
+    };
+
+    /**
+     * @param key: 主密钥
+     * @param salt: 主盐
+     * @return 长度不符、profile 不支持或没有 openssl 时返回空
+    */
+    static Ptr create(SrtpProfile profile, const std::string &key, const std::string &salt);
+
+    ~SrtpContext();
+
+    /**
+     * 批量加密, STUN/DTLS 等其他报文保持原样
+     * 加密后的报文替换 buf, tail 被清空, size 同步更新
+     * @return 加密的报文个数
+    */
+    size_t protect(Socket::UdpPacket *pkts, size_t count);
+    //加密一个 rtp/rtcp 报文，可由多个片段组成，失败返回空
+    Buffer::Ptr protect(const std::vector<Buffer::Ptr> &pieces);
+
+    /**
+     * 解密一个 srtp/srtcp 报文，在原内存上解密(接收到的 Buffer 只有调用者持有)
+     * @return 明文的切片; 认证失败、重放或格式错误返回空
+    */
+    Buffer::Ptr unprotect(const Buffer::Ptr &buf);
+
+    //把 protect 挂到 socket 的 sendmmsg 之前，socket 持有本对象的引用
+    void attach(const Socket::Ptr &sock);
+
+    SrtpProfile profile() const { return _profile; }
+    const Stats &stats() const { return _stats; }
+
+private:
+    struct Stream {
+        bool rtp_init = false;
+        //收到或发出过的最大序号及其 ROC
+        uint16_t seq = 0;
+        uint32_t roc = 0;
+        //发送的下一个 srtcp 序号
+        uint32_t rtcp_index = 0;
+        SrtpReplayWindow rtp_window;
+        SrtpReplayWindow rtcp_window;
+    };
+
+    SrtpContext(SrtpProfile profile);
+    bool init(const std::string &key, const std::string &salt);
+    Stream *getStream(uint32_t ssrc, bool create);
+    //data 为连续的明文，容量至少为 size + SRTP_MAX_TRAILER, 原地加密
+    bool protectPacket(uint8_t *data, size_t size, size_t &out_size);
+    bool protectRtp(uint8_t *data, size_t size, size_t &out_size);
+    bool protectRtcp(uint8_t *data, size_t size, size_t &out_size);
+    bool unprotectRtp(uint8_t *data, size_t size, size_t &out_size);
+    bool unprotectRtcp(uint8_t *data, size_t size, size_t &out_size);
+    //AES-CM 原地加解密(两者相同), iv 为16字节
+    bool cryptCtr(evp_cipher_ctx_st *ctx, const uint8_t *iv, uint8_t *data, size_t size);
+    //AES-GCM 原地加解密, iv 为12字节; 附加数据分两段(srtcp 为头部和尾部的序号); 加密时输出 tag, 解密时校验 tag
+    bool cryptGcm(evp_cipher_ctx_st *ctx, const uint8_t *iv, bool encrypt, const uint8_t *aad, size_t aad_size,
+                  const uint8_t *aad_tail, size_t aad_tail_size, uint8_t *data, size_t size, uint8_t *tag);
+    //HMAC-SHA1(data | extra), 输出 20 字节
+    bool authenticate(bool rtcp, const uint8_t *data, size_t size, const uint8_t *extra, size_t extra_size,
+                      uint8_t *out);
+
+private:
+    SrtpProfile _profile;
+    bool _gcm;
+    //rtp 认证标签长度
+    size_t _tag_size;
+    size_t _salt_size;
+    //派生出的会话盐，0: rtp, 1: rtcp
+    uint8_t _salt[2][14];
+    evp_cipher_ctx_st *_cipher[2] = {nullptr, nullptr};
+    //HMAC 上下文, openssl 3 为 EVP_MAC_CTX, 之前为 HMAC_CTX
+    void *_hmac[2] = {nullptr, nullptr};
+    std::unordered_map<uint32_t, Stream> _streams;
+    //同一批中的包大多属于同一个 ssrc
+    uint32_t _last_ssrc = 0;
+    Stream *_last_stream = nullptr;
+    Stats _stats;
+};
+
+}
+#endif  //__SRTP_H__
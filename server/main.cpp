@@ -29,6 +29,8 @@ int main_func(int argc, char *argv[]) {
             return 0;
         });
 
+        //对端断开后写 socket(包括 OpenSSL 的 socket BIO)返回 EPIPE, 不要让信号杀掉进程
+        signal(SIGPIPE, SIG_IGN);
         signal(SIGINT, [](int sig) {
             signal(SIGINT, SIG_IGN);
             sem.notify();
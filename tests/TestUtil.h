@@ -0,0 +1,47 @@
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+
+#include "Util/Util.h"
+#include <functional>
+#include <thread>
+#include <stdio.h>
+
+/**
+ * test_ 开头的功能测试共用的断言和等待:
+ * CHECK 失败时打印位置并计数，不中断后续检查; main 最后 return testResult() 作为 ctest 的结果
+*/
+
+//失败的检查个数，每个测试是单独的可执行文件
+static int s_test_fails = 0;
+
+static inline void testFailed() {
+    ++s_test_fails;
+}
+
+#define CHECK(exp)                                                     \
+    do {                                                               \
+        if (!(exp)) {                                                  \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #exp);      \
+            testFailed();                                              \
+        }                                                              \
+    } while (0)
+
+//轮询等待条件成立，超时返回 false
+static inline bool waitFor(const std::function<bool()> &cond, uint32_t timeout_ms) {
+    auto end = beton::getCurrentMilliSecond() + timeout_ms;
+    while (!cond()) {
+        if (beton::getCurrentMilliSecond() > end) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+//打印结论并返回进程退出码
+static inline int testResult() {
+    printf("%s\n", s_test_fails ? "FAILED" : "OK");
+    return s_test_fails ? 1 : 0;
+}
+
+#endif  //__TEST_UTIL_H__
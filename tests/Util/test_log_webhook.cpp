@@ -0,0 +1,284 @@
+#include "Util/Logger.h"
+#include "TestUtil.h"
+#include "Util/Util.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * LogWebHook 对接本机回环上的简易 HTTP 服务器:
+ * 1. 日志攒批成 JSON 数组 POST, 每批不超过 max_batch 条，内容按写入顺序并正确转义
+ * 2. 多次 POST 复用同一个 keep-alive 连接
+ * 3. 队列满时丢弃并计数，之后的请求在 X-Log-Dropped 头中带上累计丢弃数
+ * 4. 服务端卡住(收下连接但不读不回)时，Logger::write 和其他日志通道都不受影响
+*/
+
+//只在本地回环上监听的 HTTP 服务器，记录收到的每个请求
+class HookServer {
+public:
+    struct Request {
+        //第几个连接
+        size_t conn;
+        string body;
+        uint64_t dropped;
+    };
+
+    /**
+     * @param stall: 收下连接后不读也不回复
+     * @param delay_ms: 回复之前等待的时间
+    */
+    HookServer(bool stall = false, uint32_t delay_ms = 0) : _stall(stall), _delay_ms(delay_ms) {
+        _fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_fd, (struct sockaddr *)&addr, sizeof(addr));
+        listen(_fd, 16);
+        socklen_t len = sizeof(addr);
+        getsockname(_fd, (struct sockaddr *)&addr, &len);
+        _port = ntohs(addr.sin_port);
+        _threads.emplace_back([this]() { acceptLoop(); });
+    }
+
+    ~HookServer() {
+        _exit_flag = true;
+        shutdown(_fd, SHUT_RDWR);
+        closeConnections();
+        for (auto &thread : _threads) {
+            thread.join();
+        }
+        close(_fd);
+    }
+
+    string url() const { return "http://127.0.0.1:" + to_string(_port) + "/log"; }
+
+    //断开所有连接，卡住的连接上阻塞的收发立即失败
+    void closeConnections() {
+        lock_guard<mutex> lck(_mutex);
+        for (auto fd : _conns) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+    vector<Request> requests() {
+        lock_guard<mutex> lck(_mutex);
+        return _requests;
+    }
+
+    size_t connections() {
+        lock_guard<mutex> lck(_mutex);
+        return _conns.size();
+    }
+
+private:
+    void acceptLoop() {
+        while (!_exit_flag) {
+            int fd = accept(_fd, nullptr, nullptr);
+            if (fd == -1) {
+                continue;
+            }
+            lock_guard<mutex> lck(_mutex);
+            auto index = _conns.size();
+            _conns.emplace_back(fd);
+            _threads.emplace_back([this, fd, index]() {
+                serve(fd, index);
+                close(fd);
+            });
+        }
+    }
+
+    void serve(int fd, size_t index) {
+        string data;
+        char buf[4096];
+        while (!_exit_flag) {
+            if (_stall) {
+                //直到被 shutdown
+                if (recv(fd, buf, 0, 0) < 0 || _exit_flag) {
+                    return;
+                }
+                this_thread::sleep_for(chrono::milliseconds(10));
+                continue;
+            }
+            auto header_end = data.find("\r\n\r\n");
+            size_t content_len = 0;
+            if (header_end != string::npos) {
+                auto header = data.substr(0, header_end + 2);
+                content_len = atoi(headerValue(header, "Content-Length").data());
+                if (data.size() >= header_end + 4 + content_len) {
+                    Request request{index, data.substr(header_end + 4, content_len),
+                                    strtoull(headerValue(header, "X-Log-Dropped").data(), nullptr, 10)};
+                    data.erase(0, header_end + 4 + content_len);
+                    if (_delay_ms) {
+                        this_thread::sleep_for(chrono::milliseconds(_delay_ms));
+                    }
+                    {
+                        lock_guard<mutex> lck(_mutex);
+                        _requests.emplace_back(std::move(request));
+                    }
+                    static const string s_response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+                    send(fd, s_response.data(), s_response.size(), MSG_NOSIGNAL);
+                    continue;
+                }
+            }
+            auto n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                return;
+            }
+            data.append(buf, n);
+        }
+    }
+
+    static string headerValue(const string &header, const string &key) {
+        auto line = "\r\n" + key + ":";
+        for (size_t pos = 0; (pos = header.find("\r\n", pos)) != string::npos; pos += 2) {
+            if (!strncasecmp(header.data() + pos, line.data(), line.size())) {
+                auto start = header.find_first_not_of(' ', pos + line.size());
+                return header.substr(start, header.find("\r\n", start) - start);
+            }
+        }
+        return "";
+    }
+
+private:
+    bool _stall;
+    uint32_t _delay_ms;
+    int _fd;
+    uint16_t _port;
+    atomic<bool> _exit_flag{false};
+    mutex _mutex;
+    vector<int> _conns;
+    vector<Request> _requests;
+    vector<thread> _threads;
+};
+
+static Context::Ptr makeContext(const string &content) {
+    auto ctx = std::make_shared<Context>(LogLevel::Error, __FILE__, __LINE__);
+    *ctx << content;
+    return ctx;
+}
+
+static size_t countRecords(const string &body) {
+    size_t count = 0;
+    for (size_t pos = 0; (pos = body.find("{\"time\":", pos)) != string::npos; ++pos) {
+        ++count;
+    }
+    return count;
+}
+
+static void testBatching() {
+    HookServer server;
+    //flush_ms 足够长，只有攒满一批才会发送，最后不满的一批等超时
+    auto hook = std::make_shared<LogWebHook>("hook", LogLevel::Error, server.url(), 64, 4, 300);
+    for (int i = 0; i < 10; ++i) {
+        hook->write(makeContext("msg-" + to_string(i) + (i == 9 ? " \"quoted\"\n" : "")));
+    }
+    CHECK(waitFor([&]() { return hook->sentCount() == 10; }, 3000));
+    auto requests = server.requests();
+    vector<size_t> batches;
+    string all;
+    for (auto &request : requests) {
+        CHECK(request.body.front() == '[' && request.body.back() == ']');
+        batches.emplace_back(countRecords(request.body));
+        all += request.body;
+        //所有请求都走同一个连接
+        CHECK(request.conn == 0);
+    }
+    CHECK(batches == vector<size_t>({4, 4, 2}));
+    size_t pos = 0;
+    for (int i = 0; i < 10; ++i) {
+        auto next = all.find("\"content\":\"msg-" + to_string(i), pos);
+        CHECK(next != string::npos);
+        pos = next == string::npos ? pos : next;
+    }
+    CHECK(all.find("msg-9 \\\"quoted\\\"\\n\"}") != string::npos);
+    CHECK(all.find("\"level\":\"error\"") != string::npos);
+    CHECK(server.connections() == 1);
+    CHECK(hook->droppedCount() == 0 && hook->failedCount() == 0);
+    printf("batching: %zu requests on %zu connection(s)\n", requests.size(), server.connections());
+}
+
+static void testDropped() {
+    //服务端每次回复慢 200ms, 期间写入的日志超出队列长度
+    HookServer server(false, 200);
+    auto hook = std::make_shared<LogWebHook>("hook", LogLevel::Error, server.url(), 8, 4, 20);
+    for (int i = 0; i < 4; ++i) {
+        hook->write(makeContext("first-" + to_string(i)));
+    }
+    //第一批已经发出，正在等待回复
+    CHECK(waitFor([&]() { return server.connections() == 1; }, 1000));
+    this_thread::sleep_for(chrono::milliseconds(50));
+    for (int i = 0; i < 20; ++i) {
+        hook->write(makeContext("burst-" + to_string(i)));
+    }
+    auto dropped = hook->droppedCount();
+    CHECK(dropped == 12);
+    CHECK(waitFor([&]() { return hook->sentCount() + dropped == 24; }, 5000));
+    auto requests = server.requests();
+    CHECK(!requests.empty() && requests.front().dropped == 0);
+    CHECK(!requests.empty() && requests.back().dropped == dropped);
+    size_t records = 0;
+    for (auto &request : requests) {
+        records += countRecords(request.body);
+    }
+    CHECK(records + dropped == 24);
+    printf("overflow: %lu dropped, reported as X-Log-Dropped: %lu\n", (unsigned long)dropped,
+           requests.empty() ? 0UL : (unsigned long)requests.back().dropped);
+}
+
+//统计写入条数的通道，用于确认写日志线程没有被卡住
+class CountChannel : public Channel {
+public:
+    CountChannel() : Channel("count", LogLevel::Info) {}
+    void write(const Context::Ptr &ctx) override { ++count; }
+    atomic<size_t> count{0};
+};
+
+static void testStalled() {
+    HookServer server(true);
+    auto hook = std::make_shared<LogWebHook>("hook", LogLevel::Info, server.url(), 64, 16, 10);
+    auto counter = std::make_shared<CountChannel>();
+    auto &logger = Logger::Instance();
+    logger.add(counter);
+    logger.add(hook);
+
+    static constexpr size_t s_count = 20000;
+    uint64_t max_us = 0;
+    auto start = getCurrentMicroSecond();
+    for (size_t i = 0; i < s_count; ++i) {
+        auto begin = getCurrentMicroSecond();
+        logger.write(makeContext("stalled-" + to_string(i)));
+        max_us = std::max(max_us, getCurrentMicroSecond() - begin);
+    }
+    auto total_us = getCurrentMicroSecond() - start;
+    //其他通道照常收到全部日志
+    CHECK(waitFor([&]() { return counter->count == s_count; }, 3000));
+    CHECK(server.connections() == 1);
+    CHECK(hook->sentCount() == 0);
+    CHECK(hook->droppedCount() > 0);
+    //hook 线程在等待回复，写入最多是队列长度加上一批
+    CHECK(hook->droppedCount() >= s_count - 64 - 16);
+    printf("stalled endpoint: %zu writes in %.1fms (max %.1fms), count channel got %zu, hook dropped %lu\n",
+           s_count, total_us / 1e3, max_us / 1e3, counter->count.load(), (unsigned long)hook->droppedCount());
+    CHECK(max_us < 100000);
+
+    logger.del("hook");
+    logger.del("count");
+    //让 hook 线程结束阻塞的请求再析构
+    server.closeConnections();
+}
+
+int main() {
+    testBatching();
+    testDropped();
+    testStalled();
+    return testResult();
+}
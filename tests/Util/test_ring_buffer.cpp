@@ -0,0 +1,181 @@
+#include "Util/RingBuffer.h"
+#include "TestUtil.h"
+#include "Util/Util.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * RingBuffer 一写多读的压力测试: 一个写线程不停写入，几个读者同时读取，其中一个读得很慢
+ * 1. 读到的每一帧都是游标所指的那一帧，内容完整(没有读到被复用节点上的新帧或写了一半的帧)
+ * 2. 两次读取之间序号连续，只有在被追上(-1)或等待关键帧时才有跳跃，跳过去的第一帧是关键帧
+ * 3. 返回 -1 时确实已被追上一圈(lag >= capacity), 慢读者一定会被追上
+ * 4. 节点经由引用计数和空闲链表回收: 存活的帧数始终有上限，环形缓冲析构后全部释放
+*/
+
+static constexpr size_t s_capacity = 256;
+//关键帧间隔
+static constexpr uint64_t s_gop = 32;
+static constexpr size_t s_fast_readers = 4;
+static constexpr uint64_t s_run_ms = 2000;
+
+//带校验内容的帧，统计存活个数
+struct Frame {
+    using Ptr = shared_ptr<Frame>;
+
+    Frame(uint64_t seq_in) : seq(seq_in) {
+        for (size_t i = 0; i < sizeof(data) / sizeof(data[0]); ++i) {
+            data[i] = seq * (i + 1) + 0x9E3779B97F4A7C15ULL;
+        }
+        ++s_alive;
+    }
+    ~Frame() { --s_alive; }
+
+    bool intact() const {
+        for (size_t i = 0; i < sizeof(data) / sizeof(data[0]); ++i) {
+            if (data[i] != seq * (i + 1) + 0x9E3779B97F4A7C15ULL) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t seq;
+    uint64_t data[8];
+    static atomic<int64_t> s_alive;
+};
+
+atomic<int64_t> Frame::s_alive(0);
+
+using Ring = RingBuffer<Frame::Ptr>;
+
+struct ReaderResult {
+    uint64_t frames = 0;
+    //被追上的次数
+    uint64_t laps = 0;
+    //skipToKeyFrame 跳过的帧数
+    uint64_t skipped = 0;
+    //以下为违反约定的次数
+    uint64_t wrong_seq = 0;
+    uint64_t corrupt = 0;
+    uint64_t gap = 0;
+    uint64_t not_key = 0;
+    uint64_t early_lap = 0;
+    uint64_t final_seq = 0;
+};
+
+/**
+ * @param slow: 每读一帧休眠一会，必然被追上
+ * @param from_key: 从最近的关键帧起播，否则从最新位置等待下一个关键帧
+*/
+static void readLoop(const Ring::Ptr &ring, const atomic<bool> &writing, bool slow, bool from_key,
+                     ReaderResult &result) {
+    Ring::Reader reader(ring);
+    if (from_key) {
+        reader.seekToKeyFrame();
+    }
+    //刚起播或被追上之后，下一帧必须是关键帧
+    bool resync = true;
+    uint64_t expect = 0;
+    Frame::Ptr frame;
+    while (true) {
+        auto ret = reader.read(frame);
+        if (ret == 0) {
+            if (!writing && reader.lag() == 0) {
+                break;
+            }
+            this_thread::yield();
+            continue;
+        }
+        if (ret < 0) {
+            ++result.laps;
+            if (reader.lag() < ring->capacity()) {
+                ++result.early_lap;
+            }
+            result.skipped += reader.skipToKeyFrame();
+            resync = true;
+            continue;
+        }
+        ++result.frames;
+        if (!frame || frame->seq != reader.seq() - 1) {
+            ++result.wrong_seq;
+            continue;
+        }
+        if (!frame->intact()) {
+            ++result.corrupt;
+        }
+        if (resync) {
+            if (frame->seq % s_gop != 0) {
+                ++result.not_key;
+            }
+        } else if (frame->seq != expect) {
+            ++result.gap;
+        }
+        resync = false;
+        expect = frame->seq + 1;
+        if (slow) {
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+    }
+    result.final_seq = reader.seq();
+}
+
+int main() {
+    auto ring = std::make_shared<Ring>(s_capacity);
+    CHECK(ring->capacity() == s_capacity);
+    atomic<bool> writing{true};
+    vector<ReaderResult> results(s_fast_readers + 1);
+    vector<thread> threads;
+    for (size_t i = 0; i < results.size(); ++i) {
+        bool slow = i == s_fast_readers;
+        threads.emplace_back([&, i, slow]() { readLoop(ring, writing, slow, i % 2 == 1, results[i]); });
+    }
+
+    //槽位 + 每个读者手上的一帧和正在归还的一帧 + 写线程手上的一帧
+    int64_t alive_limit = s_capacity + 2 * results.size() + 1;
+    int64_t max_alive = 0;
+    uint64_t seq = 0;
+    auto end = getCurrentMilliSecond() + s_run_ms;
+    while (getCurrentMilliSecond() < end) {
+        for (int i = 0; i < 64; ++i, ++seq) {
+            ring->write(std::make_shared<Frame>(seq), seq % s_gop == 0);
+            max_alive = std::max<int64_t>(max_alive, Frame::s_alive);
+        }
+        CHECK(ring->writeSeq() == seq);
+        CHECK(ring->keySeq() == (seq - 1) / s_gop * s_gop);
+        this_thread::yield();
+    }
+    writing = false;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &result = results[i];
+        printf("%s reader %zu: %lu frames, %lu laps, %lu skipped\n", i == s_fast_readers ? "slow" : "fast", i,
+               (unsigned long)result.frames, (unsigned long)result.laps, (unsigned long)result.skipped);
+        CHECK(result.frames > 0);
+        CHECK(result.wrong_seq == 0);
+        CHECK(result.corrupt == 0);
+        CHECK(result.gap == 0);
+        CHECK(result.not_key == 0);
+        CHECK(result.early_lap == 0);
+        CHECK(result.final_seq == seq);
+    }
+    //慢读者每秒最多读 5000 帧，一定会被追上
+    CHECK(results.back().laps > 0 && results.back().skipped > 0);
+    printf("writer: %lu frames, max %ld frames alive (limit %ld)\n", (unsigned long)seq, (long)max_alive,
+           (long)alive_limit);
+    CHECK(seq > 10 * s_capacity);
+    CHECK(max_alive <= alive_limit);
+    //读者都已退出，只剩槽位上的帧
+    CHECK(Frame::s_alive == (int64_t)s_capacity);
+    ring.reset();
+    CHECK(Frame::s_alive == 0);
+    return testResult();
+}
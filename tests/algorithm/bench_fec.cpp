@@ -0,0 +1,157 @@
+#include "algorithm/Fec.h"
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * FEC 编解码吞吐(按数据分片的字节数计), 每种实现(scalar/ssse3/avx2)分别测试:
+ * 1. 分片大小: 188*7(ts over udp/srt), 1200 和 1400 (rtp)
+ * 2. XorFec 10x10 行列校验, 每轮丢 10 个数据包
+ * 3. ReedSolomon(10,4) 和 (20,5), 每轮丢满校验个数的数据分片, 丢失位置每轮变化(含求逆)
+ * 计时之前以及计时之后都核对恢复出的分片与原始数据逐字节一致, 不一致时返回1
+ * 用法: bench_fec [每项的轮数]
+*/
+
+static const char *s_kernels[] = {"scalar", "ssse3", "avx2"};
+static const size_t s_shard_sizes[] = {188 * 7, 1200, 1400};
+
+static mt19937 s_rng(7);
+
+struct Shards {
+    Shards(size_t count, size_t size) : data(count, vector<uint8_t>(size)) {
+        for (auto &shard : data) {
+            for (auto &byte : shard) {
+                byte = s_rng();
+            }
+        }
+        for (auto &shard : data) {
+            ptrs.push_back(shard.data());
+        }
+    }
+    const uint8_t *const *cptrs() const { return (const uint8_t *const *)ptrs.data(); }
+
+    vector<vector<uint8_t>> data;
+    vector<uint8_t *> ptrs;
+};
+
+static double rate(size_t bytes, uint64_t us) {
+    return us ? bytes / (double)us : 0;
+}
+
+//第 round 轮丢失的数据分片: 从 round 开始连续 lost 个
+static void markLost(Shards &shards, vector<char> &present, size_t data_count, size_t lost, size_t round, bool garbage) {
+    for (size_t i = 0; i < present.size(); ++i) {
+        present[i] = true;
+    }
+    for (size_t i = 0; i < lost; ++i) {
+        auto index = (round + i) % data_count;
+        present[index] = false;
+        if (garbage) {
+            memset(shards.ptrs[index], 0xee, shards.data[index].size());
+        }
+    }
+}
+
+static bool benchRs(size_t k, size_t m, size_t size, int rounds) {
+    ReedSolomon rs(k, m);
+    Shards shards(k + m, size);
+    auto original = shards.data;
+    vector<char> present(k + m);
+
+    auto start = getCurrentMicroSecond();
+    for (int i = 0; i < rounds; ++i) {
+        rs.encode(shards.cptrs(), shards.ptrs.data() + k, size);
+    }
+    auto encode_us = getCurrentMicroSecond() - start;
+    original = shards.data;
+
+    //先用垃圾数据覆盖丢失的分片，确认确实是解码写回的
+    for (size_t round = 0; round < k; ++round) {
+        markLost(shards, present, k, m, round, true);
+        if (!rs.decode(shards.ptrs.data(), (bool *)present.data(), size) || shards.data != original) {
+            printf("RS(%zu,%zu) %zuB: decode mismatch\n", k, m, size);
+            return false;
+        }
+    }
+    uint64_t decode_us = 0;
+    for (int i = 0; i < rounds; ++i) {
+        markLost(shards, present, k, m, i, false);
+        start = getCurrentMicroSecond();
+        rs.decode(shards.ptrs.data(), (bool *)present.data(), size);
+        decode_us += getCurrentMicroSecond() - start;
+    }
+    if (shards.data != original) {
+        printf("RS(%zu,%zu) %zuB: decode mismatch\n", k, m, size);
+        return false;
+    }
+    printf("  RS(%2zu,%zu)  %4zuB: encode %6.0f MB/s, decode(%zu lost) %6.0f MB/s\n", k, m, size,
+           rate(k * size * rounds, encode_us), m, rate(k * size * rounds, decode_us));
+    return true;
+}
+
+static bool benchXor(size_t columns, size_t rows, size_t size, int rounds) {
+    XorFec fec(columns, rows);
+    auto count = fec.dataCount();
+    Shards data(count, size), row_fec(rows, size), col_fec(columns, size);
+    vector<char> present(count);
+
+    auto start = getCurrentMicroSecond();
+    for (int i = 0; i < rounds; ++i) {
+        fec.encode(data.cptrs(), row_fec.ptrs.data(), col_fec.ptrs.data(), size);
+    }
+    auto encode_us = getCurrentMicroSecond() - start;
+    auto original = data.data;
+
+    //每行丢一个，位置每轮变化，行校验即可全部恢复
+    auto lose = [&](size_t round, bool garbage) {
+        for (size_t i = 0; i < count; ++i) {
+            present[i] = (i % columns) != (i / columns + round) % columns;
+            if (!present[i] && garbage) {
+                memset(data.ptrs[i], 0xee, size);
+            }
+        }
+    };
+    for (size_t round = 0; round < columns; ++round) {
+        lose(round, true);
+        if (fec.decode(data.ptrs.data(), (bool *)present.data(), row_fec.cptrs(), col_fec.cptrs(), size) ||
+            data.data != original) {
+            printf("XOR %zux%zu %zuB: decode mismatch\n", columns, rows, size);
+            return false;
+        }
+    }
+    uint64_t decode_us = 0;
+    for (int i = 0; i < rounds; ++i) {
+        lose(i, false);
+        start = getCurrentMicroSecond();
+        fec.decode(data.ptrs.data(), (bool *)present.data(), row_fec.cptrs(), col_fec.cptrs(), size);
+        decode_us += getCurrentMicroSecond() - start;
+    }
+    if (data.data != original) {
+        printf("XOR %zux%zu %zuB: decode mismatch\n", columns, rows, size);
+        return false;
+    }
+    printf("  XOR %zux%zu %4zuB: encode %6.0f MB/s, decode(%zu lost) %6.0f MB/s\n", columns, rows, size,
+           rate(count * size * rounds, encode_us), rows, rate(count * size * rounds, decode_us));
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    printf("default kernel %s, %d rounds each\n", fecKernel(), rounds);
+    for (auto kernel : s_kernels) {
+        if (!setFecKernel(kernel)) {
+            printf("%s: not supported\n", kernel);
+            continue;
+        }
+        printf("%s:\n", kernel);
+        for (auto size : s_shard_sizes) {
+            if (!benchXor(10, 10, size, rounds / 5) || !benchRs(10, 4, size, rounds) || !benchRs(20, 5, size, rounds / 2)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include "algorithm/Nack.h"
+#include "TestUtil.h"
+#include <random>
+#include <stdio.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * NackGenerator/NackResponder 以及 NACK FCI 编解码的测试，只用模拟时间:
+ * 1. 序号在 65535 -> 0 回绕时丢包检测、请求顺序和补回都正确
+ * 2. 一次跳号超过窗口时放弃所有丢包重新开始(abandonAll)
+ * 3. 窗口转过一圈后，槽位上残留的旧丢包位被计为放弃，不会被当成新的丢包或补回
+ * 4. 丢包按 reorder_ms 延后、按 RTT 重复请求，次数用完后放弃
+ * 5. 发送端一个 RTT 内不重复重传同一个包，被覆盖或过期的包计为 missed
+ * 6. FCI 编码后解码得到原来的序号，含 BLP 最高位(相差16)和序号回绕
+*/
+
+//单调时钟的起点，避开 0(NackResponder 用 0 表示没有重传过)
+static constexpr uint64_t s_start_ms = 10000;
+
+static vector<uint16_t> pollSeqs(NackGenerator &gen, uint64_t now_ms) {
+    vector<uint16_t> seqs;
+    gen.poll(now_ms, seqs);
+    return seqs;
+}
+
+static void testSeqWrap() {
+    NackGenerator gen(1024, 10, 10);
+    auto now = s_start_ms;
+    //丢掉回绕前后的 65534 和 0
+    for (uint16_t seq : {65530, 65531, 65532, 65533, 65535, 1, 2}) {
+        gen.onPacket(seq, now);
+    }
+    CHECK(gen.missing() == 2 && gen.stats().lost == 2);
+    //还在等乱序
+    CHECK(pollSeqs(gen, now + 5).empty());
+    auto seqs = pollSeqs(gen, now + 10);
+    CHECK(seqs == vector<uint16_t>({65534, 0}));
+    string fci;
+    makeNackFci(seqs, fci);
+    //一项即可: PID 65534, BLP 第1位表示 0
+    CHECK(fci.size() == 4 && (uint8_t)fci[0] == 0xFF && (uint8_t)fci[1] == 0xFE && fci[2] == 0 && fci[3] == 0x02);
+    //重传的 0 到达，65534 仍然缺失
+    gen.onPacket(0, now + 20);
+    CHECK(gen.missing() == 1 && gen.stats().recovered == 1);
+    //下次请求在一个 RTT(默认100ms) 之后
+    CHECK(pollSeqs(gen, now + 50).empty());
+    CHECK(pollSeqs(gen, now + 110) == vector<uint16_t>({65534}));
+    //重复的包不算补回
+    gen.onPacket(0, now + 120);
+    gen.onPacket(65534, now + 120);
+    gen.onPacket(65534, now + 121);
+    CHECK(gen.missing() == 0 && gen.stats().recovered == 2 && gen.stats().abandoned == 0);
+    CHECK(gen.stats().requested == 3);
+    printf("seq wrap: requested %lu, recovered %lu\n", (unsigned long)gen.stats().requested,
+           (unsigned long)gen.stats().recovered);
+}
+
+static void testJump() {
+    NackGenerator gen(64, 10, 0);
+    auto now = s_start_ms;
+    for (uint16_t seq : {100, 102, 104, 106}) {
+        gen.onPacket(seq, now);
+    }
+    CHECK(gen.missing() == 3);
+    //跳过的序号比窗口还多，之前的丢包全部放弃，中间的序号也不当作丢包
+    gen.onPacket(106 + 65, now);
+    CHECK(gen.missing() == 0 && gen.stats().abandoned == 3 && gen.stats().lost == 3);
+    CHECK(pollSeqs(gen, now + 1000).empty());
+    //之后照常检测
+    gen.onPacket(106 + 67, now);
+    CHECK(pollSeqs(gen, now) == vector<uint16_t>({106 + 66}));
+    printf("jump: %lu losses abandoned after a jump beyond the window\n", (unsigned long)gen.stats().abandoned);
+}
+
+static void testStaleBits() {
+    //窗口 64: 序号 s 和 s + 64 共用一个槽位
+    NackGenerator gen(64, 100, 0);
+    auto now = s_start_ms;
+    for (uint16_t seq = 0; seq < 10; ++seq) {
+        gen.onPacket(seq, now);
+    }
+    gen.onPacket(11, now);
+    //槽位下标回绕之后，序号仍然按窗口内唯一的那个还原
+    for (uint16_t seq = 12; seq < 74; ++seq) {
+        gen.onPacket(seq, now);
+    }
+    CHECK(pollSeqs(gen, now) == vector<uint16_t>({10}));
+    //74 到达时覆盖 10 的槽位: 10 计为放弃，74 本身不是丢包
+    gen.onPacket(74, now);
+    CHECK(gen.missing() == 0 && gen.stats().abandoned == 1);
+    CHECK(pollSeqs(gen, now + 1000).empty());
+    //迟到的 10 已经在窗口之外，不算补回
+    gen.onPacket(10, now);
+    CHECK(gen.stats().recovered == 0 && gen.missing() == 0);
+
+    //丢失的 80 的槽位被新的丢包 144 接替: 80 放弃，144 是新的丢包，计数不变
+    for (uint16_t seq = 75; seq < 80; ++seq) {
+        gen.onPacket(seq, now);
+    }
+    gen.onPacket(81, now);
+    for (uint16_t seq = 82; seq < 144; ++seq) {
+        gen.onPacket(seq, now);
+    }
+    CHECK(gen.missing() == 1);
+    gen.onPacket(145, now);
+    CHECK(gen.missing() == 1 && gen.stats().abandoned == 2 && gen.stats().lost == 3);
+    CHECK(pollSeqs(gen, now + 1) == vector<uint16_t>({144}));
+    //80 迟到也不会清掉 144 的位
+    gen.onPacket(80, now);
+    CHECK(gen.missing() == 1 && gen.stats().recovered == 0);
+    gen.onPacket(144, now);
+    CHECK(gen.missing() == 0 && gen.stats().recovered == 1);
+    printf("stale bits: abandoned %lu, lost %lu, recovered %lu\n", (unsigned long)gen.stats().abandoned,
+           (unsigned long)gen.stats().lost, (unsigned long)gen.stats().recovered);
+}
+
+static void testRetries() {
+    NackGenerator gen(1024, 3, 20);
+    gen.setRtt(50);
+    auto now = s_start_ms;
+    gen.onPacket(1, now);
+    gen.onPacket(3, now);
+    CHECK(pollSeqs(gen, now + 19).empty());
+    CHECK(pollSeqs(gen, now + 20).size() == 1);
+    CHECK(pollSeqs(gen, now + 60).empty());
+    CHECK(pollSeqs(gen, now + 70).size() == 1);
+    CHECK(pollSeqs(gen, now + 120).size() == 1);
+    //第4次请求时放弃
+    CHECK(pollSeqs(gen, now + 170).empty());
+    CHECK(gen.missing() == 0 && gen.stats().abandoned == 1 && gen.stats().requested == 3);
+}
+
+static void testResponder() {
+    NackResponder<int> rtx(64, 1000);
+    rtx.setRtt(50);
+    auto now = s_start_ms;
+    //发送跨越回绕的 65500 ~ 65535, 0 ~ 43
+    for (uint32_t i = 0; i < 80; ++i) {
+        rtx.insert((uint16_t)(65500 + i), (int)i, now + i);
+    }
+    CHECK(rtx.capacity() == 64);
+    vector<uint16_t> resent;
+    auto cb = [&](uint16_t seq, const int &pkt) {
+        CHECK((uint16_t)(65500 + pkt) == seq);
+        resent.emplace_back(seq);
+    };
+    now += 100;
+    //65500 已被 65564(即 28) 覆盖
+    CHECK(rtx.onNack({65500, 65535, 0, 28}, now, cb) == 3);
+    CHECK(resent == vector<uint16_t>({65535, 0, 28}));
+    CHECK(rtx.stats().missed == 1);
+    //一个 RTT 之内的重复请求被忽略
+    CHECK(rtx.onNack({0, 1}, now + 49, cb) == 1);
+    CHECK(rtx.stats().suppressed == 1);
+    CHECK(rtx.onNack({0}, now + 50, cb) == 1);
+    CHECK(resent == vector<uint16_t>({65535, 0, 28, 1, 0}));
+    //RTT 变大后间隔随之变大
+    rtx.setRtt(200);
+    CHECK(rtx.onNack({0}, now + 200, cb) == 0);
+    CHECK(rtx.onNack({0}, now + 250, cb) == 1);
+    CHECK(rtx.stats().suppressed == 2);
+    //超过 max_age 不再重传
+    CHECK(rtx.find(28, now + 900));
+    CHECK(!rtx.find(28, s_start_ms + 64 + 1001));
+    CHECK(rtx.onNack({28}, s_start_ms + 64 + 1001, cb) == 0);
+    CHECK(rtx.stats().missed == 2 && rtx.stats().resent == 6);
+    CHECK(rtx.find(43, now));
+    rtx.clear();
+    CHECK(!rtx.find(43, now));
+    printf("responder: resent %lu, suppressed %lu, missed %lu\n", (unsigned long)rtx.stats().resent,
+           (unsigned long)rtx.stats().suppressed, (unsigned long)rtx.stats().missed);
+}
+
+static vector<uint16_t> roundTrip(const vector<uint16_t> &seqs, size_t *items = nullptr) {
+    string fci;
+    makeNackFci(seqs, fci);
+    if (items) {
+        *items = fci.size() / 4;
+    }
+    vector<uint16_t> ret;
+    parseNackFci((const uint8_t *)fci.data(), fci.size(), ret);
+    return ret;
+}
+
+static void testFci() {
+    //相差16 用 BLP 最高位; 相差17 开始新的一项; 回绕后从 65535 到 15 相差16
+    vector<uint16_t> seqs = {100, 116, 117, 133, 65535, 15};
+    string fci;
+    makeNackFci(seqs, fci);
+    CHECK(fci.size() == 12);
+    CHECK((uint8_t)fci[2] == 0x80 && fci[3] == 0);
+    CHECK((uint8_t)fci[4] == 0 && (uint8_t)fci[5] == 117 && (uint8_t)fci[6] == 0x80);
+    CHECK((uint8_t)fci[8] == 0xFF && (uint8_t)fci[9] == 0xFF && (uint8_t)fci[10] == 0x80);
+    CHECK(roundTrip(seqs) == seqs);
+    //17 个连续的序号正好一项
+    vector<uint16_t> run;
+    for (uint16_t seq = 65530; run.size() < 17; ++seq) {
+        run.emplace_back(seq);
+    }
+    size_t items = 0;
+    CHECK(roundTrip(run, &items) == run && items == 1);
+    run.emplace_back(run.back() + 1);
+    CHECK(roundTrip(run, &items) == run && items == 2);
+
+    //随机的递增序列(含回绕)
+    mt19937 rng(7);
+    size_t total_items = 0, total_seqs = 0;
+    for (int round = 0; round < 1000; ++round) {
+        vector<uint16_t> random_seqs;
+        uint16_t seq = rng();
+        for (size_t i = 0, n = rng() % 40 + 1; i < n; ++i) {
+            random_seqs.emplace_back(seq);
+            seq += rng() % 20 + 1;
+        }
+        auto ret = roundTrip(random_seqs, &items);
+        CHECK(ret == random_seqs);
+        total_items += items;
+        total_seqs += random_seqs.size();
+    }
+    //截断的 FCI 只解析完整的项
+    vector<uint16_t> partial;
+    CHECK(parseNackFci((const uint8_t *)fci.data(), 7, partial) == 2 && partial.size() == 2);
+    printf("fci: %zu seqs in %zu items round-tripped\n", total_seqs, total_items);
+}
+
+int main() {
+    testSeqWrap();
+    testJump();
+    testStaleBits();
+    testRetries();
+    testResponder();
+    testFci();
+    return testResult();
+}
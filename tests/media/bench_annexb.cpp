@@ -0,0 +1,135 @@
+#include "media/AnnexB.h"
+#include "Util/Util.h"
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * 起始码查找的吞吐(GB/s)和正确性:
+ * 1. 每种实现(scalar/sse2/avx2)在所有对齐和长度下都和标量实现返回相同的位置
+ * 2. 在一段大的 Annex-B 数据上分别计时 findStartCode 逐个查找和 splitAnnexB
+ * 用法: bench_annexb [数据大小MB]
+*/
+
+static const char *s_scanners[] = {"scalar", "sse2", "avx2"};
+
+//带防竞争字节的随机 NAL, 零字节比随机数据多，让 SIMD 实现更常走到候选位置的确认
+static void appendNal(string &out, mt19937 &rng, size_t size) {
+    static const char s_start_code[] = {0, 0, 0, 1};
+    //一半4字节起始码，一半3字节
+    bool long_code = rng() % 2;
+    out.append(long_code ? s_start_code : s_start_code + 1, long_code ? 4 : 3);
+    out.push_back(0x41);
+    int zeros = 0;
+    for (size_t i = 1; i < size; ++i) {
+        uint8_t byte = rng() % 8 == 0 ? 0 : (uint8_t)rng();
+        if (zeros >= 2 && byte <= 3) {
+            out.push_back(3);
+            zeros = 0;
+        }
+        out.push_back(byte);
+        zeros = byte ? 0 : zeros + 1;
+    }
+    //NAL 不能以 0 结尾
+    if (out.back() == 0) {
+        out.back() = 0x80;
+    }
+}
+
+static vector<size_t> scanAll(const uint8_t *data, size_t size) {
+    vector<size_t> ret;
+    auto end = data + size;
+    for (auto pos = findStartCode(data, end); pos != end; pos = findStartCode(pos + 3, end)) {
+        ret.push_back(pos - data);
+    }
+    return ret;
+}
+
+//所有实现在各种对齐、长度、起始码位置下返回的位置一致
+static bool checkScanners(const string &stream) {
+    auto data = (const uint8_t *)stream.data();
+    setStartCodeScanner("scalar");
+    auto expect = scanAll(data, stream.size());
+    //短数据: 00 00 01 放在 [0, len] 的每个位置，覆盖 16/32 字节块的边界和尾部
+    uint8_t small[256];
+    for (auto name : s_scanners) {
+        if (!setStartCodeScanner(name)) {
+            continue;
+        }
+        if (scanAll(data, stream.size()) != expect) {
+            printf("%s: offsets differ from scalar on the large stream\n", name);
+            return false;
+        }
+        for (size_t align = 0; align < 32; ++align) {
+            for (size_t len = 0; len < 130; ++len) {
+                for (size_t pos = 0; pos <= len; ++pos) {
+                    auto buf = small + align;
+                    memset(buf, 0xff, len);
+                    //靠近末尾时起始码被截断，应当找不到
+                    for (size_t i = pos; i < pos + 3 && i < len; ++i) {
+                        buf[i] = i == pos + 2 ? 1 : 0;
+                    }
+                    if (findStartCode(buf, buf + len) != findStartCodeScalar(buf, buf + len)) {
+                        printf("%s: mismatch at align %zu len %zu pos %zu\n", name, align, len, pos);
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    printf("%zu start codes, all scanners agree with scalar\n", expect.size());
+    return true;
+}
+
+template <typename FUNC>
+static double measure(size_t bytes, FUNC &&func) {
+    //至少跑 0.5 秒
+    uint64_t total = 0;
+    auto start = getCurrentMicroSecond();
+    uint64_t elapsed = 0;
+    do {
+        func();
+        total += bytes;
+        elapsed = getCurrentMicroSecond() - start;
+    } while (elapsed < 500000);
+    return total / 1e3 / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = (argc > 1 ? atoi(argv[1]) : 64) << 20;
+    mt19937 rng(1);
+    string stream;
+    stream.reserve(size + (1 << 20));
+    while (stream.size() < size) {
+        //视频 slice 大小不一，夹杂小的 SEI/参数集
+        appendNal(stream, rng, rng() % 4 == 0 ? 8 + rng() % 64 : 500 + rng() % 50000);
+    }
+    printf("annex-b stream: %.1f MB, default scanner %s\n", stream.size() / 1048576.0, startCodeScanner());
+    if (!checkScanners(stream)) {
+        return 1;
+    }
+
+    auto buf = BufferRaw::create(stream.size(), stream.size());
+    memcpy(buf->data(), stream.data(), stream.size());
+    auto data = (const uint8_t *)buf->data();
+    vector<Buffer::Ptr> nalus;
+    for (auto name : s_scanners) {
+        if (!setStartCodeScanner(name)) {
+            printf("%-6s: not supported\n", name);
+            continue;
+        }
+        size_t count = 0;
+        auto find_rate = measure(stream.size(), [&]() { count = scanAll(data, stream.size()).size(); });
+        auto split_rate = measure(stream.size(), [&]() {
+            nalus.clear();
+            splitAnnexB(buf, nalus);
+        });
+        printf("%-6s: findStartCode %6.2f GB/s, splitAnnexB %6.2f GB/s (%zu nalus)\n", name, find_rate, split_rate,
+               nalus.size());
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "network/TcpServer.h"
+#include "threadpool/ThreadPool.h"
+#include "Util/Logger.h"
+#include "Util/Util.h"
+#include <atomic>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * TcpServer 的 accept 速率: N 个客户端线程在本机回环上不停地建立连接后立即 RST 关闭,
+ * 分别在每个 poller 一个 SO_REUSEPORT 监听socket 和单个监听socket 两种方式下，
+ * 统计每秒创建的会话数以及会话在各个 poller 上的分布
+ * 用法: bench_accept [poller 数] [客户端线程数] [每种方式的秒数]
+*/
+
+static constexpr size_t s_max_pollers = 64;
+static vector<PollerThread::Ptr> s_pollers;
+static atomic<uint64_t> s_accepted[s_max_pollers];
+
+class CountSession : public Session {
+public:
+    CountSession(const Socket::Ptr &sock) : Session(sock) {
+        for (size_t i = 0; i < s_pollers.size(); ++i) {
+            if (s_pollers[i] == sock->getPoller()) {
+                ++s_accepted[i];
+                break;
+            }
+        }
+    }
+    void onRecv(const Buffer::Ptr &buf) override {}
+    void onError(const SockException &ex) override {}
+};
+
+static uint64_t totalAccepted() {
+    uint64_t ret = 0;
+    for (size_t i = 0; i < s_pollers.size(); ++i) {
+        ret += s_accepted[i];
+    }
+    return ret;
+}
+
+static void runClients(uint16_t port, size_t threads, double seconds, atomic<uint64_t> &connected) {
+    atomic<bool> stop(false);
+    vector<thread> clients;
+    for (size_t i = 0; i < threads; ++i) {
+        clients.emplace_back([&]() {
+            struct sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            //RST 关闭，不在客户端留下 TIME_WAIT 占用本地端口
+            struct linger lg = {1, 0};
+            while (!stop) {
+                int fd = socket(AF_INET, SOCK_STREAM, 0);
+                if (fd < 0) {
+                    continue;
+                }
+                setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+                if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+                    ++connected;
+                }
+                close(fd);
+            }
+        });
+    }
+    this_thread::sleep_for(chrono::microseconds((uint64_t)(seconds * 1e6)));
+    stop = true;
+    for (auto &client : clients) {
+        client.join();
+    }
+}
+
+static void bench(bool reuse_port, size_t threads, double seconds) {
+    for (auto &count : s_accepted) {
+        count = 0;
+    }
+    auto server = std::make_shared<TcpServer>();
+    server->setReusePort(reuse_port);
+    if (!server->start<CountSession>(0, "127.0.0.1")) {
+        printf("start tcp server failed\n");
+        exit(1);
+    }
+    atomic<uint64_t> connected(0);
+    auto start = getCurrentMicroSecond();
+    runClients(server->getPort(), threads, seconds, connected);
+    //等排队中的连接都被 accept
+    for (int i = 0; i < 200 && totalAccepted() < connected; ++i) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    auto elapsed = getCurrentMicroSecond() - start;
+    auto accepted = totalAccepted();
+    server->stop();
+
+    uint64_t min = UINT64_MAX, max = 0;
+    string spread;
+    for (size_t i = 0; i < s_pollers.size(); ++i) {
+        uint64_t count = s_accepted[i];
+        min = std::min(min, count);
+        max = std::max(max, count);
+        spread += (i ? " " : "") + to_string(count);
+    }
+    printf("%-16s: %8.0f accepts/s (%lu accepted, %lu connected), per poller [%s], max/min %.2f\n",
+           reuse_port ? "SO_REUSEPORT" : "single listener", accepted * 1e6 / elapsed, (unsigned long)accepted,
+           (unsigned long)connected.load(), spread.c_str(), min ? (double)max / min : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    Logger::Instance().add(std::make_shared<LogConsole>("console", LogLevel::Warn));
+    size_t pollers = argc > 1 ? atoi(argv[1]) : 4;
+    size_t threads = argc > 2 ? atoi(argv[2]) : 4;
+    double seconds = argc > 3 ? atof(argv[3]) : 2;
+    pollers = std::max<size_t>(1, std::min(pollers, s_max_pollers));
+    ThreadPool::initialize(pollers, 1, false);
+    s_pollers = ThreadPool::Instance().getAllPollers();
+    printf("%zu pollers, %zu client threads, %u cpus\n", s_pollers.size(), threads, std::thread::hardware_concurrency());
+    bench(true, threads, seconds);
+    bench(false, threads, seconds);
+    return 0;
+}
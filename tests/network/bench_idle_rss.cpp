@@ -0,0 +1,142 @@
+#include "network/TcpServer.h"
+#include "network/TcpClient.h"
+#include "threadpool/ThreadPool.h"
+#include "Util/Logger.h"
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * 空闲连接的内存占用: 在本机回环上建立 N 对 tcp 连接，客户端发一条消息、服务端回一条,
+ * 双方都像协议解析器一样拷贝保存收到的不完整尾部，然后连接保持空闲,
+ * 打印建立连接前后的 VmRSS 以及每对连接(客户端+服务端)的平均占用
+ * 传 slice 时双方直接保存收到的切片，用于对比上层持有接收缓冲区的代价
+ * 每对连接的平均占用超过预算时返回失败; copy 默认预算 s_default_budget, slice 默认不检查
+ * 用法: bench_idle_rss [连接数] [copy|slice] [每对连接的预算(字节), 0 不检查]
+*/
+
+//每对连接的默认预算: 两个 Socket 各约 330 字节, 其余是会话对象、会话登记、epoll 回调等
+static constexpr size_t s_default_budget = 3 * 1024;
+
+static bool s_keep_slice = false;
+
+static long rssKb() {
+    ifstream file("/proc/self/status");
+    string line;
+    while (getline(file, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    return 0;
+}
+
+//像解析器保存不完整消息那样保留收到的数据
+static Buffer::Ptr keepTail(const Buffer::Ptr &buf) {
+    if (s_keep_slice) {
+        return buf;
+    }
+    auto ret = BufferRaw::create(buf->size(), buf->size());
+    memcpy(ret->data(), buf->data(), buf->size());
+    return ret;
+}
+
+class IdleSession : public Session {
+public:
+    IdleSession(const Socket::Ptr &sock) : Session(sock) {}
+    void onRecv(const Buffer::Ptr &buf) override {
+        _tail = keepTail(buf);
+        send("ok\r\n");
+    }
+    void onError(const SockException &ex) override {}
+
+private:
+    Buffer::Ptr _tail;
+};
+
+static atomic<size_t> s_replied(0);
+
+class IdleClient : public TcpClient {
+public:
+    void onConnect(const SockException &ex) override {
+        if (!ex) {
+            send("hello, keepalive\r\n");
+        }
+    }
+    void onRecv(const Buffer::Ptr &buf) override {
+        if (!_tail) {
+            ++s_replied;
+        }
+        _tail = keepTail(buf);
+    }
+    void onError(const SockException &ex) override {}
+
+private:
+    Buffer::Ptr _tail;
+};
+
+int main(int argc, char *argv[]) {
+    Logger::Instance().add(std::make_shared<LogConsole>("console", LogLevel::Warn));
+    size_t count = argc > 1 ? atoi(argv[1]) : 8000;
+    s_keep_slice = argc > 2 && !strcmp(argv[2], "slice");
+    size_t budget = argc > 3 ? atoi(argv[3]) : (s_keep_slice ? 0 : s_default_budget);
+    //每对连接占两个 fd
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < 2 * count + 256) {
+        limit.rlim_cur = std::min<rlim_t>(2 * count + 256, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    ThreadPool::initialize(0, 1, false);
+
+    auto server = std::make_shared<TcpServer>();
+    if (!server->start<IdleSession>(0, "127.0.0.1")) {
+        printf("start tcp server failed\n");
+        return 1;
+    }
+    //让线程、内存池先完成初始化
+    this_thread::sleep_for(chrono::seconds(1));
+    auto base = rssKb();
+
+    vector<IdleClient::Ptr> clients;
+    clients.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto client = std::make_shared<IdleClient>();
+        client->startConnect("127.0.0.1", server->getPort());
+        clients.emplace_back(std::move(client));
+        //别让监听队列溢出
+        if (i % 500 == 499) {
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+    }
+    for (int i = 0; i < 200 && (server->sessionCount() < count || s_replied < count); ++i) {
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    //等最后的收发完成、发送队列清空
+    this_thread::sleep_for(chrono::seconds(1));
+    auto rss = rssKb();
+
+    printf("%zu idle connection pairs (%zu sessions, %zu replied), keep %s\n", count, server->sessionCount(),
+           s_replied.load(), s_keep_slice ? "slice" : "copy");
+    auto per_pair = (rss - base) * 1024.0 / count;
+    printf("VmRSS before %ld KB, after %ld KB, %.0f bytes per pair, sizeof(Socket) %zu\n", base, rss, per_pair,
+           sizeof(Socket));
+    int ret = 0;
+    if (server->sessionCount() < count || s_replied < count) {
+        printf("not all connections established\n");
+        ret = 1;
+    } else if (budget && per_pair > budget) {
+        printf("over budget: %.0f > %zu bytes per pair\n", per_pair, budget);
+        ret = 1;
+    }
+    clients.clear();
+    server->stop();
+    return ret;
+}
@@ -0,0 +1,302 @@
+#include "network/DnsResolver.h"
+#include "TestUtil.h"
+#include "threadpool/ThreadPool.h"
+#include "Util/Logger.h"
+#include "Util/Util.h"
+#include <atomic>
+#include <map>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * DnsResolver 对接本机的 udp 桩服务器(setNameServers("127.0.0.1:port")):
+ * 1. A/AAAA 应答合并，ipv6 在前; 只有 A 记录的域名
+ * 2. NXDOMAIN 按权威段 SOA 的 TTL/MINIMUM 做否定缓存，过期后重新查询
+ * 3. 响应被截断(TC)时退回系统解析，不使用截断报文中的记录，也不重发
+ * 4. 服务器不响应时超时后换下一个服务器; 所有服务器都不响应时返回超时
+ * 5. 缓存按记录的 TTL 过期
+*/
+
+static void writeU16(string &out, uint16_t value) {
+    out.push_back((char)(value >> 8));
+    out.push_back((char)(value & 0xFF));
+}
+
+static void writeU32(string &out, uint32_t value) {
+    writeU16(out, value >> 16);
+    writeU16(out, value & 0xFFFF);
+}
+
+//指向问题段域名的资源记录
+static void writeRecord(string &out, uint16_t type, uint32_t ttl, const string &rdata) {
+    writeU16(out, 0xC00C);
+    writeU16(out, type);
+    writeU16(out, 1);
+    writeU32(out, ttl);
+    writeU16(out, rdata.size());
+    out.append(rdata);
+}
+
+static string makeSoa(uint32_t minimum) {
+    //mname 和 rname 都是根域名
+    string rdata(2, 0);
+    for (uint32_t value : {1u, 3600u, 600u, 86400u, minimum}) {
+        writeU32(rdata, value);
+    }
+    return rdata;
+}
+
+static string ipv4(const char *ip) {
+    struct in_addr addr;
+    inet_pton(AF_INET, ip, &addr);
+    return string((char *)&addr, 4);
+}
+
+static string ipv6(const char *ip) {
+    struct in6_addr addr;
+    inet_pton(AF_INET6, ip, &addr);
+    return string((char *)&addr, 16);
+}
+
+/**
+ * 在独立线程中应答的 udp DNS 服务器，按域名决定应答:
+ * both.test: A 127.0.0.2 + AAAA ::2; v4only.test: 只有 A 127.0.0.3;
+ * short.test: A 127.0.0.4, TTL 1 秒; nx.test: NXDOMAIN, SOA MINIMUM 1 秒;
+ * tc.test: 截断的应答，带一条不应被使用的 A 记录; slow.test 以及 silent 的服务器: 不应答
+*/
+class StubServer {
+public:
+    StubServer(bool silent) : _silent(silent) {
+        _fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_fd, (struct sockaddr *)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(_fd, (struct sockaddr *)&addr, &len);
+        _port = ntohs(addr.sin_port);
+        //定时醒来检查是否退出
+        struct timeval tv = {0, 50000};
+        setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        _thread = thread([this]() { run(); });
+    }
+
+    ~StubServer() {
+        _exit_flag = true;
+        _thread.join();
+        close(_fd);
+    }
+
+    string address() const { return "127.0.0.1:" + to_string(_port); }
+
+    //收到的某个域名的查询个数(A 和 AAAA 各算一个)
+    size_t queries(const string &name) {
+        lock_guard<mutex> lck(_mutex);
+        return _queries[name];
+    }
+
+private:
+    void run() {
+        while (!_exit_flag) {
+            uint8_t buf[512];
+            struct sockaddr_storage peer;
+            socklen_t peer_len = sizeof(peer);
+            auto size = recvfrom(_fd, buf, sizeof(buf), 0, (struct sockaddr *)&peer, &peer_len);
+            if (size < 12) {
+                continue;
+            }
+            string name;
+            size_t pos = 12;
+            while (pos < (size_t)size && buf[pos]) {
+                name += (name.empty() ? "" : ".") + string((char *)buf + pos + 1, buf[pos]);
+                pos += buf[pos] + 1;
+            }
+            pos += 5;
+            if (pos > (size_t)size) {
+                continue;
+            }
+            uint16_t type = buf[pos - 4] << 8 | buf[pos - 3];
+            {
+                lock_guard<mutex> lck(_mutex);
+                ++_queries[name];
+            }
+            if (_silent || name == "slow.test") {
+                continue;
+            }
+            auto response = answer(string((char *)buf, pos), name, type);
+            sendto(_fd, response.data(), response.size(), 0, (struct sockaddr *)&peer, peer_len);
+        }
+    }
+
+    static string answer(const string &query, const string &name, uint16_t type) {
+        //头部 + 问题段, QR RD RA
+        string out = query;
+        out[2] = (char)0x81;
+        out[3] = (char)0x80;
+        uint16_t answers = 0, authorities = 0;
+        string records;
+        if (name == "nx.test") {
+            out[3] = (char)0x83;
+            writeRecord(records, 6, 600, makeSoa(1));
+            ++authorities;
+        } else if (name == "tc.test") {
+            out[2] = (char)0x83;
+            writeRecord(records, 1, 300, ipv4("192.0.2.1"));
+            ++answers;
+        } else if (type == 1) {
+            auto ip = name == "both.test" ? "127.0.0.2" : (name == "v4only.test" ? "127.0.0.3" : "127.0.0.4");
+            writeRecord(records, 1, name == "short.test" ? 1 : 300, ipv4(ip));
+            ++answers;
+        } else if (name == "both.test") {
+            writeRecord(records, 28, 300, ipv6("::2"));
+            ++answers;
+        } else {
+            //没有 AAAA 记录
+            writeRecord(records, 6, 60, makeSoa(60));
+            ++authorities;
+        }
+        out[6] = answers >> 8;
+        out[7] = answers & 0xFF;
+        out[8] = authorities >> 8;
+        out[9] = authorities & 0xFF;
+        return out + records;
+    }
+
+private:
+    bool _silent;
+    int _fd;
+    uint16_t _port;
+    atomic<bool> _exit_flag{false};
+    thread _thread;
+    mutex _mutex;
+    map<string, size_t> _queries;
+};
+
+struct Result {
+    SockException ex;
+    vector<string> addrs;
+    uint64_t elapsed_ms = 0;
+};
+
+static Result resolve(const string &host) {
+    Result ret;
+    semaphore sem;
+    auto start = getCurrentMilliSecond();
+    DnsResolver::Instance().resolve(host, [&](const SockException &ex, const DnsResolver::AddrList &addrs) {
+        ret.ex = ex;
+        for (auto &addr : addrs) {
+            ret.addrs.emplace_back(SockUtil::inetNtoa((struct sockaddr *)&addr));
+        }
+        ret.elapsed_ms = getCurrentMilliSecond() - start;
+        sem.notify();
+    });
+    if (!sem.wait_for(10000)) {
+        printf("FAIL resolve %s: no callback\n", host.data());
+        testFailed();
+    }
+    return ret;
+}
+
+static void testAnswers(StubServer &server) {
+    auto result = resolve("Both.Test.");
+    CHECK(!result.ex);
+    CHECK(result.addrs == vector<string>({"::2", "127.0.0.2"}));
+    CHECK(server.queries("both.test") == 2);
+    //命中缓存，不再查询
+    result = resolve("both.test");
+    CHECK(result.addrs.size() == 2 && server.queries("both.test") == 2);
+
+    auto v4only = resolve("v4only.test");
+    CHECK(!v4only.ex);
+    CHECK(v4only.addrs == vector<string>({"127.0.0.3"}));
+    printf("answers: both.test -> %zu addrs, v4only.test -> %zu addrs\n", result.addrs.size(), v4only.addrs.size());
+}
+
+static void testNegativeCache(StubServer &server) {
+    auto result = resolve("nx.test");
+    CHECK(result.ex && result.ex.custom_code() == Err_Dns && result.addrs.empty());
+    //等另一种类型的应答也到达，之后的计数只来自新的查询
+    this_thread::sleep_for(chrono::milliseconds(100));
+    auto queries = server.queries("nx.test");
+    CHECK(queries >= 1);
+    result = resolve("nx.test");
+    CHECK(result.ex && server.queries("nx.test") == queries);
+    //SOA 的 MINIMUM 为 1 秒，比默认的否定缓存时间短
+    this_thread::sleep_for(chrono::milliseconds(1200));
+    result = resolve("nx.test");
+    CHECK(result.ex && server.queries("nx.test") > queries);
+    printf("nxdomain: %s, cached until the SOA minimum expires\n", result.ex.what());
+}
+
+static void testTtlExpiry(StubServer &server) {
+    auto result = resolve("short.test");
+    CHECK(result.addrs == vector<string>({"127.0.0.4"}));
+    this_thread::sleep_for(chrono::milliseconds(100));
+    auto queries = server.queries("short.test");
+    result = resolve("short.test");
+    CHECK(result.addrs.size() == 1 && server.queries("short.test") == queries);
+    this_thread::sleep_for(chrono::milliseconds(1200));
+    result = resolve("short.test");
+    CHECK(result.addrs.size() == 1 && server.queries("short.test") > queries);
+    printf("ttl expiry: short.test queried again after 1s\n");
+}
+
+static void testTruncated(StubServer &server) {
+    auto result = resolve("tc.test");
+    //结果来自系统解析(通常是不存在), 截断报文中的记录不能用
+    for (auto &addr : result.addrs) {
+        CHECK(addr != "192.0.2.1");
+    }
+    this_thread::sleep_for(chrono::milliseconds(300));
+    CHECK(server.queries("tc.test") >= 1 && server.queries("tc.test") <= 2);
+    printf("truncated: fell back to the system resolver (%s), %zu queries\n", result.ex.what(),
+           server.queries("tc.test"));
+}
+
+static void testTimeout(StubServer &server, StubServer &silent) {
+    auto &resolver = DnsResolver::Instance();
+    resolver.clearCache();
+    //第一个服务器不应答，超时后换到第二个
+    resolver.setNameServers({silent.address(), server.address()});
+    resolver.setTimeout(200, 3);
+    auto queries = server.queries("both.test");
+    auto result = resolve("both.test");
+    CHECK(!result.ex && result.addrs.size() == 2);
+    CHECK(result.elapsed_ms >= 190);
+    CHECK(silent.queries("both.test") == 2 && server.queries("both.test") == queries + 2);
+    printf("retry: answered by the second server after %lums\n", (unsigned long)result.elapsed_ms);
+
+    //两个服务器都不应答
+    resolver.setTimeout(100, 2);
+    result = resolve("slow.test");
+    CHECK(result.ex && result.ex.custom_code() == Err_Timeout && result.ex.sock_code() == ETIMEDOUT);
+    CHECK(result.elapsed_ms >= 190);
+    CHECK(silent.queries("slow.test") == 2 && server.queries("slow.test") == 2);
+    printf("timeout: %s after %lums\n", result.ex.what(), (unsigned long)result.elapsed_ms);
+}
+
+int main() {
+    Logger::Instance().add(std::make_shared<LogConsole>("console", LogLevel::Warn));
+    ThreadPool::initialize(1, 1, false);
+    StubServer server(false), silent(true);
+    auto &resolver = DnsResolver::Instance();
+    resolver.setNameServers({server.address()});
+    resolver.setTimeout(1000, 2);
+    //正缓存下限放到1秒，验证按 TTL 过期
+    resolver.setCache(4096, 1, 3600, 30);
+
+    testAnswers(server);
+    testNegativeCache(server);
+    testTtlExpiry(server);
+    testTruncated(server);
+    testTimeout(server, silent);
+    return testResult();
+}
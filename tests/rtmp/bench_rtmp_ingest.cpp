@@ -0,0 +1,202 @@
+#include "rtmp/RtmpSession.h"
+#include "media/H264.h"
+#include "threadpool/ThreadPool.h"
+#include "Util/Logger.h"
+#include "Util/Util.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * rtmp 推流接收的单核吞吐:
+ * 合成的推流字节流按 64KB 一次交给 RtmpSession::onRecv, 经过 RtmpProtocol::onParseRtmp 解块,
+ * 再写入 RtmpMediaSource 和 RtspMuxer, 全部在一个 poller 线程中执行并计时
+ * 会话的 socket 是一条本机 tcp 连接的服务端，对端不发送数据，只是让会话的回复有地方可写
+ * 用法: bench_rtmp_ingest [每种块大小的测试秒数]
+*/
+
+//一次 read 交给会话的数据量
+static constexpr size_t s_read_size = 64 * 1024;
+//每轮推流的时长，30fps 视频 + 43fps 音频
+static constexpr int s_round_frames = 300;
+
+static Buffer::Ptr makeBuffer(const string &str) {
+    auto buf = BufferRaw::create(str.size(), str.size());
+    memcpy(buf->data(), str.data(), str.size());
+    return buf;
+}
+
+static string unhex(const char *str) {
+    string ret;
+    while (*str) {
+        ret.push_back((char)strtol(str, (char **)&str, 16));
+    }
+    return ret;
+}
+
+//推流端: 把要发送的块写到 out
+class Publisher : public RtmpProtocol {
+public:
+    string out;
+
+protected:
+    void onSendRawData(Buffer::Ptr buf) override { out.append(buf->data(), buf->size()); }
+    void onRtmpMessage(const RtmpPacket::Ptr &pkt) override {}
+};
+
+struct IngestStream {
+    //握手、connect/publish、序列头
+    string prefix;
+    //一轮的音视频
+    vector<Buffer::Ptr> media;
+    size_t media_bytes = 0;
+    size_t media_count = 0;
+};
+
+static IngestStream makeStream(size_t chunk_size, const string &stream) {
+    IngestStream ret;
+    Publisher pub;
+    //C0 C1 C2, 服务端不校验 C2 的内容
+    pub.out.assign(1 + RTMP_HANDSHAKE_SIZE * 2, 'c');
+    pub.out[0] = RTMP_VERSION;
+
+    AmfEncoder enc;
+    AmfValue obj(AMF_OBJECT);
+    obj.set("app", "live").set("tcUrl", "rtmp://127.0.0.1/live").set("objectEncoding", 0);
+    enc << "connect" << 1 << obj;
+    pub.sendAmf(RTMP_COMMAND_AMF0, 0, enc);
+    enc << "createStream" << 2 << AmfValue(AMF_NULL);
+    pub.sendAmf(RTMP_COMMAND_AMF0, 0, enc);
+    enc << "publish" << 3 << AmfValue(AMF_NULL) << stream << "live";
+    pub.sendAmf(RTMP_COMMAND_AMF0, 1, enc);
+    AmfValue meta(AMF_ECMA_ARRAY);
+    meta.set("width", 1280).set("height", 720).set("framerate", 30);
+    enc << "@setDataFrame" << "onMetaData" << meta;
+    pub.sendAmf(RTMP_DATA_AMF0, 1, enc, RTMP_CSID_DATA);
+    pub.setChunkSize(chunk_size);
+
+    auto sps = unhex("67 64 00 1f ac d9 40 50 05 bb 01 10 00 00 03 00 10 00 00 03 03 c0 f1 83 19 60");
+    auto pps = unhex("68 eb e3 cb 22 c0");
+    pub.sendRtmp(RTMP_VIDEO, 1, makeBuffer(string("\x17\x00\x00\x00\x00", 5) + makeAvcConfig(sps, pps)), 0, RTMP_CSID_VIDEO);
+    pub.sendRtmp(RTMP_AUDIO, 1, makeBuffer(string("\xaf\x00\x12\x10", 4)), 0, RTMP_CSID_AUDIO);
+    ret.prefix.swap(pub.out);
+
+    //约 5Mbps: 每 2 秒一个 60KB 的关键帧，其余 15~25KB
+    srand(1);
+    uint32_t audio_ts = 0;
+    for (int i = 0; i < s_round_frames; ++i) {
+        uint32_t ts = i * 1000 / 30;
+        bool key = i % 60 == 0;
+        size_t nal_size = key ? 60000 : 15000 + rand() % 10000;
+        string tag(9 + nal_size, (char)i);
+        tag[0] = key ? 0x17 : 0x27;
+        tag[1] = 1;
+        tag[2] = tag[3] = tag[4] = 0;
+        tag[5] = nal_size >> 24;
+        tag[6] = nal_size >> 16;
+        tag[7] = nal_size >> 8;
+        tag[8] = nal_size;
+        tag[9] = key ? 0x65 : 0x41;
+        pub.sendRtmp(RTMP_VIDEO, 1, makeBuffer(tag), ts, RTMP_CSID_VIDEO);
+        ++ret.media_count;
+        for (; audio_ts <= ts; audio_ts += 23) {
+            pub.sendRtmp(RTMP_AUDIO, 1, makeBuffer(string("\xaf\x01", 2) + string(300, 'a')), audio_ts, RTMP_CSID_AUDIO);
+            ++ret.media_count;
+        }
+    }
+    ret.media_bytes = pub.out.size();
+    for (size_t pos = 0; pos < pub.out.size(); pos += s_read_size) {
+        ret.media.emplace_back(makeBuffer(pub.out.substr(pos, s_read_size)));
+    }
+    return ret;
+}
+
+//建立一条本机 tcp 连接，fds[0] 为服务端
+static bool tcpPair(int fds[2]) {
+    struct sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    fds[1] = socket(AF_INET, SOCK_STREAM, 0);
+    bool ok = listen_fd >= 0 && fds[1] >= 0 && !bind(listen_fd, (struct sockaddr *)&addr, len) && !listen(listen_fd, 1) &&
+              !getsockname(listen_fd, (struct sockaddr *)&addr, &len) && !connect(fds[1], (struct sockaddr *)&addr, len) &&
+              (fds[0] = accept(listen_fd, nullptr, nullptr)) >= 0;
+    close(listen_fd);
+    if (!ok) {
+        close(fds[1]);
+    }
+    return ok;
+}
+
+//返回本轮耗时(微秒), 失败返回0
+static uint64_t runRound(const PollerThread::Ptr &poller, const IngestStream &stream, const string &name) {
+    int fds[2];
+    if (!tcpPair(fds)) {
+        ErrorL << "connect over loopback failed: " << SockException(errno);
+        return 0;
+    }
+    uint64_t elapsed = 0;
+    poller->sync([&]() {
+        auto sock = Socket::create(poller);
+        if (!sock->attachFd(fds[0], SockInfo::Sock_Tcp)) {
+            close(fds[0]);
+            return;
+        }
+        auto session = std::make_shared<RtmpSession>(sock);
+        session->attachSock(sock);
+        session->onRecv(makeBuffer(stream.prefix));
+        auto src = RtmpMediaSource::find(DEFAULT_VHOST, "live", name);
+        if (!src) {
+            ErrorL << "publish " << name << " failed";
+            return;
+        }
+        auto start = getCurrentMicroSecond();
+        for (auto &buf : stream.media) {
+            session->onRecv(buf);
+        }
+        elapsed = getCurrentMicroSecond() - start;
+        if (session->bytesReceived() != stream.prefix.size() + stream.media_bytes) {
+            ErrorL << "session stopped after " << session->bytesReceived() << " bytes";
+            elapsed = 0;
+        }
+        sock->closeSock();
+        session->onError(SockException(0, "bench round end", Err_Eof));
+    });
+    close(fds[1]);
+    return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    //每轮都会新建会话和媒体源，只输出警告以上的日志
+    Logger::Instance().add(std::make_shared<LogConsole>("console", LogLevel::Warn));
+    ThreadPool::initialize(1, 1, false);
+    double seconds = argc > 1 ? atof(argv[1]) : 2;
+    auto poller = ThreadPool::Instance().getPoller();
+
+    printf("rtmp ingest, one poller thread, %zu KB reads\n", s_read_size / 1024);
+    for (size_t chunk_size : {128, 4096, 60000}) {
+        uint64_t total_us = 0, total_bytes = 0, total_msgs = 0;
+        for (int round = 0; total_us < seconds * 1e6; ++round) {
+            auto name = "bench_" + to_string(chunk_size) + "_" + to_string(round);
+            auto stream = makeStream(chunk_size, name);
+            auto elapsed = runRound(poller, stream, name);
+            if (!elapsed) {
+                return 1;
+            }
+            total_us += elapsed;
+            total_bytes += stream.media_bytes;
+            total_msgs += stream.media_count;
+        }
+        printf("chunk size %5zu: %8.1f MB/s %8.0f msgs/s, %6.0f x 5Mbps publishers per core\n", chunk_size,
+               total_bytes / (double)total_us, total_msgs * 1e6 / total_us, total_bytes * 8.0 / total_us / 5);
+    }
+    return 0;
+}
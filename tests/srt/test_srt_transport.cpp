@@ -0,0 +1,285 @@
+#include "srt/SrtTransport.h"
+#include "TestUtil.h"
+#include "Util/Logger.h"
+#include "Util/Util.h"
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * SrtTransport 的协议测试，不经过 socket: caller 和 listener 两个子类背靠背连接,
+ * 报文经过一条单程时延固定、可注入丢包的模拟链路，由一个线程按真实时间驱动收发和定时器
+ * 1. 握手: 双方都进入连接状态，延时取两端较大值，listener 拿到 caller 的 stream id
+ * 2. 随机丢包(含重传包): NAK 和重传补回所有丢包，按序号连续交付，交付时间不早于 TSBPD 延时
+ * 3. 永久丢包: 来不及补回的包被放弃(stats().recv_dropped), 其余的包仍然按序按时交付
+*/
+
+//单程时延
+static constexpr uint64_t s_link_delay_us = 10000;
+
+class Link;
+
+class Endpoint : public SrtTransport {
+public:
+    //决定是否丢掉一个数据包，参数为负载中的计数
+    using onFilter = function<bool(uint64_t counter)>;
+
+    Endpoint(bool caller, const SrtConfig &config, Link &link) : SrtTransport(caller, config), _link(link) {}
+
+    void setPeer(Endpoint *peer) { _peer = peer; }
+    void setDropFilter(onFilter filter) { _drop = std::move(filter); }
+    //到时间时调用 onSrtTimer
+    void poll(uint64_t now_us) {
+        if (now_us >= _wakeup_us) {
+            _wakeup_us = UINT64_MAX;
+            auto next = onSrtTimer();
+            if (next) {
+                _wakeup_us = std::min(_wakeup_us, now_us + next * 1000);
+            }
+        }
+    }
+
+    bool up = false;
+    bool down = false;
+    string handshake_stream_id;
+    //交付的计数以及从发送到交付的时间
+    vector<uint64_t> got;
+    vector<int64_t> latency;
+    //按计数丢掉的数据包(含重传)
+    size_t filtered = 0;
+
+protected:
+    void onSrtSend(vector<Buffer::Ptr> bufs) override;
+    uint32_t onSrtHandshake(const string &stream_id) override {
+        handshake_stream_id = stream_id;
+        return 0;
+    }
+    void onSrtConnected() override { up = true; }
+    void onSrtData(const Buffer::Ptr &payload) override {
+        uint64_t counter, send_us;
+        memcpy(&counter, payload->data(), 8);
+        memcpy(&send_us, payload->data() + 8, 8);
+        got.push_back(counter);
+        latency.push_back(getCurrentMicroSecond() - send_us);
+    }
+    void onSrtClose(const SockException &ex) override { down = true; }
+    void onSrtWakeup(uint32_t delay_ms) override { _wakeup_us = getCurrentMicroSecond() + delay_ms * 1000; }
+
+private:
+    Link &_link;
+    Endpoint *_peer = nullptr;
+    onFilter _drop;
+    uint64_t _wakeup_us = 0;
+};
+
+//按到达时间排队的报文
+class Link {
+public:
+    void push(Endpoint *dst, Buffer::Ptr buf) {
+        _packets.emplace_back(Packet{getCurrentMicroSecond() + s_link_delay_us, dst, std::move(buf)});
+    }
+
+    /**
+     * 驱动两端直到 duration_ms 结束或 until 返回 true
+     * @param on_tick: 每轮调用一次，用于按节奏发送
+    */
+    bool run(Endpoint &a, Endpoint &b, uint64_t duration_ms, const function<bool()> &until = nullptr,
+             const function<void(uint64_t now_us)> &on_tick = nullptr) {
+        auto end = getCurrentMicroSecond() + duration_ms * 1000;
+        while (true) {
+            auto now = getCurrentMicroSecond();
+            if (until && until()) {
+                return true;
+            }
+            if (now >= end) {
+                return false;
+            }
+            if (on_tick) {
+                on_tick(now);
+            }
+            //链路时延固定，队列按到达时间有序
+            while (!_packets.empty() && _packets.front().arrive_us <= now) {
+                auto pkt = std::move(_packets.front());
+                _packets.pop_front();
+                pkt.dst->onSrtPacket(pkt.buf);
+            }
+            a.poll(now);
+            b.poll(now);
+            this_thread::sleep_for(chrono::microseconds(500));
+        }
+    }
+
+private:
+    struct Packet {
+        uint64_t arrive_us;
+        Endpoint *dst;
+        Buffer::Ptr buf;
+    };
+    deque<Packet> _packets;
+};
+
+void Endpoint::onSrtSend(vector<Buffer::Ptr> bufs) {
+    size_t size = 0;
+    for (auto &buf : bufs) {
+        size += buf->size();
+    }
+    auto pkt = BufferRaw::create(size, size);
+    size_t offset = 0;
+    for (auto &buf : bufs) {
+        memcpy(pkt->data() + offset, buf->data(), buf->size());
+        offset += buf->size();
+    }
+    //数据包的最高位为0, 负载紧跟在16字节头部之后
+    bool data = !(pkt->data()[0] & 0x80);
+    if (data && _drop && size >= SRT_HEADER_SIZE + 8) {
+        uint64_t counter;
+        memcpy(&counter, pkt->data() + SRT_HEADER_SIZE, 8);
+        if (_drop(counter)) {
+            ++filtered;
+            return;
+        }
+    }
+    _link.push(_peer, std::move(pkt));
+}
+
+static Buffer::Ptr makePayload(uint64_t counter) {
+    auto buf = BufferRaw::create(SRT_LIVE_PAYLOAD, SRT_LIVE_PAYLOAD);
+    memset(buf->data(), 0x47, SRT_LIVE_PAYLOAD);
+    auto now = getCurrentMicroSecond();
+    memcpy(buf->data(), &counter, 8);
+    memcpy(buf->data() + 8, &now, 8);
+    return buf;
+}
+
+struct Pair {
+    Pair(const SrtConfig &caller_config, const SrtConfig &listener_config)
+        : caller(true, caller_config, link), listener(false, listener_config, link) {
+        caller.setPeer(&listener);
+        listener.setPeer(&caller);
+    }
+
+    bool connect() {
+        caller.startHandshake();
+        return link.run(caller, listener, 2000, [&]() { return caller.up && listener.up; });
+    }
+
+    //每 10ms 发 10 个包(约 10.5Mbps), 持续 duration_ms, 之后再运行 tail_ms 让丢包补回、数据交付完
+    uint64_t pump(uint64_t duration_ms, uint64_t tail_ms) {
+        uint64_t counter = 0;
+        auto start = getCurrentMicroSecond();
+        uint64_t next_us = start;
+        link.run(caller, listener, duration_ms, nullptr, [&](uint64_t now_us) {
+            while (now_us >= next_us) {
+                for (int i = 0; i < 10; ++i) {
+                    caller.sendData(makePayload(counter++));
+                }
+                next_us += 10000;
+            }
+        });
+        link.run(caller, listener, tail_ms);
+        return counter;
+    }
+
+    Link link;
+    Endpoint caller;
+    Endpoint listener;
+};
+
+static void testHandshake() {
+    SrtConfig caller_config, listener_config;
+    caller_config.stream_id = "#!::r=live/test,m=publish";
+    caller_config.latency_ms = 120;
+    listener_config.latency_ms = 200;
+    Pair pair(caller_config, listener_config);
+    CHECK(pair.connect());
+    CHECK(pair.caller.connected() && pair.listener.connected());
+    CHECK(pair.caller.latencyMs() == 200 && pair.listener.latencyMs() == 200);
+    CHECK(pair.listener.handshake_stream_id == caller_config.stream_id);
+    CHECK(pair.listener.streamId() == caller_config.stream_id);
+    printf("handshake: latency %ums, stream id %s\n", pair.listener.latencyMs(), pair.listener.streamId().c_str());
+}
+
+static void testLossRecovery() {
+    SrtConfig config;
+    config.latency_ms = 120;
+    Pair pair(config, config);
+    CHECK(pair.connect());
+    //5% 的数据包(含重传)被丢掉; 最后的包丢了没有后续包能发现，不丢
+    mt19937 rng(42);
+    pair.caller.setDropFilter([&](uint64_t counter) { return counter < 1900 && rng() % 100 < 5; });
+    auto total = pair.pump(2000, 600);
+
+    auto &got = pair.listener.got;
+    auto &stats = pair.listener.stats();
+    bool in_order = got.size() == total;
+    for (size_t i = 0; in_order && i < got.size(); ++i) {
+        in_order = got[i] == i;
+    }
+    auto latency = pair.listener.latency;
+    sort(latency.begin(), latency.end());
+    printf("loss recovery: sent %lu, dropped on link %zu, delivered %zu, lost %lu, recovered %lu, nak %lu, "
+           "retransmitted %lu, latency %.1f-%.1fms\n",
+           (unsigned long)total, pair.caller.filtered, got.size(), (unsigned long)stats.lost,
+           (unsigned long)stats.recovered, (unsigned long)stats.nak_sent,
+           (unsigned long)pair.caller.stats().retransmitted, latency.empty() ? 0 : latency.front() / 1e3,
+           latency.empty() ? 0 : latency.back() / 1e3);
+    CHECK(pair.caller.filtered > 0);
+    CHECK(in_order);
+    CHECK(stats.lost > 0 && stats.recovered == stats.lost);
+    CHECK(stats.nak_sent > 0 && pair.caller.stats().nak_received > 0);
+    CHECK(pair.caller.stats().retransmitted >= pair.caller.filtered);
+    CHECK(stats.recv_dropped == 0);
+    //TSBPD: 补回的包和按时到达的包一样在 延时+单程时延 交付
+    CHECK(!latency.empty() && latency.front() >= (int64_t)(config.latency_ms * 1000));
+    CHECK(!latency.empty() && latency.back() < (int64_t)(config.latency_ms * 1000 + s_link_delay_us + 60000));
+}
+
+static void testTooLateDrop() {
+    SrtConfig config;
+    config.latency_ms = 120;
+    Pair pair(config, config);
+    CHECK(pair.connect());
+    //计数 %100 == 7 的包每次发送都被丢掉，永远补不回来
+    pair.caller.setDropFilter([](uint64_t counter) { return counter % 100 == 7; });
+    auto total = pair.pump(2000, 600);
+
+    auto &got = pair.listener.got;
+    auto &stats = pair.listener.stats();
+    size_t unexpected = 0, missing = 0;
+    uint64_t expect = 0;
+    for (auto counter : got) {
+        if (counter < expect) {
+            ++unexpected;
+            continue;
+        }
+        for (; expect < counter; ++expect) {
+            expect % 100 == 7 ? ++missing : ++unexpected;
+        }
+        ++expect;
+    }
+    auto latency = pair.listener.latency;
+    sort(latency.begin(), latency.end());
+    printf("too-late drop: sent %lu, delivered %zu, missing %zu, unexpected %zu, recv_dropped %lu, "
+           "latency %.1f-%.1fms\n",
+           (unsigned long)total, got.size(), missing, unexpected, (unsigned long)stats.recv_dropped,
+           latency.empty() ? 0 : latency.front() / 1e3, latency.empty() ? 0 : latency.back() / 1e3);
+    CHECK(unexpected == 0);
+    CHECK(expect == total);
+    CHECK(missing == total / 100 && stats.recv_dropped == missing);
+    //放弃丢包不能拖住后面的包
+    CHECK(!latency.empty() && latency.back() < (int64_t)(config.latency_ms * 1000 + s_link_delay_us + 60000));
+}
+
+int main() {
+    Logger::Instance().add(std::make_shared<LogConsole>("console", LogLevel::Warn));
+    testHandshake();
+    testLossRecovery();
+    testTooLateDrop();
+    return testResult();
+}
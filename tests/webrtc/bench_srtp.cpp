@@ -0,0 +1,143 @@
+#include "webrtc/Srtp.h"
+#include "Util/Logger.h"
+#include "Util/Util.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+using namespace beton;
+
+/**
+ * srtp 单核每秒加解密的包数，每个 profile 分别测试:
+ * 1. protect: 模拟 rtsp/webrtc 的发送，每个包是本端的 12 字节 rtp 头 + 所有订阅者共享的负载,
+ *    按 sendmmsg 的批大小调用 SrtpContext::protect(Socket::UdpPacket *, n)
+ * 2. unprotect: 用另一个同样密钥的上下文解密，并核对明文与发送的一致
+ * 用法: bench_srtp [每项的秒数]
+*/
+
+static const SrtpProfile s_profiles[] = {SRTP_AES128_CM_SHA1_80, SRTP_AES128_CM_SHA1_32, SRTP_AEAD_AES_128_GCM,
+                                         SRTP_AEAD_AES_256_GCM};
+static const size_t s_payload_sizes[] = {160, 1200};
+static const size_t s_batch_sizes[] = {1, 32, 256};
+
+static void writeRtpHeader(uint8_t *data, uint16_t seq, uint32_t ssrc) {
+    data[0] = 0x80;
+    data[1] = 96;
+    data[2] = seq >> 8;
+    data[3] = seq & 0xff;
+    for (int i = 0; i < 4; ++i) {
+        data[4 + i] = (seq * 3000) >> (24 - 8 * i);
+        data[8 + i] = ssrc >> (24 - 8 * i);
+    }
+}
+
+static Buffer::Ptr copyBuffer(const Buffer::Ptr &buf) {
+    auto ret = BufferRaw::create(buf->size(), buf->size());
+    memcpy(ret->data(), buf->data(), buf->size());
+    return ret;
+}
+
+/**
+ * @param seconds: 加密计时的时长
+ * @return 失败返回 false
+*/
+static bool benchProfile(SrtpProfile profile, size_t payload_size, size_t batch, double seconds) {
+    string key(srtpKeySize(profile), 0), salt(srtpSaltSize(profile), 0);
+    for (size_t i = 0; i < key.size(); ++i) {
+        key[i] = i * 7 + 1;
+    }
+    for (size_t i = 0; i < salt.size(); ++i) {
+        salt[i] = i * 13 + 5;
+    }
+    auto sender = SrtpContext::create(profile, key, salt);
+    auto receiver = SrtpContext::create(profile, key, salt);
+    if (!sender || !receiver) {
+        printf("%s: create context failed\n", srtpProfileName(profile));
+        return false;
+    }
+    auto payload = BufferRaw::create(payload_size, payload_size);
+    for (size_t i = 0; i < payload_size; ++i) {
+        payload->data()[i] = (char)(i * 31);
+    }
+
+    vector<Socket::UdpPacket> pkts(batch);
+    //保留一部分密文用于解密测试
+    vector<Buffer::Ptr> encrypted;
+    uint16_t seq = 0;
+    size_t total = 0;
+    uint64_t elapsed = 0;
+    auto start = getCurrentMicroSecond();
+    while (elapsed < seconds * 1e6) {
+        for (auto &pkt : pkts) {
+            auto header = BufferRaw::create(12, 12);
+            writeRtpHeader((uint8_t *)header->data(), seq++, 0x12345678);
+            pkt.buf = std::move(header);
+            pkt.tail.assign(1, payload);
+            pkt.size = 12 + payload_size;
+        }
+        if (sender->protect(pkts.data(), pkts.size()) != pkts.size()) {
+            printf("%s: protect failed\n", srtpProfileName(profile));
+            return false;
+        }
+        total += pkts.size();
+        if (encrypted.size() < 8192) {
+            for (auto &pkt : pkts) {
+                encrypted.emplace_back(copyBuffer(pkt.buf));
+            }
+        }
+        elapsed = getCurrentMicroSecond() - start;
+    }
+    auto protect_rate = total * 1e3 / elapsed;
+
+    //解密会在原内存上进行，计时的一轮之前先复制好
+    size_t decrypted = 0;
+    uint64_t unprotect_us = 0;
+    for (int round = 0; round < 4; ++round) {
+        //同一批密文再次解密会被当作重放，每轮换一个接收上下文
+        receiver = SrtpContext::create(profile, key, salt);
+        vector<Buffer::Ptr> bufs;
+        for (auto &buf : encrypted) {
+            bufs.emplace_back(copyBuffer(buf));
+        }
+        start = getCurrentMicroSecond();
+        vector<Buffer::Ptr> plains;
+        plains.reserve(bufs.size());
+        for (auto &buf : bufs) {
+            plains.emplace_back(receiver->unprotect(buf));
+        }
+        unprotect_us += getCurrentMicroSecond() - start;
+        for (size_t i = 0; i < plains.size(); ++i) {
+            auto &plain = plains[i];
+            uint8_t header[12];
+            writeRtpHeader(header, (uint16_t)i, 0x12345678);
+            //密文不能是明文原样
+            if (!memcmp(encrypted[i]->data() + 12, payload->data(), payload_size) || !plain ||
+                plain->size() != 12 + payload_size || memcmp(plain->data(), header, 12) ||
+                memcmp(plain->data() + 12, payload->data(), payload_size)) {
+                printf("%s: packet %zu does not round trip\n", srtpProfileName(profile), i);
+                return false;
+            }
+        }
+        decrypted += plains.size();
+    }
+    printf("  %-24s payload %4zu batch %3zu: protect %5.0f kpps %5.2f Gbit/s, unprotect %5.0f kpps\n",
+           srtpProfileName(profile), payload_size, batch, protect_rate, protect_rate * (12 + payload_size) * 8 / 1e6,
+           decrypted * 1e3 / unprotect_us);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Logger::Instance().add(std::make_shared<LogConsole>("console", LogLevel::Warn));
+    double seconds = argc > 1 ? atof(argv[1]) : 0.5;
+    printf("srtp, one core\n");
+    for (auto profile : s_profiles) {
+        for (auto payload_size : s_payload_sizes) {
+            for (auto batch : s_batch_sizes) {
+                if (!benchProfile(profile, payload_size, batch, seconds)) {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
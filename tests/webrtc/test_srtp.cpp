@@ -0,0 +1,348 @@
+#include "webrtc/Srtp.h"
+#include "TestUtil.h"
+#include "Util/Logger.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef ENABLE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#endif
+
+using namespace std;
+using namespace beton;
+
+/**
+ * SrtpContext 的正确性测试:
+ * 1. 已知答案: 测试内按 RFC 写的参考实现(密钥派生、AES-CM + HMAC-SHA1、AES-GCM)先对上
+ *    RFC 3711 B.3 和 RFC 7714 16.1.1 的向量，再逐字节比对 SrtpContext 四个 profile 的输出
+ *    (会话密钥不对外暴露，只能这样间接验证)
+ * 2. 序号 65535 -> 0 时 ROC 进位，跨越进位的乱序包也能解密
+ * 3. 重复的包和落在防重放窗口之前的包被拒绝
+ * 4. 篡改 tag 或负载的包认证失败，且不影响之后收到的原包
+*/
+
+#ifdef ENABLE_OPENSSL
+
+static const SrtpProfile s_profiles[] = {SRTP_AES128_CM_SHA1_80, SRTP_AES128_CM_SHA1_32, SRTP_AEAD_AES_128_GCM,
+                                         SRTP_AEAD_AES_256_GCM};
+static constexpr uint32_t s_ssrc = 0x5501a0b2;
+
+static string fromHex(const string &hex) {
+    string ret;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        ret.push_back((char)strtoul(hex.substr(i, 2).data(), nullptr, 16));
+    }
+    return ret;
+}
+
+static string toHex(const string &data) {
+    string ret;
+    char buf[3];
+    for (auto ch : data) {
+        snprintf(buf, sizeof(buf), "%02x", (uint8_t)ch);
+        ret += buf;
+    }
+    return ret;
+}
+
+static bool isGcm(SrtpProfile profile) {
+    return profile == SRTP_AEAD_AES_128_GCM || profile == SRTP_AEAD_AES_256_GCM;
+}
+
+static const EVP_CIPHER *ctrCipher(size_t key_size) {
+    return key_size == 32 ? EVP_aes_256_ctr() : EVP_aes_128_ctr();
+}
+
+static string aesCtr(const string &key, const string &iv, const string &data) {
+    string out(data.size(), 0);
+    int len = 0;
+    auto ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(ctx, ctrCipher(key.size()), nullptr, (const uint8_t *)key.data(), (const uint8_t *)iv.data());
+    EVP_EncryptUpdate(ctx, (uint8_t *)&out[0], &len, (const uint8_t *)data.data(), data.size());
+    EVP_CIPHER_CTX_free(ctx);
+    return out;
+}
+
+//返回 密文 | 16字节 tag
+static string aesGcm(const string &key, const string &iv, const string &aad, const string &data) {
+    string out(data.size() + 16, 0);
+    int len = 0;
+    auto ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(ctx, key.size() == 32 ? EVP_aes_256_gcm() : EVP_aes_128_gcm(), nullptr,
+                       (const uint8_t *)key.data(), (const uint8_t *)iv.data());
+    EVP_EncryptUpdate(ctx, nullptr, &len, (const uint8_t *)aad.data(), aad.size());
+    EVP_EncryptUpdate(ctx, (uint8_t *)&out[0], &len, (const uint8_t *)data.data(), data.size());
+    EVP_EncryptFinal_ex(ctx, (uint8_t *)&out[0] + data.size(), &len);
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, 16, (uint8_t *)&out[0] + data.size());
+    EVP_CIPHER_CTX_free(ctx);
+    return out;
+}
+
+//RFC 3711 4.3.1, key_derivation_rate 为0: x = label << 48 XOR master_salt, 输出 AES-CM(x << 16) 的密钥流
+static string refKdf(const string &master_key, const string &master_salt, uint8_t label, size_t size) {
+    //GCM 的主盐只有12字节，后面补0
+    string iv = master_salt + string(16 - master_salt.size(), 0);
+    iv[7] ^= label;
+    return aesCtr(master_key, iv, string(size, 0));
+}
+
+//48位包序号为 roc << 16 | seq
+static string refProtectRtp(SrtpProfile profile, const string &master_key, const string &master_salt, uint32_t roc,
+                            const string &packet) {
+    auto key = refKdf(master_key, master_salt, 0, master_key.size());
+    auto salt = refKdf(master_key, master_salt, 2, isGcm(profile) ? 12 : 14);
+    auto header = packet.substr(0, 12);
+    auto payload = packet.substr(12);
+    uint64_t index = ((uint64_t)roc << 16) | ((uint8_t)packet[2] << 8 | (uint8_t)packet[3]);
+    if (isGcm(profile)) {
+        //RFC 7714 8.1: IV = (00 00 | ssrc | roc | seq) XOR salt
+        string iv(12, 0);
+        memcpy(&iv[2], &packet[8], 4);
+        for (int i = 0; i < 6; ++i) {
+            iv[6 + i] = (char)(index >> (40 - 8 * i));
+        }
+        for (size_t i = 0; i < iv.size(); ++i) {
+            iv[i] ^= salt[i];
+        }
+        return header + aesGcm(key, iv, header, payload);
+    }
+    //RFC 3711 4.1.1: IV = (salt << 16) XOR (ssrc << 64) XOR (index << 16)
+    string iv = salt + string(2, 0);
+    for (int i = 0; i < 4; ++i) {
+        iv[4 + i] ^= packet[8 + i];
+    }
+    for (int i = 0; i < 6; ++i) {
+        iv[8 + i] ^= (char)(index >> (40 - 8 * i));
+    }
+    auto out = header + aesCtr(key, iv, payload);
+    //RFC 3711 4.2: HMAC-SHA1(auth_key, 认证部分 | roc), 截短为 tag
+    auto auth_key = refKdf(master_key, master_salt, 1, 20);
+    string auth = out;
+    for (int i = 0; i < 4; ++i) {
+        auth.push_back((char)(roc >> (24 - 8 * i)));
+    }
+    uint8_t tag[20];
+    unsigned int tag_size = 0;
+    HMAC(EVP_sha1(), auth_key.data(), auth_key.size(), (const uint8_t *)auth.data(), auth.size(), tag, &tag_size);
+    return out + string((char *)tag, profile == SRTP_AES128_CM_SHA1_32 ? 4 : 10);
+}
+
+static string makeRtp(uint16_t seq, size_t payload_size) {
+    string ret(12 + payload_size, 0);
+    ret[0] = (char)0x80;
+    ret[1] = 96;
+    ret[2] = (char)(seq >> 8);
+    ret[3] = (char)seq;
+    for (int i = 0; i < 4; ++i) {
+        ret[4 + i] = (char)((seq * 3000) >> (24 - 8 * i));
+        ret[8 + i] = (char)(s_ssrc >> (24 - 8 * i));
+    }
+    for (size_t i = 0; i < payload_size; ++i) {
+        ret[12 + i] = (char)(seq + i * 31);
+    }
+    return ret;
+}
+
+static Buffer::Ptr toBuffer(const string &data) {
+    auto ret = BufferRaw::create(data.size(), data.size());
+    memcpy(ret->data(), data.data(), data.size());
+    return ret;
+}
+
+static string toString(const Buffer::Ptr &buf) {
+    return buf ? string(buf->data(), buf->size()) : string();
+}
+
+struct Keys {
+    Keys(SrtpProfile profile) : key(srtpKeySize(profile), 0), salt(srtpSaltSize(profile), 0) {
+        for (size_t i = 0; i < key.size(); ++i) {
+            key[i] = (char)(i * 7 + 1);
+        }
+        for (size_t i = 0; i < salt.size(); ++i) {
+            salt[i] = (char)(i * 13 + 5);
+        }
+    }
+    string key;
+    string salt;
+};
+
+static void testKdfVector() {
+    //RFC 3711 B.3
+    auto master_key = fromHex("E1F97A0D3E018BE0D64FA32C06DE4139");
+    auto master_salt = fromHex("0EC675AD498AFEEBB6960B3AABE6");
+    CHECK(refKdf(master_key, master_salt, 0, 16) == fromHex("C61E7A93744F39EE10734AFE3FF7A087"));
+    CHECK(refKdf(master_key, master_salt, 2, 14) == fromHex("30CBBC08863D8C85D49DB34A9AE1"));
+    CHECK(refKdf(master_key, master_salt, 1, 20) == fromHex("CEBE321F6FF7716B6FD4AB49AF256A156D38BAA4"));
+    printf("kdf: RFC 3711 B.3 session keys match\n");
+}
+
+static void testGcmVector() {
+    //RFC 7714 16.1.1, 直接给出的是会话密钥和会话盐
+    auto key = fromHex("000102030405060708090a0b0c0d0e0f");
+    auto salt = fromHex("517569642070726f2071756f");
+    auto packet = fromHex("8040f17b8041f8d35501a0b2"
+                          "47616c6c696120657374206f6d6e69732064697669736120696e207061727465732074726573");
+    string iv(12, 0);
+    memcpy(&iv[2], &packet[8], 4);
+    memcpy(&iv[10], &packet[2], 2);
+    for (size_t i = 0; i < iv.size(); ++i) {
+        iv[i] ^= salt[i];
+    }
+    CHECK(toHex(iv) == "51753c6580c2726f20718414");
+    auto out = packet.substr(0, 12) + aesGcm(key, iv, packet.substr(0, 12), packet.substr(12));
+    CHECK(toHex(out) == "8040f17b8041f8d35501a0b2"
+                        "f24de3a3fb34de6cacba861c9d7e4bcabe633bd50d294e6f42a5f47a51c7d19b"
+                        "36de3adf8833899d7f27beb16a9152cf765ee4390cce");
+    printf("gcm: RFC 7714 16.1.1 packet matches\n");
+}
+
+static void testProfiles() {
+    for (auto profile : s_profiles) {
+        Keys keys(profile);
+        auto sender = SrtpContext::create(profile, keys.key, keys.salt);
+        auto receiver = SrtpContext::create(profile, keys.key, keys.salt);
+        CHECK(sender && receiver);
+        if (!sender || !receiver) {
+            continue;
+        }
+        size_t matched = 0;
+        for (size_t payload_size : {0, 1, 160, 1200}) {
+            auto packet = makeRtp(1000 + payload_size, payload_size);
+            //头部和负载分两段传入
+            auto srtp = sender->protect({toBuffer(packet.substr(0, 12)), toBuffer(packet.substr(12))});
+            CHECK(srtp);
+            auto expect = refProtectRtp(profile, keys.key, keys.salt, 0, packet);
+            CHECK(toString(srtp) == expect);
+            matched += toString(srtp) == expect;
+            CHECK(srtp && toString(receiver->unprotect(srtp)) == packet);
+        }
+        CHECK(sender->stats().encrypted == 4 && receiver->stats().decrypted == 4);
+        printf("%s: %zu/4 packets match the reference\n", srtpProfileName(profile), matched);
+    }
+}
+
+static void testRocWrap() {
+    for (auto profile : s_profiles) {
+        Keys keys(profile);
+        auto sender = SrtpContext::create(profile, keys.key, keys.salt);
+        auto receiver = SrtpContext::create(profile, keys.key, keys.salt);
+        if (!sender || !receiver) {
+            testFailed();
+            continue;
+        }
+        vector<string> packets;
+        vector<Buffer::Ptr> srtp;
+        for (uint16_t seq : {65533, 65534, 65535, 0, 1, 2}) {
+            packets.emplace_back(makeRtp(seq, 100));
+            srtp.emplace_back(sender->protect({toBuffer(packets.back())}));
+            //进位之后用 ROC=1 加密
+            auto expect = refProtectRtp(profile, keys.key, keys.salt, seq < 0x8000 ? 1 : 0, packets.back());
+            CHECK(toString(srtp.back()) == expect);
+        }
+        //进位前后乱序到达: 65535 晚于 0 到达时仍然按 ROC=0 解密
+        for (size_t i : {0, 1, 3, 2, 5, 4}) {
+            CHECK(toString(receiver->unprotect(srtp[i])) == packets[i]);
+        }
+        CHECK(receiver->stats().decrypted == 6 && receiver->stats().auth_failed == 0);
+        //进位之后发出的包不能再按 ROC=0 加密
+        auto late = makeRtp(3, 100);
+        CHECK(toString(sender->protect({toBuffer(late)})) == refProtectRtp(profile, keys.key, keys.salt, 1, late));
+    }
+    printf("roc wrap: 65535 -> 0 carries into the ROC for all profiles\n");
+}
+
+static void testReplay() {
+    SrtpReplayWindow window;
+    window.add(5000);
+    CHECK(window.check(5000) == -1);
+    CHECK(window.check(5001) == 0 && window.check(4999) == 0);
+    CHECK(window.check(5000 - SrtpReplayWindow::kSize + 1) == 0);
+    CHECK(window.check(5000 - SrtpReplayWindow::kSize) == -2);
+    //窗口前移时滑出的位被清掉，绕回同一位置的新序号可以接受
+    window.add(5000 + SrtpReplayWindow::kSize / 2);
+    CHECK(window.check(5000) == -1);
+    CHECK(window.check(5000 + SrtpReplayWindow::kSize) == 0);
+    window.add(5000 + SrtpReplayWindow::kSize);
+    CHECK(window.check(5000) == -2);
+    CHECK(window.check(5000 + SrtpReplayWindow::kSize / 2) == -1);
+
+    for (auto profile : s_profiles) {
+        Keys keys(profile);
+        auto sender = SrtpContext::create(profile, keys.key, keys.salt);
+        auto receiver = SrtpContext::create(profile, keys.key, keys.salt);
+        if (!sender || !receiver) {
+            testFailed();
+            continue;
+        }
+        //解密在原内存上进行，重放用的是收到时的拷贝
+        vector<string> srtp;
+        for (uint16_t seq = 100; seq < 1300; ++seq) {
+            srtp.emplace_back(toString(sender->protect({toBuffer(makeRtp(seq, 20))})));
+        }
+        CHECK(receiver->unprotect(toBuffer(srtp[0])));
+        CHECK(!receiver->unprotect(toBuffer(srtp[0])));
+        CHECK(receiver->stats().replayed == 1);
+        //跳过序号 110 和 600
+        for (size_t i = 1; i < srtp.size(); ++i) {
+            if (i != 10 && i != 500) {
+                CHECK(receiver->unprotect(toBuffer(srtp[i])));
+            }
+        }
+        //最大序号 1299: 600 仍在窗口内，110 已经太旧
+        CHECK(receiver->unprotect(toBuffer(srtp[500])));
+        CHECK(!receiver->unprotect(toBuffer(srtp[10])));
+        CHECK(!receiver->unprotect(toBuffer(srtp[1000])));
+        CHECK(receiver->stats().replayed == 3);
+        CHECK(receiver->stats().decrypted == srtp.size() - 1 && receiver->stats().auth_failed == 0);
+    }
+    printf("replay: duplicates and packets behind the %zu window rejected\n", SrtpReplayWindow::kSize);
+}
+
+static void testTamper() {
+    for (auto profile : s_profiles) {
+        Keys keys(profile);
+        auto sender = SrtpContext::create(profile, keys.key, keys.salt);
+        auto receiver = SrtpContext::create(profile, keys.key, keys.salt);
+        if (!sender || !receiver) {
+            testFailed();
+            continue;
+        }
+        auto packet = makeRtp(7, 160);
+        auto srtp = toString(sender->protect({toBuffer(packet)}));
+        auto bad_tag = srtp;
+        bad_tag.back() ^= 0x01;
+        auto bad_payload = srtp;
+        bad_payload[20] ^= 0x80;
+        auto bad_header = srtp;
+        //时间戳被改
+        bad_header[7] ^= 0x01;
+        CHECK(!receiver->unprotect(toBuffer(bad_tag)));
+        CHECK(!receiver->unprotect(toBuffer(bad_payload)));
+        CHECK(!receiver->unprotect(toBuffer(bad_header)));
+        CHECK(receiver->stats().auth_failed == 3 && receiver->stats().replayed == 0);
+        //认证失败的包不进防重放窗口，之后到达的原包照常解密
+        CHECK(toString(receiver->unprotect(toBuffer(srtp))) == packet);
+        CHECK(receiver->stats().decrypted == 1);
+    }
+    printf("tamper: modified tag, payload and header rejected\n");
+}
+
+int main() {
+    Logger::Instance().add(std::make_shared<LogConsole>("console", LogLevel::Warn));
+    testKdfVector();
+    testGcmVector();
+    testProfiles();
+    testRocWrap();
+    testReplay();
+    testTamper();
+    return testResult();
+}
+
+#else  //ENABLE_OPENSSL
+
+int main() {
+    printf("srtp needs openssl, skipped\n");
+    return 0;
+}
+
+#endif  //ENABLE_OPENSSL
@@ -1,6 +1,7 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/vfs.h>
+#include <strings.h>
 #include <unistd.h>
 #include "File.h"
 #include "Logger.h"
@@ -253,6 +254,69 @@ uint64_t File::fileSize(const char *path) {
     return fileSize(fp.get());
 }
 
+//解析十进制数字，不允许空串和其他字符
+static bool parseDecimal(const std::string &str, uint64_t &value) {
+    if (str.empty() || str.size() > 19) {
+        return false;
+    }
+    value = 0;
+    for (auto ch : str) {
+        if (ch < '0' || ch > '9') {
+            return false;
+        }
+        value = value * 10 + (ch - '0');
+    }
+    return true;
+}
+
+int File::parseRange(const std::string &range, uint64_t file_size, uint64_t &offset, uint64_t &length) {
+    std::string spec;
+    for (auto ch : range) {
+        if (ch != ' ' && ch != '\t') {
+            spec.push_back(ch);
+        }
+    }
+    if (spec.size() < 6 || strncasecmp(spec.data(), "bytes=", 6) != 0) {
+        return 0;
+    }
+    spec = spec.substr(6);
+    auto pos = spec.find('-');
+    if (pos == std::string::npos || spec.find(',') != std::string::npos) {
+        return 0;
+    }
+
+    uint64_t first = 0, last = 0;
+    auto first_str = spec.substr(0, pos);
+    auto last_str = spec.substr(pos + 1);
+    if (first_str.empty()) {
+        //bytes=-N, 最后N个字节
+        if (!parseDecimal(last_str, last)) {
+            return 0;
+        }
+        if (last == 0 || file_size == 0) {
+            return -1;
+        }
+        length = std::min(last, file_size);
+        offset = file_size - length;
+        return 1;
+    }
+    if (!parseDecimal(first_str, first) || (!last_str.empty() && !parseDecimal(last_str, last))) {
+        return 0;
+    }
+    if (!last_str.empty() && last < first) {
+        return 0;
+    }
+    if (first >= file_size) {
+        return -1;
+    }
+    if (last_str.empty() || last >= file_size) {
+        last = file_size - 1;
+    }
+    offset = first;
+    length = last - first + 1;
+    return 1;
+}
+
 uint64_t File::diskFreeSpace(const char *dir) {
     if (!dir) {
         return 0;
@@ -87,6 +87,16 @@ public:
      */
     static uint64_t fileSize(const char *path);
 
+    /**
+     * 解析 HTTP Range 请求头，得到文件中需要发送的区间，只支持单个区间
+     * @param range Range 头的值，如 "bytes=0-499", "bytes=500-", "bytes=-500"
+     * @param file_size 文件大小
+     * @param offset 区间起始偏移
+     * @param length 区间长度
+     * @return 1:成功; 0:格式无法识别或多区间，应忽略 Range 发送整个文件; -1:区间不可满足，应回复 416
+     */
+    static int parseRange(const std::string &range, uint64_t file_size, uint64_t &offset, uint64_t &length);
+
     /**
      * 获取指定目录的磁盘剩余空间
      * @param dir 磁盘目录
@@ -1,10 +1,21 @@
 #include "Logger.h"
 #include "threadpool/Thread.h"
 #include "File.h"
+#include "network/SockUtil.h"
 #include <iostream>
+#include <algorithm>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
 #include <unistd.h>
+#ifdef ENABLE_ZLIB
+#include <zlib.h>
+#endif
 
 using namespace std;
 
@@ -100,9 +111,19 @@ LogFile::LogFile(const string &name, LogLevel level, uint8_t max_days, const str
 
     _log_file_map.clear();
     string exe_name = fileNameWithoutPath(exeName().data());
-    File::scanDir(_path, [this, exe_name](const std::string &path, bool is_dir) -> bool {
-        if (!is_dir && start_with(path, exe_name) && end_with(path, ".log")) {
+    auto &suffix = LogCompressor::suffix();
+    File::scanDir(_path, [&](const std::string &path, bool is_dir) -> bool {
+        if (is_dir || !start_with(fileNameWithoutPath(path.data()), exe_name)) {
+            return true;
+        }
+        if (end_with(path, ".log")) {
             _log_file_map.emplace(path);
+            _uncompressed_set.emplace(path);
+        } else if (end_with(path, ".log" + suffix)) {
+            _log_file_map.emplace(path.substr(0, path.size() - suffix.size()));
+        } else if (end_with(path, ".log" + suffix + ".tmp")) {
+            //上次退出时未压缩完的临时文件
+            File::delete_file(path.data());
         }
         return true;
     }, false);
@@ -127,6 +148,10 @@ LogFile::LogFile(const string &name, LogLevel level, uint8_t max_days, const str
             }
         }
     }
+
+    if (LogCompressor::supported()) {
+        _compressor = make_shared<LogCompressor>();
+    }
 }
 
 LogFile::~LogFile() {
@@ -151,6 +176,15 @@ void LogFile::setFileMaxCount(size_t max_count) {
     if (_max_file_count != max_count) { _max_file_count = max_count; }
 }
 
+void LogFile::setEnableCompress(bool enable, size_t max_bytes_per_sec) {
+    //写日志线程可能正在滚动文件，原子地替换
+    LogCompressor::Ptr compressor;
+    if (enable && LogCompressor::supported()) {
+        compressor = make_shared<LogCompressor>(max_bytes_per_sec);
+    }
+    std::atomic_store(&_compressor, compressor);
+}
+
 void LogFile::write(const Context::Ptr &ctx) {
     if (ctx->_level < level()) { return; }
 
@@ -183,9 +217,18 @@ static string getLogFilePathName(const string &dir, time_t time, uint32_t file_i
     return dir + buf;
 }
 
+//日志切片可能已经被压缩，两种文件都要删除
+static void deleteLogFile(const string &path) {
+    File::delete_file(path.data());
+    File::delete_file((path + LogCompressor::suffix()).data());
+}
+
 static time_t getLogFileTime(const string &full_path) {
     string name = fileNameWithoutPath(full_path.data());
+    //strptime 只会填充年月日，其余字段必须先清零，否则 mktime 结果不可预期
     struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_isdst = -1;
     if (!strptime(name.substr(name.find("-") + 1).data(), "%Y-%02m-%02d", &tm)) {
         return 0;
     }
@@ -215,6 +258,7 @@ void LogFile::check(const Context::Ptr &ctx) {
 }
 
 void LogFile::openFile(time_t time) {
+    auto last_log_file = _current_log_file;
     auto log_file = getLogFilePathName(_path, time, _file_index++);
     _log_file_map.emplace(log_file);
     _current_log_file = log_file;
@@ -228,6 +272,20 @@ void LogFile::openFile(time_t time) {
 
     _file.open(log_file, ios_base::out | ios_base::app);
 
+    //不再写入的日志切片交给后台线程压缩; 只取一次，setEnableCompress 可能同时在其他线程替换
+    auto compressor = std::atomic_load(&_compressor);
+    if (compressor) {
+        if (!last_log_file.empty() && last_log_file != log_file) {
+            compressor->compress(last_log_file);
+        }
+        for (auto &file : _uncompressed_set) {
+            if (file != log_file) {
+                compressor->compress(file);
+            }
+        }
+    }
+    _uncompressed_set.clear();
+
     //每次新建一个日志文件，都要检查一下是否超过文件数量了，如果有则删除
     delExpiredFile();
 }
@@ -246,7 +304,7 @@ void LogFile::delExpiredFile() {
             break;
         }
         //这个文件距今超过了一定天数，则删除文件
-        File::delete_file(it->data());
+        deleteLogFile(*it);
         //删除这条记录
         it = _log_file_map.erase(it);
     }
@@ -259,7 +317,7 @@ void LogFile::delExpiredFile() {
             break;
         }
         //删除文件
-        File::delete_file(it->data());
+        deleteLogFile(*it);
         //删除这条记录
         _log_file_map.erase(it);
     }
@@ -272,37 +330,472 @@ void LogFile::setEnableStackTrace(bool enable, LogLevel level) {
     }
 }
 
+//////////////////////////// 日志压缩类 ////////////////////////////
+LogCompressor::LogCompressor(size_t max_bytes_per_sec) {
+    _max_bytes_per_sec = std::max<size_t>(max_bytes_per_sec, 64 * 1024);
+    if (!supported()) {
+        return;
+    }
+    _started = true;
+    _thread = make_shared<std::thread>(&LogCompressor::run_loop, this);
+}
+
+LogCompressor::~LogCompressor() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _started = false;
+    }
+    _cond.notify_one();
+    if (_thread) {
+        _thread->join();
+    }
+}
+
+bool LogCompressor::supported() {
+#ifdef ENABLE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+const string &LogCompressor::suffix() {
+    static const string s_suffix = ".gz";
+    return s_suffix;
+}
+
+void LogCompressor::compress(const std::string &path) {
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (!_started || std::find(_file_list.begin(), _file_list.end(), path) != _file_list.end()) {
+            return;
+        }
+        _file_list.emplace_back(path);
+    }
+    _cond.notify_one();
+}
+
+void LogCompressor::run_loop() {
+    Thread::setThreadName("log-compress");
+    //CPU 只在空闲时调度，IO 使用 idle 优先级
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    static constexpr int s_ioprio_who_process = 1;
+    static constexpr int s_ioprio_class_idle = 3;
+    syscall(SYS_ioprio_set, s_ioprio_who_process, 0, s_ioprio_class_idle << 13);
+
+    while (true) {
+        string path;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _cond.wait(lock, [this]() { return !_started || !_file_list.empty(); });
+            if (!_started) {
+                break;
+            }
+            path = std::move(_file_list.front());
+            _file_list.pop_front();
+        }
+        compressFile(path);
+    }
+}
+
+bool LogCompressor::compressFile(const std::string &path) {
+#ifdef ENABLE_ZLIB
+    auto dst_path = path + suffix();
+    auto tmp_path = dst_path + ".tmp";
+    auto src = std::unique_ptr<FILE, decltype(&fclose)>(fopen(path.data(), "rb"), fclose);
+    if (!src) {
+        return false;
+    }
+    auto dst = gzopen(tmp_path.data(), "wb6");
+    if (!dst) {
+        return false;
+    }
+
+    bool success = true;
+    uint64_t total = 0;
+    auto start = getCurrentMilliSecond();
+    std::vector<char> buffer(64 * 1024);
+    while (_started) {
+        auto size = fread(buffer.data(), 1, buffer.size(), src.get());
+        if (size == 0) {
+            success = !ferror(src.get());
+            break;
+        }
+        if (gzwrite(dst, buffer.data(), size) != (int) size) {
+            success = false;
+            break;
+        }
+        //限速：处理得比预期快就睡眠补齐
+        total += size;
+        auto expect_ms = total * 1000 / _max_bytes_per_sec;
+        auto elapsed_ms = getCurrentMilliSecond() - start;
+        if (expect_ms > elapsed_ms) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(expect_ms - elapsed_ms));
+        }
+    }
+    success = (gzclose(dst) == Z_OK) && success && _started;
+
+    //压缩期间原文件可能已经被过期清理删除了
+    if (!success || access(path.data(), F_OK) != 0 || rename(tmp_path.data(), dst_path.data()) != 0) {
+        unlink(tmp_path.data());
+        return false;
+    }
+    //检查和改名之间写日志线程仍可能删除了原文件(及当时还不存在的压缩文件), 改名后再确认一次，避免留下孤立的压缩文件
+    if (access(path.data(), F_OK) != 0) {
+        unlink(dst_path.data());
+        return false;
+    }
+    unlink(path.data());
+    return true;
+#else
+    return false;
+#endif
+}
+
 //////////////////////////// webhook写日志类 ////////////////////////////
-LogWebHook::LogWebHook(const std::string &name, LogLevel level, const std::string &url)
-    :Channel(name, level) {
+//与单个hook地址之间的HTTP长连接，只在hook线程内使用，所以可以用阻塞IO
+struct LogWebHook::HookConn {
+    std::string host;
+    std::string port = "80";
+    std::string path = "/";
+    int fd = -1;
+    //连续失败时退避，避免hook服务端不可用时每一批都去重连
+    uint32_t backoff_ms = 0;
+    uint64_t retry_time = 0;
+
+    ~HookConn() { close(); }
+
+    bool parse(const string &url) {
+        static const string s_schema = "http://";
+        if (!start_with(url, s_schema)) {
+            return false;
+        }
+        auto host_port = url.substr(s_schema.size());
+        auto pos = host_port.find('/');
+        if (pos != string::npos) {
+            path = host_port.substr(pos);
+            host_port.resize(pos);
+        }
+        pos = host_port.rfind(':');
+        if (pos != string::npos && host_port.find(']', pos) == string::npos) {
+            port = host_port.substr(pos + 1);
+            host_port.resize(pos);
+        }
+        if (host_port.size() > 2 && host_port.front() == '[' && host_port.back() == ']') {
+            host_port = host_port.substr(1, host_port.size() - 2);
+        }
+        host = host_port;
+        return !host.empty();
+    }
+
+    void close() {
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool connect(int timeout_ms) {
+        close();
+        struct addrinfo hints, *res = nullptr;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.data(), port.data(), &hints, &res) != 0 || !res) {
+            return false;
+        }
+        for (auto ai = res; ai && fd == -1; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, ai->ai_protocol);
+            if (fd == -1) {
+                continue;
+            }
+            int ret = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+            if (ret == -1 && errno == EINPROGRESS) {
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                int err = 0;
+                socklen_t len = sizeof(err);
+                if (poll(&pfd, 1, timeout_ms) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+                    ret = 0;
+                }
+            }
+            if (ret != 0) {
+                close();
+            }
+        }
+        freeaddrinfo(res);
+        if (fd == -1) {
+            return false;
+        }
+        try {
+            SockUtil::setNonBlock(fd, false);
+            SockUtil::setNoDelay(fd);
+            SockUtil::setSndTimeout(fd, timeout_ms);
+            SockUtil::setRcvTimeout(fd, timeout_ms);
+        } catch (std::exception &) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    //发送请求并读完整个回复，连接可复用时保持连接
+    bool request(const string &req) {
+        size_t sent = 0;
+        while (sent < req.size()) {
+            auto n = ::send(fd, req.data() + sent, req.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                if (n == -1 && errno == EINTR) { continue; }
+                return false;
+            }
+            sent += n;
+        }
+
+        string rsp;
+        char buf[4096];
+        size_t header_end = string::npos;
+        while ((header_end = rsp.find("\r\n\r\n")) == string::npos) {
+            auto n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                if (n == -1 && errno == EINTR) { continue; }
+                return false;
+            }
+            rsp.append(buf, n);
+        }
+        header_end += 4;
+
+        int status = 0;
+        if (sscanf(rsp.data(), "HTTP/%*d.%*d %d", &status) != 1) {
+            return false;
+        }
+        auto header = rsp.substr(0, header_end);
+        for (auto &ch : header) { ch = tolower(ch); }
+        bool keep_alive = header.find("connection: close") == string::npos && start_with(header, "http/1.1");
+        bool chunked = header.find("transfer-encoding: chunked") != string::npos;
+        size_t content_len = 0;
+        auto pos = header.find("content-length:");
+        if (pos != string::npos) {
+            content_len = strtoul(header.data() + pos + 15, nullptr, 10);
+        } else if (!chunked) {
+            //既没有长度也不是chunked，只能以关闭连接作为结束
+            keep_alive = false;
+        }
+
+        //丢弃回复body, 只关心状态码
+        auto body_done = [&]() {
+            if (chunked) {
+                return rsp.find("0\r\n\r\n", header_end) != string::npos;
+            }
+            return rsp.size() >= header_end + content_len;
+        };
+        while (keep_alive && !body_done()) {
+            auto n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                if (n == -1 && errno == EINTR) { continue; }
+                keep_alive = false;
+                break;
+            }
+            rsp.append(buf, n);
+        }
+        if (!keep_alive) {
+            close();
+        }
+        return status >= 200 && status < 300;
+    }
+};
+
+static void jsonEscape(string &out, const string &str) {
+    static const char s_hex[] = "0123456789abcdef";
+    for (unsigned char ch : str) {
+        switch (ch) {
+            case '"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            default:
+                if (ch < 0x20) {
+                    out.append("\\u00");
+                    out.push_back(s_hex[ch >> 4]);
+                    out.push_back(s_hex[ch & 0x0F]);
+                } else {
+                    out.push_back(ch);
+                }
+                break;
+        }
+    }
+}
+
+LogWebHook::LogWebHook(const std::string &name, LogLevel level, const std::string &url,
+                       size_t max_queue, size_t max_batch, uint32_t flush_ms)
+    :Channel(name, level), _max_queue(max_queue), _max_batch(max_batch), _flush_ms(flush_ms) {
+    _max_queue = std::max<size_t>(_max_queue, 1);
+    _max_batch = clamp<size_t>(1, _max_batch, _max_queue);
+    _flush_ms = std::max<uint32_t>(_flush_ms, 1);
     if (!url.empty()) {
-        _url_map.emplace();
+        _url_map.emplace(url);
     }
+    _started = true;
+    _thread = make_shared<std::thread>(&LogWebHook::run_loop, this);
 }
 
-void LogWebHook::addHookUrl(const std::string &url) {
+LogWebHook::~LogWebHook() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _started = false;
+    }
+    _cond.notify_one();
+    _thread->join();
+}
 
+void LogWebHook::addHookUrl(const std::string &url) {
+    if (url.empty()) { return; }
+    lock_guard<mutex> lock(_mutex);
+    _url_map.emplace(url);
 }
 
 void LogWebHook::delHookUrl(const std::string &url) {
-
+    lock_guard<mutex> lock(_mutex);
+    _url_map.erase(url);
 }
 
 void LogWebHook::write(const Context::Ptr &ctx) {
+    if (ctx->_level < level()) { return; }
+
+    bool notify = false;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_url_map.empty()) { return; }
+        if (_queue.size() >= _max_queue) {
+            //宁可丢日志也不能阻塞日志线程
+            ++_dropped;
+            return;
+        }
+        _queue.emplace_back(ctx);
+        notify = _queue.size() >= _max_batch;
+    }
+    if (notify) { _cond.notify_one(); }
+}
+
+void LogWebHook::run_loop() {
+    Thread::setThreadName("log-hook");
+    static const char *s_level_name[LogLevel::End] = {"trace", "debug", "info", "warn", "error"};
+    string body;
+    while (true) {
+        std::vector<Context::Ptr> batch;
+        std::set<string> urls;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _cond.wait_for(lock, std::chrono::milliseconds(_flush_ms), [this]() {
+                return !_started || _queue.size() >= _max_batch;
+            });
+            if (!_started && _queue.empty()) {
+                break;
+            }
+            auto count = std::min(_queue.size(), _max_batch);
+            batch.assign(_queue.begin(), _queue.begin() + count);
+            _queue.erase(_queue.begin(), _queue.begin() + count);
+            urls = _url_map;
+        }
+
+        //清理已经被删除的hook地址的连接
+        for (auto it = _conn_map.begin(); it != _conn_map.end();) {
+            it = urls.count(it->first) ? std::next(it) : _conn_map.erase(it);
+        }
+        if (batch.empty()) {
+            continue;
+        }
+        for (auto &url : urls) {
+            auto &conn = _conn_map[url];
+            if (!conn) {
+                conn = std::make_shared<HookConn>();
+                if (!conn->parse(url)) {
+                    conn->retry_time = UINT64_MAX;
+                }
+            }
+        }
+
+        body.clear();
+        body.push_back('[');
+        for (auto &ctx : batch) {
+            if (body.size() > 1) { body.push_back(','); }
+            uint64_t stamp = (uint64_t) ctx->_tv.tv_sec * 1000 + ctx->_tv.tv_usec / 1000;
+            body.append("{\"time\":").append(to_string(stamp));
+            body.append(",\"level\":\"").append(s_level_name[ctx->_level]);
+            body.append("\",\"thread\":\"");
+            jsonEscape(body, ctx->_thread_name);
+            body.append("\",\"file\":\"");
+            jsonEscape(body, ctx->_file);
+            body.append("\",\"line\":").append(to_string(ctx->_line));
+            body.append(",\"content\":\"");
+            jsonEscape(body, ctx->str());
+            body.append("\"}");
+        }
+        body.push_back(']');
+        post(body, batch.size());
+    }
+    _conn_map.clear();
+}
+
+void LogWebHook::post(const std::string &body, size_t count) {
+    static constexpr int s_timeout_ms = 3000;
+    static constexpr uint32_t s_max_backoff_ms = 30 * 1000;
+    auto now = getCurrentMilliSecond();
+    for (auto &pr : _conn_map) {
+        auto &conn = *pr.second;
+        if (now < conn.retry_time) {
+            _failed += count;
+            continue;
+        }
+
+        string req;
+        req.reserve(body.size() + 256);
+        req.append("POST ").append(conn.path).append(" HTTP/1.1\r\n");
+        req.append("Host: ").append(conn.host).append(":").append(conn.port).append("\r\n");
+        req.append("Content-Type: application/json\r\n");
+        req.append("Connection: keep-alive\r\n");
+        req.append("X-Log-Dropped: ").append(to_string(_dropped.load())).append("\r\n");
+        req.append("Content-Length: ").append(to_string(body.size())).append("\r\n\r\n");
+        req.append(body);
+
+        //复用的连接可能已被服务端因空闲关闭，此时重连重试一次
+        bool reused = conn.fd != -1;
+        bool success = (reused || conn.connect(s_timeout_ms)) && conn.request(req);
+        if (!success && reused) {
+            success = conn.connect(s_timeout_ms) && conn.request(req);
+        }
 
+        if (success) {
+            conn.backoff_ms = 0;
+            conn.retry_time = 0;
+            _sent += count;
+        } else {
+            conn.close();
+            conn.backoff_ms = clamp<uint32_t>(500, conn.backoff_ms * 2, s_max_backoff_ms);
+            conn.retry_time = getCurrentMilliSecond() + conn.backoff_ms;
+            _failed += count;
+        }
+    }
 }
 
 //////////////////////////// 异步写日志线程类 ////////////////////////////
-LogAsyncWriter::LogAsyncWriter() {
+LogAsyncWriter::LogAsyncWriter(std::function<void()> on_tick) : _on_tick(std::move(on_tick)) {
     _started = true;
     _thread = make_shared<std::thread>(&LogAsyncWriter::run_loop, this);
 }
 
 LogAsyncWriter::~LogAsyncWriter() {
+    stop();
+    flush();
+}
+
+void LogAsyncWriter::stop() {
     _started = false;
     _sem.notify();
-    _thread->join();
-    flush();
+    if (_thread && _thread->joinable()) {
+        _thread->join();
+    }
 }
 
 void LogAsyncWriter::write(const WriteContext &ctx) {
@@ -328,49 +821,93 @@ void LogAsyncWriter::flush() {
 }
 
 void LogAsyncWriter::run_loop() {
+    static constexpr uint32_t s_tick_ms = 1000;
     Thread::setThreadName("async-log");
+    auto last_tick = getCurrentMilliSecond();
     while (_started) {
-        _sem.wait();
+        _sem.wait_for(s_tick_ms);
         flush();
+        auto now = getCurrentMilliSecond();
+        if (_on_tick && now - last_tick >= s_tick_ms) {
+            last_tick = now;
+            _on_tick();
+        }
+    }
+}
+
+//////////////////////////// 日志限流类 ////////////////////////////
+std::atomic<LogLimiter *> LogLimiter::s_head = {nullptr};
+
+LogLimiter::LogLimiter(Mode mode, uint64_t value, LogLevel level, const char *file, int line)
+    : _mode(mode), _level(level), _line(line), _file(file) {
+    _value = value ? value : 1;
+    _next = s_head.load(std::memory_order_relaxed);
+    while (!s_head.compare_exchange_weak(_next, this, std::memory_order_release, std::memory_order_relaxed));
+}
+
+uint64_t LogLimiter::takeSuppressed() {
+    uint64_t count = _count.load(std::memory_order_relaxed);
+    uint64_t allowed = 0;
+    switch (_mode) {
+        case FirstN: allowed = std::min(count, _value); break;
+        case EveryN: allowed = (count + _value - 1) / _value; break;
+        //按时间限流时放行条数无法由总数推算，只能单独计数
+        default: allowed = _emitted.load(std::memory_order_relaxed); break;
     }
+    auto suppressed = count - allowed;
+    auto ret = suppressed - std::min(suppressed, _reported);
+    _reported = suppressed;
+    return ret;
 }
 
 //////////////////////////// 日志控制类 ////////////////////////////
 INSTANCE_IMP(Logger)
 
 Logger::Logger() {
-    _writer = make_shared<LogAsyncWriter>();
+    _channels = make_shared<ChannelMap>();
+    _writer = make_shared<LogAsyncWriter>([this]() { reportSuppressed(); });
 }
 
 Logger::~Logger() {
+    //先停掉写日志线程，它的周期任务会访问 _writer 和 _channels
+    _writer->stop();
     _writer.reset();
     {
         LogCapture(*this, Info, __FILE__, __LINE__) << "Logger destructor";
     }
     //删除所有注册的日志通道
-    _channel_map.clear();
+    std::atomic_store(&_channels, std::shared_ptr<const ChannelMap>(make_shared<ChannelMap>()));
 }
 
 void Logger::add(const Channel::Ptr &chn) {
     if (!chn) { return; }
 
-    _channel_map.emplace(chn->name(), chn);
+    lock_guard<mutex> lock(_mutex);
+    auto channels = make_shared<ChannelMap>(*std::atomic_load(&_channels));
+    channels->emplace(chn->name(), chn);
+    std::atomic_store(&_channels, std::shared_ptr<const ChannelMap>(std::move(channels)));
 }
 
 void Logger::del(const std::string &name) {
     if (name.empty()) { return; }
-    _channel_map.erase(name);
+    lock_guard<mutex> lock(_mutex);
+    auto channels = make_shared<ChannelMap>(*std::atomic_load(&_channels));
+    if (!channels->erase(name)) {
+        return;
+    }
+    std::atomic_store(&_channels, std::shared_ptr<const ChannelMap>(std::move(channels)));
 }
 
 Channel::Ptr Logger::get(const std::string &name) {
-    if (name.empty() || _channel_map.find(name) == _channel_map.end()) {
-        return nullptr;
-    }
-    return _channel_map[name];
+    auto channels = std::atomic_load(&_channels);
+    auto it = channels->find(name);
+    return it == channels->end() ? nullptr : it->second;
 }
 
 void Logger::foreach(std::function<void(const Channel::Ptr &chn)> func) {
-    for (auto it : _channel_map) {
+    //快照不会被修改，回调中可以增删通道
+    auto channels = std::atomic_load(&_channels);
+    for (auto &it : *channels) {
         if (it.second) {
             func(it.second);
         }
@@ -381,8 +918,8 @@ static int64_t timeval_diff(struct timeval &last, struct timeval &cur) {
     return (1000 * (cur.tv_sec - last.tv_sec)) + ((cur.tv_usec - last.tv_usec) / 1000);
 }
 
-void Logger::writeChannels(const Context::Ptr &ctx) {
-    for (auto chn : _channel_map) {
+void Logger::writeChannels(const ChannelMap &channels, const Context::Ptr &ctx) {
+    for (auto &chn : channels) {
         if (chn.second) {
             //异步写日志线程存在，则异步写，否则同步直接写
             _writer ? _writer->write(make_pair(chn.second, ctx)) : chn.second->write(ctx);
@@ -391,30 +928,61 @@ void Logger::writeChannels(const Context::Ptr &ctx) {
 }
 
 void Logger::write(const Context::Ptr &ctx) {
-    if (_channel_map.empty()) {
+    //整条日志只取一次通道快照
+    auto channels = std::atomic_load(&_channels);
+    if (channels->empty()) {
         return;
     }
 
-    if (_last_ctx &&
-        _last_ctx->_file == ctx->_file &&
-        _last_ctx->_line == ctx->_line &&
-        ctx->str() == _last_ctx->str()) {
-
-        _last_ctx->_repeat++;
-        if (timeval_diff(_last_ctx->_tv, ctx->_tv) < 500) {
-            return;
+    //重复日志的合并在锁内判断，写通道放到锁外(同步写的通道可能再次写日志)
+    Context::Ptr repeated;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_last_ctx &&
+            _last_ctx->_file == ctx->_file &&
+            _last_ctx->_line == ctx->_line &&
+            ctx->str() == _last_ctx->str()) {
+
+            _last_ctx->_repeat++;
+            if (timeval_diff(_last_ctx->_tv, ctx->_tv) < 500) {
+                return;
+            }
+            repeated = _last_ctx;
+        } else if (_last_ctx && _last_ctx->_repeat > 0) {
+            repeated = _last_ctx;
         }
-        writeChannels(_last_ctx);
-    } else if (_last_ctx && _last_ctx->_repeat > 0) {
-        struct timeval cur;
-        gettimeofday(&cur, NULL);
-        writeChannels(_last_ctx);
+        _last_ctx = ctx;
+        _last_ctx->_repeat = 0;
     }
 
-    writeChannels(ctx);
+    if (repeated) {
+        writeChannels(*channels, repeated);
+    }
+    writeChannels(*channels, ctx);
+}
 
-    _last_ctx = ctx;
-    _last_ctx->_repeat = 0;
+void Logger::setSuppressReportInterval(uint32_t second) {
+    _suppress_report_ms = std::max<uint32_t>(second, 1) * 1000;
+}
+
+void Logger::reportSuppressed() {
+    //在写日志线程中执行，按周期汇总各个限流调用点被抑制的日志条数
+    static uint64_t s_last_report = getCurrentMilliSecond();
+    auto now = getCurrentMilliSecond();
+    if (now - s_last_report < _suppress_report_ms) {
+        return;
+    }
+    auto elapsed = now - s_last_report;
+    s_last_report = now;
+
+    auto channels = std::atomic_load(&_channels);
+    for (auto limiter = LogLimiter::head(); limiter; limiter = limiter->next()) {
+        auto suppressed = limiter->takeSuppressed();
+        if (!suppressed) { continue; }
+        auto ctx = std::make_shared<Context>(limiter->level(), fileNameWithoutPath(limiter->file()), limiter->line());
+        (*ctx) << "Suppressed " << suppressed << " rate-limited messages in last " << elapsed / 1000 << "s";
+        writeChannels(*channels, ctx);
+    }
 }
 
 }
\ No newline at end of file
@@ -5,10 +5,13 @@
 #include <memory>
 #include <set>
 #include <list>
+#include <deque>
+#include <atomic>
 #include <unordered_map>
 #include <sstream>
 #include <fstream>
 #include <thread>
+#include <condition_variable>
 
 #include <cstring>
 #include <time.h>
@@ -83,6 +86,36 @@ private:
     bool _enable_color;
 };
 
+//在独立的低优先级线程中压缩滚动后的日志文件(xxx.log -> xxx.log.gz)
+//线程使用 SCHED_IDLE 调度和 idle IO 优先级，并按字节速率限速，避免与写日志线程争抢CPU和磁盘
+class LogCompressor {
+public:
+    using Ptr = std::shared_ptr<LogCompressor>;
+    //max_bytes_per_sec: 每秒最多读取并压缩的原始日志字节数
+    explicit LogCompressor(size_t max_bytes_per_sec = 8 * 1024 * 1024);
+    ~LogCompressor();
+
+    //编译时是否找到了压缩库
+    static bool supported();
+    //压缩后文件的后缀
+    static const std::string &suffix();
+
+    void compress(const std::string &path);
+
+private:
+    void run_loop();
+    bool compressFile(const std::string &path);
+
+private:
+    //压缩循环中不加锁读取
+    std::atomic<bool> _started = {false};
+    size_t _max_bytes_per_sec;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::list<std::string> _file_list;
+    std::shared_ptr<std::thread> _thread;
+};
+
 //用于向文件输出日志
 class LogFile : public Channel {
 public:
@@ -98,6 +131,9 @@ public:
 
     void setEnableStackTrace(bool enable, LogLevel level = LogLevel::Error);
 
+    //是否在后台压缩滚动后的日志文件，需要编译时找到zlib
+    void setEnableCompress(bool enable, size_t max_bytes_per_sec = 8 * 1024 * 1024);
+
     void write(const Context::Ptr &ctx) override;
 
 private:
@@ -122,13 +158,28 @@ private:
     std::string _path;
     std::string _current_log_file;
     std::ofstream _file;
+    //记录的是未压缩时的文件名，压缩后的文件按同名 + LogCompressor::suffix() 处理
     std::set<std::string> _log_file_map;
+    //启动时扫描到的尚未压缩的日志文件
+    std::set<std::string> _uncompressed_set;
+    //只通过 std::atomic_load/atomic_store 访问
+    LogCompressor::Ptr _compressor;
 };
 
 //用于向注册的WebHook输出日志
+//write() 只把日志放入有界队列，由独立线程攒批成 JSON 数组，通过 keep-alive 的 HTTP 长连接 POST 出去
+//队列满时直接丢弃并计数，慢速的 hook 服务端永远不会反压到日志线程
 class LogWebHook : public Channel {
 public:
-    LogWebHook(const std::string &name = "hook", LogLevel level = LogLevel::Error, const std::string &url = "");
+    /**
+     * @param url: 形如 http://host[:port][/path], 暂不支持https
+     * @param max_queue: 待发送日志队列的最大长度，超出则丢弃
+     * @param max_batch: 每次 POST 最多携带的日志条数
+     * @param flush_ms: 队列未攒满一批时，最长等待多久发送一次
+    */
+    LogWebHook(const std::string &name = "hook", LogLevel level = LogLevel::Error, const std::string &url = "",
+               size_t max_queue = 4096, size_t max_batch = 128, uint32_t flush_ms = 1000);
+    ~LogWebHook();
 
     void addHookUrl(const std::string &url);
 
@@ -136,8 +187,34 @@ public:
 
     void write(const Context::Ptr &ctx) override;
 
+    //因队列满而丢弃的日志条数
+    uint64_t droppedCount() const { return _dropped; }
+    //成功投递的日志条数
+    uint64_t sentCount() const { return _sent; }
+    //投递失败的日志条数(连接或HTTP错误)
+    uint64_t failedCount() const { return _failed; }
+
+private:
+    struct HookConn;
+    void run_loop();
+    void post(const std::string &body, size_t count);
+
 private:
+    bool _started = false;
+    size_t _max_queue;
+    size_t _max_batch;
+    uint32_t _flush_ms;
+    std::atomic<uint64_t> _dropped = {0};
+    std::atomic<uint64_t> _sent = {0};
+    std::atomic<uint64_t> _failed = {0};
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<Context::Ptr> _queue;
     std::set<std::string> _url_map;
+    //以下仅在 hook 线程内访问
+    std::unordered_map<std::string, std::shared_ptr<HookConn> > _conn_map;
+    std::shared_ptr<std::thread> _thread;
 };
 
 //开启一个线程用于异步执行 Logger 提交的写日志任务
@@ -145,17 +222,22 @@ class LogAsyncWriter {
 public:
     using Ptr = std::shared_ptr<LogAsyncWriter>;
     using WriteContext = std::pair<Channel::Ptr, Context::Ptr>;
-    explicit LogAsyncWriter();
+    //on_tick: 在写日志线程中大约每秒执行一次的周期任务
+    explicit LogAsyncWriter(std::function<void()> on_tick = nullptr);
     ~LogAsyncWriter();
 
     void write(const WriteContext &ctx);
 
+    //停止并等待写日志线程退出, 返回后 on_tick 不会再执行; 可重复调用
+    void stop();
+
 private:
     void flush();
     void run_loop();
 
 private:
-    bool _started = false;
+    std::atomic<bool> _started = {false};
+    std::function<void()> _on_tick;
     std::mutex _mutex;
     std::list<WriteContext> _content_list;
 
@@ -165,7 +247,7 @@ private:
 
 /**
  * 包含：writer, channel_list
- * 增，删，查操作线程不安全
+ * channel_list 按写时复制发布: 增删时在锁内复制一份再整体替换，写日志和查找只原子地取一次快照，不加锁
 */
 class Logger : public noncopyable, public std::enable_shared_from_this<Logger> {
 public:
@@ -184,13 +266,24 @@ public:
 
     void write(const Context::Ptr &ctx);
 
+    //限流日志被抑制条数的汇报周期
+    void setSuppressReportInterval(uint32_t second);
+
 private:
-    void writeChannels(const Context::Ptr &ctx);
+    using ChannelMap = std::unordered_map<std::string, Channel::Ptr>;
+
+    void writeChannels(const ChannelMap &channels, const Context::Ptr &ctx);
+
+    void reportSuppressed();
 
 private:
-    Context::Ptr _last_ctx = nullptr;
+    uint32_t _suppress_report_ms = 10 * 1000;
     LogAsyncWriter::Ptr _writer;
-    std::unordered_map<std::string, Channel::Ptr> _channel_map;
+    //串行化 add/del 的复制替换，同时保护 _last_ctx; 锁内不调用通道
+    std::mutex _mutex;
+    Context::Ptr _last_ctx = nullptr;
+    //只通过 std::atomic_load/atomic_store 访问
+    std::shared_ptr<const ChannelMap> _channels;
 };
 
 //LogCapture用于捕获，展开日志，生成Context，write 到 Logger, 
@@ -231,5 +324,96 @@ private:
 #define WarnL  LogWrite(::beton::LogLevel::Warn)
 #define ErrorL LogWrite(::beton::LogLevel::Error)
 
+/**
+ * 热点路径(如逐包处理)的日志限流，每个调用点持有一个静态的 LogLimiter
+ * 被抑制时只做一次原子计数，不会构造 Context；被抑制的条数由写日志线程周期性汇总输出
+*/
+class LogLimiter : public noncopyable {
+public:
+    typedef enum : uint8_t {
+        EveryMs = 0,    //每 value 毫秒最多输出一条
+        FirstN,         //只输出前 value 条
+        EveryN,         //每 value 条采样输出一条
+    }Mode;
+
+    LogLimiter(Mode mode, uint64_t value, LogLevel level, const char *file, int line);
+
+    bool allow() {
+        auto count = _count.fetch_add(1, std::memory_order_relaxed);
+        switch (_mode) {
+            case FirstN: return count < _value;
+            case EveryN: return count % _value == 0;
+            default: break;
+        }
+        auto now = coarseMilliSecond();
+        auto last = _last_ms.load(std::memory_order_relaxed);
+        if ((count == 0 || now - last >= _value) &&
+            _last_ms.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+            _emitted.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    //写日志线程调用: 取出自上次汇报以来被抑制的条数
+    uint64_t takeSuppressed();
+
+    LogLevel level() const { return _level; }
+    const char *file() const { return _file; }
+    int line() const { return _line; }
+    LogLimiter *next() const { return _next; }
+    static LogLimiter *head() { return s_head.load(std::memory_order_acquire); }
+
+private:
+    static uint64_t coarseMilliSecond() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+private:
+    Mode _mode;
+    LogLevel _level;
+    int _line;
+    const char *_file;
+    uint64_t _value;
+    uint64_t _reported = 0;
+    std::atomic<uint64_t> _count = {0};
+    std::atomic<uint64_t> _last_ms = {0};
+    std::atomic<uint64_t> _emitted = {0};
+    //所有调用点串成无锁单链表，只增不删
+    LogLimiter *_next = nullptr;
+    static std::atomic<LogLimiter *> s_head;
+};
+
+//lambda 内的静态变量保证每个调用点独有一份限流状态；for 循环最多执行一次，便于后接 << 输出
+#define LogWriteLimited(level, mode, value) \
+    for (bool bt_log_allow_ = [&]() { \
+            static ::beton::LogLimiter s_limiter(mode, value, level, __FILE__, __LINE__); \
+            return s_limiter.allow(); }(); \
+         bt_log_allow_; bt_log_allow_ = false) LogWrite(level)
+
+#define LogWrite_EVERY_MS(level, ms) LogWriteLimited(level, ::beton::LogLimiter::EveryMs, ms)
+#define LogWrite_FIRST_N(level, n)   LogWriteLimited(level, ::beton::LogLimiter::FirstN, n)
+#define LogWrite_EVERY_N(level, n)   LogWriteLimited(level, ::beton::LogLimiter::EveryN, n)
+
+#define TraceL_EVERY_MS(ms) LogWrite_EVERY_MS(::beton::LogLevel::Trace, ms)
+#define DebugL_EVERY_MS(ms) LogWrite_EVERY_MS(::beton::LogLevel::Debug, ms)
+#define InfoL_EVERY_MS(ms)  LogWrite_EVERY_MS(::beton::LogLevel::Info, ms)
+#define WarnL_EVERY_MS(ms)  LogWrite_EVERY_MS(::beton::LogLevel::Warn, ms)
+#define ErrorL_EVERY_MS(ms) LogWrite_EVERY_MS(::beton::LogLevel::Error, ms)
+
+#define TraceL_FIRST_N(n) LogWrite_FIRST_N(::beton::LogLevel::Trace, n)
+#define DebugL_FIRST_N(n) LogWrite_FIRST_N(::beton::LogLevel::Debug, n)
+#define InfoL_FIRST_N(n)  LogWrite_FIRST_N(::beton::LogLevel::Info, n)
+#define WarnL_FIRST_N(n)  LogWrite_FIRST_N(::beton::LogLevel::Warn, n)
+#define ErrorL_FIRST_N(n) LogWrite_FIRST_N(::beton::LogLevel::Error, n)
+
+#define TraceL_EVERY_N(n) LogWrite_EVERY_N(::beton::LogLevel::Trace, n)
+#define DebugL_EVERY_N(n) LogWrite_EVERY_N(::beton::LogLevel::Debug, n)
+#define InfoL_EVERY_N(n)  LogWrite_EVERY_N(::beton::LogLevel::Info, n)
+#define WarnL_EVERY_N(n)  LogWrite_EVERY_N(::beton::LogLevel::Warn, n)
+#define ErrorL_EVERY_N(n) LogWrite_EVERY_N(::beton::LogLevel::Error, n)
+
 }
 #endif  //__LOGGER_H__
\ No newline at end of file
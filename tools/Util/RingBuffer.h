@@ -0,0 +1,229 @@
+#ifndef __RING_BUFFER_H__
+#define __RING_BUFFER_H__
+
+#include "Util.h"
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace beton {
+
+/**
+ * 一写多读的无锁环形缓冲，用于把一路流的帧分发给多个播放端:
+ * 1. 只有一个写线程；每个读者持有自己的游标(Reader), 在自己的线程读取，读者之间、读写之间都不加锁
+ * 2. 槽位保存指向节点的原子指针，节点里是帧本身(通常是 shared_ptr), 读取只是拷贝一次 shared_ptr
+ * 3. 节点带 "序号 + 引用计数" 的原子状态，读者 CAS 成功才能拷贝，槽位被覆盖后旧节点由最后一个使用者放回空闲链表;
+ *    节点内存直到环形缓冲析构才释放，读到已被复用的节点是安全的，序号不匹配即视为被追上
+ * 4. 读者落后超过容量时读取失败，可以跳到最近的关键帧继续
+*/
+template <typename T>
+class RingBuffer : public noncopyable {
+public:
+    using Ptr = std::shared_ptr<RingBuffer>;
+
+    //容量向上取整到2的幂
+    RingBuffer(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _mask = size - 1;
+        _slots.reset(new std::atomic<Node *>[size]);
+        for (size_t i = 0; i < size; ++i) {
+            _slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~RingBuffer() {
+        //析构时已经没有读者
+        for (auto node : _nodes) {
+            delete node;
+        }
+    }
+
+    /**
+     * 写入一帧，只能在同一个线程调用
+     * @param key: 是否为关键帧, 落后的读者从这里恢复
+    */
+    void write(T value, bool key) {
+        uint64_t seq = _write_seq.load(std::memory_order_relaxed);
+        auto node = obtainNode();
+        node->value = std::move(value);
+        node->key = key;
+        //节点先对本序号生效，再挂到槽位上，最后公布写序号
+        node->state.store((tag(seq) << kRefBits) | 1, std::memory_order_release);
+        auto old = _slots[seq & _mask].exchange(node, std::memory_order_acq_rel);
+        if (key) {
+            _key_seq.store(seq, std::memory_order_release);
+        }
+        _write_seq.store(seq + 1, std::memory_order_release);
+        if (old) {
+            //释放环形缓冲自己持有的引用
+            releaseNode(old);
+        }
+    }
+
+    size_t capacity() const { return _mask + 1; }
+    //下一帧的序号, 也就是已写入的帧数
+    uint64_t writeSeq() const { return _write_seq.load(std::memory_order_acquire); }
+    //最近一个关键帧的序号，没有时返回 UINT64_MAX
+    uint64_t keySeq() const { return _key_seq.load(std::memory_order_acquire); }
+
+    //一个读者的游标，只能在一个线程使用
+    class Reader {
+    public:
+        /**
+         * 默认从最新位置开始，等到下一个关键帧才输出
+         * 没有视频的流(纯音频)写入时每帧都应标记为关键帧
+        */
+        Reader(Ptr ring) : _ring(std::move(ring)) {
+            _seq = _ring->writeSeq();
+        }
+
+        /**
+         * 读取下一帧
+         * @return 1 读到; 0 暂无数据; -1 被写入端追上，需要调用 skipToKeyFrame()
+        */
+        int read(T &value) {
+            while (true) {
+                uint64_t write_seq = _ring->writeSeq();
+                if (_seq >= write_seq) {
+                    return 0;
+                }
+                if (write_seq - _seq > _ring->capacity()) {
+                    return -1;
+                }
+                bool key;
+                if (!_ring->copyAt(_seq, value, key)) {
+                    return -1;
+                }
+                ++_seq;
+                if (_wait_key && !key) {
+                    continue;
+                }
+                _wait_key = false;
+                return 1;
+            }
+        }
+
+        /**
+         * 丢掉积压的帧，从最近的关键帧(还在缓冲内)继续; 没有可用的关键帧时跳到最新位置并等待下一个关键帧
+         * @return 跳过的帧数
+        */
+        uint64_t skipToKeyFrame() {
+            uint64_t write_seq = _ring->writeSeq();
+            uint64_t key_seq = _ring->keySeq();
+            uint64_t old = _seq;
+            //关键帧还没有被覆盖(留一半容量的余量，避免刚跳过去又被追上)
+            if (key_seq != UINT64_MAX && key_seq > _seq && write_seq - key_seq < _ring->capacity() / 2) {
+                _seq = key_seq;
+                _wait_key = false;
+            } else {
+                _seq = write_seq;
+                _wait_key = true;
+            }
+            return _seq - old;
+        }
+
+        //从指定序号继续读，比如 GOP 缓存之后的下一帧; 已被覆盖时下次读取返回-1
+        void seek(uint64_t seq) {
+            _seq = seq;
+            _wait_key = false;
+        }
+
+        //从最近的关键帧开始读，用于起播; 没有关键帧时等待下一个
+        void seekToKeyFrame() {
+            uint64_t write_seq = _ring->writeSeq();
+            uint64_t key_seq = _ring->keySeq();
+            if (key_seq != UINT64_MAX && write_seq - key_seq < _ring->capacity() / 2) {
+                _seq = key_seq;
+                _wait_key = false;
+            } else {
+                _seq = write_seq;
+                _wait_key = true;
+            }
+        }
+
+        //未读取的帧数
+        uint64_t lag() const { return _ring->writeSeq() - _seq; }
+        uint64_t seq() const { return _seq; }
+        const Ptr &ring() const { return _ring; }
+
+    private:
+        bool _wait_key = true;
+        uint64_t _seq;
+        Ptr _ring;
+    };
+
+private:
+    //状态字低位是引用计数，高位是节点当前承载的帧序号
+    static constexpr int kRefBits = 20;
+    static constexpr uint64_t kRefMask = (1ULL << kRefBits) - 1;
+
+    struct Node {
+        std::atomic<uint64_t> state{0};
+        bool key = false;
+        T value;
+        //空闲链表
+        Node *next = nullptr;
+    };
+
+    static uint64_t tag(uint64_t seq) { return seq & ((1ULL << (64 - kRefBits)) - 1); }
+
+    //拷贝指定序号的帧，槽位已被覆盖时返回 false
+    bool copyAt(uint64_t seq, T &value, bool &key) {
+        auto node = _slots[seq & _mask].load(std::memory_order_acquire);
+        if (!node) {
+            return false;
+        }
+        uint64_t state = node->state.load(std::memory_order_acquire);
+        do {
+            //节点已经承载了其他帧，或者正在被回收
+            if ((state >> kRefBits) != tag(seq) || (state & kRefMask) == 0) {
+                return false;
+            }
+        } while (!node->state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel, std::memory_order_acquire));
+        value = node->value;
+        key = node->key;
+        releaseNode(node);
+        return true;
+    }
+
+    void releaseNode(Node *node) {
+        if ((node->state.fetch_sub(1, std::memory_order_acq_rel) & kRefMask) != 1) {
+            return;
+        }
+        //最后一个引用，在当前线程释放帧并归还节点
+        node->value = T();
+        auto head = _free.load(std::memory_order_relaxed);
+        do {
+            node->next = head;
+        } while (!_free.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    //只在写线程调用，空闲链表只有这一个取出方，不存在 ABA
+    Node *obtainNode() {
+        auto head = _free.load(std::memory_order_acquire);
+        while (head && !_free.compare_exchange_weak(head, head->next, std::memory_order_acquire, std::memory_order_acquire)) {
+        }
+        if (head) {
+            return head;
+        }
+        //节点总数不超过容量加上同时在拷贝的读者数
+        auto node = new Node;
+        _nodes.push_back(node);
+        return node;
+    }
+
+private:
+    size_t _mask;
+    std::unique_ptr<std::atomic<Node *>[]> _slots;
+    std::atomic<uint64_t> _write_seq{0};
+    std::atomic<uint64_t> _key_seq{UINT64_MAX};
+    std::atomic<Node *> _free{nullptr};
+    //所有分配过的节点，只在写线程修改
+    std::vector<Node *> _nodes;
+};
+
+}
+#endif  //__RING_BUFFER_H__
@@ -5,6 +5,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <ctime>
+#include <chrono>
 #include <vector>
 
 namespace beton {
@@ -65,6 +66,16 @@ public:
         while (_count == 0) { _condition.wait(lock); }
         --_count;
     }
+
+    //超时未等到信号返回false
+    bool wait_for(uint32_t timeout_ms) {
+        std::unique_lock<std::recursive_mutex> lock(_mutex);
+        if (!_condition.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return _count > 0; })) {
+            return false;
+        }
+        --_count;
+        return true;
+    }
 private:
     size_t _count = 0;
     std::recursive_mutex _mutex;
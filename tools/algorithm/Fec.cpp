@@ -0,0 +1,464 @@
+#include "Fec.h"
+#include <string.h>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ENABLE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace beton {
+
+//GF(2^8) 的查表数据，静态初始化时生成
+struct GfTables {
+    uint8_t exp[512];
+    uint8_t log[256];
+    //完整乘法表，标量实现按乘数取一行
+    uint8_t mul[256][256];
+    //pshufb 用的半字节表: lo[c][x] = c * x, hi[c][x] = c * (x << 4)
+    alignas(16) uint8_t lo[256][16];
+    alignas(16) uint8_t hi[256][16];
+
+    GfTables() {
+        //本原多项式 x^8 + x^4 + x^3 + x^2 + 1, 生成元为2
+        unsigned x = 1;
+        for (int i = 0; i < 255; ++i) {
+            exp[i] = x;
+            log[x] = i;
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11d;
+            }
+        }
+        for (int i = 255; i < 512; ++i) {
+            exp[i] = exp[i - 255];
+        }
+        log[0] = 0;
+        for (int a = 0; a < 256; ++a) {
+            for (int b = 0; b < 256; ++b) {
+                mul[a][b] = (a && b) ? exp[log[a] + log[b]] : 0;
+            }
+            for (int n = 0; n < 16; ++n) {
+                lo[a][n] = mul[a][n];
+                hi[a][n] = mul[a][n << 4];
+            }
+        }
+    }
+};
+
+static const GfTables s_gf;
+
+uint8_t gfMul(uint8_t a, uint8_t b) {
+    return s_gf.mul[a][b];
+}
+
+uint8_t gfInv(uint8_t a) {
+    return s_gf.exp[255 - s_gf.log[a]];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void fecXorScalar(uint8_t *dst, const uint8_t *src, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, 8);
+        memcpy(&b, src + i, 8);
+        a ^= b;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < size; ++i) {
+        dst[i] ^= src[i];
+    }
+}
+
+static void gfMulAddScalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+    auto row = s_gf.mul[c];
+    for (size_t i = 0; i < size; ++i) {
+        dst[i] ^= row[src[i]];
+    }
+}
+
+static void gfMulScalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+    auto row = s_gf.mul[c];
+    for (size_t i = 0; i < size; ++i) {
+        dst[i] = row[src[i]];
+    }
+}
+
+#ifdef ENABLE_X86_SIMD
+static void fecXorSse2(uint8_t *dst, const uint8_t *src, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        auto a = _mm_loadu_si128((const __m128i *)(dst + i));
+        auto b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a, b));
+    }
+    fecXorScalar(dst + i, src + i, size - i);
+}
+
+//16个字节的乘法: 低4位和高4位分别查表再异或
+__attribute__((target("ssse3")))
+static inline __m128i gfMul16(__m128i x, __m128i lo, __m128i hi, __m128i mask) {
+    auto l = _mm_shuffle_epi8(lo, _mm_and_si128(x, mask));
+    auto h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+    return _mm_xor_si128(l, h);
+}
+
+__attribute__((target("ssse3")))
+static void gfMulAddSsse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+    auto lo = _mm_load_si128((const __m128i *)s_gf.lo[c]);
+    auto hi = _mm_load_si128((const __m128i *)s_gf.hi[c]);
+    auto mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        auto x = _mm_loadu_si128((const __m128i *)(src + i));
+        auto d = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, gfMul16(x, lo, hi, mask)));
+    }
+    gfMulAddScalar(dst + i, src + i, c, size - i);
+}
+
+__attribute__((target("ssse3")))
+static void gfMulSsse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+    auto lo = _mm_load_si128((const __m128i *)s_gf.lo[c]);
+    auto hi = _mm_load_si128((const __m128i *)s_gf.hi[c]);
+    auto mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        auto x = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), gfMul16(x, lo, hi, mask));
+    }
+    gfMulScalar(dst + i, src + i, c, size - i);
+}
+
+__attribute__((target("avx2")))
+static void fecXorAvx2(uint8_t *dst, const uint8_t *src, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        auto a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        auto b = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(a, b));
+    }
+    //尾部不能调用 sse 版本: 在 avx 代码中间执行非 VEX 编码的 sse 指令有状态切换的代价
+    for (; i + 16 <= size; i += 16) {
+        auto a = _mm_loadu_si128((const __m128i *)(dst + i));
+        auto b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a, b));
+    }
+    fecXorScalar(dst + i, src + i, size - i);
+}
+
+//vpshufb 在每个128位通道内查表，两个通道放同一张表
+__attribute__((target("avx2")))
+static inline __m256i gfMul32(__m256i x, __m256i lo, __m256i hi, __m256i mask) {
+    auto l = _mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask));
+    auto h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+    return _mm256_xor_si256(l, h);
+}
+
+__attribute__((target("avx2")))
+static void gfMulAddAvx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+    auto lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)s_gf.lo[c]));
+    auto hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)s_gf.hi[c]));
+    auto mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    //每轮64字节，两组独立的依赖链
+    for (; i + 64 <= size; i += 64) {
+        auto x0 = _mm256_loadu_si256((const __m256i *)(src + i));
+        auto x1 = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        auto d0 = _mm256_loadu_si256((const __m256i *)(dst + i));
+        auto d1 = _mm256_loadu_si256((const __m256i *)(dst + i + 32));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d0, gfMul32(x0, lo, hi, mask)));
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), _mm256_xor_si256(d1, gfMul32(x1, lo, hi, mask)));
+    }
+    for (; i + 32 <= size; i += 32) {
+        auto x = _mm256_loadu_si256((const __m256i *)(src + i));
+        auto d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, gfMul32(x, lo, hi, mask)));
+    }
+    //不足32字节的部分用同一张表的低128位
+    if (i + 16 <= size) {
+        auto x = _mm_loadu_si128((const __m128i *)(src + i));
+        auto d = _mm_loadu_si128((const __m128i *)(dst + i));
+        auto p = gfMul32(_mm256_castsi128_si256(x), lo, hi, mask);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, _mm256_castsi256_si128(p)));
+        i += 16;
+    }
+    gfMulAddScalar(dst + i, src + i, c, size - i);
+}
+
+__attribute__((target("avx2")))
+static void gfMulAvx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+    auto lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)s_gf.lo[c]));
+    auto hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)s_gf.hi[c]));
+    auto mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        auto x = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), gfMul32(x, lo, hi, mask));
+    }
+    if (i + 16 <= size) {
+        auto x = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm256_castsi256_si128(gfMul32(_mm256_castsi128_si256(x), lo, hi, mask)));
+        i += 16;
+    }
+    gfMulScalar(dst + i, src + i, c, size - i);
+}
+#endif  //ENABLE_X86_SIMD
+
+struct FecKernel {
+    const char *name;
+    void (*xor_func)(uint8_t *, const uint8_t *, size_t);
+    void (*mul_add)(uint8_t *, const uint8_t *, uint8_t, size_t);
+    void (*mul)(uint8_t *, const uint8_t *, uint8_t, size_t);
+};
+
+static FecKernel s_kernel = []() {
+#ifdef ENABLE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return FecKernel{"avx2", fecXorAvx2, gfMulAddAvx2, gfMulAvx2};
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return FecKernel{"ssse3", fecXorSse2, gfMulAddSsse3, gfMulSsse3};
+    }
+#endif
+    return FecKernel{"scalar", fecXorScalar, gfMulAddScalar, gfMulScalar};
+}();
+
+void fecXor(uint8_t *dst, const uint8_t *src, size_t size) {
+    s_kernel.xor_func(dst, src, size);
+}
+
+void gfMulAdd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+    //乘0和乘1很常见(单位矩阵部分), 不必查表
+    if (c == 1) {
+        s_kernel.xor_func(dst, src, size);
+    } else if (c) {
+        s_kernel.mul_add(dst, src, c, size);
+    }
+}
+
+void gfMul(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+    if (c == 1) {
+        memmove(dst, src, size);
+    } else if (c) {
+        s_kernel.mul(dst, src, c, size);
+    } else {
+        memset(dst, 0, size);
+    }
+}
+
+const char *fecKernel() {
+    return s_kernel.name;
+}
+
+bool setFecKernel(const string &name) {
+    if (name == "scalar") {
+        s_kernel = {"scalar", fecXorScalar, gfMulAddScalar, gfMulScalar};
+        return true;
+    }
+#ifdef ENABLE_X86_SIMD
+    if (name == "ssse3" && __builtin_cpu_supports("ssse3")) {
+        s_kernel = {"ssse3", fecXorSse2, gfMulAddSsse3, gfMulSsse3};
+        return true;
+    }
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        s_kernel = {"avx2", fecXorAvx2, gfMulAddAvx2, gfMulAvx2};
+        return true;
+    }
+#endif
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+XorFec::XorFec(size_t columns, size_t rows) {
+    if (!columns || !rows) {
+        throw std::invalid_argument("xor fec needs at least one row and one column");
+    }
+    _columns = columns;
+    _rows = rows;
+}
+
+void XorFec::encode(const uint8_t *const *data, uint8_t *const *row_fec, uint8_t *const *col_fec, size_t size) const {
+    for (size_t r = 0; r < _rows; ++r) {
+        auto row = data + r * _columns;
+        memcpy(row_fec[r], row[0], size);
+        for (size_t c = 1; c < _columns; ++c) {
+            fecXor(row_fec[r], row[c], size);
+        }
+    }
+    if (_rows == 1 || !col_fec) {
+        return;
+    }
+    for (size_t c = 0; c < _columns; ++c) {
+        memcpy(col_fec[c], data[c], size);
+        for (size_t r = 1; r < _rows; ++r) {
+            fecXor(col_fec[c], data[r * _columns + c], size);
+        }
+    }
+}
+
+bool XorFec::recoverGroup(uint8_t *const *data, bool *present, const uint8_t *fec, size_t first, size_t step,
+                          size_t count, size_t size) const {
+    size_t lost = SIZE_MAX;
+    for (size_t i = 0, index = first; i < count; ++i, index += step) {
+        if (present[index]) {
+            continue;
+        }
+        if (lost != SIZE_MAX) {
+            //一组丢了不止一个
+            return false;
+        }
+        lost = index;
+    }
+    if (lost == SIZE_MAX || !fec) {
+        return false;
+    }
+    memcpy(data[lost], fec, size);
+    for (size_t i = 0, index = first; i < count; ++i, index += step) {
+        if (index != lost) {
+            fecXor(data[lost], data[index], size);
+        }
+    }
+    present[lost] = true;
+    return true;
+}
+
+size_t XorFec::decode(uint8_t *const *data, bool *present, const uint8_t *const *row_fec, const uint8_t *const *col_fec,
+                      size_t size) const {
+    //行恢复出的包可能让某一列只剩一个丢包，反之亦然，直到没有进展为止
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (size_t r = 0; r < _rows; ++r) {
+            progress |= recoverGroup(data, present, row_fec ? row_fec[r] : nullptr, r * _columns, 1, _columns, size);
+        }
+        if (_rows == 1 || !col_fec) {
+            break;
+        }
+        for (size_t c = 0; c < _columns; ++c) {
+            progress |= recoverGroup(data, present, col_fec[c], c, _columns, _rows, size);
+        }
+    }
+    size_t missing = 0;
+    for (size_t i = 0; i < dataCount(); ++i) {
+        missing += !present[i];
+    }
+    return missing;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+ReedSolomon::ReedSolomon(size_t data_shards, size_t parity_shards) {
+    if (!data_shards || !parity_shards || data_shards + parity_shards > 256) {
+        throw std::invalid_argument("invalid reed-solomon shard count");
+    }
+    _data_shards = data_shards;
+    _parity_shards = parity_shards;
+    //柯西矩阵: 1 / (x_i + y_j), x_i = data_shards + i, y_j = j, 两组互不相同所以分母不为0
+    _parity_matrix.resize(parity_shards * data_shards);
+    for (size_t i = 0; i < parity_shards; ++i) {
+        for (size_t j = 0; j < data_shards; ++j) {
+            _parity_matrix[i * data_shards + j] = gfInv((uint8_t)((data_shards + i) ^ j));
+        }
+    }
+}
+
+void ReedSolomon::encode(const uint8_t *const *data, uint8_t *const *parity, size_t size) const {
+    for (size_t i = 0; i < _parity_shards; ++i) {
+        auto coef = &_parity_matrix[i * _data_shards];
+        gfMul(parity[i], data[0], coef[0], size);
+        for (size_t j = 1; j < _data_shards; ++j) {
+            gfMulAdd(parity[i], data[j], coef[j], size);
+        }
+    }
+}
+
+bool ReedSolomon::invert(vector<uint8_t> &matrix, size_t n) {
+    //高斯-约当消元，右半部分从单位矩阵变为逆矩阵
+    vector<uint8_t> aug(n * n * 2, 0);
+    for (size_t r = 0; r < n; ++r) {
+        memcpy(&aug[r * 2 * n], &matrix[r * n], n);
+        aug[r * 2 * n + n + r] = 1;
+    }
+    for (size_t col = 0; col < n; ++col) {
+        size_t pivot = col;
+        while (pivot < n && !aug[pivot * 2 * n + col]) {
+            ++pivot;
+        }
+        if (pivot == n) {
+            return false;
+        }
+        if (pivot != col) {
+            for (size_t k = 0; k < 2 * n; ++k) {
+                std::swap(aug[pivot * 2 * n + k], aug[col * 2 * n + k]);
+            }
+        }
+        auto row = &aug[col * 2 * n];
+        auto inv = gfInv(row[col]);
+        gfMul(row, row, inv, 2 * n);
+        for (size_t r = 0; r < n; ++r) {
+            auto other = &aug[r * 2 * n];
+            if (r != col && other[col]) {
+                gfMulAdd(other, row, other[col], 2 * n);
+            }
+        }
+    }
+    for (size_t r = 0; r < n; ++r) {
+        memcpy(&matrix[r * n], &aug[r * 2 * n + n], n);
+    }
+    return true;
+}
+
+bool ReedSolomon::decode(uint8_t *const *shards, bool *present, size_t size) {
+    vector<size_t> lost;
+    for (size_t i = 0; i < _data_shards; ++i) {
+        if (!present[i]) {
+            lost.emplace_back(i);
+        }
+    }
+    if (lost.empty()) {
+        return true;
+    }
+    //优先选用收到的数据分片，其系数是单位矩阵的行
+    vector<size_t> rows;
+    for (size_t i = 0; i < _data_shards + _parity_shards && rows.size() < _data_shards; ++i) {
+        if (present[i]) {
+            rows.emplace_back(i);
+        }
+    }
+    if (rows.size() < _data_shards) {
+        return false;
+    }
+    if (rows != _cached_rows) {
+        vector<uint8_t> matrix(_data_shards * _data_shards, 0);
+        for (size_t r = 0; r < _data_shards; ++r) {
+            auto dst = &matrix[r * _data_shards];
+            if (rows[r] < _data_shards) {
+                dst[rows[r]] = 1;
+            } else {
+                memcpy(dst, &_parity_matrix[(rows[r] - _data_shards) * _data_shards], _data_shards);
+            }
+        }
+        if (!invert(matrix, _data_shards)) {
+            return false;
+        }
+        _cached_rows = std::move(rows);
+        _cached_inverse = std::move(matrix);
+    }
+    //丢失的数据分片 = 逆矩阵的对应行 x 选中的分片
+    for (auto index : lost) {
+        auto coef = &_cached_inverse[index * _data_shards];
+        auto out = shards[index];
+        gfMul(out, shards[_cached_rows[0]], coef[0], size);
+        for (size_t t = 1; t < _data_shards; ++t) {
+            gfMulAdd(out, shards[_cached_rows[t]], coef[t], size);
+        }
+        present[index] = true;
+    }
+    return true;
+}
+
+}
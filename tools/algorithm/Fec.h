@@ -0,0 +1,126 @@
+#ifndef __FEC_H__
+#define __FEC_H__
+
+#include "Util/Util.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace beton {
+
+/**
+ * 前向纠错，用于 SRT/WebRTC 等有丢包的链路，按包(分片)编码，所有分片等长，不足的由调用者补零
+ * 底层是 GF(2^8)(多项式 0x11d) 的乘加和异或，按 cpu 选择实现:
+ * avx2/ssse3 用 pshufb 查表，乘数按高低4位拆成两张16字节的表，一条指令完成16/32个字节的乘法; 否则用标量查表
+*/
+
+//dst ^= src
+void fecXor(uint8_t *dst, const uint8_t *src, size_t size);
+//dst ^= c * src, GF(2^8) 乘法
+void gfMulAdd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size);
+//dst = c * src
+void gfMul(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size);
+
+//GF(2^8) 的单字节乘法和求逆(a 不能为0)
+uint8_t gfMul(uint8_t a, uint8_t b);
+uint8_t gfInv(uint8_t a);
+
+//当前使用的实现: "scalar", "ssse3" 或 "avx2"
+const char *fecKernel();
+//强制使用某个实现，用于测试和性能对比; cpu 不支持时返回 false
+bool setFecKernel(const std::string &name);
+
+/**
+ * 行列异或 FEC(SMPTE 2022-1 / ULPFEC 的矩阵方式):
+ * columns x rows 个数据包按行排列，每行生成一个行校验包，每列生成一个列校验包
+ * 每行、每列各能恢复一个丢包，解码时行列交替迭代，可以恢复部分成串的丢包
+*/
+class XorFec {
+public:
+    /**
+     * @param columns: 每行的包数(L)
+     * @param rows: 行数(D), 为 1 时只有行校验; 列校验个数为 columns
+    */
+    XorFec(size_t columns, size_t rows);
+
+    size_t columns() const { return _columns; }
+    size_t rows() const { return _rows; }
+    size_t dataCount() const { return _columns * _rows; }
+
+    /**
+     * 编码
+     * @param data: dataCount() 个数据包，按行排列
+     * @param row_fec: rows() 个行校验包的输出
+     * @param col_fec: columns() 个列校验包的输出, rows 为 1 时可以为 nullptr
+    */
+    void encode(const uint8_t *const *data, uint8_t *const *row_fec, uint8_t *const *col_fec, size_t size) const;
+
+    /**
+     * 恢复丢失的数据包
+     * @param data: 数据包，丢失的包需要提供 size 字节的内存用于写入恢复的数据
+     * @param present: 各数据包是否收到，恢复后置为 true
+     * @param row_fec: 行校验包，丢失的为 nullptr
+     * @param col_fec: 列校验包，丢失的为 nullptr
+     * @return 仍然无法恢复的数据包个数
+    */
+    size_t decode(uint8_t *const *data, bool *present, const uint8_t *const *row_fec, const uint8_t *const *col_fec,
+                  size_t size) const;
+
+private:
+    //恢复一组(一行或一列)中唯一的丢包，没有恢复返回 false
+    bool recoverGroup(uint8_t *const *data, bool *present, const uint8_t *fec, size_t first, size_t step, size_t count,
+                      size_t size) const;
+
+private:
+    size_t _columns;
+    size_t _rows;
+};
+
+/**
+ * GF(2^8) 上的系统 Reed-Solomon 码: data_shards 个数据分片生成 parity_shards 个校验分片,
+ * 任意收到 data_shards 个分片即可恢复全部数据
+ * 生成矩阵为单位矩阵加柯西矩阵，任意 data_shards 行组成的方阵都可逆
+ * 解码时按丢失的分片组合求逆矩阵，最近一次的逆矩阵会被缓存, 连续丢同样位置的包时不必重复求逆
+*/
+class ReedSolomon : public noncopyable {
+public:
+    /**
+     * @param data_shards: 数据分片数
+     * @param parity_shards: 校验分片数, 两者之和不超过 256
+    */
+    ReedSolomon(size_t data_shards, size_t parity_shards);
+
+    size_t dataShards() const { return _data_shards; }
+    size_t parityShards() const { return _parity_shards; }
+
+    /**
+     * 编码
+     * @param data: data_shards 个数据分片
+     * @param parity: parity_shards 个校验分片的输出
+    */
+    void encode(const uint8_t *const *data, uint8_t *const *parity, size_t size) const;
+
+    /**
+     * 恢复丢失的数据分片(不恢复校验分片)
+     * @param shards: data_shards + parity_shards 个分片，数据在前; 丢失的数据分片需要提供 size 字节的内存
+     * @param present: 各分片是否收到，恢复的数据分片置为 true
+     * @return 收到的分片不足 data_shards 个时返回 false
+    */
+    bool decode(uint8_t *const *shards, bool *present, size_t size);
+
+private:
+    //求 n x n 矩阵的逆，不可逆时返回 false
+    static bool invert(std::vector<uint8_t> &matrix, size_t n);
+
+private:
+    size_t _data_shards;
+    size_t _parity_shards;
+    //校验部分的编码矩阵, parity_shards x data_shards
+    std::vector<uint8_t> _parity_matrix;
+    //缓存的解码矩阵及其对应的分片选择
+    std::vector<size_t> _cached_rows;
+    std::vector<uint8_t> _cached_inverse;
+};
+
+}
+#endif  //__FEC_H__
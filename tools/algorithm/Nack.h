@@ -0,0 +1,333 @@
+#ifndef __NACK_H__
+#define __NACK_H__
+
+#include "Util/Util.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace beton {
+
+/**
+ * 解析 RTCP 通用 NACK(RFC 4585 6.2.1) 的 FCI, 每项4字节: 2字节 PID + 2字节 BLP
+ * BLP 的第 i 位表示 PID + i + 1 也丢失
+ * @return 解析出的序号个数
+*/
+static inline size_t parseNackFci(const uint8_t *fci, size_t size, std::vector<uint16_t> &seqs) {
+    size_t count = 0;
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+        uint16_t pid = (fci[i] << 8) | fci[i + 1];
+        uint16_t blp = (fci[i + 2] << 8) | fci[i + 3];
+        seqs.emplace_back(pid);
+        ++count;
+        for (int bit = 0; blp; ++bit, blp >>= 1) {
+            if (blp & 1) {
+                seqs.emplace_back(pid + bit + 1);
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * 把丢失的序号编码为 NACK 的 FCI, 追加到 out
+ * @param seqs: 按发送顺序(考虑回绕)排好的序号, NackGenerator::poll 的输出即是
+*/
+static inline void makeNackFci(const std::vector<uint16_t> &seqs, std::string &out) {
+    size_t i = 0;
+    while (i < seqs.size()) {
+        uint16_t pid = seqs[i++];
+        uint16_t blp = 0;
+        while (i < seqs.size()) {
+            uint16_t diff = seqs[i] - pid;
+            if (diff == 0 || diff > 16) {
+                break;
+            }
+            blp |= 1 << (diff - 1);
+            ++i;
+        }
+        char fci[4] = {(char)(pid >> 8), (char)pid, (char)(blp >> 8), (char)blp};
+        out.append(fci, sizeof(fci));
+    }
+}
+
+/**
+ * 发送端的重传缓存，保存最近发出的 rtp 包，收到 NACK 时取出重传:
+ * 1. 固定大小的环形数组，按 seq & mask 定位，不查 map, 插入和查找都是 O(1)
+ * 2. 新包覆盖同一槽位的旧包，占用的内存有上限; 包以引用计数的方式保存(比如 Buffer::Ptr), 不拷贝数据
+ * 3. 超过 max_age 的包不再重传，接收端大概率已经放弃; 一个 RTT 内同一个包只重传一次, 避免多个 NACK 引起重复重传
+ * 只在一个线程中使用，不加锁
+*/
+template <typename T>
+class NackResponder : public noncopyable {
+public:
+    struct Stats {
+        //重传的包数
+        uint64_t resent = 0;
+        //已被覆盖或过期，无法重传的包数
+        uint64_t missed = 0;
+        //距离上次重传不到一个 RTT, 被忽略的请求数
+        uint64_t suppressed = 0;
+    };
+
+    /**
+     * @param capacity: 缓存的包数，向上取整到2的幂，最大 32768(序号空间的一半)
+     * @param max_age_ms: 包发出后可以重传的时长
+    */
+    NackResponder(size_t capacity = 1024, uint32_t max_age_ms = 1000) : _max_age_ms(max_age_ms) {
+        size_t size = 16;
+        while (size < capacity && size < 0x8000) {
+            size <<= 1;
+        }
+        _mask = size - 1;
+        _slots.resize(size);
+    }
+
+    /**
+     * 记录一个已发送的包
+     * @param now_ms: 单调时钟的毫秒数
+    */
+    void insert(uint16_t seq, T pkt, uint64_t now_ms) {
+        auto &slot = _slots[seq & _mask];
+        slot.pkt = std::move(pkt);
+        slot.seq = seq;
+        slot.valid = true;
+        slot.sent_ms = now_ms;
+        slot.resent_ms = 0;
+    }
+
+    //查找缓存中的包，不存在或已过期时返回 nullptr
+    const T *find(uint16_t seq, uint64_t now_ms) const {
+        auto &slot = _slots[seq & _mask];
+        if (!slot.valid || slot.seq != seq || now_ms - slot.sent_ms > _max_age_ms) {
+            return nullptr;
+        }
+        return &slot.pkt;
+    }
+
+    /**
+     * 处理 NACK 请求的序号
+     * @param cb: 对每个需要重传的包调用, 签名为 void(uint16_t seq, const T &pkt)
+     * @return 重传的包数
+    */
+    template <typename Func>
+    size_t onNack(const std::vector<uint16_t> &seqs, uint64_t now_ms, Func &&cb) {
+        size_t resent = 0;
+        for (auto seq : seqs) {
+            auto &slot = _slots[seq & _mask];
+            if (!slot.valid || slot.seq != seq || now_ms - slot.sent_ms > _max_age_ms) {
+                ++_stats.missed;
+                continue;
+            }
+            if (slot.resent_ms && now_ms - slot.resent_ms < _rtt_ms) {
+                //上次的重传还在路上
+                ++_stats.suppressed;
+                continue;
+            }
+            slot.resent_ms = now_ms;
+            cb(seq, (const T &)slot.pkt);
+            ++resent;
+        }
+        _stats.resent += resent;
+        return resent;
+    }
+
+    //更新 RTT, 决定同一个包的最短重传间隔
+    void setRtt(uint32_t rtt_ms) { _rtt_ms = std::max<uint32_t>(rtt_ms, 1); }
+
+    //释放所有缓存的包
+    void clear() {
+        for (auto &slot : _slots) {
+            slot.pkt = T();
+            slot.valid = false;
+        }
+    }
+
+    size_t capacity() const { return _mask + 1; }
+    const Stats &stats() const { return _stats; }
+
+private:
+    struct Slot {
+        T pkt;
+        uint16_t seq = 0;
+        bool valid = false;
+        uint64_t sent_ms = 0;
+        //最近一次重传的时间，0 表示没有重传过
+        uint64_t resent_ms = 0;
+    };
+
+    size_t _mask;
+    uint32_t _max_age_ms;
+    uint32_t _rtt_ms = 100;
+    Stats _stats;
+    std::vector<Slot> _slots;
+};
+
+/**
+ * 接收端的丢包检测和 NACK 生成:
+ * 1. 序号展开为64位后，最近 window 个包的丢失状态记在位图里，每个包一位; 每个丢失的包另有一个槽位记录下次请求时间和次数
+ * 2. 收到跳号的包时把中间的序号标记为丢失，迟到或重传的包到达后清掉; 滑出窗口的丢包视为永久丢失
+ * 3. 丢包先等 reorder_ms 排除乱序，之后按 RTT 间隔重复请求，最多 max_retries 次
+ * 4. poll 按 64 位一组扫描位图，没有丢包时几乎没有开销
+ * 只在一个线程中使用，不加锁
+*/
+class NackGenerator : public noncopyable {
+public:
+    struct Stats {
+        //检测到的丢包数
+        uint64_t lost = 0;
+        //请求后(或乱序)补回的包数
+        uint64_t recovered = 0;
+        //请求次数用完或滑出窗口，最终放弃的包数
+        uint64_t abandoned = 0;
+        //发出请求的序号数，含重复请求
+        uint64_t requested = 0;
+    };
+
+    /**
+     * @param window: 跟踪的序号范围，向上取整到64的倍数(2的幂), 最大 16384
+     * @param max_retries: 每个丢包最多请求的次数
+     * @param reorder_ms: 检测到跳号后等待多久再请求
+    */
+    NackGenerator(size_t window = 1024, uint32_t max_retries = 10, uint32_t reorder_ms = 10)
+        : _max_retries(max_retries), _reorder_ms(reorder_ms) {
+        size_t size = 64;
+        while (size < window && size < 0x4000) {
+            size <<= 1;
+        }
+        _mask = size - 1;
+        _missing.resize(size / 64);
+        _slots.resize(size);
+    }
+
+    /**
+     * 收到一个 rtp 包(包括重传的包)
+     * @param now_ms: 单调时钟的毫秒数
+    */
+    void onPacket(uint16_t seq, uint64_t now_ms) {
+        if (!_started) {
+            _started = true;
+            _highest = 0x10000 + seq;
+            return;
+        }
+        //展开为离当前最大序号最近的64位序号
+        int16_t diff = (int16_t)(seq - (uint16_t)_highest);
+        uint64_t ext = _highest + diff;
+        if (diff <= 0) {
+            //迟到或重传的包
+            if (_highest - ext <= _mask && test(ext)) {
+                clearBit(ext);
+                ++_stats.recovered;
+            }
+            return;
+        }
+        if ((uint64_t)diff > _mask) {
+            //跳得太远(比如推流端重启), 全部重新开始
+            abandonAll();
+            _highest = ext;
+            return;
+        }
+        for (uint64_t lost = _highest + 1; lost < ext; ++lost) {
+            if (test(lost)) {
+                //槽位上是一个窗口之前的丢包，位保持置位，改为记录新的丢包
+                ++_stats.abandoned;
+            } else {
+                setBit(lost);
+                ++_missing_count;
+            }
+            auto &slot = _slots[lost & _mask];
+            slot.next_ms = now_ms + _reorder_ms;
+            slot.retries = 0;
+            ++_stats.lost;
+        }
+        //当前包的槽位可能也残留着一个窗口之前的丢包
+        if (test(ext)) {
+            clearBit(ext);
+            ++_stats.abandoned;
+        }
+        _highest = ext;
+    }
+
+    /**
+     * 取出此刻需要请求重传的序号，按发送顺序排列，可以直接交给 makeNackFci
+     * @return 序号个数
+    */
+    size_t poll(uint64_t now_ms, std::vector<uint16_t> &seqs) {
+        if (!_missing_count) {
+            return 0;
+        }
+        std::vector<uint64_t> found;
+        for (size_t word = 0; word < _missing.size(); ++word) {
+            uint64_t bits = _missing[word];
+            while (bits) {
+                auto bit = __builtin_ctzll(bits);
+                bits &= bits - 1;
+                size_t index = word * 64 + bit;
+                //槽位对应窗口内唯一的序号
+                uint64_t ext = _highest - ((_highest - index) & _mask);
+                auto &slot = _slots[index];
+                if (slot.next_ms > now_ms) {
+                    continue;
+                }
+                if (slot.retries >= _max_retries) {
+                    clearBit(ext);
+                    ++_stats.abandoned;
+                    continue;
+                }
+                ++slot.retries;
+                slot.next_ms = now_ms + _rtt_ms;
+                found.emplace_back(ext);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        for (auto ext : found) {
+            seqs.emplace_back((uint16_t)ext);
+        }
+        _stats.requested += found.size();
+        return found.size();
+    }
+
+    //更新 RTT, 决定同一个丢包的重复请求间隔
+    void setRtt(uint32_t rtt_ms) { _rtt_ms = std::max<uint32_t>(rtt_ms, 1); }
+
+    //当前窗口内仍未收到的包数
+    size_t missing() const { return _missing_count; }
+    const Stats &stats() const { return _stats; }
+
+private:
+    bool test(uint64_t ext) const { return (_missing[(ext & _mask) >> 6] >> (ext & 63)) & 1; }
+    void setBit(uint64_t ext) { _missing[(ext & _mask) >> 6] |= 1ULL << (ext & 63); }
+    void clearBit(uint64_t ext) {
+        _missing[(ext & _mask) >> 6] &= ~(1ULL << (ext & 63));
+        --_missing_count;
+    }
+
+    void abandonAll() {
+        _stats.abandoned += _missing_count;
+        _missing_count = 0;
+        std::fill(_missing.begin(), _missing.end(), 0);
+    }
+
+private:
+    struct Slot {
+        uint64_t next_ms = 0;
+        uint32_t retries = 0;
+    };
+
+    bool _started = false;
+    uint32_t _max_retries;
+    uint32_t _reorder_ms;
+    uint32_t _rtt_ms = 100;
+    size_t _mask;
+    size_t _missing_count = 0;
+    //展开后的最大序号，从 0x10000 开始，避免回退到负数
+    uint64_t _highest = 0;
+    std::vector<uint64_t> _missing;
+    std::vector<Slot> _slots;
+    Stats _stats;
+};
+
+}
+#endif  //__NACK_H__
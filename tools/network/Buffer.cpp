@@ -0,0 +1,221 @@
+#include "Buffer.h"
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+namespace beton {
+
+//////////////////////////// 分级内存池 ////////////////////////////
+//常见尺寸：RTP/UDP 包 2K 以内，TCP 单次读 16K~64K，大帧 256K 以上
+static constexpr size_t s_level_size[] = {256, 1024, 2048, 4096, 8192, 16384, 65536, 262144, BufferPool::kMaxPooledSize};
+static constexpr uint8_t s_level_count = sizeof(s_level_size) / sizeof(s_level_size[0]);
+static constexpr uint8_t s_unpooled = 0xFF;
+//每个线程每一级最多缓存的空闲字节数，超出的直接归还系统
+static constexpr size_t s_max_cached_bytes = 4 * 1024 * 1024;
+static constexpr size_t s_min_cached_count = 16;
+
+//线程退出时 cache 先析构，之后本线程再释放的内存直接 free
+static thread_local bool s_cache_destroyed = false;
+
+struct BufferPoolCache {
+    std::vector<char *> free_list[s_level_count];
+
+    ~BufferPoolCache() {
+        s_cache_destroyed = true;
+        for (auto &list : free_list) {
+            for (auto ptr : list) {
+                free(ptr);
+            }
+            list.clear();
+        }
+    }
+};
+
+static BufferPoolCache &getPoolCache() {
+    static thread_local BufferPoolCache s_cache;
+    return s_cache;
+}
+
+char *BufferPool::obtain(size_t &capacity, uint8_t &level) {
+    if (capacity > kMaxPooledSize) {
+        level = s_unpooled;
+        return (char *) malloc(capacity);
+    }
+    level = 0;
+    while (s_level_size[level] < capacity) {
+        ++level;
+    }
+    capacity = s_level_size[level];
+    if (!s_cache_destroyed) {
+        auto &list = getPoolCache().free_list[level];
+        if (!list.empty()) {
+            auto ret = list.back();
+            list.pop_back();
+            return ret;
+        }
+    }
+    return (char *) malloc(capacity);
+}
+
+void BufferPool::recycle(char *data, uint8_t level) {
+    if (level >= s_level_count || s_cache_destroyed) {
+        free(data);
+        return;
+    }
+    auto &list = getPoolCache().free_list[level];
+    auto max_count = std::max(s_min_cached_count, s_max_cached_bytes / s_level_size[level]);
+    if (list.size() >= max_count) {
+        free(data);
+        return;
+    }
+    list.emplace_back(data);
+}
+
+//////////////////////////// BufferRaw ////////////////////////////
+BufferRaw::Ptr BufferRaw::create(size_t capacity, size_t size) {
+    uint8_t level;
+    capacity = std::max(capacity, size);
+    auto data = BufferPool::obtain(capacity, level);
+    if (!data) {
+        throw std::bad_alloc();
+    }
+    auto ret = std::make_shared<BufferRaw>(data, capacity, level);
+    ret->_size = size;
+    return ret;
+}
+
+BufferRaw::BufferRaw(char *data, size_t capacity, uint8_t level)
+    : _level(level), _capacity(capacity), _data(data) {}
+
+BufferRaw::~BufferRaw() {
+    BufferPool::recycle(_data, _level);
+}
+
+void BufferRaw::setSize(size_t size) {
+    if (size > _capacity) {
+        throw std::invalid_argument("BufferRaw::setSize out of capacity");
+    }
+    _size = size;
+}
+
+bool BufferRaw::assign(const char *data, size_t size) {
+    if (size > _capacity) {
+        return false;
+    }
+    memcpy(_data, data, size);
+    _size = size;
+    return true;
+}
+
+//////////////////////////// BufferSlice ////////////////////////////
+BufferSlice::BufferSlice(Buffer::Ptr buffer, size_t offset, size_t size) : _buffer(std::move(buffer)) {
+    auto total = _buffer ? _buffer->size() : 0;
+    _offset = std::min(offset, total);
+    _size = std::min(size, total - _offset);
+}
+
+Buffer::Ptr BufferSlice::create(const Buffer::Ptr &buffer, size_t offset, size_t size) {
+    auto slice = std::dynamic_pointer_cast<BufferSlice>(buffer);
+    if (!slice) {
+        return std::make_shared<BufferSlice>(buffer, offset, size);
+    }
+    //切片的切片直接引用底层Buffer，避免引用链越来越长
+    offset = std::min(offset, slice->size());
+    size = std::min(size, slice->size() - offset);
+    return std::make_shared<BufferSlice>(slice->parent(), slice->offset() + offset, size);
+}
+
+//////////////////////////// BufferChain ////////////////////////////
+//清空后保留的容量，以及头部攒够多少个已消费元素再整体移除
+static constexpr size_t s_chain_keep_capacity = 64;
+
+void BufferChain::push_back(Buffer::Ptr buffer) {
+    if (!buffer || !buffer->size()) {
+        return;
+    }
+    _size += buffer->size();
+    _list.emplace_back(std::move(buffer));
+}
+
+void BufferChain::push_front(Buffer::Ptr buffer) {
+    if (!buffer || !buffer->size()) {
+        return;
+    }
+    //头部已被部分消费时，先把剩余部分切出来，保持 _offset 只作用于第一个 Buffer
+    if (_offset) {
+        _list[_head] = BufferSlice::create(_list[_head], _offset);
+        _offset = 0;
+    }
+    _size += buffer->size();
+    if (_head) {
+        _list[--_head] = std::move(buffer);
+    } else {
+        _list.emplace(_list.begin(), std::move(buffer));
+    }
+}
+
+void BufferChain::clear() {
+    std::vector<Buffer::Ptr>().swap(_list);
+    _size = 0;
+    _offset = 0;
+    _head = 0;
+}
+
+size_t BufferChain::toIovec(struct iovec *iov, size_t max_count) const {
+    size_t count = 0;
+    for (auto i = _head; i < _list.size() && count < max_count; ++i, ++count) {
+        size_t offset = count ? 0 : _offset;
+        iov[count].iov_base = _list[i]->data() + offset;
+        iov[count].iov_len = _list[i]->size() - offset;
+    }
+    return count;
+}
+
+void BufferChain::consume(size_t size, std::vector<Buffer::Ptr> *touched) {
+    size = std::min(size, _size);
+    _size -= size;
+    while (size && _head < _list.size()) {
+        auto &front = _list[_head];
+        auto remain = front->size() - _offset;
+        if (touched) {
+            touched->emplace_back(front);
+        }
+        if (size < remain) {
+            _offset += size;
+            break;
+        }
+        size -= remain;
+        _offset = 0;
+        front = nullptr;
+        ++_head;
+    }
+    if (_head == _list.size()) {
+        //发送队列清空，突发流量留下的大容量也一并释放
+        if (_list.capacity() > s_chain_keep_capacity) {
+            std::vector<Buffer::Ptr>().swap(_list);
+        } else {
+            _list.clear();
+        }
+        _head = 0;
+    } else if (_head >= s_chain_keep_capacity && _head * 2 >= _list.size()) {
+        _list.erase(_list.begin(), _list.begin() + _head);
+        _head = 0;
+    }
+}
+
+Buffer::Ptr BufferChain::merge() const {
+    auto ret = BufferRaw::create(_size, _size);
+    auto ptr = ret->data();
+    size_t offset = _offset;
+    for (auto i = _head; i < _list.size(); ++i) {
+        auto &buffer = _list[i];
+        memcpy(ptr, buffer->data() + offset, buffer->size() - offset);
+        ptr += buffer->size() - offset;
+        offset = 0;
+    }
+    return ret;
+}
+
+}
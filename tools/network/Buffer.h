@@ -0,0 +1,147 @@
+#ifndef __BUFFER_H__
+#define __BUFFER_H__
+
+#include "Util/Util.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+namespace beton {
+
+/**
+ * 收发数据在 socket 与各协议层之间统一以 Buffer::Ptr 传递:
+ * 1. BufferRaw 的内存来自按尺寸分级的内存池，一次 read/recvmsg 只占用一块
+ * 2. BufferSlice 引用另一个 Buffer 的一段数据，协议层切分消息时不拷贝
+ * 3. BufferChain 把多个 Buffer 串起来，供 writev/sendmsg 一次系统调用发送
+ * Buffer 的内容在交给下一层之后应视为只读，多个使用者共享同一块内存
+*/
+class Buffer : public noncopyable {
+public:
+    using Ptr = std::shared_ptr<Buffer>;
+
+    virtual ~Buffer() = default;
+    virtual char *data() const = 0;
+    virtual size_t size() const = 0;
+
+    std::string toString() const { return std::string(data(), size()); }
+};
+
+//内存池分配的定长内存块，有效数据长度可以调整
+class BufferRaw : public Buffer {
+public:
+    using Ptr = std::shared_ptr<BufferRaw>;
+
+    /**
+     * 从内存池中获取一块内存，实际容量会向上取整到内存池的尺寸等级
+     * @param capacity: 最小容量
+     * @param size: 初始有效数据长度
+    */
+    static Ptr create(size_t capacity, size_t size = 0);
+
+    ~BufferRaw() override;
+
+    char *data() const override { return _data; }
+    size_t size() const override { return _size; }
+    size_t capacity() const { return _capacity; }
+
+    //设置有效数据长度，不能超过容量
+    void setSize(size_t size);
+    //拷贝数据，容量不足时返回false
+    bool assign(const char *data, size_t size);
+
+    //仅供 create() 使用，内存由 BufferPool 提供
+    BufferRaw(char *data, size_t capacity, uint8_t level);
+
+private:
+    uint8_t _level;
+    size_t _size = 0;
+    size_t _capacity;
+    char *_data;
+};
+
+//引用另一个 Buffer 的一段数据，持有其引用计数而不拷贝
+class BufferSlice : public Buffer {
+public:
+    using Ptr = std::shared_ptr<BufferSlice>;
+
+    /**
+     * @param buffer: 被引用的内存块
+     * @param offset: 起始偏移
+     * @param size: 长度, 超出部分会被截断, 默认到结尾
+    */
+    BufferSlice(Buffer::Ptr buffer, size_t offset = 0, size_t size = std::string::npos);
+
+    char *data() const override { return _buffer->data() + _offset; }
+    size_t size() const override { return _size; }
+    const Buffer::Ptr &parent() const { return _buffer; }
+    size_t offset() const { return _offset; }
+
+    //从已有Buffer上切一段出来，若是切片的切片则直接引用最底层的Buffer
+    static Buffer::Ptr create(const Buffer::Ptr &buffer, size_t offset, size_t size = std::string::npos);
+
+private:
+    size_t _offset;
+    size_t _size;
+    Buffer::Ptr _buffer;
+};
+
+//持有 std::string 的 Buffer，用于兼容现成的字符串数据，构造时 move 进来避免拷贝
+class BufferString : public Buffer {
+public:
+    using Ptr = std::shared_ptr<BufferString>;
+
+    BufferString(std::string str) : _str(std::move(str)) {}
+
+    char *data() const override { return const_cast<char *>(_str.data()); }
+    size_t size() const override { return _str.size(); }
+
+private:
+    std::string _str;
+};
+
+//有序的 Buffer 链，头部可能已经被部分消费
+class BufferChain {
+public:
+    void push_back(Buffer::Ptr buffer);
+    void push_front(Buffer::Ptr buffer);
+
+    bool empty() const { return _head == _list.size(); }
+    //Buffer 个数
+    size_t count() const { return _list.size() - _head; }
+    //剩余未消费的字节数
+    size_t size() const { return _size; }
+    void clear();
+
+    //填充 iovec, 返回填充的个数
+    size_t toIovec(struct iovec *iov, size_t max_count) const;
+    /**
+     * 头部消费掉 size 字节, 消费完的 Buffer 被释放
+     * @param touched: 不为空时保存这 size 字节所在的全部 Buffer(包括只消费了一部分的头部 Buffer)
+    */
+    void consume(size_t size, std::vector<Buffer::Ptr> *touched = nullptr);
+    //把剩余数据拷贝成一个连续的 Buffer，仅用于不支持分散读写的场合
+    Buffer::Ptr merge() const;
+
+private:
+    size_t _size = 0;
+    //头部 Buffer 已消费的字节数
+    size_t _offset = 0;
+    //_list 中已经消费完的元素个数，攒够一批再整体移除
+    size_t _head = 0;
+    //空的 vector 不占用堆内存(deque 即使为空也要分配), 大量空闲连接的发送队列几乎没有开销
+    std::vector<Buffer::Ptr> _list;
+};
+
+//分级内存池，每个线程持有自己的空闲链表，申请和释放都不加锁
+class BufferPool {
+public:
+    //超过该尺寸的内存不再池化
+    static constexpr size_t kMaxPooledSize = 1024 * 1024;
+
+    static char *obtain(size_t &capacity, uint8_t &level);
+    static void recycle(char *data, uint8_t level);
+};
+
+}
+#endif  //__BUFFER_H__
@@ -0,0 +1,604 @@
+#include "DnsResolver.h"
+#include "threadpool/ThreadPool.h"
+#include "Util/File.h"
+#include <algorithm>
+#include <sstream>
+#include <strings.h>
+
+using namespace std;
+
+namespace beton {
+
+static constexpr uint16_t s_dns_port = 53;
+static constexpr uint16_t s_type_a = 1;
+static constexpr uint16_t s_type_cname = 5;
+static constexpr uint16_t s_type_soa = 6;
+static constexpr uint16_t s_type_aaaa = 28;
+static constexpr uint16_t s_class_in = 1;
+static constexpr uint8_t s_rcode_nxdomain = 3;
+//getaddrinfo 不返回 TTL, 使用固定的缓存时间
+static constexpr uint32_t s_system_ttl = 60;
+
+INSTANCE_IMP(DnsResolver)
+
+static uint16_t readU16(const uint8_t *ptr) {
+    return (uint16_t)(ptr[0] << 8 | ptr[1]);
+}
+
+static uint32_t readU32(const uint8_t *ptr) {
+    return (uint32_t)ptr[0] << 24 | (uint32_t)ptr[1] << 16 | (uint32_t)ptr[2] << 8 | ptr[3];
+}
+
+static void writeU16(string &out, uint16_t value) {
+    out.push_back((char)(value >> 8));
+    out.push_back((char)(value & 0xFF));
+}
+
+//小写并去掉末尾的点
+static string normalizeHost(const string &host) {
+    string ret = host;
+    std::transform(ret.begin(), ret.end(), ret.begin(), ::tolower);
+    while (!ret.empty() && ret.back() == '.') {
+        ret.pop_back();
+    }
+    return ret;
+}
+
+//"ip", "ip:port", "[ipv6]:port"
+static bool parseServer(const string &str, struct sockaddr_storage &addr) {
+    string host = str;
+    uint16_t port = s_dns_port;
+    auto pos = str.rfind(':');
+    if (!str.empty() && str.front() == '[') {
+        auto end = str.find(']');
+        if (end == string::npos) {
+            return false;
+        }
+        host = str.substr(1, end - 1);
+        if (end + 1 < str.size() && str[end + 1] == ':') {
+            port = (uint16_t)atoi(str.data() + end + 2);
+        }
+    } else if (pos != string::npos && str.find(':') == pos) {
+        //只有一个冒号的是 ipv4:port
+        host = str.substr(0, pos);
+        port = (uint16_t)atoi(str.data() + pos + 1);
+    }
+    return port && SockUtil::makeSockAddr(host, port, addr);
+}
+
+static bool sameAddr(const struct sockaddr *addr, const struct sockaddr_storage &server) {
+    if (addr->sa_family != server.ss_family) {
+        return false;
+    }
+    if (addr->sa_family == AF_INET) {
+        auto &a = (const struct sockaddr_in &)*addr;
+        auto &b = (const struct sockaddr_in &)server;
+        return a.sin_port == b.sin_port && a.sin_addr.s_addr == b.sin_addr.s_addr;
+    }
+    auto &a = (const struct sockaddr_in6 &)*addr;
+    auto &b = (const struct sockaddr_in6 &)server;
+    return a.sin6_port == b.sin6_port && memcmp(&a.sin6_addr, &b.sin6_addr, sizeof(a.sin6_addr)) == 0;
+}
+
+//读取可能带压缩指针的域名，pos 移到域名之后
+static bool readName(const uint8_t *data, size_t len, size_t &pos, string *out) {
+    size_t cur = pos;
+    bool jumped = false;
+    int hops = 0;
+    while (true) {
+        if (cur >= len) {
+            return false;
+        }
+        uint8_t c = data[cur];
+        if ((c & 0xC0) == 0xC0) {
+            //压缩指针，限制跳转次数防止循环
+            if (cur + 1 >= len || ++hops > 16) {
+                return false;
+            }
+            if (!jumped) {
+                pos = cur + 2;
+                jumped = true;
+            }
+            cur = (size_t)(c & 0x3F) << 8 | data[cur + 1];
+            continue;
+        }
+        if (c & 0xC0) {
+            return false;
+        }
+        ++cur;
+        if (c == 0) {
+            break;
+        }
+        if (cur + c > len) {
+            return false;
+        }
+        if (out) {
+            if (!out->empty()) {
+                out->push_back('.');
+            }
+            out->append((const char *)data + cur, c);
+        }
+        cur += c;
+    }
+    if (!jumped) {
+        pos = cur;
+    }
+    return true;
+}
+
+static Buffer::Ptr makeQuery(uint16_t id, const string &host, uint16_t type) {
+    string packet;
+    packet.reserve(host.size() + 18);
+    writeU16(packet, id);
+    //RD, 递归查询
+    writeU16(packet, 0x0100);
+    writeU16(packet, 1);
+    writeU16(packet, 0);
+    writeU16(packet, 0);
+    writeU16(packet, 0);
+    size_t start = 0;
+    while (start <= host.size()) {
+        auto end = host.find('.', start);
+        if (end == string::npos) {
+            end = host.size();
+        }
+        auto label_len = end - start;
+        if (label_len == 0 || label_len > 63) {
+            return nullptr;
+        }
+        packet.push_back((char)label_len);
+        packet.append(host, start, label_len);
+        start = end + 1;
+    }
+    packet.push_back(0);
+    writeU16(packet, type);
+    writeU16(packet, s_class_in);
+    if (packet.size() > 12 + 255 + 4) {
+        return nullptr;
+    }
+    return std::make_shared<BufferString>(std::move(packet));
+}
+
+static void notifyWaiter(const DnsResolver::onResolve &cb, const PollerThread::Ptr &poller,
+                         const SockException &ex, const DnsResolver::AddrList &addrs) {
+    if (poller && !poller->is_current_thread()) {
+        poller->async([cb, ex, addrs]() {
+            cb(ex, addrs);
+        });
+        return;
+    }
+    cb(ex, addrs);
+}
+
+static SockException noSuchHost(const string &host) {
+    return SockException(0, "resolve " + host + " failed: no such host", Err_Dns);
+}
+
+DnsResolver::DnsResolver() {
+    _poller = ThreadPool::Instance().getPoller();
+    _random.seed(std::random_device()());
+    loadSystemConfig();
+    _servers = _system_servers;
+}
+
+DnsResolver::~DnsResolver() {}
+
+void DnsResolver::loadSystemConfig() {
+    string line;
+    istringstream resolv(File::loadFile("/etc/resolv.conf"));
+    while (getline(resolv, line)) {
+        istringstream iss(line);
+        string key, value;
+        iss >> key >> value;
+        struct sockaddr_storage addr;
+        //带 scope 的链路本地地址交给系统解析
+        if (key == "nameserver" && value.find('%') == string::npos && SockUtil::makeSockAddr(value, s_dns_port, addr)) {
+            _system_servers.emplace_back(addr);
+        }
+    }
+
+    istringstream hosts(File::loadFile("/etc/hosts"));
+    lock_guard<mutex> lck(_mutex);
+    while (getline(hosts, line)) {
+        line = line.substr(0, line.find('#'));
+        istringstream iss(line);
+        string ip, name;
+        struct sockaddr_storage addr;
+        if (!(iss >> ip) || !SockUtil::makeSockAddr(ip, 0, addr)) {
+            continue;
+        }
+        while (iss >> name) {
+            _hosts[normalizeHost(name)].emplace_back(addr);
+        }
+    }
+}
+
+void DnsResolver::resolve(const string &host_in, const onResolve &cb, const PollerThread::Ptr &poller) {
+    if (!cb) {
+        return;
+    }
+    struct sockaddr_storage addr;
+    if (SockUtil::makeSockAddr(host_in, 0, addr)) {
+        notifyWaiter(cb, poller, SockException(), AddrList{addr});
+        return;
+    }
+    auto host = normalizeHost(host_in);
+    if (host.empty()) {
+        notifyWaiter(cb, poller, noSuchHost(host_in), AddrList());
+        return;
+    }
+    AddrList addrs;
+    if (lookupHosts(host, addrs) || lookupCache(host, addrs)) {
+        notifyWaiter(cb, poller, addrs.empty() ? noSuchHost(host) : SockException(), addrs);
+        return;
+    }
+    Waiter waiter{poller, cb};
+    _poller->async([this, host, waiter]() {
+        startQuery(host, waiter);
+    });
+}
+
+void DnsResolver::setNameServers(const vector<string> &servers) {
+    vector<struct sockaddr_storage> addrs;
+    for (auto &server : servers) {
+        struct sockaddr_storage addr;
+        if (parseServer(server, addr)) {
+            addrs.emplace_back(addr);
+        } else {
+            WarnL << "invalid dns server: " << server;
+        }
+    }
+    _poller->async([this, addrs]() {
+        _servers = addrs.empty() ? _system_servers : addrs;
+    });
+}
+
+void DnsResolver::setTimeout(uint32_t timeout_ms, uint32_t attempts) {
+    _poller->async([this, timeout_ms, attempts]() {
+        _timeout_ms = std::max<uint32_t>(timeout_ms, 10);
+        _attempts = std::max<uint32_t>(attempts, 1);
+    });
+}
+
+void DnsResolver::setCache(size_t capacity, uint32_t min_ttl, uint32_t max_ttl, uint32_t negative_ttl) {
+    lock_guard<mutex> lck(_mutex);
+    _capacity = capacity;
+    _min_ttl = min_ttl;
+    _max_ttl = std::max(min_ttl, max_ttl);
+    _negative_ttl = negative_ttl;
+    while (_lru.size() > _capacity) {
+        _cache.erase(_lru.back().host);
+        _lru.pop_back();
+    }
+}
+
+void DnsResolver::clearCache() {
+    lock_guard<mutex> lck(_mutex);
+    _cache.clear();
+    _lru.clear();
+}
+
+bool DnsResolver::lookupHosts(const string &host, AddrList &addrs) {
+    lock_guard<mutex> lck(_mutex);
+    auto it = _hosts.find(host);
+    if (it == _hosts.end()) {
+        return false;
+    }
+    addrs = it->second;
+    return true;
+}
+
+bool DnsResolver::lookupCache(const string &host, AddrList &addrs) {
+    lock_guard<mutex> lck(_mutex);
+    auto it = _cache.find(host);
+    if (it == _cache.end()) {
+        return false;
+    }
+    if (it->second->expire_ms <= getCurrentMilliSecond()) {
+        _lru.erase(it->second);
+        _cache.erase(it);
+        return false;
+    }
+    //移到链表头部
+    _lru.splice(_lru.begin(), _lru, it->second);
+    addrs = it->second->addrs;
+    return true;
+}
+
+void DnsResolver::saveCache(const string &host, const AddrList &addrs, uint32_t ttl) {
+    lock_guard<mutex> lck(_mutex);
+    if (addrs.empty()) {
+        ttl = std::min(ttl, _negative_ttl);
+    } else {
+        ttl = std::max(_min_ttl, std::min(ttl, _max_ttl));
+    }
+    if (!ttl || !_capacity) {
+        return;
+    }
+    auto it = _cache.find(host);
+    if (it != _cache.end()) {
+        _lru.erase(it->second);
+        _cache.erase(it);
+    }
+    _lru.emplace_front(CacheEntry{host, addrs, getCurrentMilliSecond() + ttl * 1000ULL});
+    _cache[host] = _lru.begin();
+    while (_lru.size() > _capacity) {
+        _cache.erase(_lru.back().host);
+        _lru.pop_back();
+    }
+}
+
+//------------------以下在解析器线程执行---------------------//
+void DnsResolver::startQuery(const string &host, const Waiter &waiter) {
+    auto it = _queries.find(host);
+    if (it != _queries.end()) {
+        it->second->waiters.emplace_back(waiter);
+        return;
+    }
+    //排队期间其他请求可能已经完成了查询
+    AddrList addrs;
+    if (lookupCache(host, addrs)) {
+        notifyWaiter(waiter.cb, waiter.poller, addrs.empty() ? noSuchHost(host) : SockException(), addrs);
+        return;
+    }
+
+    auto query = std::make_shared<Query>();
+    query->host = host;
+    query->waiters.emplace_back(waiter);
+    _queries[host] = query;
+    if (_servers.empty() || host.find('.') == string::npos) {
+        fallbackSystem(query);
+        return;
+    }
+    for (auto &id : query->id) {
+        id = makeQueryId();
+        _query_ids[id] = query;
+    }
+    sendQuery(query);
+}
+
+uint16_t DnsResolver::makeQueryId() {
+    while (true) {
+        uint16_t id = (uint16_t)_random();
+        if (id && !_query_ids.count(id)) {
+            return id;
+        }
+    }
+}
+
+Socket::Ptr DnsResolver::getSock(int family) {
+    auto &sock = family == AF_INET ? _sock4 : _sock6;
+    if (sock) {
+        return sock;
+    }
+    auto new_sock = Socket::create(_poller);
+    new_sock->setRecvFromCB([this](const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t) {
+        onResponse(buf, addr);
+    });
+    if (!new_sock->bindUdp(0, family == AF_INET ? "0.0.0.0" : "::")) {
+        return nullptr;
+    }
+    sock = new_sock;
+    return sock;
+}
+
+void DnsResolver::sendQuery(const Query::Ptr &query) {
+    query->server = _servers[query->attempt % _servers.size()];
+    auto sock = getSock(query->server.ss_family);
+    if (!sock) {
+        finishQuery(query, SockException(errno, "create dns socket failed", Err_Dns), 0);
+        return;
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (query->done[i]) {
+            continue;
+        }
+        auto packet = makeQuery(query->id[i], query->host, i == 0 ? s_type_a : s_type_aaaa);
+        if (!packet) {
+            finishQuery(query, SockException(EINVAL, "invalid host name " + query->host, Err_Dns), 0);
+            return;
+        }
+        sock->sendTo(packet, (struct sockaddr *)&query->server, SockUtil::getSockLen((struct sockaddr *)&query->server));
+    }
+
+    weak_ptr<Query> weak_query = query;
+    query->timer = _poller->doDelayTask(_timeout_ms, [this, weak_query]() -> uint64_t {
+        auto query = weak_query.lock();
+        if (query && query->timer) {
+            query->timer = nullptr;
+            onQueryTimeout(query);
+        }
+        return 0;
+    });
+}
+
+void DnsResolver::onQueryTimeout(const Query::Ptr &query) {
+    if (query->timer) {
+        query->timer->cancel();
+        query->timer = nullptr;
+    }
+    //换下一个服务器重发未完成的类型
+    if (++query->attempt < _attempts) {
+        sendQuery(query);
+        return;
+    }
+    //只有一种类型有结果时也算成功
+    finishQuery(query, SockException(ETIMEDOUT, "resolve " + query->host + " timeout", Err_Timeout), query->ttl);
+}
+
+void DnsResolver::onResponse(const Buffer::Ptr &buf, const struct sockaddr *addr) {
+    auto data = (const uint8_t *)buf->data();
+    auto len = buf->size();
+    if (len < 12 || !(data[2] & 0x80)) {
+        return;
+    }
+    auto it = _query_ids.find(readU16(data));
+    if (it == _query_ids.end()) {
+        return;
+    }
+    auto query = it->second;
+    int index = query->id[0] == readU16(data) ? 0 : 1;
+    //只接受发往的服务器的响应
+    if (query->done[index] || !sameAddr(addr, query->server)) {
+        return;
+    }
+
+    size_t pos = 12;
+    string name;
+    if (readU16(data + 4) != 1 || !readName(data, len, pos, &name) || pos + 4 > len ||
+        strcasecmp(name.data(), query->host.data()) != 0 ||
+        readU16(data + pos) != (index == 0 ? s_type_a : s_type_aaaa)) {
+        return;
+    }
+    pos += 4;
+
+    if (data[2] & 0x02) {
+        //响应被截断，需要 tcp 查询，交给系统解析
+        fallbackSystem(query);
+        return;
+    }
+    auto rcode = data[3] & 0x0F;
+    if (rcode != 0 && rcode != s_rcode_nxdomain) {
+        //服务器错误，立即换下一个
+        onQueryTimeout(query);
+        return;
+    }
+
+    auto answer_count = readU16(data + 6);
+    auto authority_count = readU16(data + 8);
+    for (uint32_t i = 0; i < (uint32_t)answer_count + authority_count; ++i) {
+        if (!readName(data, len, pos, nullptr) || pos + 10 > len) {
+            return;
+        }
+        auto type = readU16(data + pos);
+        auto ttl = readU32(data + pos + 4);
+        auto rdlen = readU16(data + pos + 8);
+        pos += 10;
+        if (pos + rdlen > len) {
+            return;
+        }
+        auto rdata = data + pos;
+        if (i < answer_count) {
+            struct sockaddr_storage record;
+            memset(&record, 0, sizeof(record));
+            if (type == s_type_a && index == 0 && rdlen == 4) {
+                auto &addr4 = (struct sockaddr_in &)record;
+                addr4.sin_family = AF_INET;
+                memcpy(&addr4.sin_addr, rdata, 4);
+                query->addrs[0].emplace_back(record);
+                query->ttl = std::min(query->ttl, ttl);
+            } else if (type == s_type_aaaa && index == 1 && rdlen == 16) {
+                auto &addr6 = (struct sockaddr_in6 &)record;
+                addr6.sin6_family = AF_INET6;
+                memcpy(&addr6.sin6_addr, rdata, 16);
+                query->addrs[1].emplace_back(record);
+                query->ttl = std::min(query->ttl, ttl);
+            } else if (type == s_type_cname) {
+                query->ttl = std::min(query->ttl, ttl);
+            }
+        } else if (type == s_type_soa) {
+            //否定缓存时间取 SOA 记录的 TTL 和 MINIMUM 中较小的
+            size_t soa_pos = pos;
+            if (readName(data, len, soa_pos, nullptr) && readName(data, len, soa_pos, nullptr) &&
+                soa_pos + 20 <= pos + rdlen) {
+                query->negative_ttl = std::min(query->negative_ttl, std::min(ttl, readU32(data + soa_pos + 16)));
+            }
+        }
+        pos += rdlen;
+    }
+
+    query->done[index] = true;
+    if (rcode == s_rcode_nxdomain) {
+        //域名不存在，另一种类型也不用等了
+        query->addrs[0].clear();
+        query->addrs[1].clear();
+        finishQuery(query, SockException(), query->negative_ttl);
+        return;
+    }
+    if (query->done[0] && query->done[1]) {
+        bool found = !query->addrs[0].empty() || !query->addrs[1].empty();
+        finishQuery(query, SockException(), found ? query->ttl : query->negative_ttl);
+    }
+}
+
+void DnsResolver::fallbackSystem(const Query::Ptr &query) {
+    if (query->timer) {
+        query->timer->cancel();
+        query->timer = nullptr;
+    }
+    for (auto id : query->id) {
+        auto it = _query_ids.find(id);
+        if (it != _query_ids.end() && it->second == query) {
+            _query_ids.erase(it);
+        }
+    }
+    //getaddrinfo 会阻塞，放到任务线程执行
+    ThreadPool::Instance().getThread()->async([this, query]() {
+        struct addrinfo hints, *res = nullptr;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        int ret = getaddrinfo(query->host.data(), nullptr, &hints, &res);
+        AddrList addrs;
+        for (auto ai = res; ret == 0 && ai; ai = ai->ai_next) {
+            struct sockaddr_storage addr;
+            memset(&addr, 0, sizeof(addr));
+            memcpy(&addr, ai->ai_addr, std::min<size_t>(ai->ai_addrlen, sizeof(addr)));
+            bool dup = false;
+            for (auto &item : addrs) {
+                dup = dup || sameAddr((struct sockaddr *)&addr, item);
+            }
+            if (!dup) {
+                addrs.emplace_back(addr);
+            }
+        }
+        if (res) {
+            freeaddrinfo(res);
+        }
+        _poller->async([this, query, ret, addrs]() {
+            query->addrs[0] = addrs;
+            query->addrs[1].clear();
+            //域名不存在时缓存否定结果，其他错误(比如网络不通)不缓存
+            bool not_found = ret == EAI_NONAME || ret == EAI_NODATA;
+            SockException ex;
+            if (ret != 0 && !not_found) {
+                ex = SockException(0, "resolve " + query->host + " failed: " + gai_strerror(ret), Err_Dns);
+            }
+            finishQuery(query, ex, not_found ? UINT32_MAX : s_system_ttl);
+        });
+    });
+}
+
+void DnsResolver::finishQuery(const Query::Ptr &query, const SockException &ex, uint32_t ttl) {
+    if (query->timer) {
+        query->timer->cancel();
+        query->timer = nullptr;
+    }
+    auto it = _queries.find(query->host);
+    if (it != _queries.end() && it->second == query) {
+        _queries.erase(it);
+    }
+    for (auto id : query->id) {
+        auto it = _query_ids.find(id);
+        if (it != _query_ids.end() && it->second == query) {
+            _query_ids.erase(it);
+        }
+    }
+
+    //ipv6 在前，连接时再交替排列
+    AddrList addrs = query->addrs[1];
+    addrs.insert(addrs.end(), query->addrs[0].begin(), query->addrs[0].end());
+    SockException err = ex;
+    if (!addrs.empty()) {
+        err = SockException();
+        saveCache(query->host, addrs, ttl);
+    } else if (!ex) {
+        err = noSuchHost(query->host);
+        saveCache(query->host, addrs, ttl);
+    }
+    for (auto &waiter : query->waiters) {
+        notifyWaiter(waiter.cb, waiter.poller, err, addrs);
+    }
+}
+
+}
@@ -0,0 +1,119 @@
+#ifndef __DNS_RESOLVER_H__
+#define __DNS_RESOLVER_H__
+
+#include "Socket.h"
+#include <list>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+namespace beton {
+
+/**
+ * 异步域名解析:
+ * 1. 在一个 poller 上用非阻塞 udp 直接向 /etc/resolv.conf 中的服务器同时查询 A 和 AAAA, 不占用任何线程等待
+ * 2. 结果按 TTL 缓存，所有线程共享，LRU 淘汰; 不存在的域名(NXDOMAIN/无记录)也缓存一段时间
+ * 3. 同一域名同时只有一个查询在进行，后来的请求等待同一个结果
+ * 4. 没有可用的服务器、响应被截断、单标签主机名(依赖 search 列表)时退回任务线程中的 getaddrinfo
+ * /etc/hosts 中的条目优先于 DNS
+*/
+class DnsResolver : public noncopyable {
+public:
+    using AddrList = std::vector<struct sockaddr_storage>;
+    //解析结果，地址的端口为0; 在发起解析时指定的 poller 线程回调
+    using onResolve = std::function<void(const SockException &ex, const AddrList &addrs)>;
+
+    static DnsResolver &Instance();
+    ~DnsResolver();
+
+    /**
+     * 解析域名，命中缓存时在调用线程(或指定 poller)立即回调
+     * @param host: 域名或IP
+     * @param cb: 结果回调
+     * @param poller: 回调所在线程，为空则在解析器线程回调
+    */
+    void resolve(const std::string &host, const onResolve &cb, const PollerThread::Ptr &poller = nullptr);
+
+    //以下设置可以在任意线程调用, 对之后发起的查询生效
+    //指定 DNS 服务器 "ip" 或 "ip:port"/"[ipv6]:port", 为空则使用系统的 resolv.conf
+    void setNameServers(const std::vector<std::string> &servers);
+    //单次查询超时和总的尝试次数(在多个服务器间轮换)
+    void setTimeout(uint32_t timeout_ms, uint32_t attempts);
+    //缓存条目数上限，以及 TTL 的上下限(秒); 解析失败的缓存时间
+    void setCache(size_t capacity, uint32_t min_ttl, uint32_t max_ttl, uint32_t negative_ttl);
+    void clearCache();
+
+private:
+    DnsResolver();
+
+    struct CacheEntry {
+        std::string host;
+        //为空表示域名不存在
+        AddrList addrs;
+        uint64_t expire_ms;
+    };
+
+    struct Waiter {
+        PollerThread::Ptr poller;
+        onResolve cb;
+    };
+
+    //一个域名的查询，A 和 AAAA 各一个报文
+    struct Query {
+        using Ptr = std::shared_ptr<Query>;
+        std::string host;
+        uint16_t id[2] = {0, 0};
+        bool done[2] = {false, false};
+        //下标 0 为 A, 1 为 AAAA
+        AddrList addrs[2];
+        uint32_t ttl = UINT32_MAX;
+        //没有记录时 SOA 给出的缓存时间
+        uint32_t negative_ttl = UINT32_MAX;
+        uint32_t attempt = 0;
+        struct sockaddr_storage server;
+        PollerThread::DelayTask::Ptr timer;
+        std::vector<Waiter> waiters;
+    };
+
+    //命中时返回 true, 域名不存在的缓存返回空列表
+    bool lookupCache(const std::string &host, AddrList &addrs);
+    void saveCache(const std::string &host, const AddrList &addrs, uint32_t ttl);
+    bool lookupHosts(const std::string &host, AddrList &addrs);
+    void loadSystemConfig();
+
+    //以下函数只在解析器线程执行
+    void startQuery(const std::string &host, const Waiter &waiter);
+    void sendQuery(const Query::Ptr &query);
+    void onQueryTimeout(const Query::Ptr &query);
+    void onResponse(const Buffer::Ptr &buf, const struct sockaddr *addr);
+    void finishQuery(const Query::Ptr &query, const SockException &ex, uint32_t ttl);
+    void fallbackSystem(const Query::Ptr &query);
+    Socket::Ptr getSock(int family);
+    uint16_t makeQueryId();
+
+private:
+    PollerThread::Ptr _poller;
+    //v4 和 v6 服务器各用一个 socket
+    Socket::Ptr _sock4;
+    Socket::Ptr _sock6;
+    std::vector<struct sockaddr_storage> _servers;
+    std::vector<struct sockaddr_storage> _system_servers;
+    uint32_t _timeout_ms = 1500;
+    uint32_t _attempts = 4;
+    std::unordered_map<std::string, Query::Ptr> _queries;
+    std::unordered_map<uint16_t, Query::Ptr> _query_ids;
+    std::mt19937 _random;
+
+    //缓存和 hosts 在任意线程读取
+    std::mutex _mutex;
+    size_t _capacity = 4096;
+    uint32_t _min_ttl = 5;
+    uint32_t _max_ttl = 3600;
+    uint32_t _negative_ttl = 30;
+    std::list<CacheEntry> _lru;
+    std::unordered_map<std::string, std::list<CacheEntry>::iterator> _cache;
+    std::unordered_map<std::string, AddrList> _hosts;
+};
+
+}
+#endif  //__DNS_RESOLVER_H__
@@ -1,13 +1,18 @@
 #include "Session.h"
+#include "SessionManager.h"
 
 using namespace std;
 
 namespace beton {
 
-Session::Session() {
+static std::atomic<uint64_t> s_session_id(0);
 
+Session::Session(const Socket::Ptr &sock) : SocketHelper(sock) {
+    _id = ++s_session_id;
 }
 
+Session::~Session() {
+    SessionManager::Instance().remove(_id, _poller);
+}
 
-
-}
\ No newline at end of file
+}
@@ -5,11 +5,20 @@
 
 namespace beton {
 
+//服务端会话，由 TcpServer 在 accept 之后创建，所有回调都在 socket 所属的 poller 线程执行
 class Session : public SocketHelper {
 public:
-    Session();
+    using Ptr = std::shared_ptr<Session>;
 
+    Session(const Socket::Ptr &sock);
+    ~Session() override;
+
+    //进程内唯一的会话id, 用于 SessionManager 查找
+    uint64_t id() const { return _id; }
+
+private:
+    uint64_t _id;
 };
 
 }
-#endif  //__SESSION_H__
\ No newline at end of file
+#endif  //__SESSION_H__
@@ -0,0 +1,122 @@
+#include "SessionManager.h"
+#include "threadpool/ThreadPool.h"
+
+using namespace std;
+
+namespace beton {
+
+SessionManager &SessionManager::Instance() {
+    //不随静态对象析构: ThreadPool 先于本对象创建、后于本对象析构, 进程退出时 poller 线程仍可能析构会话并调用 remove
+    static SessionManager *s_instance = new SessionManager();
+    return *s_instance;
+}
+
+SessionManager::SessionManager() {
+    for (auto &poller : ThreadPool::Instance().getAllPollers()) {
+        auto shard = std::make_shared<Shard>();
+        shard->poller = poller;
+        _shards.emplace(poller.get(), std::move(shard));
+    }
+}
+
+string SessionManager::makeKey(uint64_t id) {
+    return string((const char *)&id, sizeof(id));
+}
+
+SessionManager::Shard::Ptr SessionManager::getShard(const PollerThread::Ptr &poller) const {
+    auto it = _shards.find(poller.get());
+    return it == _shards.end() ? nullptr : it->second;
+}
+
+void SessionManager::add(const Session::Ptr &session) {
+    auto shard = getShard(session->getPoller());
+    if (!shard) {
+        WarnL << "session " << session->id() << " is not on a pool poller, skip registering";
+        return;
+    }
+    auto id = session->id();
+    _index.insert(makeKey(id), session);
+    weak_ptr<Session> weak_session = session;
+    shard->poller->async([shard, id, weak_session]() {
+        if (!weak_session.expired()) {
+            shard->sessions[id] = weak_session;
+        }
+    });
+}
+
+void SessionManager::remove(uint64_t id, const PollerThread::Ptr &poller) {
+    auto shard = poller ? getShard(poller) : nullptr;
+    if (!shard || !_index.erase(makeKey(id), nullptr)) {
+        return;
+    }
+    //可能正在遍历本分片，不在当前调用栈中修改
+    shard->poller->async([shard, id]() {
+        shard->sessions.erase(id);
+    }, Thread::Normal, false);
+}
+
+Session::Ptr SessionManager::find(uint64_t id) const {
+    return _index.find(makeKey(id));
+}
+
+bool SessionManager::post(uint64_t id, const onSession &cmd) {
+    auto session = find(id);
+    if (!session || !cmd) {
+        return false;
+    }
+    weak_ptr<Session> weak_session = session;
+    session->getPoller()->async([weak_session, cmd]() {
+        auto strong_session = weak_session.lock();
+        if (strong_session) {
+            cmd(strong_session);
+        }
+    });
+    return true;
+}
+
+bool SessionManager::kick(uint64_t id, const SockException &ex) {
+    auto session = find(id);
+    if (!session) {
+        return false;
+    }
+    session->shutdown(ex);
+    return true;
+}
+
+void SessionManager::forEach(const onSession &func, const function<void()> &done) {
+    if (!func) {
+        return;
+    }
+    if (_shards.empty()) {
+        if (done) {
+            done();
+        }
+        return;
+    }
+    auto remain = std::make_shared<std::atomic<size_t> >(_shards.size());
+    for (auto &pr : _shards) {
+        auto shard = pr.second;
+        shard->poller->async([shard, func, done, remain]() {
+            //先取出强引用再回调，回调中会话可能被断开并从本分片移除
+            vector<Session::Ptr> sessions;
+            sessions.reserve(shard->sessions.size());
+            for (auto it = shard->sessions.begin(); it != shard->sessions.end();) {
+                auto session = it->second.lock();
+                if (!session) {
+                    it = shard->sessions.erase(it);
+                    continue;
+                }
+                sessions.emplace_back(std::move(session));
+                ++it;
+            }
+            for (auto &session : sessions) {
+                func(session);
+            }
+            if (--*remain == 0 && done) {
+                done();
+            }
+        });
+    }
+}
+
+}
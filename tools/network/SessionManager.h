@@ -0,0 +1,65 @@
+#ifndef __SESSION_MANAGER_H__
+#define __SESSION_MANAGER_H__
+
+#include "SessionTable.h"
+#include <unordered_map>
+
+namespace beton {
+
+/**
+ * 全局会话登记，TcpServer/UdpServer 创建的会话自动登记，会话析构时自动移除:
+ * 1. 按 PollerThread 分片，每个分片的会话列表只在所属 poller 线程访问，没有全局锁
+ * 2. 按id查找走 SessionTable, 不经过表的互斥锁，可以在任意线程调用
+ * 3. 对会话的控制命令投递到会话所属的 poller 执行
+ * 4. 遍历在各个 poller 上并行进行，每个分片只遍历自己的会话
+*/
+class SessionManager : public noncopyable {
+public:
+    using onSession = std::function<void(const Session::Ptr &session)>;
+
+    static SessionManager &Instance();
+
+    //登记会话，可以在任意线程调用
+    void add(const Session::Ptr &session);
+    //移除会话，由 Session 析构时调用
+    void remove(uint64_t id, const PollerThread::Ptr &poller);
+
+    //按id查找，可以在任意线程调用
+    Session::Ptr find(uint64_t id) const;
+    size_t size() const { return _index.size(); }
+
+    /**
+     * 在会话所属 poller 线程执行命令
+     * @return 会话不存在时返回 false
+    */
+    bool post(uint64_t id, const onSession &cmd);
+    //断开会话，会话会收到 onError
+    bool kick(uint64_t id, const SockException &ex = SockException(0, "kicked", Err_Shutdown));
+
+    /**
+     * 遍历所有会话，比如定时的保活检查; func 在各个会话所属的 poller 线程执行
+     * @param done: 所有分片都遍历完之后回调一次，在最后完成的 poller 线程执行
+    */
+    void forEach(const onSession &func, const std::function<void()> &done = nullptr);
+
+private:
+    SessionManager();
+
+    //一个 poller 上的会话，只在该 poller 线程访问
+    struct Shard {
+        using Ptr = std::shared_ptr<Shard>;
+        PollerThread::Ptr poller;
+        std::unordered_map<uint64_t, std::weak_ptr<Session> > sessions;
+    };
+
+    Shard::Ptr getShard(const PollerThread::Ptr &poller) const;
+    static std::string makeKey(uint64_t id);
+
+private:
+    //创建后不再修改，读取不需要加锁
+    std::unordered_map<PollerThread *, Shard::Ptr> _shards;
+    SessionTable _index;
+};
+
+}
+#endif  //__SESSION_MANAGER_H__
@@ -0,0 +1,137 @@
+#include "SessionTable.h"
+
+using namespace std;
+
+namespace beton {
+
+SessionTable::Table::Table(size_t capacity) {
+    size_t size = 16;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mask = size - 1;
+    slots.reset(new EntryPtr[size]);
+}
+
+SessionTable::SessionTable(size_t capacity) {
+    _table = std::make_shared<Table>(capacity);
+}
+
+const SessionTable::EntryPtr &SessionTable::tombstone() {
+    static EntryPtr s_tombstone = std::make_shared<Entry>();
+    return s_tombstone;
+}
+
+Session::Ptr SessionTable::find(const string &key) const {
+    auto hash = std::hash<string>()(key);
+    //持有表和条目的引用，期间被替换或删除也不会释放
+    auto table = std::atomic_load(&_table);
+    for (size_t i = 0; i <= table->mask; ++i) {
+        auto entry = std::atomic_load(&table->slots[(hash + i) & table->mask]);
+        if (!entry) {
+            break;
+        }
+        if (entry != tombstone() && entry->hash == hash && entry->key == key) {
+            return entry->session.lock();
+        }
+    }
+    return nullptr;
+}
+
+size_t SessionTable::findSlot(const Table &table, size_t hash, const string &key, bool &found) const {
+    found = false;
+    size_t free_slot = table.mask + 1;
+    for (size_t i = 0; i <= table.mask; ++i) {
+        auto index = (hash + i) & table.mask;
+        //只有持有 _mutex 的线程修改槽位，这里直接读
+        auto &entry = table.slots[index];
+        if (!entry) {
+            return free_slot <= table.mask ? free_slot : index;
+        }
+        if (entry == tombstone()) {
+            if (free_slot > table.mask) {
+                free_slot = index;
+            }
+            continue;
+        }
+        if (entry->hash == hash && entry->key == key) {
+            found = true;
+            return index;
+        }
+    }
+    return free_slot;
+}
+
+void SessionTable::insert(const string &key, const Session::Ptr &session) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto capacity = _table->mask + 1;
+    if ((_used + 1) * 2 > capacity) {
+        //超过一半槽位被占用(包括删除标记), 有效条目多就扩容，否则只清理删除标记
+        rehash(_size * 4 > capacity ? capacity * 2 : capacity);
+    }
+
+    auto &table = *_table;
+    auto hash = std::hash<string>()(key);
+    bool found;
+    auto index = findSlot(table, hash, key, found);
+    auto old = std::atomic_exchange(&table.slots[index], EntryPtr(std::make_shared<Entry>(Entry{hash, key, session})));
+    if (found) {
+        return;
+    }
+    if (!old) {
+        ++_used;
+    }
+    ++_size;
+}
+
+bool SessionTable::erase(const string &key, const Session *session) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto &table = *_table;
+    bool found;
+    auto index = findSlot(table, std::hash<string>()(key), key, found);
+    if (!found) {
+        return false;
+    }
+    auto current = table.slots[index]->session.lock();
+    if (session && current && current.get() != session) {
+        //已经被新的会话替换
+        return false;
+    }
+    std::atomic_store(&table.slots[index], tombstone());
+    --_size;
+    return true;
+}
+
+void SessionTable::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto &table = *_table;
+    for (size_t i = 0; i <= table.mask; ++i) {
+        std::atomic_store(&table.slots[i], EntryPtr());
+    }
+    _size = 0;
+    _used = 0;
+}
+
+void SessionTable::rehash(size_t capacity) {
+    auto old_table = _table;
+    auto table = std::make_shared<Table>(capacity);
+    for (size_t i = 0; i <= old_table->mask; ++i) {
+        auto &entry = old_table->slots[i];
+        if (!entry || entry == tombstone()) {
+            continue;
+        }
+        for (size_t j = 0; j <= table->mask; ++j) {
+            //新表还没有发布，直接写
+            auto &slot = table->slots[(entry->hash + j) & table->mask];
+            if (!slot) {
+                slot = entry;
+                break;
+            }
+        }
+    }
+    //条目由新旧两张表共享，旧表在最后一个查找放开引用时释放
+    std::atomic_store(&_table, table);
+    _used = _size;
+}
+
+}
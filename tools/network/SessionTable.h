@@ -0,0 +1,60 @@
+#ifndef __SESSION_TABLE_H__
+#define __SESSION_TABLE_H__
+
+#include "Session.h"
+#include <mutex>
+
+namespace beton {
+
+/**
+ * 字符串标识到会话的映射表(如 udp 对端地址、会话id), 查找不加表锁，可以在任意线程调用; 插入删除用互斥锁串行化
+ * 开放寻址 + 线性探测，表和每个槽位的不可变条目都是 shared_ptr, 通过 std::atomic_load/atomic_store 发布:
+ * 查找期间持有表和条目的引用，删除的条目和扩容前的旧表在最后一个引用释放时回收，不依赖超时
+*/
+class SessionTable : public noncopyable {
+public:
+    SessionTable(size_t capacity = 1024);
+    ~SessionTable() = default;
+
+    Session::Ptr find(const std::string &key) const;
+    //插入或替换
+    void insert(const std::string &key, const Session::Ptr &session);
+    //key 仍然对应该会话时才删除
+    bool erase(const std::string &key, const Session *session);
+    void clear();
+    size_t size() const { return _size; }
+
+private:
+    struct Entry {
+        size_t hash;
+        std::string key;
+        std::weak_ptr<Session> session;
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    struct Table {
+        using Ptr = std::shared_ptr<Table>;
+        Table(size_t capacity);
+        size_t mask;
+        //槽位只通过 std::atomic_load/atomic_store/atomic_exchange 访问
+        std::unique_ptr<EntryPtr[]> slots;
+    };
+
+    //删除标记
+    static const EntryPtr &tombstone();
+    //以下函数调用时需要持有 _mutex
+    //返回 key 所在的槽位，不存在时返回可以插入的槽位
+    size_t findSlot(const Table &table, size_t hash, const std::string &key, bool &found) const;
+    void rehash(size_t capacity);
+
+private:
+    //只通过 std::atomic_load/atomic_store 访问
+    Table::Ptr _table;
+    std::atomic<size_t> _size = {0};
+    //已使用的槽位, 包含删除标记
+    size_t _used = 0;
+    std::mutex _mutex;
+};
+
+}
+#endif  //__SESSION_TABLE_H__
@@ -1,14 +1,23 @@
 #include "SockUtil.h"
+#include "Util/Errors.h"
 #include <errno.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
 using namespace std;
 
 namespace beton {
@@ -16,8 +25,8 @@ namespace beton {
 SockException::SockException(int sock_code, const std::string &des, ErrorCode custom_code)
     : _sock_code(sock_code), _what(des), _custom_code(custom_code) {
     if (_sock_code != 0) {
-        _what.reserve(128);
-        strerror_r(_sock_code, (char *)_what.data(), 128);
+        //附带系统错误描述
+        _what += ": " + ErrorMsg::getErrorMsg(_sock_code);
     }
 }
 
@@ -42,6 +51,30 @@ void SockUtil::setReusePort(int sockfd) {
     }
 }
 
+bool SockUtil::setIncomingCpu(int sockfd, int cpu) {
+#ifdef SO_INCOMING_CPU
+    if (setsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, (const char *)&cpu, sizeof(cpu)) == 0) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+bool SockUtil::setRxqOvfl(int sockfd, bool enable) {
+    int opt = enable ? 1 : 0;
+    return setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, (const char *)&opt, sizeof(opt)) == 0;
+}
+
+bool SockUtil::setUdpGro(int sockfd, bool enable) {
+    int opt = enable ? 1 : 0;
+    return setsockopt(sockfd, SOL_UDP, UDP_GRO, (const char *)&opt, sizeof(opt)) == 0;
+}
+
+bool SockUtil::setZeroCopy(int sockfd, bool enable) {
+    int opt = enable ? 1 : 0;
+    return setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, (const char *)&opt, sizeof(opt)) == 0;
+}
+
 void SockUtil::setNoDelay(int sockfd, bool nodelay) {
     int opt = nodelay ? 1 : 0;
     if (setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (const char *)&opt, sizeof(opt)) == -1) {
@@ -144,17 +177,148 @@ void SockUtil::setTcpQuickAck(int sockfd, bool quick_ack) {
     }
 }
 
+void SockUtil::setIpv6Only(int sockfd, bool enable) {
+    int opt = enable ? 1 : 0;
+    if (setsockopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, (const char *)&opt, sizeof(opt)) == -1) {
+        throw SockException(errno, "set ipv6 only failed");
+    }
+}
+
 std::string SockUtil::getLocalIP(int sockfd) {
-    char ip[INET_ADDRSTRLEN];
-    struct sockaddr_in addr;
+    struct sockaddr_storage addr;
     socklen_t addr_len = sizeof(addr);
     if (getsockname(sockfd, (struct sockaddr *)&addr, &addr_len) == -1) {
         throw SockException(errno, "get local ip failed");
     }
-    if (inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip)) == nullptr) {
-        throw SockException(errno, "inet_ntop failed");
+    return inetNtoa((struct sockaddr *)&addr);
+}
+
+std::string SockUtil::getPeerIP(int sockfd) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(sockfd, (struct sockaddr *)&addr, &addr_len) == -1) {
+        return "";
+    }
+    return inetNtoa((struct sockaddr *)&addr);
+}
+
+uint16_t SockUtil::getLocalPort(int sockfd) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(sockfd, (struct sockaddr *)&addr, &addr_len) == -1) {
+        return 0;
+    }
+    return inetPort((struct sockaddr *)&addr);
+}
+
+uint16_t SockUtil::getPeerPort(int sockfd) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(sockfd, (struct sockaddr *)&addr, &addr_len) == -1) {
+        return 0;
+    }
+    return inetPort((struct sockaddr *)&addr);
+}
+
+int SockUtil::getSockError(int sockfd) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) {
+        return errno;
+    }
+    return err;
+}
+
+std::string SockUtil::inetNtoa(const struct sockaddr *addr) {
+    char ip[INET6_ADDRSTRLEN] = {0};
+    switch (addr->sa_family) {
+        case AF_INET:
+            inet_ntop(AF_INET, &((struct sockaddr_in *)addr)->sin_addr, ip, sizeof(ip));
+            break;
+        case AF_INET6: {
+            auto &addr6 = ((struct sockaddr_in6 *)addr)->sin6_addr;
+            if (IN6_IS_ADDR_V4MAPPED(&addr6)) {
+                inet_ntop(AF_INET, &addr6.s6_addr[12], ip, sizeof(ip));
+            } else {
+                inet_ntop(AF_INET6, &addr6, ip, sizeof(ip));
+            }
+            break;
+        }
+        default: break;
+    }
+    return ip;
+}
+
+uint16_t SockUtil::inetPort(const struct sockaddr *addr) {
+    switch (addr->sa_family) {
+        case AF_INET: return ntohs(((struct sockaddr_in *)addr)->sin_port);
+        case AF_INET6: return ntohs(((struct sockaddr_in6 *)addr)->sin6_port);
+        default: return 0;
+    }
+}
+
+socklen_t SockUtil::getSockLen(const struct sockaddr *addr) {
+    switch (addr->sa_family) {
+        case AF_INET: return sizeof(struct sockaddr_in);
+        case AF_INET6: return sizeof(struct sockaddr_in6);
+        default: return 0;
+    }
+}
+
+bool SockUtil::makeSockAddr(const std::string &ip, uint16_t port, struct sockaddr_storage &addr) {
+    memset(&addr, 0, sizeof(addr));
+    auto &addr4 = (struct sockaddr_in &)addr;
+    if (inet_pton(AF_INET, ip.data(), &addr4.sin_addr) == 1) {
+        addr4.sin_family = AF_INET;
+        addr4.sin_port = htons(port);
+        return true;
+    }
+    auto host = ip;
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    auto &addr6 = (struct sockaddr_in6 &)addr;
+    if (inet_pton(AF_INET6, host.data(), &addr6.sin6_addr) == 1) {
+        addr6.sin6_family = AF_INET6;
+        addr6.sin6_port = htons(port);
+        return true;
+    }
+    return false;
+}
+
+bool SockUtil::isIP(const std::string &host) {
+    struct sockaddr_storage addr;
+    return makeSockAddr(host, 0, addr);
+}
+
+int SockUtil::bindSock(int type, const std::string &ip, uint16_t port, bool reuse_port) {
+    struct sockaddr_storage addr;
+    if (!makeSockAddr(ip.empty() ? "::" : ip, port, addr)) {
+        throw SockException(EINVAL, "invalid bind address " + ip);
+    }
+    int fd = ::socket(addr.ss_family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        throw SockException(errno, "create socket failed");
+    }
+    try {
+        //udp 的 SO_REUSEADDR 允许多个socket绑定同一端口，是否共享端口只由 reuse_port 决定
+        if (type == SOCK_STREAM) {
+            setReuseAddr(fd);
+        }
+        if (reuse_port) {
+            setReusePort(fd);
+        }
+        if (addr.ss_family == AF_INET6) {
+            setIpv6Only(fd, false);
+        }
+        if (::bind(fd, (struct sockaddr *)&addr, getSockLen((struct sockaddr *)&addr)) == -1) {
+            throw SockException(errno, "bind " + ip + ":" + std::to_string(port) + " failed");
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
     }
-    return std::string(ip);
+    return fd;
 }
 
 // std::pair<std::string, std::string> SockUtil::getInterfaceAddr() {
@@ -6,6 +6,7 @@
 #include <sstream>
 #include <exception>
 #include <map>
+#include <sys/socket.h>
 
 namespace beton {
 
@@ -27,7 +28,8 @@ public:
     int sock_code() const { return _sock_code; }
     int custom_code() const { return _custom_code; }
     const char *what() const noexcept override { return _what.data(); }
-    operator bool() const { return _sock_code != 0; }
+    //系统错误码或自定义错误码(如对端关闭)任一存在即为异常
+    operator bool() const { return _sock_code != 0 || _custom_code != Err_Success; }
 
 private:
     int _sock_code;
@@ -41,6 +43,14 @@ class SockUtil {
 public:
     static void setReuseAddr(int sockfd);
     static void setReusePort(int sockfd);
+    //SO_REUSEPORT 组内优先把在该cpu上收到的连接分给本socket
+    static bool setIncomingCpu(int sockfd, int cpu);
+    //接收时通过控制消息附带内核丢包计数(SO_RXQ_OVFL)
+    static bool setRxqOvfl(int sockfd, bool enable = true);
+    //udp 接收合并(UDP_GRO)
+    static bool setUdpGro(int sockfd, bool enable = true);
+    //允许 send 使用 MSG_ZEROCOPY(SO_ZEROCOPY)
+    static bool setZeroCopy(int sockfd, bool enable = true);
     static void setNoDelay(int sockfd, bool nodelay = true);
     static void setSendBuf(int sockfd, int size);
     static void setRecvBuf(int sockfd, int size);
@@ -52,10 +62,34 @@ public:
     static void setNosigpipe(int sockfd);
 
     static void setTcpQuickAck(int sockfd, bool quick_ack = true);
+    //IPv6 socket 是否只接收IPv6，关闭后可以同时监听IPv4
+    static void setIpv6Only(int sockfd, bool enable);
 
     static std::string getLocalIP(int sockfd);
+    static std::string getPeerIP(int sockfd);
+    static uint16_t getLocalPort(int sockfd);
+    static uint16_t getPeerPort(int sockfd);
+    //获取并清除socket上挂起的错误
+    static int getSockError(int sockfd);
     // static std::pair<std::string, std::string> getInterfaceAddr();
 
+    //sockaddr 转 ip 字符串，IPv4映射的IPv6地址还原成IPv4形式
+    static std::string inetNtoa(const struct sockaddr *addr);
+    static uint16_t inetPort(const struct sockaddr *addr);
+    static socklen_t getSockLen(const struct sockaddr *addr);
+    //ip字面量(不是域名)转 sockaddr，失败返回false
+    static bool makeSockAddr(const std::string &ip, uint16_t port, struct sockaddr_storage &addr);
+    static bool isIP(const std::string &host);
+
+    /**
+     * 创建并绑定socket, 返回非阻塞、close-on-exec的fd, 失败抛出SockException
+     * @param type: SOCK_STREAM 或 SOCK_DGRAM
+     * @param ip: 绑定的本地ip, 空或"::"表示所有网卡(同时支持IPv4/IPv6)
+     * @param port: 绑定端口, 0 由内核分配
+     * @param reuse_port: 是否设置 SO_REUSEPORT
+    */
+    static int bindSock(int type, const std::string &ip, uint16_t port, bool reuse_port = false);
+
 };
 
 }
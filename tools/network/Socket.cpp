@@ -1,27 +1,1741 @@
 #include "Socket.h"
+#include "DnsResolver.h"
+#include "threadpool/ThreadPool.h"
+#include <sys/epoll.h>
+#include <algorithm>
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
 
 using namespace std;
 
 namespace beton {
 
-SocketHelper::SocketHelper() {
-    
+//单次 sendmsg 最多携带的 Buffer 个数
+static constexpr size_t s_max_iov = 64;
+//单次读事件最多连续读取的次数，避免一个连接饿死同线程的其他连接
+static constexpr int s_max_read_times = 16;
+//tcp 单次读取的最大长度，读进线程共用的缓冲区，不占用连接的内存
+static constexpr size_t s_tcp_read_size = 64 * 1024;
+static constexpr size_t s_udp_read_size = 2 * 1024;
+//recvmmsg/sendmmsg 单次批量处理的报文个数
+static constexpr size_t s_udp_batch = 32;
+//开启 GRO 后一次可能收到多个合并的报文
+static constexpr size_t s_udp_gro_read_size = 64 * 1024;
+//UDP_SEGMENT 单次最多的分段数和总长度(内核限制)
+static constexpr size_t s_udp_gso_max_segs = 64;
+static constexpr size_t s_udp_gso_max_size = 65000;
+//一个 udp 报文分散写的最大片段数
+static constexpr size_t s_udp_max_pieces = 16;
+//udp 发送队列清空后保留的容量
+static constexpr size_t s_udp_keep_capacity = 16;
+//Happy Eyeballs: 上一个地址迟迟连不上时开始尝试下一个的间隔(RFC 8305 建议值)
+static constexpr uint32_t s_connect_attempt_delay_ms = 250;
+//连接关闭后内核可能仍在重传零拷贝的数据，未收到完成通知的 Buffer 延迟这么久再释放
+static constexpr uint32_t s_zc_linger_ms = 10 * 1000;
+//单次 sendfile 的最大长度，以及 sendfile 不可用时单次 pread 的长度
+static constexpr size_t s_file_chunk = 1024 * 1024;
+static constexpr size_t s_file_read_size = 64 * 1024;
+//用户态加密时单个 tls 记录的明文长度上限
+static constexpr size_t s_tls_record_size = 16 * 1024;
+
+/**
+ * 同一个 poller 线程上所有 socket 共用的接收缓冲区，读事件在线程内串行处理，不需要每个连接各备一份:
+ * tcp 读进 tcp 缓冲区，以切片交给上层，空闲连接不持有任何接收内存
+ * udp 的 recvmmsg 直接读进 udp 中的 Buffer
+ * 被上层保留的缓冲区归上层所有，下次读取再补上新的
+*/
+struct RecvScratch {
+    BufferRaw::Ptr tcp;
+    std::vector<BufferRaw::Ptr> udp;
+};
+
+static RecvScratch &getRecvScratch() {
+    static thread_local RecvScratch s_scratch;
+    return s_scratch;
+}
+
+//取出线程缓冲区，容量不合适时重新申请; udp 的缓冲区会交给上层，太大会让上层持有过多内存
+static BufferRaw::Ptr &getScratchBuffer(BufferRaw::Ptr &buf, size_t size, bool exact) {
+    if (!buf || buf->capacity() < size || (exact && buf->capacity() >= 2 * size)) {
+        buf = BufferRaw::create(size);
+    }
+    return buf;
+}
+
+//把 tcp 缓冲区中读到的 size 字节以切片交给上层，不拷贝
+static void deliverTcpScratch(const Socket::onRecv &cb, size_t size) {
+    auto &slot = getRecvScratch().tcp;
+    //回调期间同线程的其他 socket 也可能读取，先从线程缓冲区取走
+    BufferRaw::Ptr scratch = std::move(slot);
+    cb(BufferSlice::create(scratch, 0, size));
+    //上层没有保留的放回去继续使用
+    if (scratch.use_count() == 1 && !slot) {
+        slot = std::move(scratch);
+    }
+}
+
+Socket::Ptr Socket::create(const PollerThread::Ptr &poller) {
+    return std::make_shared<Socket>(poller);
+}
+
+Socket::Socket(const PollerThread::Ptr &poller) : _poller(poller) {
+    if (!_poller) {
+        _poller = ThreadPool::Instance().getPoller();
+    }
+}
+
+Socket::~Socket() {
+    closeSock();
+}
+
+bool Socket::ColdState::inUse() const {
+    return connect_timer || connect_token || race || !file_queue.empty() || pace_timer || udp_queue.capacity() ||
+           udp_gso || udp_gro || udp_connected || udp_drop_count || udp_trunc_count || peer_addr_len || zc_enable ||
+           !zc_pending.empty() || tls || on_tls || on_before_accept || on_flow_control || on_udp_flush;
+}
+
+Socket::ColdState &Socket::cold() {
+    if (!_cold) {
+        _cold.reset(new ColdState);
+    }
+    return *_cold;
+}
+
+int Socket::rawFd() const {
+    return _sock_fd ? _sock_fd->getFdNum() : -1;
+}
+
+//------------------SockInfo----------------//
+string Socket::get_peer_ip() {
+    if (_cold && _cold->peer_addr_len) {
+        return SockUtil::inetNtoa((struct sockaddr *)&_cold->peer_addr);
+    }
+    return _sock_fd ? SockUtil::getPeerIP(rawFd()) : "";
+}
+
+string Socket::get_local_ip() {
+    try {
+        return _sock_fd ? SockUtil::getLocalIP(rawFd()) : "";
+    } catch (std::exception &) {
+        return "";
+    }
+}
+
+uint16_t Socket::get_peer_port() {
+    if (_cold && _cold->peer_addr_len) {
+        return SockUtil::inetPort((struct sockaddr *)&_cold->peer_addr);
+    }
+    return _sock_fd ? SockUtil::getPeerPort(rawFd()) : 0;
+}
+
+uint16_t Socket::get_local_port() {
+    return _sock_fd ? SockUtil::getLocalPort(rawFd()) : 0;
+}
+
+//--------------网络接口管理------------------//
+void Socket::connect(const string &host, const onConnectRes &func, uint16_t port, uint8_t timeout_sec,
+                     const string &bind_addr, uint16_t bind_port) {
+    weak_ptr<Socket> weak_self = shared_from_this();
+    _poller->async([=]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return;
+        }
+        closeSock();
+        _on_connect = func;
+        cold().connect_token = std::make_shared<bool>(true);
+
+        struct sockaddr_storage addr;
+        if (SockUtil::makeSockAddr(host, port, addr)) {
+            connectAddr(addr, timeout_sec, bind_addr, bind_port);
+            return;
+        }
+
+        //异步解析，结果在本线程回调
+        weak_ptr<bool> weak_token = _cold->connect_token;
+        DnsResolver::Instance().resolve(host, [=](const SockException &ex, const DnsResolver::AddrList &addrs) {
+            auto strong_self = weak_self.lock();
+            if (!strong_self || !weak_token.lock()) {
+                //已经关闭或者重新发起了连接
+                return;
+            }
+            if (ex) {
+                onConnected(ex);
+                return;
+            }
+            startRace(addrs, port, timeout_sec, bind_addr, bind_port);
+        }, _poller);
+    });
+}
+
+void Socket::startRace(const vector<struct sockaddr_storage> &addrs, uint16_t port, uint8_t timeout_sec,
+                       const string &bind_addr, uint16_t bind_port) {
+    //ipv6 和 ipv4 交替排列，从解析结果中的第一个地址族开始
+    vector<struct sockaddr_storage> lists[2];
+    for (auto &addr : addrs) {
+        lists[addr.ss_family == AF_INET6 ? 0 : 1].emplace_back(addr);
+        auto &item = lists[addr.ss_family == AF_INET6 ? 0 : 1].back();
+        if (item.ss_family == AF_INET6) {
+            ((struct sockaddr_in6 &)item).sin6_port = htons(port);
+        } else {
+            ((struct sockaddr_in &)item).sin_port = htons(port);
+        }
+    }
+    int first = addrs.empty() || addrs[0].ss_family == AF_INET6 ? 0 : 1;
+    auto race = std::make_shared<ConnectRace>();
+    for (size_t i = 0; i < lists[0].size() || i < lists[1].size(); ++i) {
+        if (i < lists[first].size()) {
+            race->addrs.emplace_back(lists[first][i]);
+        }
+        if (i < lists[1 - first].size()) {
+            race->addrs.emplace_back(lists[1 - first][i]);
+        }
+    }
+    if (race->addrs.size() == 1) {
+        connectAddr(race->addrs[0], timeout_sec, bind_addr, bind_port);
+        return;
+    }
+    race->bind_addr = bind_addr;
+    race->bind_port = bind_port;
+    race->last_err = SockException(0, "no address to connect", Err_Dns);
+    cold().race = race;
+    _connecting = true;
+    startConnectTimer(timeout_sec);
+    raceNext();
+}
+
+void Socket::raceNext() {
+    auto race = _cold->race;
+    if (race->timer) {
+        race->timer->cancel();
+        race->timer = nullptr;
+    }
+    weak_ptr<Socket> weak_self = shared_from_this();
+    while (race->next < race->addrs.size()) {
+        SockException ex;
+        int fd = createConnectFd(race->addrs[race->next++], race->bind_addr, race->bind_port, ex);
+        if (fd == -1) {
+            race->last_err = ex;
+            continue;
+        }
+        auto attempt = std::make_shared<SockFd>(fd);
+        auto key = attempt.get();
+        if (_poller->addEvent(fd, EPOLLOUT, [weak_self, key](int event) {
+                auto strong_self = weak_self.lock();
+                if (strong_self) {
+                    strong_self->onRaceEvent(key, event);
+                }
+            }) == -1) {
+            race->last_err = SockException(errno, "add connect event failed", Err_Other);
+            continue;
+        }
+        race->attempts.emplace_back(std::move(attempt));
+        if (race->next < race->addrs.size()) {
+            race->timer = _poller->doDelayTask(s_connect_attempt_delay_ms, [weak_self]() -> uint64_t {
+                auto strong_self = weak_self.lock();
+                if (strong_self && strong_self->_cold && strong_self->_cold->race) {
+                    strong_self->raceNext();
+                }
+                return 0;
+            });
+        }
+        return;
+    }
+    if (race->attempts.empty()) {
+        onConnected(race->last_err);
+    }
+}
+
+void Socket::onRaceEvent(SockFd *key, int event) {
+    //同一轮 epoll 中已经排队的事件可能在连接结束之后到达
+    auto race = _cold ? _cold->race : nullptr;
+    if (!race) {
+        return;
+    }
+    auto it = std::find_if(race->attempts.begin(), race->attempts.end(),
+                           [key](const std::shared_ptr<SockFd> &attempt) { return attempt.get() == key; });
+    if (it == race->attempts.end()) {
+        return;
+    }
+    auto attempt = *it;
+    race->attempts.erase(it);
+    int fd = attempt->getFdNum();
+    _poller->delEvent(fd, 0, [](bool) {});
+    auto err = SockUtil::getSockError(fd);
+    if (err) {
+        race->last_err = SockException(err, "connect failed", err == ECONNREFUSED ? Err_Refuse : Err_Other);
+        //失败后不再等待，立即尝试下一个地址
+        if (race->next < race->addrs.size()) {
+            raceNext();
+        } else if (race->attempts.empty()) {
+            onConnected(race->last_err);
+        }
+        return;
+    }
+    //胜出的连接交给本socket, 其余的在 closeSock 中关闭
+    attempt->setFdNum(-1);
+    if (!attachFd(fd, Sock_Tcp)) {
+        onConnected(SockException(errno, "add connect event failed", Err_Other));
+        return;
+    }
+    onConnected(SockException());
+}
+
+void Socket::startConnectTimer(uint8_t timeout_sec) {
+    weak_ptr<Socket> weak_self = shared_from_this();
+    cold().connect_timer = _poller->doDelayTask(std::max<uint32_t>(timeout_sec, 1) * 1000, [weak_self]() -> uint64_t {
+        auto strong_self = weak_self.lock();
+        if (strong_self && strong_self->_connecting) {
+            strong_self->onConnected(SockException(ETIMEDOUT, "connect timeout", Err_Timeout));
+        }
+        return 0;
+    });
+}
+
+int Socket::createConnectFd(const struct sockaddr_storage &addr, const string &bind_addr, uint16_t bind_port,
+                            SockException &ex) {
+    int fd = -1;
+    try {
+        if (!bind_addr.empty() || bind_port) {
+            fd = SockUtil::bindSock(SOCK_STREAM, bind_addr.empty() ? (addr.ss_family == AF_INET ? "0.0.0.0" : "::") : bind_addr, bind_port);
+        } else {
+            fd = ::socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+            if (fd == -1) {
+                throw SockException(errno, "create socket failed", Err_Other);
+            }
+        }
+        SockUtil::setNoDelay(fd);
+        SockUtil::setNosigpipe(fd);
+    } catch (SockException &e) {
+        if (fd != -1) {
+            ::close(fd);
+        }
+        ex = e;
+        return -1;
+    }
+
+    int ret = ::connect(fd, (struct sockaddr *)&addr, SockUtil::getSockLen((struct sockaddr *)&addr));
+    if (ret == -1 && errno != EINPROGRESS) {
+        auto err = errno;
+        ::close(fd);
+        ex = SockException(err, "connect failed", err == ECONNREFUSED ? Err_Refuse : Err_Other);
+        return -1;
+    }
+    return fd;
+}
+
+void Socket::connectAddr(const struct sockaddr_storage &addr, uint8_t timeout_sec,
+                         const string &bind_addr, uint16_t bind_port) {
+    SockException ex;
+    int fd = createConnectFd(addr, bind_addr, bind_port, ex);
+    if (fd == -1) {
+        onConnected(ex);
+        return;
+    }
+    if (!attachFd(fd, Sock_Tcp)) {
+        onConnected(SockException(errno, "add connect event failed", Err_Other));
+        return;
+    }
+    _connecting = true;
+    //等待可写事件判断连接结果
+    enableWriteEvent(true);
+    startConnectTimer(timeout_sec);
+}
+
+void Socket::onConnected(const SockException &ex) {
+    _connecting = false;
+    if (_cold) {
+        if (_cold->connect_timer) {
+            _cold->connect_timer->cancel();
+            _cold->connect_timer = nullptr;
+        }
+        //迟到的域名解析结果不再发起连接
+        _cold->connect_token = nullptr;
+        if (!_cold->inUse()) {
+            //只为连接过程分配的，连接建立后的空闲客户端不再占用
+            _cold.reset();
+        }
+    }
+    auto cb = std::move(_on_connect);
+    _on_connect = nullptr;
+    if (ex) {
+        closeSock();
+    } else {
+        //连接期间已经有数据进入发送队列则立即发送
+        enableWriteEvent(false);
+        flushData();
+    }
+    if (cb) {
+        cb(ex);
+    }
+}
+
+bool Socket::listen(uint16_t port, const string &bind_addr, int backlog, bool reuse_port) {
+    closeSock();
+    int fd = -1;
+    try {
+        fd = SockUtil::bindSock(SOCK_STREAM, bind_addr, port, reuse_port);
+    } catch (SockException &ex) {
+        WarnL << "listen " << bind_addr << ":" << port << " failed: " << ex;
+        return false;
+    }
+    if (::listen(fd, backlog) == -1) {
+        WarnL << "listen " << bind_addr << ":" << port << " failed: " << SockException(errno);
+        ::close(fd);
+        return false;
+    }
+    return attachFd(fd, Sock_TcpServer);
+}
+
+bool Socket::bindUdp(uint16_t port, const string &bind_addr, bool reuse_port) {
+    closeSock();
+    int fd = -1;
+    try {
+        fd = SockUtil::bindSock(SOCK_DGRAM, bind_addr, port, reuse_port);
+    } catch (SockException &ex) {
+        WarnL << "bind udp " << bind_addr << ":" << port << " failed: " << ex;
+        return false;
+    }
+    return attachFd(fd, Sock_Udp);
+}
+
+bool Socket::bindPeerAddr(const struct sockaddr *addr, socklen_t addr_len, bool connect) {
+    auto &cold = this->cold();
+    cold.peer_addr_len = std::min<socklen_t>(addr_len, sizeof(cold.peer_addr));
+    memcpy(&cold.peer_addr, addr, cold.peer_addr_len);
+    if (!connect) {
+        return true;
+    }
+    if (!_sock_fd || ::connect(rawFd(), addr, addr_len) == -1) {
+        WarnL << "connect udp peer " << SockUtil::inetNtoa(addr) << " failed: " << SockException(errno);
+        return false;
+    }
+    cold.udp_connected = true;
+    return true;
+}
+
+bool Socket::attachFd(int fd, SockType type) {
+    closeSock();
+    auto sock_fd = std::make_shared<SockFd>(fd);
+    if (type == Sock_Tcp) {
+        try {
+            SockUtil::setNonBlock(fd);
+            SockUtil::setNoDelay(fd);
+            SockUtil::setNosigpipe(fd);
+        } catch (SockException &ex) {
+            WarnL << "set socket option failed: " << ex;
+        }
+    } else if (type == Sock_Udp) {
+        //接收时附带内核丢包计数
+        SockUtil::setRxqOvfl(fd);
+    }
+
+    weak_ptr<Socket> weak_self = shared_from_this();
+    _events = EPOLLIN;
+    if (_poller->addEvent(fd, _events, [weak_self](int event) {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->onSockEvent(event);
+            }
+        }) == -1) {
+        return false;
+    }
+    _type = type;
+    _sock_fd = std::move(sock_fd);
+    if (!_read_size) {
+        _read_size = type == Sock_Udp ? s_udp_read_size : s_tcp_read_size;
+    }
+    return true;
+}
+
+void Socket::closeSock() {
+    _connecting = false;
+    _send_chain.clear();
+    _flush_pending = false;
+    _flow_blocked = false;
+    _events = 0;
+    if (_cold) {
+        //回调、udp 对端地址和丢包计数保留，重新连接或绑定后继续使用
+        auto &cold = *_cold;
+        if (cold.connect_timer) {
+            cold.connect_timer->cancel();
+            cold.connect_timer = nullptr;
+        }
+        cold.connect_token = nullptr;
+        if (cold.race) {
+            auto race = std::move(cold.race);
+            cold.race = nullptr;
+            if (race->timer) {
+                race->timer->cancel();
+            }
+            for (auto &attempt : race->attempts) {
+                _poller->delEvent(attempt->getFdNum(), 0, [attempt](bool) {});
+            }
+        }
+        cold.file_queue.clear();
+        cold.file_after_size = 0;
+        if (cold.pace_timer) {
+            cold.pace_timer->cancel();
+            cold.pace_timer = nullptr;
+        }
+        std::vector<UdpPacket>().swap(cold.udp_queue);
+        cold.udp_head = 0;
+        cold.udp_filtered = 0;
+        cold.udp_queue_size = 0;
+        cold.udp_gso = false;
+        cold.udp_gro = false;
+        cold.udp_connected = false;
+        cold.tls = nullptr;
+        cold.tls_handshaking = false;
+        cold.tls_ktls_send = false;
+        cold.tls_read_want_write = false;
+        cold.tls_out = nullptr;
+        cold.tls_out_offset = 0;
+        cold.on_tls = nullptr;
+        cold.zc_enable = false;
+        cold.zc_next_id = 0;
+        if (!cold.zc_pending.empty()) {
+            //内存池复用这些内存后，仍在途的重传会发出错误的内容
+            auto pending = std::make_shared<std::list<ZeroCopySend> >(std::move(cold.zc_pending));
+            cold.zc_pending.clear();
+            _poller->doDelayTask(s_zc_linger_ms, [pending]() -> uint64_t {
+                return 0;
+            });
+        }
+    }
+    if (_sock_fd) {
+        //先从 epoll 中移除，再由 SockFd 析构关闭fd, 避免fd被复用后收到旧事件
+        auto sock_fd = std::move(_sock_fd);
+        _sock_fd = nullptr;
+        _poller->delEvent(sock_fd->getFdNum(), 0, [sock_fd](bool) {});
+    }
+}
+
+void Socket::emitErr(const SockException &ex) {
+    if (!_sock_fd) {
+        return;
+    }
+    //回调中可能释放本对象
+    auto strong_self = shared_from_this();
+    auto cb = _on_err;
+    closeSock();
+    if (cb) {
+        cb(ex);
+    }
+}
+
+//------------------事件处理---------------------//
+void Socket::onSockEvent(int event) {
+    if (_connecting) {
+        if (event & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+            auto err = SockUtil::getSockError(rawFd());
+            onConnected(err ? SockException(err, "connect failed", err == ECONNREFUSED ? Err_Refuse : Err_Other)
+                            : SockException());
+        }
+        return;
+    }
+    if (_type == Sock_TcpServer) {
+        onAcceptable();
+        return;
+    }
+    if (event & EPOLLIN) {
+        onReadable();
+    }
+    if (!_sock_fd) {
+        return;
+    }
+    if (event & EPOLLOUT) {
+        onWriteable();
+    }
+    //零拷贝完成通知在错误队列中，同样以 EPOLLERR 通知
+    bool zc_notified = _sock_fd && (event & EPOLLERR) && _cold && !_cold->zc_pending.empty() && onErrQueue();
+    if (_sock_fd && (event & (EPOLLERR | EPOLLHUP)) && !(event & EPOLLIN) && _type == Sock_Tcp) {
+        auto err = SockUtil::getSockError(rawFd());
+        if (!err && zc_notified && !(event & EPOLLHUP)) {
+            return;
+        }
+        emitErr(SockException(err, "socket error", err ? Err_Other : Err_Eof));
+    }
+}
+
+bool Socket::onErrQueue() {
+    bool notified = false;
+    while (_sock_fd) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(rawFd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            auto serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno) {
+                continue;
+            }
+            notified = true;
+            if ((serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && _cold->zc_enable) {
+                //内核仍然做了拷贝(比如回环或网卡不支持分散发送), 零拷贝只会多出通知的开销
+                _cold->zc_enable = false;
+                DebugL << "zero copy send fell back to copy, disable it on fd " << rawFd();
+            }
+            onZeroCopyDone(serr->ee_info, serr->ee_data);
+        }
+    }
+    return notified;
+}
+
+void Socket::onZeroCopyDone(uint32_t lo, uint32_t hi) {
+    if (_cold->zc_pending.empty()) {
+        return;
+    }
+    //通知的是 [lo, hi] 区间的发送完成, 序号可能回绕
+    for (auto &pending : _cold->zc_pending) {
+        if (pending.id - lo <= hi - lo) {
+            pending.done = true;
+        }
+    }
+    while (!_cold->zc_pending.empty() && _cold->zc_pending.front().done) {
+        _cold->zc_pending.pop_front();
+    }
+}
+
+void Socket::onAcceptable() {
+    while (_sock_fd) {
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        int fd = ::accept4(rawFd(), (struct sockaddr *)&addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                //fd 耗尽时每次事件都会失败，限制日志频率
+                WarnL_EVERY_MS(1000) << "accept failed: " << SockException(errno);
+            }
+            return;
+        }
+
+        Socket::Ptr peer_sock;
+        try {
+            peer_sock = _cold && _cold->on_before_accept ? _cold->on_before_accept(_poller) : nullptr;
+        } catch (std::exception &ex) {
+            ErrorL << "Exception occurred when before accept: " << ex.what();
+        }
+        if (!peer_sock) {
+            peer_sock = Socket::create(_poller);
+        }
+
+        auto on_accept = _on_accept;
+        peer_sock->getPoller()->async([peer_sock, fd, on_accept]() {
+            //attachFd 失败时fd已由 SockFd 关闭
+            if (!peer_sock->attachFd(fd, Sock_Tcp)) {
+                return;
+            }
+            if (on_accept) {
+                on_accept(peer_sock);
+            }
+        });
+    }
+}
+
+void Socket::onReadable() {
+    if (_type == Sock_Udp) {
+        onUdpReadable();
+        return;
+    }
+    if (_cold && _cold->tls) {
+        onTlsReadable();
+        return;
+    }
+    //回调中可能释放本对象
+    auto strong_self = shared_from_this();
+    for (int i = 0; i < s_max_read_times && _sock_fd; ++i) {
+        auto &scratch = getScratchBuffer(getRecvScratch().tcp, _read_size, false);
+        auto ret = ::recv(rawFd(), scratch->data(), _read_size, 0);
+        if (ret > 0) {
+            if (_on_recv) {
+                deliverTcpScratch(_on_recv, ret);
+            }
+            if ((size_t) ret < _read_size) {
+                //内核缓冲区已读空
+                return;
+            }
+            continue;
+        }
+        if (ret == 0) {
+            emitErr(SockException(0, "end of file", Err_Eof));
+            return;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            emitErr(SockException(errno, "recv failed", Err_Other));
+        }
+        return;
+    }
+}
+
+void Socket::onUdpReadable() {
+    auto strong_self = shared_from_this();
+    struct mmsghdr msgs[s_udp_batch];
+    struct iovec iovs[s_udp_batch];
+    struct sockaddr_storage addrs[s_udp_batch];
+    //SO_RXQ_OVFL(uint32) + UDP_GRO(int)
+    char controls[s_udp_batch][CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int))];
+    //回调中可能关闭甚至重新绑定socket
+    auto sock_fd = _sock_fd;
+
+    auto &bufs = getRecvScratch().udp;
+
+    for (int times = 0; times < s_max_read_times && _sock_fd == sock_fd; ++times) {
+        bufs.resize(s_udp_batch);
+        for (size_t i = 0; i < s_udp_batch; ++i) {
+            auto &buf = getScratchBuffer(bufs[i], _read_size, true);
+            iovs[i].iov_base = buf->data();
+            iovs[i].iov_len = buf->capacity();
+            auto &hdr = msgs[i].msg_hdr;
+            hdr.msg_name = &addrs[i];
+            hdr.msg_namelen = sizeof(addrs[i]);
+            hdr.msg_iov = &iovs[i];
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = controls[i];
+            hdr.msg_controllen = sizeof(controls[i]);
+            hdr.msg_flags = 0;
+            msgs[i].msg_len = 0;
+        }
+
+        int count = ::recvmmsg(rawFd(), msgs, s_udp_batch, MSG_DONTWAIT, nullptr);
+        if (count <= 0) {
+            if (count == -1 && errno == EINTR) {
+                continue;
+            }
+            //udp 的错误(如收到 ICMP 不可达)不影响后续收发
+            return;
+        }
+        //读到数据的缓冲区先全部取走，回调期间线程缓冲区可能被其他 socket 使用
+        BufferRaw::Ptr recv_bufs[s_udp_batch];
+        for (int i = 0; i < count; ++i) {
+            recv_bufs[i] = std::move(bufs[i]);
+        }
+
+        for (int i = 0; i < count && _sock_fd == sock_fd; ++i) {
+            auto &hdr = msgs[i].msg_hdr;
+            int gso_size = 0;
+            for (auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t dropped;
+                    memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+                    if (dropped != udpDropCount()) {
+                        WarnL_EVERY_MS(5000) << "udp socket " << get_local_port() << " dropped "
+                                             << dropped - udpDropCount() << " packets, total " << dropped;
+                        cold().udp_drop_count = dropped;
+                    }
+                } else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+                }
+            }
+
+            if (hdr.msg_flags & MSG_TRUNC) {
+                //报文比读取长度大，内核已丢弃超出的部分, 残缺的报文不能交给上层
+                ++cold().udp_trunc_count;
+                WarnL_EVERY_MS(5000) << "udp socket " << get_local_port() << " dropped truncated packet larger than "
+                                     << _read_size << " bytes, total " << _cold->udp_trunc_count
+                                     << ", enlarge it with setReadBufferSize";
+                continue;
+            }
+            auto &buf = recv_bufs[i];
+            buf->setSize(msgs[i].msg_len);
+            auto addr = (struct sockaddr *)&addrs[i];
+            auto addr_len = hdr.msg_namelen;
+            if (gso_size <= 0 || msgs[i].msg_len <= (size_t)gso_size) {
+                onUdpPacket(buf, addr, addr_len);
+                continue;
+            }
+            //GRO 合并的报文按原始长度切开，共享同一块内存
+            for (size_t offset = 0; offset < buf->size() && _sock_fd == sock_fd; offset += gso_size) {
+                onUdpPacket(BufferSlice::create(buf, offset, gso_size), addr, addr_len);
+            }
+        }
+        //上层没有保留的放回线程缓冲区继续使用
+        for (int i = 0; i < count; ++i) {
+            if (recv_bufs[i].use_count() == 1 && !bufs[i]) {
+                bufs[i] = std::move(recv_bufs[i]);
+            }
+        }
+        if ((size_t) count < s_udp_batch) {
+            //内核缓冲区已读空
+            return;
+        }
+    }
+}
+
+void Socket::onUdpPacket(const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t addr_len) {
+    if (_on_recv_from) {
+        _on_recv_from(buf, addr, addr_len);
+    } else if (_on_recv) {
+        _on_recv(buf);
+    }
+}
+
+void Socket::onTlsReadable() {
+    if (_cold->tls_handshaking) {
+        onTlsHandshake();
+        return;
+    }
+    auto strong_self = shared_from_this();
+    //回调中可能关闭socket
+    auto tls = _cold->tls;
+    for (int i = 0; i < s_max_read_times && _cold->tls == tls; ++i) {
+        auto &scratch = getScratchBuffer(getRecvScratch().tcp, _read_size, false);
+        //每次最多读出一个 tls 记录，不能以读不满判断内核缓冲区已空
+        auto ret = tls->read(scratch->data(), _read_size);
+        if (ret > 0) {
+            if (_on_recv) {
+                deliverTcpScratch(_on_recv, ret);
+            }
+            continue;
+        }
+        if (ret == 0) {
+            emitErr(SockException(0, "end of file", Err_Eof));
+            return;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN) {
+            if (tls->wantWrite()) {
+                _cold->tls_read_want_write = true;
+                enableWriteEvent(true);
+            }
+            return;
+        }
+        emitErr(SockException(errno, "tls recv failed", Err_Other));
+        return;
+    }
+    if (_cold->tls == tls && tls->pending()) {
+        //已解密未读取的数据不会再触发读事件
+        weak_ptr<Socket> weak_self = shared_from_this();
+        _poller->async([weak_self]() {
+            auto strong_self = weak_self.lock();
+            if (strong_self && strong_self->tlsEnabled()) {
+                strong_self->onTlsReadable();
+            }
+        }, Thread::Normal, false);
+    }
+}
+
+void Socket::onTlsHandshake() {
+    SockException ex;
+    int ret = _cold->tls->handshake(ex);
+    if (ret == 0) {
+        enableWriteEvent(_cold->tls->wantWrite());
+        return;
+    }
+    auto strong_self = shared_from_this();
+    _cold->tls_handshaking = false;
+    auto cb = std::move(_cold->on_tls);
+    _cold->on_tls = nullptr;
+    if (ret < 0) {
+        if (cb) {
+            closeSock();
+            cb(ex);
+        } else {
+            emitErr(ex);
+        }
+        return;
+    }
+    //OpenSSL 在握手完成时已经通过 TCP_ULP/TLS_TX/TLS_RX 尝试安装内核 tls
+    _cold->tls_ktls_send = _cold->tls->ktlsSend();
+    DebugL << "tls established on fd " << rawFd() << ", " << _cold->tls->description()
+           << ", ktls send: " << _cold->tls_ktls_send << ", ktls recv: " << _cold->tls->ktlsRecv();
+    enableWriteEvent(false);
+    if (cb) {
+        cb(SockException());
+    }
+    //握手期间排队的数据
+    if (_sock_fd && !_connecting) {
+        flushData();
+    }
+}
+
+void Socket::onWriteable() {
+    if (_type == Sock_Udp) {
+        flushUdpData();
+        return;
+    }
+    if (_cold && _cold->tls_handshaking) {
+        onTlsHandshake();
+        return;
+    }
+    if (_cold && _cold->tls_read_want_write) {
+        _cold->tls_read_want_write = false;
+        onTlsReadable();
+        if (!_sock_fd) {
+            return;
+        }
+    }
+    flushData();
+}
+
+//------------------数据发送---------------------//
+void Socket::send(Buffer::Ptr buf) {
+    if (!buf || !buf->size()) {
+        return;
+    }
+    if (_type == Sock_Udp) {
+        //已 connect 的socket 不需要带地址
+        auto &cold = this->cold();
+        sendTo(std::move(buf), (struct sockaddr *)&cold.peer_addr, cold.udp_connected ? 0 : cold.peer_addr_len);
+        return;
+    }
+    if (!_poller->is_current_thread()) {
+        weak_ptr<Socket> weak_self = shared_from_this();
+        _poller->async([weak_self, buf]() {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->send(buf);
+            }
+        });
+        return;
+    }
+    if (!_sock_fd) {
+        return;
+    }
+    if (_cold && !_cold->file_queue.empty()) {
+        //排在未发完的文件之后
+        _cold->file_after_size += buf->size();
+        _cold->file_queue.back()->after.push_back(std::move(buf));
+        checkWatermark();
+        return;
+    }
+    _send_chain.push_back(std::move(buf));
+    if (!_connecting && !(_events & EPOLLOUT)) {
+        //未监听可写事件说明内核缓冲区有空间，本轮事件处理完后统一发送
+        _defer_flush ? deferFlush() : (void)flushData();
+    }
+    checkWatermark();
+}
+
+void Socket::send(const char *data, size_t size) {
+    if (!data || !size) {
+        return;
+    }
+    auto buf = BufferRaw::create(size);
+    buf->assign(data, size);
+    send(std::move(buf));
+}
+
+void Socket::send(string str) {
+    if (str.empty()) {
+        return;
+    }
+    send(std::make_shared<BufferString>(std::move(str)));
+}
+
+void Socket::sendTo(Buffer::Ptr buf, const struct sockaddr *addr, socklen_t addr_len) {
+    if (!buf || !buf->size()) {
+        return;
+    }
+    if (!_poller->is_current_thread()) {
+        weak_ptr<Socket> weak_self = shared_from_this();
+        struct sockaddr_storage addr_copy;
+        addr_len = std::min<socklen_t>(addr_len, sizeof(addr_copy));
+        if (addr_len) {
+            memcpy(&addr_copy, addr, addr_len);
+        }
+        _poller->async([weak_self, buf, addr_copy, addr_len]() {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->sendTo(buf, (struct sockaddr *)&addr_copy, addr_len);
+            }
+        });
+        return;
+    }
+    if (!_sock_fd || _type != Sock_Udp) {
+        return;
+    }
+    auto size = buf->size();
+    queueUdpPacket(std::move(buf), vector<Buffer::Ptr>(), size, addr, addr_len);
+}
+
+void Socket::send(vector<Buffer::Ptr> bufs) {
+    if (_type == Sock_Udp) {
+        auto &cold = this->cold();
+        sendTo(std::move(bufs), (struct sockaddr *)&cold.peer_addr, cold.udp_connected ? 0 : cold.peer_addr_len);
+        return;
+    }
+    for (auto &buf : bufs) {
+        send(std::move(buf));
+    }
+}
+
+void Socket::sendTo(vector<Buffer::Ptr> bufs, const struct sockaddr *addr, socklen_t addr_len) {
+    if (bufs.size() <= 1) {
+        if (!bufs.empty()) {
+            sendTo(std::move(bufs[0]), addr, addr_len);
+        }
+        return;
+    }
+    if (!_poller->is_current_thread()) {
+        weak_ptr<Socket> weak_self = shared_from_this();
+        struct sockaddr_storage addr_copy;
+        addr_len = std::min<socklen_t>(addr_len, sizeof(addr_copy));
+        if (addr_len) {
+            memcpy(&addr_copy, addr, addr_len);
+        }
+        auto shared_bufs = std::make_shared<vector<Buffer::Ptr> >(std::move(bufs));
+        _poller->async([weak_self, shared_bufs, addr_copy, addr_len]() {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->sendTo(std::move(*shared_bufs), (struct sockaddr *)&addr_copy, addr_len);
+            }
+        });
+        return;
+    }
+    if (!_sock_fd || _type != Sock_Udp) {
+        return;
+    }
+    size_t size = 0;
+    for (auto &buf : bufs) {
+        size += buf->size();
+    }
+    if (!size) {
+        return;
+    }
+    if (bufs.size() > s_udp_max_pieces) {
+        //片段太多会占满一次 sendmmsg 的 iovec, 合并成一块
+        auto merged = BufferRaw::create(size, 0);
+        for (auto &buf : bufs) {
+            memcpy(merged->data() + merged->size(), buf->data(), buf->size());
+            merged->setSize(merged->size() + buf->size());
+        }
+        queueUdpPacket(std::move(merged), vector<Buffer::Ptr>(), size, addr, addr_len);
+        return;
+    }
+    auto head = std::move(bufs.front());
+    bufs.erase(bufs.begin());
+    queueUdpPacket(std::move(head), std::move(bufs), size, addr, addr_len);
+}
+
+void Socket::queueUdpPacket(Buffer::Ptr buf, vector<Buffer::Ptr> tail, size_t size, const struct sockaddr *addr, socklen_t addr_len) {
+    auto &cold = this->cold();
+    cold.udp_queue.emplace_back();
+    auto &pkt = cold.udp_queue.back();
+    pkt.addr_len = std::min<socklen_t>(addr_len, sizeof(pkt.addr));
+    if (pkt.addr_len) {
+        memcpy(&pkt.addr, addr, pkt.addr_len);
+    }
+    pkt.buf = std::move(buf);
+    pkt.tail = std::move(tail);
+    pkt.size = size;
+    cold.udp_queue_size += size;
+    //同一轮中的发送在 poller 本轮结束时一起发出
+    _defer_flush ? deferFlush() : (void)flushUdpData();
+    checkWatermark();
+}
+
+void Socket::sendFile(const string &path, const onSendFile &cb, uint64_t offset, uint64_t length, uint64_t rate) {
+    if (!_poller->is_current_thread()) {
+        weak_ptr<Socket> weak_self = shared_from_this();
+        _poller->async([weak_self, path, cb, offset, length, rate]() {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->sendFile(path, cb, offset, length, rate);
+            }
+        });
+        return;
+    }
+    if (!_sock_fd || _type != Sock_Tcp) {
+        if (cb) {
+            cb(SockException(ENOTCONN, "send file on invalid socket", Err_Other), 0);
+        }
+        return;
+    }
+    auto task = std::make_shared<FileSend>();
+    task->fd = ::open(path.data(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (task->fd == -1 || ::fstat(task->fd, &st) == -1) {
+        if (cb) {
+            cb(SockException(errno, "open " + path + " failed", Err_Other), 0);
+        }
+        return;
+    }
+    uint64_t file_size = st.st_size;
+    if (offset > file_size) {
+        if (cb) {
+            cb(SockException(EINVAL, "offset beyond end of " + path, Err_Other), 0);
+        }
+        return;
+    }
+    task->offset = offset;
+    task->remain = std::min(length, file_size - offset);
+    task->rate = rate;
+    task->cb = cb;
+    cold().file_queue.emplace_back(std::move(task));
+    if (!_connecting && !(_events & EPOLLOUT)) {
+        _defer_flush ? deferFlush() : (void)flushData();
+    }
+}
+
+bool Socket::flushFile() {
+    auto task = _cold->file_queue.front();
+    if (_cold->tls && !_cold->tls_ktls_send) {
+        //用户态加密只能先把文件读出来
+        task->use_read = true;
+    }
+    while (task->remain) {
+        if (_cold->pace_timer) {
+            return false;
+        }
+        size_t count = std::min<uint64_t>(task->remain, task->use_read ? s_file_read_size : s_file_chunk);
+        if (task->rate) {
+            //令牌桶，允许约 50ms 的突发
+            auto now = getCurrentMilliSecond();
+            if (!task->start_ms) {
+                task->start_ms = now;
+            }
+            uint64_t burst = std::max<uint64_t>(task->rate / 20, 16 * 1024);
+            uint64_t allow = (now - task->start_ms) * task->rate / 1000 + burst;
+            if (allow <= task->sent) {
+                //等到能再发半个突发量
+                uint64_t wait_ms = (task->sent - allow + burst / 2) * 1000 / task->rate + 1;
+                weak_ptr<Socket> weak_self = shared_from_this();
+                _cold->pace_timer = _poller->doDelayTask(wait_ms, [weak_self]() -> uint64_t {
+                    auto strong_self = weak_self.lock();
+                    if (strong_self) {
+                        strong_self->_cold->pace_timer = nullptr;
+                        strong_self->flushData();
+                    }
+                    return 0;
+                });
+                return false;
+            }
+            count = std::min<uint64_t>(count, allow - task->sent);
+        }
+
+        ssize_t ret;
+        if (task->use_read) {
+            auto buf = BufferRaw::create(count);
+            ret = ::pread(task->fd, buf->data(), count, task->offset);
+            if (ret > 0) {
+                //读出的数据交给发送队列，此时队列为空，顺序不变
+                buf->setSize(ret);
+                _send_chain.push_back(std::move(buf));
+            }
+        } else {
+            off_t off = task->offset;
+            ret = ::sendfile(rawFd(), task->fd, &off, count);
+        }
+        if (ret > 0) {
+            task->offset += ret;
+            task->remain -= ret;
+            task->sent += ret;
+            if (task->use_read) {
+                return true;
+            }
+            continue;
+        }
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && !task->use_read) {
+            return false;
+        }
+        if (ret == -1 && (errno == EINVAL || errno == ENOSYS) && !task->use_read) {
+            //文件系统不支持 sendfile
+            task->use_read = true;
+            continue;
+        }
+        //文件被截断或读取失败，连接上的数据已经不完整，只能断开
+        SockException ex(ret == 0 ? 0 : errno, ret == 0 ? "file truncated while sending" : "send file failed",
+                         ret == 0 ? Err_Eof : Err_Other);
+        if (task->cb) {
+            task->cb(ex, task->sent);
+        }
+        emitErr(ex);
+        return false;
+    }
+
+    //文件发完，排在它之后的数据进入发送队列
+    _cold->file_queue.pop_front();
+    _cold->file_after_size -= task->after.size();
+    _send_chain = std::move(task->after);
+    if (task->cb) {
+        task->cb(SockException(), task->sent);
+    }
+    return true;
+}
+
+bool Socket::flushData() {
+    _flush_pending = false;
+    //空闲连接没有分配不常用的状态, 文件、tls 和零拷贝只在分配了之后才检查
+    auto cold = _cold.get();
+    if (cold && cold->tls_handshaking) {
+        return true;
+    }
+    //超过内核 optmem 限制时本轮不再使用零拷贝
+    bool zc_blocked = false;
+    while (_sock_fd) {
+        if (_send_chain.empty() && !(cold && cold->tls_out)) {
+            if (!cold || cold->file_queue.empty() || !flushFile()) {
+                break;
+            }
+            continue;
+        }
+        if (cold && cold->tls && !cold->tls_ktls_send) {
+            auto ret = writeTls();
+            if (ret > 0 || (ret == -1 && errno == EINTR)) {
+                continue;
+            }
+            if (ret == -1 && errno == EAGAIN) {
+                break;
+            }
+            emitErr(SockException(ret == 0 ? 0 : errno, "tls send failed", ret == 0 ? Err_Eof : Err_Other));
+            return false;
+        }
+        struct iovec iov[s_max_iov];
+        auto count = _send_chain.toIovec(iov, s_max_iov);
+        size_t expect = 0;
+        for (size_t i = 0; i < count; ++i) {
+            expect += iov[i].iov_len;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        bool zero_copy = cold && cold->zc_enable && !zc_blocked && expect >= cold->zc_min_size;
+        //后面还有数据(一次写不下的 Buffer 或排队的文件), 让内核暂缓发出不满的报文
+        bool more = count < _send_chain.count() || (cold && !cold->file_queue.empty());
+        auto ret = ::sendmsg(rawFd(), &msg, MSG_NOSIGNAL | MSG_DONTWAIT | (zero_copy ? MSG_ZEROCOPY : 0) | (more ? MSG_MORE : 0));
+        if (ret > 0) {
+            if (zero_copy) {
+                //内核直接引用了这部分内存，持有到完成通知到达
+                cold->zc_pending.emplace_back();
+                auto &pending = cold->zc_pending.back();
+                pending.id = cold->zc_next_id++;
+                pending.done = false;
+                _send_chain.consume(ret, &pending.bufs);
+            } else {
+                _send_chain.consume(ret);
+            }
+            if ((size_t) ret < expect) {
+                //内核发送缓冲区已满
+                break;
+            }
+            continue;
+        }
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ret == -1 && errno == ENOBUFS && zero_copy) {
+            zc_blocked = true;
+            continue;
+        }
+        if (ret == -1 && errno == EOPNOTSUPP && zero_copy) {
+            //内核 tls 的软件加密路径不接受 MSG_ZEROCOPY
+            DebugL << "zero copy send unsupported, disable it on fd " << rawFd();
+            cold->zc_enable = false;
+            continue;
+        }
+        if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        emitErr(SockException(errno, "send failed", Err_Other));
+        return false;
+    }
+    if (!_sock_fd) {
+        return false;
+    }
+    //只在有数据积压时监听可写事件, 限速等待期间由定时器继续发送
+    enableWriteEvent(!_send_chain.empty() ||
+                     (cold && (cold->tls_out || cold->tls_read_want_write || (!cold->file_queue.empty() && !cold->pace_timer))));
+    checkWatermark();
+    return true;
+}
+
+ssize_t Socket::writeTls() {
+    auto &cold = *_cold;
+    if (!cold.tls_out) {
+        //凑满一个 tls 记录再加密，避免每个小 Buffer 都产生一个记录; 单个 Buffer 足够大时直接引用，不拷贝
+        struct iovec iov[s_max_iov];
+        auto count = _send_chain.toIovec(iov, s_max_iov);
+        size_t size = 0;
+        size_t pieces = 0;
+        while (pieces < count && size < s_tls_record_size) {
+            size += iov[pieces++].iov_len;
+        }
+        size = std::min(size, s_tls_record_size);
+        if (pieces == 1) {
+            std::vector<Buffer::Ptr> touched;
+            _send_chain.consume(size, &touched);
+            cold.tls_out = BufferSlice::create(touched[0], (char *)iov[0].iov_base - touched[0]->data(), size);
+        } else {
+            auto buf = BufferRaw::create(size);
+            size_t copied = 0;
+            for (size_t i = 0; copied < size; ++i) {
+                auto len = std::min(iov[i].iov_len, size - copied);
+                memcpy(buf->data() + copied, iov[i].iov_base, len);
+                copied += len;
+            }
+            buf->setSize(size);
+            _send_chain.consume(size);
+            cold.tls_out = std::move(buf);
+        }
+        cold.tls_out_offset = 0;
+    }
+    auto ret = cold.tls->write(cold.tls_out->data() + cold.tls_out_offset, cold.tls_out->size() - cold.tls_out_offset);
+    if (ret > 0) {
+        cold.tls_out_offset += ret;
+        if (cold.tls_out_offset >= cold.tls_out->size()) {
+            cold.tls_out = nullptr;
+            cold.tls_out_offset = 0;
+        }
+    }
+    return ret;
+}
+
+bool Socket::flushUdpData() {
+    _flush_pending = false;
+    //单次 sendmmsg 最多引用的 Buffer 个数
+    static constexpr size_t max_iov = 256;
+    struct mmsghdr msgs[s_udp_batch];
+    struct iovec iovs[max_iov];
+    //每个 mmsghdr 包含的报文个数
+    size_t pkt_counts[s_udp_batch];
+    char controls[s_udp_batch][CMSG_SPACE(sizeof(uint16_t))];
+
+    if (!_cold) {
+        //还没有排队过报文
+        return (bool)_sock_fd;
+    }
+    auto &cold = *_cold;
+    if (_sock_fd && cold.on_udp_flush && cold.udp_filtered < cold.udp_queue.size()) {
+        //本轮新排队的报文一次交给上层处理，之前发送失败留下的报文已经处理过
+        auto pkts = &cold.udp_queue[cold.udp_filtered];
+        auto count = cold.udp_queue.size() - cold.udp_filtered;
+        for (size_t i = 0; i < count; ++i) {
+            cold.udp_queue_size -= pkts[i].size;
+        }
+        cold.on_udp_flush(pkts, count);
+        //size 被置0的报文丢弃
+        auto end = std::remove_if(cold.udp_queue.begin() + cold.udp_filtered, cold.udp_queue.end(),
+                                  [](const UdpPacket &pkt) { return !pkt.size; });
+        cold.udp_queue.erase(end, cold.udp_queue.end());
+        for (auto i = cold.udp_filtered; i < cold.udp_queue.size(); ++i) {
+            cold.udp_queue_size += cold.udp_queue[i].size;
+        }
+        cold.udp_filtered = cold.udp_queue.size();
+    }
+    while (_sock_fd && cold.udp_head < cold.udp_queue.size()) {
+        size_t msg_count = 0;
+        size_t iov_count = 0;
+        auto it = cold.udp_queue.begin() + cold.udp_head;
+        while (msg_count < s_udp_batch && iov_count < max_iov && it != cold.udp_queue.end()) {
+            auto &first = *it;
+            auto &hdr = msgs[msg_count].msg_hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = first.addr_len ? &first.addr : nullptr;
+            hdr.msg_namelen = first.addr_len;
+            hdr.msg_iov = &iovs[iov_count];
+
+            //同一对端连续的等长报文(最后一个可以更短)合并成一个 UDP_SEGMENT 报文
+            size_t seg_size = first.size;
+            size_t segs = 0;
+            size_t total = 0;
+            size_t msg_iovs = 0;
+            bool full_seg = true;
+            while (it != cold.udp_queue.end() && iov_count + 1 + it->tail.size() <= max_iov) {
+                auto size = it->size;
+                if (segs && (!cold.udp_gso || !full_seg || size > seg_size || segs >= s_udp_gso_max_segs ||
+                             total + size > s_udp_gso_max_size || it->addr_len != first.addr_len ||
+                             memcmp(&it->addr, &first.addr, first.addr_len))) {
+                    break;
+                }
+                iovs[iov_count].iov_base = it->buf->data();
+                iovs[iov_count].iov_len = it->buf->size();
+                ++iov_count;
+                for (auto &piece : it->tail) {
+                    iovs[iov_count].iov_base = piece->data();
+                    iovs[iov_count].iov_len = piece->size();
+                    ++iov_count;
+                }
+                msg_iovs += 1 + it->tail.size();
+                ++segs;
+                total += size;
+                full_seg = size == seg_size;
+                ++it;
+            }
+            if (!segs) {
+                //剩余的 iovec 放不下下一个报文，留到下一次 sendmmsg
+                break;
+            }
+            hdr.msg_iovlen = msg_iovs;
+            if (segs > 1) {
+                hdr.msg_control = controls[msg_count];
+                hdr.msg_controllen = sizeof(controls[msg_count]);
+                auto cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t gso_size = seg_size;
+                memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+            }
+            pkt_counts[msg_count++] = segs;
+        }
+
+        int ret = ::sendmmsg(rawFd(), msgs, msg_count, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (pkt_counts[0] > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+                //内核或网卡不支持 UDP_SEGMENT, 退回逐个报文发送
+                WarnL << "udp gso unavailable, disabled: " << SockException(errno);
+                cold.udp_gso = false;
+                continue;
+            }
+            //udp 发送失败(如对端不可达)直接丢弃该报文，不影响后续发送
+            ret = 1;
+        }
+        size_t pkts = 0;
+        for (int i = 0; i < ret; ++i) {
+            pkts += pkt_counts[i];
+        }
+        for (size_t i = 0; i < pkts; ++i) {
+            auto &pkt = cold.udp_queue[cold.udp_head++];
+            cold.udp_queue_size -= pkt.size;
+            pkt.buf = nullptr;
+            pkt.tail.clear();
+        }
+    }
+    if (!_sock_fd) {
+        return false;
+    }
+    if (cold.udp_head == cold.udp_queue.size()) {
+        //发完后只保留少量容量，空闲socket不占用发送队列的内存
+        if (cold.udp_queue.capacity() > s_udp_keep_capacity) {
+            std::vector<UdpPacket>().swap(cold.udp_queue);
+        } else {
+            cold.udp_queue.clear();
+        }
+        cold.udp_head = 0;
+        cold.udp_filtered = 0;
+    } else if (cold.udp_head * 2 >= cold.udp_queue.size()) {
+        cold.udp_queue.erase(cold.udp_queue.begin(), cold.udp_queue.begin() + cold.udp_head);
+        cold.udp_filtered = cold.udp_filtered > cold.udp_head ? cold.udp_filtered - cold.udp_head : 0;
+        cold.udp_head = 0;
+    }
+    enableWriteEvent(cold.udp_head < cold.udp_queue.size());
+    checkWatermark();
+    return true;
+}
+
+void Socket::deferFlush() {
+    if (_flush_pending || (_events & EPOLLOUT) || _connecting || (_cold && _cold->tls_handshaking)) {
+        //已经安排了发送，或者正在等待可写事件/连接结果/tls 握手
+        return;
+    }
+    _flush_pending = true;
+    weak_ptr<Socket> weak_self = shared_from_this();
+    _poller->addFlushTask([weak_self]() {
+        auto strong_self = weak_self.lock();
+        if (strong_self && strong_self->_flush_pending) {
+            strong_self->onWriteable();
+        }
+    });
+}
+
+void Socket::flush() {
+    if (!_poller->is_current_thread()) {
+        weak_ptr<Socket> weak_self = shared_from_this();
+        _poller->async([weak_self]() {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->flush();
+            }
+        });
+        return;
+    }
+    if (!_sock_fd || _connecting || (_cold && _cold->tls_handshaking) || (_events & EPOLLOUT)) {
+        return;
+    }
+    onWriteable();
+}
+
+void Socket::startTls(const TlsContext::Ptr &ctx, const onConnectRes &cb, const string &server_name) {
+    if (!_poller->is_current_thread()) {
+        weak_ptr<Socket> weak_self = shared_from_this();
+        _poller->async([weak_self, ctx, cb, server_name]() {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->startTls(ctx, cb, server_name);
+            }
+        });
+        return;
+    }
+    if (!_sock_fd || _type != Sock_Tcp || _connecting || tlsEnabled()) {
+        if (cb) {
+            cb(SockException(EINVAL, "start tls on invalid socket", Err_Other));
+        }
+        return;
+    }
+    auto &cold = this->cold();
+    cold.tls = TlsStream::create(ctx, rawFd(), server_name);
+    if (!cold.tls) {
+        SockException ex(EINVAL, "create tls connection failed", Err_Other);
+        if (cb) {
+            closeSock();
+            cb(ex);
+        } else {
+            emitErr(ex);
+        }
+        return;
+    }
+    cold.tls_handshaking = true;
+    cold.on_tls = cb;
+    //客户端立即发出 ClientHello, 服务端等待对端数据
+    onTlsHandshake();
+}
+
+void Socket::enableWriteEvent(bool enable) {
+    if (!_sock_fd) {
+        return;
+    }
+    uint32_t events = enable ? (_events | EPOLLOUT) : (_events & ~EPOLLOUT);
+    if (events == _events) {
+        return;
+    }
+    _events = events;
+    _poller->modifyEvent(rawFd(), _events);
+}
+
+void Socket::checkWatermark() {
+    auto size = sendQueueSize();
+    if (!_flow_blocked && size >= _high_watermark) {
+        _flow_blocked = true;
+        if (_cold && _cold->on_flow_control) {
+            _cold->on_flow_control(true);
+        }
+    } else if (_flow_blocked && size <= _low_watermark) {
+        _flow_blocked = false;
+        if (_cold && _cold->on_flow_control) {
+            _cold->on_flow_control(false);
+        }
+    }
+}
+
+//---------------设置一些事件回调-----------------------//
+void Socket::setAcceptBeforceCB(const onAcceptBefore &cb) {
+    cold().on_before_accept = cb;
+}
+
+void Socket::setAcceptCB(const onAccept &cb) {
+    _on_accept = cb;
+}
+
+void Socket::setRecvCB(const onRecv &cb) {
+    _on_recv = cb;
+}
+
+void Socket::setRecvFromCB(const onRecvFrom &cb) {
+    _on_recv_from = cb;
+}
+
+void Socket::setErrorCB(const onError &cb) {
+    _on_err = cb;
+}
+
+void Socket::setFlowControlCB(const onFlowControl &cb) {
+    cold().on_flow_control = cb;
+}
+
+void Socket::setUdpFlushCB(const onUdpFlush &cb) {
+    cold().on_udp_flush = cb;
+}
+
+void Socket::setSendWatermark(size_t high, size_t low) {
+    _high_watermark = std::max<size_t>(high, 1);
+    _low_watermark = std::min(low, _high_watermark);
+}
+
+void Socket::setReadBufferSize(size_t size) {
+    _read_size = std::max<size_t>(size, 256);
+}
+
+void Socket::setUdpOffload(bool enable) {
+    if (!_sock_fd || _type != Sock_Udp) {
+        return;
+    }
+    auto &cold = this->cold();
+    cold.udp_gso = enable;
+    cold.udp_gro = SockUtil::setUdpGro(rawFd(), enable) && enable;
+    if (cold.udp_gro && _read_size < s_udp_gro_read_size) {
+        //合并后的报文最大接近64K, 接收缓冲区随之加大
+        _read_size = s_udp_gro_read_size;
+    }
+}
+
+void Socket::setZeroCopy(bool enable, size_t min_size) {
+    if (!_sock_fd || _type != Sock_Tcp) {
+        return;
+    }
+    auto &cold = this->cold();
+    cold.zc_min_size = min_size;
+    if (enable && !SockUtil::setZeroCopy(rawFd())) {
+        WarnL << "set SO_ZEROCOPY failed: " << SockException(errno);
+        enable = false;
+    }
+    cold.zc_enable = enable;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+SocketHelper::SocketHelper(const Socket::Ptr &sock) {
+    if (sock) {
+        _sock = sock;
+        _poller = sock->getPoller();
+    }
+}
+
+void SocketHelper::attachSock(const Socket::Ptr &sock) {
+    _sock = sock;
+    _poller = sock->getPoller();
+    weak_ptr<SocketHelper> weak_self = shared_from_this();
+    _sock->setRecvCB([weak_self](const Buffer::Ptr &buf) {
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            strong_self->onRecv(buf);
+        }
+    });
+    _sock->setErrorCB([weak_self](const SockException &ex) {
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            strong_self->onError(ex);
+        }
+    });
+    if (_flow_control) {
+        enableFlowControl();
+    }
+}
+
+void SocketHelper::enableFlowControl() {
+    _flow_control = true;
+    if (!_sock) {
+        return;
+    }
+    weak_ptr<SocketHelper> weak_self = shared_from_this();
+    _sock->setFlowControlCB([weak_self](bool blocked) {
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            strong_self->onFlowControl(blocked);
+        }
+    });
+    if (_sock->flowBlocked()) {
+        //注册之前已经超过高水位
+        onFlowControl(true);
+    }
 }
 
 string SocketHelper::get_peer_ip() {
-    return "";
+    return _sock ? _sock->get_peer_ip() : "";
 }
 
 string SocketHelper::get_local_ip() {
-    return "";
+    return _sock ? _sock->get_local_ip() : "";
 }
 
 uint16_t SocketHelper::get_peer_port() {
-    return 0;
+    return _sock ? _sock->get_peer_port() : 0;
 }
 
 uint16_t SocketHelper::get_local_port() {
-    return 0;
+    return _sock ? _sock->get_local_port() : 0;
+}
+
+void SocketHelper::send(Buffer::Ptr buf) {
+    if (_sock) {
+        _sock->send(std::move(buf));
+    }
+}
+
+void SocketHelper::send(const char *data, size_t size) {
+    if (_sock) {
+        _sock->send(data, size);
+    }
+}
+
+void SocketHelper::send(string str) {
+    if (_sock) {
+        _sock->send(std::move(str));
+    }
+}
+
+void SocketHelper::send(vector<Buffer::Ptr> bufs) {
+    if (_sock) {
+        _sock->send(std::move(bufs));
+    }
+}
+
+void SocketHelper::flush() {
+    if (_sock) {
+        _sock->flush();
+    }
+}
+
+void SocketHelper::sendFile(const string &path, const Socket::onSendFile &cb, uint64_t offset, uint64_t length,
+                            uint64_t rate) {
+    if (_sock) {
+        _sock->sendFile(path, cb, offset, length, rate);
+    } else if (cb) {
+        cb(SockException(ENOTCONN, "send file on invalid socket", Err_Other), 0);
+    }
+}
+
+void SocketHelper::shutdown(const SockException &ex) {
+    if (!_sock) {
+        return;
+    }
+    weak_ptr<SocketHelper> weak_self = shared_from_this();
+    _poller->async([weak_self, ex]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self || !strong_self->_sock) {
+            return;
+        }
+        //经由socket的错误回调通知，会话所有者可以借此清理
+        strong_self->_sock->emitErr(ex);
+    });
 }
 
 }
@@ -3,7 +3,11 @@
 
 #include "Util/Util.h"
 #include "SockUtil.h"
+#include "Buffer.h"
+#include "Tls.h"
+#include "threadpool/PollerThread.h"
 #include <functional>
+#include <list>
 
 #include <netdb.h>
 #include <arpa/inet.h>
@@ -13,6 +17,7 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
+#include <string.h>
 
 namespace beton {
 
@@ -50,6 +55,21 @@ private:
 /**
  * 一个socket应该包含 fd 的IO管理(创建，关闭，接收，发送)，以及网络建立管理(bind, connect, listen, accept)
  * socket 类属于事件发起的源头，应该绑定到一个线程上，使其仅在唯一线程处理事件，避免线程竞争
+ * 
+ * 1. 所有 fd 操作和回调都在所属 PollerThread 中执行，其他线程调用的接口会被切换到该线程
+ * 2. 读事件把数据读进 poller 线程共用的接收缓冲区，以切片交给上层; 上层保留了切片时该缓冲区归上层所有，
+ *    下次读取换一块新的; 空闲连接不持有接收内存，上层只需拷贝保存未凑成完整消息的尾部
+ * 3. 发送的数据先进入发送队列，poller 本轮事件处理完后用 sendmsg 把多个 Buffer 一次写出，
+ *    后面还有数据时带 MSG_MORE 让内核凑满报文；写不完才监听 EPOLLOUT，写完立即取消
+ * 4. 发送队列超过高水位、回落到低水位时通过回调通知上层做流控
+ * 5. udp 用 recvmmsg 批量接收；发送先排队，在 poller 本轮结束时用 sendmmsg 一次发出，
+ *    支持时用 UDP_SEGMENT/UDP_GRO 把同一对端的等长报文交给内核/网卡分段与合并;
+ *    发出前可以由上层对整批报文做一次变换(如 srtp 加密)
+ * 6. tcp 可选 MSG_ZEROCOPY, 大块数据由内核直接引用 Buffer 的内存，不再逐连接拷贝
+ * 7. 文件用 sendfile 从页缓存直接发到socket, 与 Buffer 按调用顺序排队，可以限速
+ * 8. 域名经 DnsResolver 异步解析，有多个地址时按 Happy Eyeballs 交替尝试 ipv6/ipv4
+ * 9. tcp 可以在连接建立后开启 tls, 握手在用户态完成，之后尽量把加解密交给内核(kTLS),
+ *    发送仍走上面的 sendmsg/sendfile/零拷贝路径; 内核不支持时在用户态按 tls 记录大小加密发送
 */
 
 class Socket : public SockInfo, public noncopyable, public std::enable_shared_from_this<Socket> {
@@ -57,11 +77,40 @@ public:
     using Ptr = std::shared_ptr<Socket>;
     using onConnectRes = std::function<void(const SockException &ex)>;
     using onError = std::function<void(const SockException &ex)>;
-    using onAcceptBefore = std::function<void(int sockfd)>;
+    //accept 前回调，用于决定新连接由哪个线程处理，返回空则由监听线程处理
+    using onAcceptBefore = std::function<Socket::Ptr(const PollerThread::Ptr &poller)>;
     using onAccept = std::function<void(const Socket::Ptr &sock)>;
-    using onRecv = std::function<void(const std::string &data)>;
+    /**
+     * 收到的数据, tcp 为线程接收缓冲区的切片, 上层可以再切片、转发或保存引用
+     * 保存引用会连带持有整块接收缓冲区，只需保存少量数据(如不完整消息的尾部)时应拷贝出来
+    */
+    using onRecv = std::function<void(const Buffer::Ptr &buf)>;
+    //udp 收到的数据及其来源地址
+    using onRecvFrom = std::function<void(const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t addr_len)>;
+    //发送队列水位变化，blocked 为 true 表示超过高水位，上层应暂停发送；false 表示已回落到低水位
+    using onFlowControl = std::function<void(bool blocked)>;
+    //文件发送结束，ex 为空表示成功; sent 为已发送的字节数
+    using onSendFile = std::function<void(const SockException &ex, uint64_t sent)>;
+
+    //udp 发送队列中的一个报文
+    struct UdpPacket {
+        Buffer::Ptr buf;
+        //分散写的其余片段，大多数报文为空
+        std::vector<Buffer::Ptr> tail;
+        //报文总长度
+        size_t size;
+        socklen_t addr_len;
+        struct sockaddr_storage addr;
+    };
+    /**
+     * sendmmsg 之前对新排队的udp报文做一次批量处理，如 srtp 加密
+     * 每个报文只经过一次回调; 回调可以替换 buf/tail, 同时必须更新 size, 把 size 置0表示丢弃
+    */
+    using onUdpFlush = std::function<void(UdpPacket *pkts, size_t count)>;
+
+    static Ptr create(const PollerThread::Ptr &poller = nullptr);
 
-    Socket(SockInfo::SockType type);
+    Socket(const PollerThread::Ptr &poller = nullptr);
     ~Socket();
 
     //------------------SockInfo----------------//
@@ -87,8 +136,69 @@ public:
      * @param port: 监听端口
      * @param bind_addr: 指定监听的网卡/IP, 空IP即监听所有网卡/IP
      * @param backlog: 最大排队队列，包含了 [未就绪] 和 [已就绪] 连接, 默认1024
+     * @param reuse_port: 设置 SO_REUSEPORT, 允许多个socket监听同一端口，由内核分配连接
+    */
+    bool listen(uint16_t port, const std::string &bind_addr = "::", int backlog = 1024, bool reuse_port = false);
+
+    /**
+     * 创建udp socket
+     * @param port: 绑定端口, 0 由内核分配
+     * @param bind_addr: 绑定的网卡/IP
+     * @param reuse_port: 设置 SO_REUSEPORT
+    */
+    bool bindUdp(uint16_t port, const std::string &bind_addr = "::", bool reuse_port = false);
+
+    /**
+     * 设置udp的默认对端地址，之后 send() 都发往该地址
+     * @param connect: 同时 connect() 到该地址，内核只接收该对端的数据
+    */
+    bool bindPeerAddr(const struct sockaddr *addr, socklen_t addr_len, bool connect = false);
+
+    //接管一个已经建立的fd, 比如 accept 得到的连接, 必须在所属 poller 线程调用
+    bool attachFd(int fd, SockType type);
+
+    //关闭socket, 清空发送队列, 不会触发错误回调
+    void closeSock();
+    //关闭socket并触发错误回调，让socket的所有者(如服务器的会话列表)得到通知, 必须在所属 poller 线程调用
+    void emitErr(const SockException &ex);
+
+    //------------------数据发送---------------------//
+    //Buffer 进入发送队列后不再拷贝，调用者之后不应修改其内容
+    void send(Buffer::Ptr buf);
+    void send(const char *data, size_t size);
+    void send(std::string str);
+    //udp 发送到指定地址
+    void sendTo(Buffer::Ptr buf, const struct sockaddr *addr, socklen_t addr_len);
+    /**
+     * 发送由多个 Buffer 拼成的一段数据，比如协议头 + 负载切片，不拷贝
+     * tcp 依次进入发送队列; udp 作为一个报文，用分散写发出
+    */
+    void send(std::vector<Buffer::Ptr> bufs);
+    void sendTo(std::vector<Buffer::Ptr> bufs, const struct sockaddr *addr, socklen_t addr_len);
+    /**
+     * tcp 发送文件的一段, 用 sendfile 直接从页缓存写入socket, 不经过用户态内存
+     * 文件排在之前 send 的数据之后，之后 send 的数据等文件发完再发送
+     * @param path: 文件路径
+     * @param cb: 发送结束回调，在 poller 线程执行; 文件读取失败时连接随后被关闭
+     * @param offset: 起始偏移，可配合 File::parseRange 处理 HTTP Range
+     * @param length: 发送长度，超过文件末尾时截断
+     * @param rate: 限速，字节/秒, 0 不限速
+    */
+    void sendFile(const std::string &path, const onSendFile &cb = nullptr, uint64_t offset = 0,
+                  uint64_t length = UINT64_MAX, uint64_t rate = 0);
+
+    //立即写出发送队列中的数据，不等 poller 本轮结束，用于对时延敏感的控制消息
+    void flush();
+
+    /**
+     * 在已建立的 tcp 连接上开启 tls, 角色(服务端/客户端)由 ctx 决定
+     * 握手期间 send 的数据(包括调用之前仍在发送队列中的)在握手完成后加密发送，收到的数据解密后交给 onRecv
+     * 握手完成后如果内核支持，加解密交给内核(kTLS), 之后发送不再经过用户态加密，sendfile 和零拷贝依然有效
+     * @param ctx: tls 配置
+     * @param cb: 握手结果回调，失败时socket已关闭; 为空时失败经由错误回调通知
+     * @param server_name: 客户端的 SNI 以及证书校验的域名
     */
-    void listen(uint16_t port, const std::string &bind_addr = "::", int backlog = 1024);
+    void startTls(const TlsContext::Ptr &ctx, const onConnectRes &cb = nullptr, const std::string &server_name = "");
 
     //---------------设置一些事件回调-----------------------//
     void setAcceptBeforceCB(const onAcceptBefore &cb);
@@ -97,17 +207,237 @@ public:
 
     void setRecvCB(const onRecv &cb);
 
+    void setRecvFromCB(const onRecvFrom &cb);
+
     void setErrorCB(const onError &cb);
 
+    void setFlowControlCB(const onFlowControl &cb);
+
+    void setUdpFlushCB(const onUdpFlush &cb);
+
+    //---------------属性---------------------------------//
+    //设置发送队列的高低水位(字节)
+    void setSendWatermark(size_t high, size_t low);
+    //每次读操作的最大长度，数据读进 poller 线程共用的缓冲区; udp 报文超过该长度会被截断丢弃
+    void setReadBufferSize(size_t size);
+    /**
+     * 是否把一轮事件处理中的多次 send 合并到本轮结束时一次写出，默认开启
+     * 关闭后每次 send 都立即写入内核
+    */
+    void setDeferFlush(bool enable) { _defer_flush = enable; }
+    /**
+     * 开启 udp 分段/合并卸载，需要在 bindUdp 之后调用
+     * 发送时同一对端连续的等长报文合并为一次 UDP_SEGMENT 发送，接收时开启 UDP_GRO 并把合并的报文切回原样
+     * 内核或网卡不支持时自动退回普通收发
+    */
+    void setUdpOffload(bool enable);
+    /**
+     * 开启 tcp 零拷贝发送(MSG_ZEROCOPY), 需要在连接建立之后、在所属 poller 线程调用
+     * 单次写出不少于 min_size 字节时内核直接引用发送队列中 Buffer 的内存，这些 Buffer 被持有到内核
+     * 通过错误队列通知发送完成; 小块写入、内核不支持、或内核报告实际做了拷贝(如回环)时使用普通发送
+     * 适合同一份帧数据发给大量连接的场合
+    */
+    void setZeroCopy(bool enable, size_t min_size = 16 * 1024);
+
+    int rawFd() const;
+    SockType sockType() const { return _type; }
+    const PollerThread::Ptr &getPoller() const { return _poller; }
+    //发送队列中尚未写入内核的字节数
+    size_t sendQueueSize() const {
+        auto size = _send_chain.size();
+        if (_cold) {
+            size += _cold->file_after_size + _cold->udp_queue_size + (_cold->tls_out ? _cold->tls_out->size() - _cold->tls_out_offset : 0);
+        }
+        return size;
+    }
+    bool flowBlocked() const { return _flow_blocked; }
+    //内核因接收缓冲区满而丢弃的udp包数(SO_RXQ_OVFL), 累计值
+    uint32_t udpDropCount() const { return _cold ? _cold->udp_drop_count : 0; }
+    //超过读取长度而被截断丢弃的udp包数, 累计值
+    uint64_t udpTruncCount() const { return _cold ? _cold->udp_trunc_count : 0; }
+    //已交给内核、尚未收到完成通知的零拷贝发送次数
+    size_t zeroCopyPending() const { return _cold ? _cold->zc_pending.size() : 0; }
+    //是否开启了 tls, 以及发送方向是否已由内核加密
+    bool tlsEnabled() const { return _cold && _cold->tls; }
+    bool ktlsSend() const { return _cold && _cold->tls_ktls_send; }
+
 private:
-    
+    void onSockEvent(int event);
+    void onConnected(const SockException &ex);
+    void onAcceptable();
+    void onReadable();
+    void onUdpReadable();
+    void onUdpPacket(const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t addr_len);
+    void onWriteable();
+    void onTlsReadable();
+    void onTlsHandshake();
+    //读取错误队列中的零拷贝完成通知，返回是否读到了通知
+    bool onErrQueue();
+    void onZeroCopyDone(uint32_t lo, uint32_t hi);
 
-};
+    void connectAddr(const struct sockaddr_storage &addr, uint8_t timeout_sec,
+                     const std::string &bind_addr, uint16_t bind_port);
+    //创建非阻塞socket并发起连接，失败返回-1
+    int createConnectFd(const struct sockaddr_storage &addr, const std::string &bind_addr, uint16_t bind_port,
+                        SockException &ex);
+    void startConnectTimer(uint8_t timeout_sec);
+    //对多个地址竞速连接
+    void startRace(const std::vector<struct sockaddr_storage> &addrs, uint16_t port, uint8_t timeout_sec,
+                   const std::string &bind_addr, uint16_t bind_port);
+    void raceNext();
+    void onRaceEvent(SockFd *attempt, int event);
+    bool flushData();
+    //用户态加密写出一个 tls 记录, 返回值同 send
+    ssize_t writeTls();
+    //发送队列头部的文件，返回 false 表示需要等待可写或限速
+    bool flushFile();
+    bool flushUdpData();
+    void queueUdpPacket(Buffer::Ptr buf, std::vector<Buffer::Ptr> tail, size_t size, const struct sockaddr *addr, socklen_t addr_len);
+    void deferFlush();
+    void enableWriteEvent(bool enable);
+    void checkWatermark();
+    struct ColdState;
+    //取出不常用的状态，第一次使用时分配
+    ColdState &cold();
+
+private:
+    struct FileSend {
+        using Ptr = std::shared_ptr<FileSend>;
+        ~FileSend() {
+            if (fd != -1) {
+                ::close(fd);
+            }
+        }
+        int fd = -1;
+        //sendfile 不可用时退回 pread
+        bool use_read = false;
+        uint64_t offset = 0;
+        uint64_t remain = 0;
+        uint64_t sent = 0;
+        uint64_t rate = 0;
+        uint64_t start_ms = 0;
+        onSendFile cb;
+        //文件之后 send 的数据
+        BufferChain after;
+    };
+
+    //Happy Eyeballs 连接竞速
+    struct ConnectRace {
+        using Ptr = std::shared_ptr<ConnectRace>;
+        //已按 ipv6/ipv4 交替排列
+        std::vector<struct sockaddr_storage> addrs;
+        size_t next = 0;
+        std::string bind_addr;
+        uint16_t bind_port = 0;
+        //正在进行的连接
+        std::vector<std::shared_ptr<SockFd> > attempts;
+        //上一个连接迟迟没有结果时发起下一个
+        PollerThread::DelayTask::Ptr timer;
+        SockException last_err;
+    };
+
+    //一次零拷贝发送引用的 Buffer
+    struct ZeroCopySend {
+        uint32_t id;
+        bool done;
+        std::vector<Buffer::Ptr> bufs;
+    };
+
+    /**
+     * 空闲 tcp 连接用不到的状态: 连接过程、文件发送、udp 发送队列、零拷贝、tls、udp 对端地址以及很少设置的回调
+     * 第一次用到时才分配(见 cold()), closeSock 只重置其中的连接状态; 只为连接过程分配的在连接结束后释放
+     * 大量空闲连接时每个 Socket 只有下面的常用成员
+    */
+    struct ColdState {
+        ColdState() { memset(&peer_addr, 0, sizeof(peer_addr)); }
+        //是否有成员不是初始值
+        bool inUse() const;
+
+        PollerThread::DelayTask::Ptr connect_timer;
+        //每次 connect 生成一个新标记，用于丢弃过期的异步域名解析结果
+        std::shared_ptr<bool> connect_token;
+        ConnectRace::Ptr race;
+
+        //等待发送的文件, 以及排在文件之后的数据量
+        std::list<FileSend::Ptr> file_queue;
+        size_t file_after_size = 0;
+        //文件限速时等待的定时器
+        PollerThread::DelayTask::Ptr pace_timer;
+
+        //udp 发送队列，每个包可能有不同的目标地址; udp_head 之前的已经发出
+        size_t udp_queue_size = 0;
+        size_t udp_head = 0;
+        std::vector<UdpPacket> udp_queue;
+        //udp_queue 中已经过 onUdpFlush 处理的报文个数(从头算)
+        size_t udp_filtered = 0;
+        bool udp_gso = false;
+        bool udp_gro = false;
+        //已 connect 的udp socket 发送时不带地址
+        bool udp_connected = false;
+        uint32_t udp_drop_count = 0;
+        uint64_t udp_trunc_count = 0;
+        //udp 默认对端地址
+        socklen_t peer_addr_len = 0;
+        struct sockaddr_storage peer_addr;
 
+        //零拷贝发送
+        bool zc_enable = false;
+        size_t zc_min_size = 0;
+        //下一次零拷贝发送的序号，与内核为该socket分配的序号一致
+        uint32_t zc_next_id = 0;
+        //按序号排列，完成通知到达后从头部释放
+        std::list<ZeroCopySend> zc_pending;
 
+        //tls 连接，握手完成前不发送应用数据
+        TlsStream::Ptr tls;
+        bool tls_handshaking = false;
+        //发送方向已交给内核，直接写明文
+        bool tls_ktls_send = false;
+        //读操作需要先写出数据(如 tls1.3 KeyUpdate), 等可写后重试读
+        bool tls_read_want_write = false;
+        //用户态加密时正在写出的 tls 记录，写不完时必须用同样的数据重试
+        Buffer::Ptr tls_out;
+        size_t tls_out_offset = 0;
+        onConnectRes on_tls;
+
+        onAcceptBefore on_before_accept;
+        onFlowControl on_flow_control;
+        onUdpFlush on_udp_flush;
+    };
+
+    SockType _type = Sock_Invalid;
+    bool _connecting = false;
+    bool _flow_blocked = false;
+    //发送推迟到 poller 本轮结束
+    bool _defer_flush = true;
+    //已经在 poller 本轮结束时安排了发送
+    bool _flush_pending = false;
+    //当前注册到 epoll 的事件
+    uint32_t _events = 0;
+    size_t _read_size = 0;
+    size_t _high_watermark = 4 * 1024 * 1024;
+    size_t _low_watermark = 1024 * 1024;
+
+    std::shared_ptr<SockFd> _sock_fd;
+    PollerThread::Ptr _poller;
+    //tcp 发送队列
+    BufferChain _send_chain;
+    std::unique_ptr<ColdState> _cold;
+
+    onConnectRes _on_connect;
+    onError _on_err;
+    onAccept _on_accept;
+    onRecv _on_recv;
+    onRecvFrom _on_recv_from;
+};
+
+//socket 的使用者基类，比如 tcp 客户端、服务端会话，负责把 socket 的回调转发给虚函数
 class SocketHelper : public SockInfo, public std::enable_shared_from_this<SocketHelper> {
 public:
-    SocketHelper();
+    using Ptr = std::shared_ptr<SocketHelper>;
+
+    SocketHelper(const Socket::Ptr &sock = nullptr);
+    virtual ~SocketHelper() = default;
 
     //---------------sockInfo------------------//
     std::string get_peer_ip() override;
@@ -115,9 +445,42 @@ public:
     uint16_t get_peer_port() override;
     uint16_t get_local_port() override;
 
+    /**
+     * 绑定socket，把socket的各种回调转发到本对象的虚函数
+     * 需要 shared_from_this，所以不能在构造函数中调用
+    */
+    void attachSock(const Socket::Ptr &sock);
+    const Socket::Ptr &getSock() const { return _sock; }
+    const PollerThread::Ptr &getPoller() const { return _poller; }
+
+    void send(Buffer::Ptr buf);
+    void send(const char *data, size_t size);
+    void send(std::string str);
+    void send(std::vector<Buffer::Ptr> bufs);
+    void flush();
+    void sendFile(const std::string &path, const Socket::onSendFile &cb = nullptr, uint64_t offset = 0,
+                  uint64_t length = UINT64_MAX, uint64_t rate = 0);
 
-private:
+    //主动断开连接，会触发 onError
+    void shutdown(const SockException &ex = SockException(0, "shutdown", Err_Shutdown));
+    /**
+     * 开始接收发送队列的水位通知(onFlowControl), 之后 attachSock 的socket 也会注册
+     * 只有需要流控的会话(如播放)才调用，避免每个空闲连接都为此分配 socket 的额外状态; 不能在构造函数中调用
+    */
+    void enableFlowControl();
+
+    //---------------事件------------------//
+    virtual void onRecv(const Buffer::Ptr &buf) = 0;
+    virtual void onError(const SockException &ex) = 0;
+    //发送队列水位变化
+    virtual void onFlowControl(bool blocked) {}
 
+protected:
+    Socket::Ptr _sock;
+    PollerThread::Ptr _poller;
+
+private:
+    bool _flow_control = false;
 };
 
 }
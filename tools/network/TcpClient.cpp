@@ -0,0 +1,46 @@
+#include "TcpClient.h"
+#include "threadpool/ThreadPool.h"
+
+using namespace std;
+
+namespace beton {
+
+TcpClient::TcpClient(const PollerThread::Ptr &poller) {
+    _poller = poller ? poller : ThreadPool::Instance().getPoller();
+}
+
+void TcpClient::startConnect(const string &host, uint16_t port, uint8_t timeout_sec, uint16_t local_port) {
+    weak_ptr<TcpClient> weak_self = static_pointer_cast<TcpClient>(shared_from_this());
+    _poller->async([=]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return;
+        }
+        if (_sock) {
+            _sock->closeSock();
+        }
+        _alive = false;
+        auto sock = Socket::create(_poller);
+        attachSock(sock);
+        auto tls_ctx = _tls_ctx;
+        auto on_connect = [weak_self](const SockException &ex) {
+            auto strong_self = weak_self.lock();
+            if (!strong_self) {
+                return;
+            }
+            strong_self->_alive = !ex;
+            strong_self->onConnect(ex);
+        };
+        weak_ptr<Socket> weak_sock = sock;
+        sock->connect(host, [weak_sock, tls_ctx, host, on_connect](const SockException &ex) {
+            auto strong_sock = weak_sock.lock();
+            if (ex || !tls_ctx || !strong_sock) {
+                on_connect(ex);
+                return;
+            }
+            strong_sock->startTls(tls_ctx, on_connect, host);
+        }, port, timeout_sec, "", local_port);
+    });
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef __TCP_CLIENT_H__
+#define __TCP_CLIENT_H__
+
+#include "Socket.h"
+
+namespace beton {
+
+//tcp 客户端，继承后实现 onConnect/onRecv/onError
+class TcpClient : public SocketHelper {
+public:
+    using Ptr = std::shared_ptr<TcpClient>;
+
+    TcpClient(const PollerThread::Ptr &poller = nullptr);
+    ~TcpClient() override = default;
+
+    /**
+     * 发起连接，结果通过 onConnect 回调，重复调用会先断开之前的连接
+     * @param host: 目标IP或者域名
+     * @param port: 目标端口
+     * @param timeout_sec: 连接超时
+     * @param local_port: 绑定的本地端口, 0 由内核分配
+    */
+    virtual void startConnect(const std::string &host, uint16_t port, uint8_t timeout_sec = 5, uint16_t local_port = 0);
+
+    /**
+     * 连接建立后开启 tls, 握手完成后才回调 onConnect, 需要在 startConnect 之前设置
+     * 连接的域名同时作为 SNI 和证书校验的域名
+    */
+    void setTls(const TlsContext::Ptr &ctx) { _tls_ctx = ctx; }
+
+    //是否已经连接成功
+    bool alive() const { return _alive && _sock && _sock->rawFd() != -1; }
+
+protected:
+    virtual void onConnect(const SockException &ex) = 0;
+
+private:
+    bool _alive = false;
+    TlsContext::Ptr _tls_ctx;
+};
+
+}
+#endif  //__TCP_CLIENT_H__
@@ -0,0 +1,152 @@
+#include "TcpServer.h"
+#include "SessionManager.h"
+#include "threadpool/ThreadPool.h"
+
+using namespace std;
+
+namespace beton {
+
+TcpServer::TcpServer() {}
+
+TcpServer::~TcpServer() {
+    stop();
+}
+
+bool TcpServer::start(uint16_t port, const string &host, int backlog, const onCreateSession &cb) {
+    stop();
+    if (!cb) {
+        return false;
+    }
+    _on_create_session = cb;
+    _port = port;
+
+    for (auto &poller : ThreadPool::Instance().getAllPollers()) {
+        auto acceptor = std::make_shared<Acceptor>();
+        acceptor->sock = Socket::create(poller);
+        _acceptors.emplace_back(std::move(acceptor));
+    }
+    if (_acceptors.empty()) {
+        return false;
+    }
+
+    //第一个监听socket决定端口，之后的都绑定到同一个端口
+    bool reuse_port = _reuse_port;
+    if (!startAcceptor(_acceptors[0], host, backlog, reuse_port)) {
+        if (!reuse_port || !startAcceptor(_acceptors[0], host, backlog, false)) {
+            stop();
+            return false;
+        }
+        reuse_port = false;
+        WarnL << "SO_REUSEPORT unavailable, fall back to single acceptor on port " << _port;
+    }
+
+    size_t acceptor_count = 1;
+    for (size_t i = 1; reuse_port && i < _acceptors.size(); ++i) {
+        if (startAcceptor(_acceptors[i], host, backlog, reuse_port)) {
+            ++acceptor_count;
+        }
+    }
+    InfoL << "tcp server listen on " << host << ":" << _port << ", acceptors: " << acceptor_count
+          << (reuse_port && _incoming_cpu ? ", incoming cpu steering" : "");
+    return true;
+}
+
+bool TcpServer::startAcceptor(const Acceptor::Ptr &acceptor, const string &host, int backlog, bool reuse_port) {
+    auto &sock = acceptor->sock;
+    weak_ptr<TcpServer> weak_self = shared_from_this();
+    //回调里只持有监听时的快照，重新 start 不影响已经在路上的连接; 用弱引用避免循环引用
+    vector<weak_ptr<Acceptor> > acceptors(_acceptors.begin(), _acceptors.end());
+
+    if (!reuse_port) {
+        //单个监听socket, 新连接轮流交给各个 poller
+        sock->setAcceptBeforceCB([](const PollerThread::Ptr &) -> Socket::Ptr {
+            return Socket::create(ThreadPool::Instance().getPoller());
+        });
+    }
+    sock->setAcceptCB([weak_self, acceptors](const Socket::Ptr &peer) {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return;
+        }
+        for (auto &weak_acceptor : acceptors) {
+            auto acceptor = weak_acceptor.lock();
+            if (acceptor && acceptor->sock->getPoller() == peer->getPoller()) {
+                strong_self->onAccept(acceptor, peer);
+                return;
+            }
+        }
+    });
+
+    bool success = false;
+    sock->getPoller()->sync([&]() {
+        success = sock->listen(_port, host, backlog, reuse_port);
+        if (!success) {
+            return;
+        }
+        _port = sock->get_local_port();
+        auto cpu = sock->getPoller()->cpuIndex();
+        if (reuse_port && _incoming_cpu && cpu >= 0 && !SockUtil::setIncomingCpu(sock->rawFd(), cpu)) {
+            WarnL << "set SO_INCOMING_CPU failed: " << SockException(errno);
+        }
+    });
+    return success;
+}
+
+void TcpServer::onAccept(const Acceptor::Ptr &acceptor, const Socket::Ptr &sock) {
+    Session::Ptr session;
+    try {
+        session = _on_create_session(sock);
+    } catch (std::exception &ex) {
+        WarnL << "create session failed: " << ex.what();
+    }
+    if (!session) {
+        sock->closeSock();
+        return;
+    }
+    session->attachSock(sock);
+
+    auto key = session.get();
+    acceptor->sessions.emplace(key, session);
+    ++_session_count;
+    SessionManager::Instance().add(session);
+
+    //会话出错时先回调给会话，再从列表中移除
+    weak_ptr<TcpServer> weak_self = shared_from_this();
+    weak_ptr<Acceptor> weak_acceptor = acceptor;
+    weak_ptr<Session> weak_session = session;
+    sock->setErrorCB([weak_self, weak_acceptor, weak_session, key](const SockException &ex) {
+        auto strong_session = weak_session.lock();
+        if (strong_session) {
+            strong_session->onError(ex);
+        }
+        auto strong_acceptor = weak_acceptor.lock();
+        if (strong_acceptor && strong_acceptor->sessions.erase(key)) {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                --strong_self->_session_count;
+            }
+        }
+    });
+    if (_tls_ctx) {
+        sock->startTls(_tls_ctx);
+    }
+}
+
+void TcpServer::stop() {
+    auto acceptors = std::move(_acceptors);
+    _acceptors.clear();
+    _session_count = 0;
+    for (auto &acceptor : acceptors) {
+        acceptor->sock->getPoller()->async([acceptor]() {
+            acceptor->sock->closeSock();
+            auto sessions = std::move(acceptor->sessions);
+            acceptor->sessions.clear();
+            for (auto &pr : sessions) {
+                pr.second->getSock()->closeSock();
+                pr.second->onError(SockException(0, "server shutdown", Err_Shutdown));
+            }
+        });
+    }
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef __TCP_SERVER_H__
+#define __TCP_SERVER_H__
+
+#include "Session.h"
+#include <unordered_map>
+
+namespace beton {
+
+/**
+ * tcp 服务器，每个 PollerThread 持有一个 SO_REUSEPORT 监听socket:
+ * 1. 内核按四元组哈希把新连接分给各个监听socket，accept 不再集中在一个线程
+ * 2. 可选 SO_INCOMING_CPU, 连接交给收到其数据包的cpu所绑定的 poller 处理
+ * 3. 连接在 accept 它的 poller 上创建会话，此后所有IO都不跨线程
+ * 内核不支持 SO_REUSEPORT 时退化为单个监听socket, 新连接轮流分配到各个 poller
+ * 设置了 tls 配置时，会话创建后立即开始 tls 握手，会话收发的都是明文
+*/
+class TcpServer : public noncopyable, public std::enable_shared_from_this<TcpServer> {
+public:
+    using Ptr = std::shared_ptr<TcpServer>;
+    using onCreateSession = std::function<Session::Ptr(const Socket::Ptr &sock)>;
+
+    TcpServer();
+    ~TcpServer();
+
+    /**
+     * 开始监听
+     * @param port: 监听端口, 0 由内核分配，所有监听socket共用该端口
+     * @param host: 监听的网卡/IP
+     * @param backlog: 每个监听socket的排队队列长度
+    */
+    template <typename SessionType>
+    bool start(uint16_t port, const std::string &host = "::", int backlog = 1024) {
+        return start(port, host, backlog, [](const Socket::Ptr &sock) -> Session::Ptr {
+            return std::make_shared<SessionType>(sock);
+        });
+    }
+
+    bool start(uint16_t port, const std::string &host, int backlog, const onCreateSession &cb);
+
+    //停止监听并断开所有会话
+    void stop();
+
+    //是否每个 poller 一个 SO_REUSEPORT 监听socket, 需要在 start 之前设置, 默认开启; 关闭时与内核不支持时相同
+    void setReusePort(bool enable) { _reuse_port = enable; }
+    //是否使用 SO_INCOMING_CPU, 需要在 start 之前设置, 默认开启
+    void setIncomingCpu(bool enable) { _incoming_cpu = enable; }
+    //开启 tls(如 RTMPS/HTTPS), 需要在 start 之前设置; 握手失败的连接经由会话的 onError 通知
+    void setTls(const TlsContext::Ptr &ctx) { _tls_ctx = ctx; }
+
+    uint16_t getPort() const { return _port; }
+    //监听socket个数
+    size_t acceptorCount() const { return _acceptors.size(); }
+    //当前会话数
+    size_t sessionCount() const { return _session_count; }
+
+private:
+    //每个 poller 上的监听socket及其接受的会话，只在该 poller 线程访问
+    struct Acceptor {
+        using Ptr = std::shared_ptr<Acceptor>;
+        Socket::Ptr sock;
+        std::unordered_map<Session *, Session::Ptr> sessions;
+    };
+
+    bool startAcceptor(const Acceptor::Ptr &acceptor, const std::string &host, int backlog, bool reuse_port);
+    void onAccept(const Acceptor::Ptr &acceptor, const Socket::Ptr &sock);
+
+private:
+    bool _reuse_port = true;
+    bool _incoming_cpu = true;
+    uint16_t _port = 0;
+    std::atomic<size_t> _session_count = {0};
+    onCreateSession _on_create_session;
+    TlsContext::Ptr _tls_ctx;
+    std::vector<Acceptor::Ptr> _acceptors;
+};
+
+}
+#endif  //__TCP_SERVER_H__
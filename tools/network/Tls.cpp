@@ -0,0 +1,263 @@
+#include "Tls.h"
+#include "Util/Logger.h"
+#include <errno.h>
+#include <climits>
+
+#ifdef ENABLE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+#endif
+
+using namespace std;
+
+namespace beton {
+
+#ifdef ENABLE_OPENSSL
+
+//取出并清空 OpenSSL 线程错误队列，拼成一条说明
+static string getSslErrors() {
+    string ret;
+    unsigned long err;
+    while ((err = ERR_get_error()) != 0) {
+        char buf[256];
+        ERR_error_string_n(err, buf, sizeof(buf));
+        if (!ret.empty()) {
+            ret += "; ";
+        }
+        ret += buf;
+    }
+    return ret;
+}
+
+static SSL_CTX *newSslCtx(bool server) {
+    auto ctx = SSL_CTX_new(server ? TLS_server_method() : TLS_client_method());
+    if (!ctx) {
+        return nullptr;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    //发送队列中的 Buffer 在重试之间可能被整理，允许重试时换用新的地址
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+    return ctx;
+}
+
+TlsContext::Ptr TlsContext::createServer(const string &cert_file, const string &key_file) {
+    auto ctx = newSslCtx(true);
+    if (!ctx) {
+        WarnL << "create tls server context failed: " << getSslErrors();
+        return nullptr;
+    }
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_file.data()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, key_file.data(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        WarnL << "load tls certificate " << cert_file << " failed: " << getSslErrors();
+        SSL_CTX_free(ctx);
+        return nullptr;
+    }
+    return Ptr(new TlsContext(ctx, true, false));
+}
+
+TlsContext::Ptr TlsContext::createClient(bool verify, const string &ca_file) {
+    auto ctx = newSslCtx(false);
+    if (!ctx) {
+        WarnL << "create tls client context failed: " << getSslErrors();
+        return nullptr;
+    }
+    if (verify) {
+        int ret = ca_file.empty() ? SSL_CTX_set_default_verify_paths(ctx) : SSL_CTX_load_verify_locations(ctx, ca_file.data(), nullptr);
+        if (ret != 1) {
+            WarnL << "load tls ca " << ca_file << " failed: " << getSslErrors();
+            SSL_CTX_free(ctx);
+            return nullptr;
+        }
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    }
+    return Ptr(new TlsContext(ctx, false, verify));
+}
+
+TlsContext::TlsContext(ssl_ctx_st *ctx, bool server, bool verify) : _server(server), _verify(verify), _ctx(ctx) {}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(_ctx);
+}
+
+void TlsContext::setKtls(bool enable) {
+#ifdef SSL_OP_ENABLE_KTLS
+    if (enable) {
+        SSL_CTX_set_options(_ctx, SSL_OP_ENABLE_KTLS);
+    } else {
+        SSL_CTX_clear_options(_ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+}
+
+void TlsContext::setIgnoreUnexpectedEof(bool enable) {
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    if (enable) {
+        SSL_CTX_set_options(_ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+    } else {
+        SSL_CTX_clear_options(_ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+    }
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+TlsStream::Ptr TlsStream::create(const TlsContext::Ptr &ctx, int fd, const string &server_name) {
+    if (!ctx || fd == -1) {
+        return nullptr;
+    }
+    auto ssl = SSL_new(ctx->get());
+    if (!ssl) {
+        WarnL << "create tls connection failed: " << getSslErrors();
+        return nullptr;
+    }
+    Ptr ret(new TlsStream(ssl));
+    //socket BIO 直接读写fd, 握手后 OpenSSL 通过它安装内核 tls
+    if (SSL_set_fd(ssl, fd) != 1) {
+        WarnL << "bind tls connection to fd " << fd << " failed: " << getSslErrors();
+        return nullptr;
+    }
+    if (ctx->isServer()) {
+        SSL_set_accept_state(ssl);
+        return ret;
+    }
+    SSL_set_connect_state(ssl);
+    //SNI 不能是IP地址
+    if (!server_name.empty() && !SockUtil::isIP(server_name)) {
+        SSL_set_tlsext_host_name(ssl, server_name.data());
+    }
+    if (ctx->verify() && !server_name.empty()) {
+        SSL_set_hostflags(ssl, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
+        SSL_set1_host(ssl, server_name.data());
+    }
+    return ret;
+}
+
+TlsStream::TlsStream(ssl_st *ssl) : _ssl(ssl) {}
+
+TlsStream::~TlsStream() {
+    //连接随 socket 直接关闭，不再发送 close_notify
+    SSL_free(_ssl);
+}
+
+int TlsStream::handshake(SockException &ex) {
+    ERR_clear_error();
+    errno = 0;
+    _want_write = false;
+    int ret = SSL_do_handshake(_ssl);
+    if (ret == 1) {
+        return 1;
+    }
+    int err = SSL_get_error(_ssl, ret);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        _want_write = err == SSL_ERROR_WANT_WRITE;
+        return 0;
+    }
+    if (err == SSL_ERROR_SYSCALL && errno) {
+        ex = SockException(errno, "tls handshake failed", Err_Other);
+    } else if (SSL_get_verify_result(_ssl) != X509_V_OK) {
+        ex = SockException(EPROTO, string("tls verify failed: ") + X509_verify_cert_error_string(SSL_get_verify_result(_ssl)), Err_Other);
+    } else {
+        auto reason = getSslErrors();
+        ex = SockException(EPROTO, "tls handshake failed: " + (reason.empty() ? string("connection closed") : reason),
+                           reason.empty() ? Err_Eof : Err_Other);
+    }
+    return -1;
+}
+
+ssize_t TlsStream::read(void *data, size_t size) {
+    ERR_clear_error();
+    errno = 0;
+    _want_write = false;
+    int ret = SSL_read(_ssl, data, std::min<size_t>(size, INT_MAX));
+    return ret > 0 ? ret : onError(ret);
+}
+
+ssize_t TlsStream::write(const void *data, size_t size) {
+    ERR_clear_error();
+    errno = 0;
+    _want_write = false;
+    int ret = SSL_write(_ssl, data, std::min<size_t>(size, INT_MAX));
+    return ret > 0 ? ret : onError(ret);
+}
+
+ssize_t TlsStream::onError(int ret) {
+    switch (SSL_get_error(_ssl, ret)) {
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_WANT_WRITE:
+            _want_write = true;
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_WANT_READ:
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_SYSCALL:
+            if (!errno) {
+                //没有 close_notify 的 eof
+                return 0;
+            }
+            return -1;
+        default: {
+            WarnL_EVERY_MS(1000) << "tls error: " << getSslErrors();
+            errno = EPROTO;
+            return -1;
+        }
+    }
+}
+
+size_t TlsStream::pending() const {
+    return SSL_pending(_ssl);
+}
+
+bool TlsStream::ktlsSend() const {
+    return BIO_get_ktls_send(SSL_get_wbio(_ssl));
+}
+
+bool TlsStream::ktlsRecv() const {
+    return BIO_get_ktls_recv(SSL_get_rbio(_ssl));
+}
+
+string TlsStream::description() const {
+    auto cipher = SSL_get_current_cipher(_ssl);
+    return string(SSL_get_version(_ssl)) + " " + (cipher ? SSL_CIPHER_get_name(cipher) : "");
+}
+
+#else  //ENABLE_OPENSSL
+
+TlsContext::Ptr TlsContext::createServer(const string &cert_file, const string &key_file) {
+    WarnL << "tls is unavailable, rebuild with openssl";
+    return nullptr;
+}
+
+TlsContext::Ptr TlsContext::createClient(bool verify, const string &ca_file) {
+    WarnL << "tls is unavailable, rebuild with openssl";
+    return nullptr;
+}
+
+TlsContext::TlsContext(ssl_ctx_st *ctx, bool server, bool verify) : _server(server), _verify(verify), _ctx(ctx) {}
+TlsContext::~TlsContext() {}
+void TlsContext::setKtls(bool enable) {}
+void TlsContext::setIgnoreUnexpectedEof(bool enable) {}
+
+TlsStream::Ptr TlsStream::create(const TlsContext::Ptr &ctx, int fd, const string &server_name) { return nullptr; }
+TlsStream::TlsStream(ssl_st *ssl) : _ssl(ssl) {}
+TlsStream::~TlsStream() {}
+int TlsStream::handshake(SockException &ex) {
+    ex = SockException(ENOTSUP, "tls is unavailable", Err_Other);
+    return -1;
+}
+ssize_t TlsStream::read(void *data, size_t size) { errno = ENOTSUP; return -1; }
+ssize_t TlsStream::write(const void *data, size_t size) { errno = ENOTSUP; return -1; }
+ssize_t TlsStream::onError(int ret) { return -1; }
+size_t TlsStream::pending() const { return 0; }
+bool TlsStream::ktlsSend() const { return false; }
+bool TlsStream::ktlsRecv() const { return false; }
+string TlsStream::description() const { return ""; }
+
+#endif  //ENABLE_OPENSSL
+
+}
@@ -0,0 +1,111 @@
+#ifndef __TLS_H__
+#define __TLS_H__
+
+#include "Util/Util.h"
+#include "SockUtil.h"
+#include <sys/types.h>
+
+struct ssl_st;
+struct ssl_ctx_st;
+
+namespace beton {
+
+/**
+ * TLS 配置(证书、私钥、校验方式)，同一个服务器或同类客户端的所有连接共享一份
+ * 需要编译时找到 OpenSSL(ENABLE_OPENSSL), 否则创建总是失败
+ * OpenSSL 的 socket BIO 用 write() 写fd, 无法带 MSG_NOSIGNAL, 使用 tls 的进程需要在启动时忽略 SIGPIPE
+*/
+class TlsContext : public noncopyable {
+public:
+    using Ptr = std::shared_ptr<TlsContext>;
+
+    /**
+     * 服务端配置
+     * @param cert_file: PEM 格式的证书(链)
+     * @param key_file: PEM 格式的私钥
+     * @return 加载失败返回空
+    */
+    static Ptr createServer(const std::string &cert_file, const std::string &key_file);
+
+    /**
+     * 客户端配置
+     * @param verify: 是否校验服务端证书及其域名
+     * @param ca_file: 校验使用的 CA 文件，为空则使用系统默认路径
+    */
+    static Ptr createClient(bool verify = true, const std::string &ca_file = "");
+
+    ~TlsContext();
+
+    /**
+     * 握手完成后是否尝试把加解密交给内核(kTLS), 默认开启
+     * 内核没有 tls 模块或协商的加密套件不支持时自动使用用户态加解密
+    */
+    void setKtls(bool enable);
+
+    /**
+     * 对端不发 close_notify 直接断开时按正常关闭处理，默认关闭(按截断报错)
+     * 只适合消息自带长度或分块的协议，比如 HTTP(S)-FLV 服务端面对的浏览器和播放器
+    */
+    void setIgnoreUnexpectedEof(bool enable);
+
+    bool isServer() const { return _server; }
+    bool verify() const { return _verify; }
+    ssl_ctx_st *get() const { return _ctx; }
+
+private:
+    TlsContext(ssl_ctx_st *ctx, bool server, bool verify);
+
+private:
+    bool _server;
+    bool _verify;
+    ssl_ctx_st *_ctx;
+};
+
+/**
+ * 一个 tls 连接，直接在 socket 的fd上读写，只在 socket 所属的 poller 线程使用
+ * 读写接口的返回值与非阻塞的 recv/send 一致，需要等待时返回-1并置 errno 为 EAGAIN
+*/
+class TlsStream : public noncopyable {
+public:
+    using Ptr = std::shared_ptr<TlsStream>;
+
+    /**
+     * @param server_name: 客户端发送的 SNI, 开启证书校验时同时用于校验域名
+    */
+    static Ptr create(const TlsContext::Ptr &ctx, int fd, const std::string &server_name = "");
+
+    ~TlsStream();
+
+    /**
+     * 推进握手
+     * @return 1 握手完成; 0 需要等待socket可读或可写(见 wantWrite); -1 失败, ex 为原因
+    */
+    int handshake(SockException &ex);
+
+    //读取解密后的数据, 0 表示对端关闭了 tls 连接
+    ssize_t read(void *data, size_t size);
+    //加密并写出, 可能只写出一部分; 返回-1且 errno 为 EAGAIN 时，之后必须用相同的数据重试
+    ssize_t write(const void *data, size_t size);
+
+    //上一次操作是否在等待socket可写
+    bool wantWrite() const { return _want_write; }
+    //已解密、尚未读取的字节数
+    size_t pending() const;
+    //握手后发送/接收方向是否已交给内核，发送交给内核后可以直接对fd使用 send/sendfile
+    bool ktlsSend() const;
+    bool ktlsRecv() const;
+    //协商的协议版本和加密套件, 用于日志
+    std::string description() const;
+
+private:
+    TlsStream(ssl_st *ssl);
+    //把 SSL_get_error 的结果转换为 errno, 返回-1
+    ssize_t onError(int ret);
+
+private:
+    bool _want_write = false;
+    ssl_st *_ssl;
+};
+
+}
+#endif  //__TLS_H__
@@ -0,0 +1,40 @@
+#include "UdpClient.h"
+#include "threadpool/ThreadPool.h"
+
+using namespace std;
+
+namespace beton {
+
+UdpClient::UdpClient(const PollerThread::Ptr &poller) {
+    _poller = poller ? poller : ThreadPool::Instance().getPoller();
+}
+
+bool UdpClient::startConnect(const string &peer_ip, uint16_t peer_port, uint16_t local_port, bool offload) {
+    struct sockaddr_storage addr;
+    if (!SockUtil::makeSockAddr(peer_ip, peer_port, addr)) {
+        WarnL << "invalid udp peer address: " << peer_ip;
+        return false;
+    }
+    if (_sock) {
+        auto old_sock = _sock;
+        _poller->async([old_sock]() { old_sock->closeSock(); });
+    }
+    //先绑定回调，避免 bind 之后到达的数据丢失
+    auto sock = Socket::create(_poller);
+    attachSock(sock);
+    bool success = false;
+    _poller->sync([&]() {
+        //本地地址族需要和对端一致，否则无法 connect
+        success = sock->bindUdp(local_port, addr.ss_family == AF_INET ? "0.0.0.0" : "::") &&
+                  sock->bindPeerAddr((struct sockaddr *)&addr, SockUtil::getSockLen((struct sockaddr *)&addr), true);
+        if (success && offload) {
+            sock->setUdpOffload(true);
+        }
+    });
+    if (!success) {
+        return false;
+    }
+    return true;
+}
+
+}
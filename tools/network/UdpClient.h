@@ -0,0 +1,27 @@
+#ifndef __UDP_CLIENT_H__
+#define __UDP_CLIENT_H__
+
+#include "Socket.h"
+
+namespace beton {
+
+//udp 客户端，使用已 connect 的 udp socket, 只接收该对端的数据；继承后实现 onRecv/onError
+class UdpClient : public SocketHelper {
+public:
+    using Ptr = std::shared_ptr<UdpClient>;
+
+    UdpClient(const PollerThread::Ptr &poller = nullptr);
+    ~UdpClient() override = default;
+
+    /**
+     * 绑定本地端口并关联对端地址，之后 send() 的数据都发往该对端
+     * @param peer_ip: 对端IP
+     * @param peer_port: 对端端口
+     * @param local_port: 本地端口, 0 由内核分配
+     * @param offload: 是否开启 UDP_GRO/UDP_SEGMENT
+    */
+    bool startConnect(const std::string &peer_ip, uint16_t peer_port, uint16_t local_port = 0, bool offload = false);
+};
+
+}
+#endif  //__UDP_CLIENT_H__
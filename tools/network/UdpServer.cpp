@@ -0,0 +1,245 @@
+#include "UdpServer.h"
+#include "SessionManager.h"
+#include "threadpool/ThreadPool.h"
+
+using namespace std;
+
+namespace beton {
+
+UdpServer::UdpServer(const PollerThread::Ptr &poller) {
+    _poller = poller ? poller : ThreadPool::Instance().getPoller();
+}
+
+UdpServer::~UdpServer() {
+    stop();
+}
+
+string UdpServer::makePeerKey(const struct sockaddr *addr, socklen_t addr_len) {
+    //本地地址对同一个服务器是固定的，对端地址和端口即可区分五元组
+    struct sockaddr_storage storage;
+    memset(&storage, 0, sizeof(storage));
+    memcpy(&storage, addr, std::min<socklen_t>(addr_len, sizeof(storage)));
+    if (storage.ss_family == AF_INET6) {
+        auto &addr6 = (struct sockaddr_in6 &)storage;
+        return string((char *)&addr6.sin6_addr, sizeof(addr6.sin6_addr)) + string((char *)&addr6.sin6_port, sizeof(addr6.sin6_port));
+    }
+    auto &addr4 = (struct sockaddr_in &)storage;
+    return string((char *)&addr4.sin_addr, sizeof(addr4.sin_addr)) + string((char *)&addr4.sin_port, sizeof(addr4.sin_port));
+}
+
+bool UdpServer::start(uint16_t port, const string &host, bool offload) {
+    _on_create_session = nullptr;
+    return startListen(port, host, offload);
+}
+
+bool UdpServer::start(uint16_t port, const string &host, bool offload, const onCreateSession &cb) {
+    if (!cb) {
+        return false;
+    }
+    _on_create_session = cb;
+    return startListen(port, host, offload);
+}
+
+bool UdpServer::startListen(uint16_t port, const string &host, bool offload) {
+    stop();
+    _host = host;
+    _offload = offload;
+    _owners.clear();
+    if (_on_create_session) {
+        for (auto &poller : ThreadPool::Instance().getAllPollers()) {
+            _owners.emplace(poller.get(), std::make_shared<SessionOwner>());
+        }
+    }
+
+    auto sock = Socket::create(_poller);
+    weak_ptr<UdpServer> weak_self = shared_from_this();
+    sock->setRecvFromCB([weak_self](const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t addr_len) {
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            strong_self->onRecv(buf, addr, addr_len);
+        }
+    });
+
+    bool success = false;
+    _poller->sync([&]() {
+        //会话模式下每个对端的 socket 都要绑定到同一个端口
+        success = sock->bindUdp(port, host, (bool)_on_create_session);
+        if (!success) {
+            return;
+        }
+        if (offload) {
+            sock->setUdpOffload(true);
+        }
+        _port = sock->get_local_port();
+    });
+    if (!success) {
+        return false;
+    }
+    _sock = std::move(sock);
+    InfoL << "udp server listen on " << host << ":" << _port << (_on_create_session ? ", per-peer sockets" : "");
+    return true;
+}
+
+void UdpServer::stop() {
+    _peers.clear();
+    for (auto &pr : _owners) {
+        auto owner = pr.second;
+        pr.first->async([owner]() {
+            auto sessions = std::move(owner->sessions);
+            owner->sessions.clear();
+            for (auto &session : sessions) {
+                session.second->getSock()->closeSock();
+                session.second->onError(SockException(0, "server shutdown", Err_Shutdown));
+            }
+        });
+    }
+    if (!_sock) {
+        return;
+    }
+    auto sock = std::move(_sock);
+    _sock = nullptr;
+    _poller->async([sock]() {
+        sock->closeSock();
+    });
+}
+
+void UdpServer::sendTo(Buffer::Ptr buf, const struct sockaddr *addr, socklen_t addr_len) {
+    if (_sock) {
+        _sock->sendTo(std::move(buf), addr, addr_len);
+    }
+}
+
+void UdpServer::onRecv(const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t addr_len) {
+    if (!_on_create_session) {
+        if (_on_recv_from) {
+            _on_recv_from(_sock, buf, addr, addr_len);
+        }
+        return;
+    }
+
+    string key;
+    if (_on_get_key) {
+        key = _on_get_key(buf, addr, addr_len);
+    }
+    if (key.empty()) {
+        key = makePeerKey(addr, addr_len);
+    }
+    auto session = _peers.find(key);
+    if (!session) {
+        createSession(key, buf, addr, addr_len);
+        return;
+    }
+    //独立 socket 建立之前到达的报文，或者按会话标识匹配到的新地址的报文，转发到会话所在线程
+    //即使会话就在本线程也要排队，保证在 socket 建立的任务之后执行
+    session->getPoller()->async([session, buf]() {
+        if (session->getSock()->rawFd() != -1) {
+            session->onRecv(buf);
+        }
+    }, Thread::Normal, false);
+}
+
+void UdpServer::createSession(const string &key, const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t addr_len) {
+    auto poller = ThreadPool::Instance().getPoller();
+    auto it = _owners.find(poller.get());
+    if (it == _owners.end()) {
+        WarnL << "unknown poller " << poller->name();
+        return;
+    }
+    auto owner = it->second;
+
+    //会话对象在这里创建，socket 的 bind/connect 以及之后的所有回调都在会话所在的 poller 上执行
+    auto sock = Socket::create(poller);
+    Session::Ptr session;
+    try {
+        session = _on_create_session(sock);
+    } catch (std::exception &ex) {
+        WarnL << "create session failed: " << ex.what();
+    }
+    if (!session) {
+        return;
+    }
+    session->attachSock(sock);
+    _peers.insert(key, session);
+    SessionManager::Instance().add(session);
+
+    //会话出错时先回调给会话，再从映射表和所属 poller 的列表中移除
+    weak_ptr<UdpServer> weak_self = shared_from_this();
+    weak_ptr<SessionOwner> weak_owner = owner;
+    weak_ptr<Session> weak_session = session;
+    auto ptr = session.get();
+    sock->setErrorCB([weak_self, weak_owner, weak_session, key, ptr](const SockException &ex) {
+        auto strong_session = weak_session.lock();
+        if (strong_session) {
+            strong_session->onError(ex);
+        }
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            strong_self->_peers.erase(key, ptr);
+        }
+        auto strong_owner = weak_owner.lock();
+        if (strong_owner) {
+            strong_owner->sessions.erase(ptr);
+        }
+    });
+
+    struct sockaddr_storage peer;
+    auto peer_len = std::min<socklen_t>(addr_len, sizeof(peer));
+    memcpy(&peer, addr, peer_len);
+    auto port = _port;
+    auto host = _host;
+    auto offload = _offload;
+    poller->async([weak_self, owner, session, sock, buf, key, peer, peer_len, port, host, offload]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self || strong_self->_peers.find(key) != session) {
+            //服务器已经停止
+            return;
+        }
+        owner->sessions.emplace(session.get(), session);
+        if (!sock->bindUdp(port, host, true)) {
+            //bind 失败时socket没有打开，不会触发错误回调
+            strong_self->_peers.erase(key, session.get());
+            owner->sessions.erase(session.get());
+            session->onError(SockException(EADDRINUSE, "bind peer socket failed", Err_Other));
+            return;
+        }
+        if (!sock->bindPeerAddr((struct sockaddr *)&peer, peer_len, true)) {
+            sock->emitErr(SockException(errno, "connect peer socket failed", Err_Other));
+            return;
+        }
+        session->onRecv(buf);
+        strong_self->drainPeerSock(session, peer, peer_len);
+        //GRO 在取完 connect 之前的报文后再开启
+        if (offload) {
+            sock->setUdpOffload(true);
+        }
+    });
+}
+
+void UdpServer::drainPeerSock(const Session::Ptr &session, const struct sockaddr_storage &peer, socklen_t peer_len) {
+    auto sock = session->getSock();
+    auto peer_key = makePeerKey((struct sockaddr *)&peer, peer_len);
+    weak_ptr<UdpServer> weak_self = shared_from_this();
+    while (sock->rawFd() != -1) {
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        auto buf = BufferRaw::create(64 * 1024);
+        auto ret = ::recvfrom(sock->rawFd(), buf->data(), buf->capacity(), MSG_DONTWAIT, (struct sockaddr *)&addr, &addr_len);
+        if (ret < 0) {
+            break;
+        }
+        buf->setSize(ret);
+        if (makePeerKey((struct sockaddr *)&addr, addr_len) == peer_key) {
+            session->onRecv(buf);
+            continue;
+        }
+        //不属于该会话，交回服务器重新分发
+        _poller->async([weak_self, buf, addr, addr_len]() {
+            auto strong_self = weak_self.lock();
+            if (strong_self) {
+                strong_self->onRecv(buf, (struct sockaddr *)&addr, addr_len);
+            }
+        });
+    }
+}
+
+}
@@ -0,0 +1,97 @@
+#ifndef __UDP_SERVER_H__
+#define __UDP_SERVER_H__
+
+#include "SessionTable.h"
+#include <unordered_map>
+
+namespace beton {
+
+/**
+ * udp 服务器，一个端口对应一个监听 socket:
+ * 1. 直接使用 setOnRecvFrom 时，所有报文都在监听 socket 所属的 poller 上处理
+ * 2. 使用会话模式(start<SessionType>)时，对端的第一个报文到达后为其创建会话, 会话分配到某个 poller,
+ *    并在该 poller 上创建一个 SO_REUSEPORT + connect 到对端的独立 socket, 内核会把之后该对端的报文
+ *    直接交给这个 socket, 稳定之后的收发不再跨线程; 建立之前到达的报文经映射表转发给会话所在线程
+ * 3. 对端以五元组区分，也可以通过 setPeerKeyCB 从报文中取出 SRT socket id、ICE ufrag 等作为会话标识
+ * 接收用 recvmmsg 批量读取，发送在 poller 本轮结束时用 sendmmsg 批量发出，
+ * 默认开启 UDP_GRO/UDP_SEGMENT 卸载(内核不支持时自动关闭)
+*/
+class UdpServer : public noncopyable, public std::enable_shared_from_this<UdpServer> {
+public:
+    using Ptr = std::shared_ptr<UdpServer>;
+    using onRecvFrom = std::function<void(const Socket::Ptr &sock, const Buffer::Ptr &buf,
+                                          const struct sockaddr *addr, socklen_t addr_len)>;
+    using onCreateSession = std::function<Session::Ptr(const Socket::Ptr &sock)>;
+    //从报文中取出会话标识，返回空则使用五元组
+    using onGetPeerKey = std::function<std::string(const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t addr_len)>;
+
+    UdpServer(const PollerThread::Ptr &poller = nullptr);
+    ~UdpServer();
+
+    /**
+     * 开始监听，收到的报文通过 setOnRecvFrom 设置的回调通知
+     * @param port: 监听端口, 0 由内核分配
+     * @param host: 监听的网卡/IP
+     * @param offload: 是否开启 UDP_GRO/UDP_SEGMENT
+    */
+    bool start(uint16_t port, const std::string &host = "::", bool offload = true);
+
+    //会话模式，每个对端一个会话
+    template <typename SessionType>
+    bool start(uint16_t port, const std::string &host = "::", bool offload = true) {
+        return start(port, host, offload, [](const Socket::Ptr &sock) -> Session::Ptr {
+            return std::make_shared<SessionType>(sock);
+        });
+    }
+
+    bool start(uint16_t port, const std::string &host, bool offload, const onCreateSession &cb);
+
+    void stop();
+
+    //以下回调需要在 start 之前设置
+    void setOnRecvFrom(const onRecvFrom &cb) { _on_recv_from = cb; }
+    void setPeerKeyCB(const onGetPeerKey &cb) { _on_get_key = cb; }
+
+    //发送到指定地址，可以在任意线程调用
+    void sendTo(Buffer::Ptr buf, const struct sockaddr *addr, socklen_t addr_len);
+
+    //按会话标识查找会话，可以在任意线程调用
+    Session::Ptr findSession(const std::string &key) const { return _peers.find(key); }
+    size_t sessionCount() const { return _peers.size(); }
+
+    uint16_t getPort() const { return _port; }
+    const Socket::Ptr &getSock() const { return _sock; }
+    const PollerThread::Ptr &getPoller() const { return _poller; }
+
+    //五元组对应的会话标识
+    static std::string makePeerKey(const struct sockaddr *addr, socklen_t addr_len);
+
+private:
+    //每个 poller 上的会话，只在该 poller 线程访问
+    struct SessionOwner {
+        using Ptr = std::shared_ptr<SessionOwner>;
+        std::unordered_map<Session *, Session::Ptr> sessions;
+    };
+
+    bool startListen(uint16_t port, const std::string &host, bool offload);
+    void onRecv(const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t addr_len);
+    void createSession(const std::string &key, const Buffer::Ptr &buf, const struct sockaddr *addr, socklen_t addr_len);
+    //bind 到 connect 之间的空隙里，其他对端的报文可能进入了会话的 socket, connect 之后把它们取出来重新分发
+    void drainPeerSock(const Session::Ptr &session, const struct sockaddr_storage &peer, socklen_t peer_len);
+
+private:
+    bool _offload = true;
+    uint16_t _port = 0;
+    std::string _host;
+    PollerThread::Ptr _poller;
+    Socket::Ptr _sock;
+    onRecvFrom _on_recv_from;
+    onGetPeerKey _on_get_key;
+    onCreateSession _on_create_session;
+    SessionTable _peers;
+    //启动后不再修改
+    std::unordered_map<PollerThread *, SessionOwner::Ptr> _owners;
+};
+
+}
+#endif  //__UDP_SERVER_H__
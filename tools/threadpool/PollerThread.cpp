@@ -11,6 +11,9 @@ namespace beton {
 
 PollerThread::PollerThread(const std::string &name, uint32_t index, bool cpu_affinity)
     : Thread(name) {
+    if (cpu_affinity) {
+        _cpu_index = index % std::max(std::thread::hardware_concurrency(), 1u);
+    }
     _setting_func = [=]() {
         Thread::setThreadName(name.data());
         if (cpu_affinity) {
@@ -45,6 +48,27 @@ void PollerThread::async(TaskFunc func, Thread::TaskPriority priority, bool may_
     _pipe.write("1", 1);
 }
 
+void PollerThread::sync(const TaskFunc &func) {
+    if (!func) {
+        return;
+    }
+    if (is_current_thread()) {
+        func();
+        return;
+    }
+    semaphore sem;
+    async([&]() {
+        try {
+            func();
+        } catch (...) {
+            sem.notify();
+            throw;
+        }
+        sem.notify();
+    });
+    sem.wait();
+}
+
 int PollerThread::addEvent(int fd, int events, onEvent on_event_cb) {
     if (fd < 0 || !on_event_cb) {
         WarnL << "fd < 0 or on_event_cb is nullptr";
@@ -54,9 +78,9 @@ int PollerThread::addEvent(int fd, int events, onEvent on_event_cb) {
     int ret = 0;
     if (is_current_thread()) {
         epoll_event ev;
-        //EPOLLEXCLUSIVE表示独占事件，避免多个线程同时处理同一个事件引发惊群问题
-        //同时，socket的fd也要设置为非阻塞
-        ev.events = events | EPOLLEXCLUSIVE;
+        //EPOLLEXCLUSIVE 用于多个 epoll 监听同一个 fd 时避免惊群，需要的调用者自行传入
+        //注意带 EPOLLEXCLUSIVE 添加的 fd 之后不能再 EPOLL_CTL_MOD，socket 的fd也要设置为非阻塞
+        ev.events = events;
         ev.data.fd = fd;
         ret = epoll_ctl(_poller_fd, EPOLL_CTL_ADD, fd, &ev);
         if (ret == 0) {
@@ -81,7 +105,7 @@ int PollerThread::modifyEvent(int fd, int events) {
     int ret = 0;
     if (is_current_thread()) {
         epoll_event ev;
-        ev.events = events | EPOLLEXCLUSIVE;
+        ev.events = events;
         ev.data.fd = fd;
         ret = epoll_ctl(_poller_fd, EPOLL_CTL_MOD, fd, &ev);
         if (ret != 0) {
@@ -104,7 +128,7 @@ int PollerThread::delEvent(int fd, int events, onDelEvent on_del_event_cb) {
     int ret = 0;
     if (is_current_thread()) {
         epoll_event ev;
-        ev.events = events | EPOLLEXCLUSIVE;
+        ev.events = events;
         ev.data.fd = fd;
         ret = epoll_ctl(_poller_fd, EPOLL_CTL_DEL, fd, &ev);
         if (ret == 0) {
@@ -122,16 +146,12 @@ int PollerThread::delEvent(int fd, int events, onDelEvent on_del_event_cb) {
     return ret;
 }
 
-uint64_t PollerThread::flushDelayTask(uint64_t now) {
+void PollerThread::flushDelayTask(uint64_t now) {
     //清空到期的延时任务
     std::multimap<uint64_t, DelayTask::Ptr> delay_task_list;
-    for (auto it = _delay_task_map.begin(); it != _delay_task_map.end();) {
-        if (it->first <= now) {
-            delay_task_list.emplace(it->first, it->second);
-            it = _delay_task_map.erase(it);
-        } else {
-            ++it;
-        }
+    for (auto it = _delay_task_map.begin(); it != _delay_task_map.end() && it->first <= now;) {
+        delay_task_list.emplace(it->first, it->second);
+        it = _delay_task_map.erase(it);
     }
     //执行到期的延时任务
     for (auto &task : delay_task_list) {
@@ -147,21 +167,43 @@ uint64_t PollerThread::flushDelayTask(uint64_t now) {
             WarnL << "delay task exception";
         }
     }
+}
+
+void PollerThread::addFlushTask(TaskFunc func) {
+    if (func) {
+        _flush_tasks.emplace_back(std::move(func));
+    }
+}
 
-    return delay_task_list.empty() ? 0 : delay_task_list.begin()->first - now;
+void PollerThread::runFlushTasks() {
+    //执行过程中新加入的任务留到下一轮
+    std::vector<TaskFunc> flush_tasks;
+    flush_tasks.swap(_flush_tasks);
+    for (auto &task : flush_tasks) {
+        try {
+            task();
+        } catch (std::exception &ex) {
+            ErrorL << "Exception in flush task: " << ex.what();
+        }
+    }
 }
 
-uint64_t PollerThread::getMinDelayTime() {
+int PollerThread::getMinDelayTime() {
     if (_delay_task_map.empty()) {
-        return 0;
+        //没有延时任务，一直等待事件
+        return -1;
     }
-    auto it = _delay_task_map.begin();
     auto now = getCurrentMilliSecond();
-    if (it->first > now) {
-        return it->first - now;
+    if (_delay_task_map.begin()->first <= now) {
+        //如果延时任务已经到期，则直接执行
+        flushDelayTask(now);
+        if (_delay_task_map.empty()) {
+            return -1;
+        }
+        now = getCurrentMilliSecond();
     }
-    //如果延时任务已经到期，则直接执行
-    return flushDelayTask(now);
+    auto first = _delay_task_map.begin()->first;
+    return first > now ? (int) std::min<uint64_t>(first - now, INT32_MAX) : 0;
 }
 
 void PollerThread::addPipeEvent() {
@@ -209,6 +251,7 @@ void PollerThread::run_loop() {
         _thread = make_shared<thread>(&PollerThread::run_loop, this);
         return;
     }
+    _tid = this_thread::get_id();
     //初始化时线程环境，名字，cpu亲和性等
     _setting_func();
     //创建epoll
@@ -223,11 +266,16 @@ void PollerThread::run_loop() {
     //设置管道的读端为epoll的事件
     addPipeEvent();
     //设置epoll的事件处理函数
-    uint64_t min_delay_time = 0;
+    int min_delay_time = -1;
     struct epoll_event ev[EPOLL_SIZE];
 
     while (_started) {
         min_delay_time = getMinDelayTime();
+        //延时任务和上一轮事件产生的发送，统一在休眠前刷出
+        runFlushTasks();
+        if (!_flush_tasks.empty()) {
+            min_delay_time = 0;
+        }
         sleep();
         int ret = epoll_wait(_poller_fd, ev, sizeof(ev) / sizeof(epoll_event), min_delay_time);
         wakeup();
@@ -244,6 +292,7 @@ void PollerThread::run_loop() {
             auto it = _event_map.find(ev[i].data.fd);
             if (it == _event_map.end()) {
                 epoll_ctl(_poller_fd, EPOLL_CTL_DEL, fd, nullptr);
+                continue;
             }
 
             auto callbakc_func = it->second;
@@ -262,6 +311,7 @@ void PollerThread::run_loop() {
         _poller_fd = -1;
     }
     _event_map.clear();
+    _flush_tasks.clear();
     //清空延时任务列表
     std::multimap<uint64_t, DelayTask::Ptr> delay_task_list;
     {
@@ -1,6 +1,7 @@
 #ifndef __POLER_THREAD_H__
 #define __POLER_THREAD_H__
 #include <map>
+#include <vector>
 #include "Thread.h"
 #include "Util/Pipe.h"
 
@@ -18,6 +19,8 @@ public:
     ~PollerThread();
     ///////////////////////////////////////////////
     void async(TaskFunc func, Thread::TaskPriority priority = Thread::Normal, bool may_sync = true) override;
+    //在本线程执行并等待完成，用于启动阶段需要拿到结果的操作，不要在其他 poller 线程中频繁调用
+    void sync(const TaskFunc &func);
     ///////////////////////////////////////////////
     int addEvent(int fd, int events, onEvent on_event_cb);
 
@@ -27,12 +30,24 @@ public:
 
     DelayTask::Ptr doDelayTask(uint32_t delay_ms, std::function<uint64_t()> func);
 
+    /**
+     * 在本轮事件处理完、下一次 epoll_wait 之前执行一次, 只能在本线程调用
+     * 用于把一轮中产生的多次发送合并成一次系统调用
+    */
+    void addFlushTask(TaskFunc func);
+
+    //线程绑定的cpu, 未绑定时返回-1
+    int cpuIndex() const { return _cpu_index; }
+
     void run_loop() override;
 
 private:
-    uint64_t getMinDelayTime();
+    //返回 epoll_wait 的超时时间，-1 表示无限等待
+    int getMinDelayTime();
+
+    void flushDelayTask(uint64_t now);
 
-    uint64_t flushDelayTask(uint64_t now);
+    void runFlushTasks();
 
     void addPipeEvent();
 
@@ -41,15 +56,18 @@ private:
 private:
     //现成初始化
     std::function<void()> _setting_func;
+    int _cpu_index = -1;
     //异步任务,使用管道唤醒epoll执行异步任务
     Pipe _pipe;
     std::mutex _task_mutex;
     std::list<TaskFunc> _task_list;
     //epoll 事件处理
-    int _poller_fd;
+    int _poller_fd = -1;
     std::unordered_map<int, std::shared_ptr<onEvent> > _event_map;
     //延时任务处理,有可能多个任务延时时间相同，所以用multimap,允许存在相同的延时时间，并对所有延时任务排序
     std::multimap<uint64_t, DelayTask::Ptr> _delay_task_map;
+    //本轮结束时执行的任务
+    std::vector<TaskFunc> _flush_tasks;
 };
 
 }
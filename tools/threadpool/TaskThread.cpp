@@ -39,6 +39,7 @@ void TaskThread::run_loop() {
         _thread = make_shared<thread>(&TaskThread::run_loop, this);
         return;
     }
+    _tid = this_thread::get_id();
 
     _setting_func();
 
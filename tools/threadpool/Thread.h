@@ -135,7 +135,7 @@ public:
     virtual ~Thread();
 
     std::string name() const { return _name; }
-    std::thread::id tid() const { return _thread ? _thread->get_id() : std::thread::id(); }
+    std::thread::id tid() const { return _tid; }
     bool started() const { return _started; }
     bool is_current_thread();
 
@@ -150,6 +150,8 @@ public:
 protected:
     std::atomic<bool> _started = {false};
     std::shared_ptr<std::thread> _thread = nullptr;
+    //由线程自己在启动时写入，_thread 赋值前线程可能已经开始运行
+    std::atomic<std::thread::id> _tid;
 private:
     std::string _name;
     //线程退出前，保持日志可用
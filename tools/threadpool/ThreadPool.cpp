@@ -61,6 +61,17 @@ PollerThread::Ptr ThreadPool::getPoller() {
     return poller;
 }
 
+std::vector<PollerThread::Ptr> ThreadPool::getAllPollers() {
+    std::vector<PollerThread::Ptr> pollers;
+    for (uint32_t index = 0; index < _poller_thread_count; index++) {
+        auto it = _poller_thread_pool.find(string("poller") + to_string(index));
+        if (it != _poller_thread_pool.end() && it->second) {
+            pollers.emplace_back(static_pointer_cast<PollerThread>(it->second));
+        }
+    }
+    return pollers;
+}
+
 TaskThread::Ptr ThreadPool::getThread() {
     auto name = string("task") + to_string(_task_index++ % _task_thread_count);
     auto &thread = _task_thread_pool[name];
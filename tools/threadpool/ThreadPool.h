@@ -14,6 +14,8 @@ public:
     ~ThreadPool();
     PollerThread::Ptr getPoller();
     TaskThread::Ptr getThread();
+    //所有 poller 线程，用于需要每个线程各自持有一份资源的场合，比如 SO_REUSEPORT 监听
+    std::vector<PollerThread::Ptr> getAllPollers();
 
 private:
     ThreadPool();